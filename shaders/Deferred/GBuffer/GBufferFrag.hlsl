@@ -6,7 +6,13 @@
 
 #include "shaders/Common/Math.hlsl"
 
+// Permutation keys, see Deferred
+#ifndef ORCA
 #define ORCA 0
+#endif
+#ifndef DRAW_MESHLETS
+#define DRAW_MESHLETS 0
+#endif
 
 struct FragmentIn
 {
@@ -111,15 +117,15 @@ FragmentOut Main(FragmentIn Input)
     float roughness = 0.0f;
     float metallic = 0.0f;
     
-    if (ORCA) {
-        ao = metallicRoughness.r;
-        roughness = metallicRoughness.g;
-        metallic = metallicRoughness.b;
-    } else {
-        metallic = metallicRoughness.b;
-        roughness = metallicRoughness.g;
-        ao = aot.r;
-    }
+#if ORCA
+    ao = metallicRoughness.r;
+    roughness = metallicRoughness.g;
+    metallic = metallicRoughness.b;
+#else
+    metallic = metallicRoughness.b;
+    roughness = metallicRoughness.g;
+    ao = aot.r;
+#endif
 
     FragmentOut output = (FragmentOut)0;
     
@@ -129,13 +135,13 @@ FragmentOut Main(FragmentIn Input)
     positionDifference *= float2(-1.0f, 1.0f);
 
     output.Normals = float4(GetNormalFromMap(Input), 1.0f);
-    if (Settings.DrawMeshlets == 1) {
-        uint meshletHash = hash(Input.MeshletIndex);
-        float3 meshletColor = float3(float(meshletHash & 255), float((meshletHash >> 8) & 255), float((meshletHash >> 16) & 255)) / 255.0;
-        output.AlbedoEmissive = float4(meshletColor, 1.0f);
-    } else {
-        output.AlbedoEmissive = float4(albedo.rgb, 1.0f);
-    }
+#if DRAW_MESHLETS
+    uint meshletHash = hash(Input.MeshletIndex);
+    float3 meshletColor = float3(float(meshletHash & 255), float((meshletHash >> 8) & 255), float((meshletHash >> 16) & 255)) / 255.0;
+    output.AlbedoEmissive = float4(meshletColor, 1.0f);
+#else
+    output.AlbedoEmissive = float4(albedo.rgb, 1.0f);
+#endif
     output.PbrAO = float4(float3(metallic, roughness, ao), 1.0f);
     output.Emissive = float4(emission.rgb, 1.0f) * Settings.EmissiveStrength;
     output.Velocity = positionDifference;
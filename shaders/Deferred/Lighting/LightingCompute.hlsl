@@ -21,6 +21,14 @@
 #define MODE_POSITION 9
 #define MODE_VELOCITY 10
 
+// Permutation keys, see Deferred
+#ifndef RT_SHADOWS
+#define RT_SHADOWS 0
+#endif
+#ifndef OUTPUT_MODE
+#define OUTPUT_MODE MODE_DEFAULT
+#endif
+
 struct SceneData
 {
     column_major float4x4 CameraMatrix;
@@ -245,32 +253,32 @@ void Main(uint3 ThreadID : SV_DispatchThreadID)
 
     // Shadow
     float shadow = 0.0;
-    if (Settings.RTShadows) {
-        float attenuation = clamp(dot(normals.rgb, LightBuffer.Sun.Direction.xyz), 0.0, 1.0);
-
-        if (attenuation > 0.0f) {
-            RayQuery<RAY_FLAG_CULL_NON_OPAQUE |
-                 RAY_FLAG_SKIP_PROCEDURAL_PRIMITIVES |
-                 RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH> q;
-
-            RayDesc desc;
-            desc.Origin = position.xyz + normals.rgb * 0.01;
-            desc.Direction = LightBuffer.Sun.Direction.xyz;
-            desc.TMin = 0.01;
-            desc.TMax = 10000.0;
-
-            q.TraceRayInline(Accel, RAY_FLAG_CULL_NON_OPAQUE | RAY_FLAG_SKIP_PROCEDURAL_PRIMITIVES | RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH, 0xFF, desc);
-            q.Proceed();
-
-            if (q.CommittedStatus() == COMMITTED_TRIANGLE_HIT) {
-                shadow = 0.0;
-            } else {
-                shadow = 1.0;
-            }
+#if RT_SHADOWS
+    float attenuation = clamp(dot(normals.rgb, LightBuffer.Sun.Direction.xyz), 0.0, 1.0);
+
+    if (attenuation > 0.0f) {
+        RayQuery<RAY_FLAG_CULL_NON_OPAQUE |
+             RAY_FLAG_SKIP_PROCEDURAL_PRIMITIVES |
+             RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH> q;
+
+        RayDesc desc;
+        desc.Origin = position.xyz + normals.rgb * 0.01;
+        desc.Direction = LightBuffer.Sun.Direction.xyz;
+        desc.TMin = 0.01;
+        desc.TMax = 10000.0;
+
+        q.TraceRayInline(Accel, RAY_FLAG_CULL_NON_OPAQUE | RAY_FLAG_SKIP_PROCEDURAL_PRIMITIVES | RAY_FLAG_ACCEPT_FIRST_HIT_AND_END_SEARCH, 0xFF, desc);
+        q.Proceed();
+
+        if (q.CommittedStatus() == COMMITTED_TRIANGLE_HIT) {
+            shadow = 0.0;
+        } else {
+            shadow = 1.0;
         }
-    } else {
-        shadow = ShadowCalculation(data, ShadowMap, ShadowSampler, LightBuffer);
     }
+#else
+    shadow = ShadowCalculation(data, ShadowMap, ShadowSampler, LightBuffer);
+#endif
 
     // Velocity
     float2 velocity = Velocity.Sample(Sampler, TexCoords);
@@ -291,9 +299,9 @@ void Main(uint3 ThreadID : SV_DispatchThreadID)
     float3 directLighting = 0.0;
     {
         float shadowFactor = shadow;
-        if (!Settings.RTShadows) {
-            shadowFactor = (1.0 - shadowFactor);
-        }
+#if !RT_SHADOWS
+        shadowFactor = (1.0 - shadowFactor);
+#endif
 
         for (int i = 0; i < LightBuffer.PointLightCount; i++) {
             Lo += CalcPointLight(data, LightBuffer.PointLights[i], V, N, F0, roughness, metallic, albedo);
@@ -324,7 +332,8 @@ void Main(uint3 ThreadID : SV_DispatchThreadID)
     float3 color = directLighting + indirectLighting;
     float4 final = float4(0.0, 0.0, 0.0, 1.0);
 
-    switch (OutputData.Mode) {
+    // Constant, the compiler only keeps the active case
+    switch (OUTPUT_MODE) {
         case MODE_DEFAULT:
             final = float4(color, 1.0);
             break;
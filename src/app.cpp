@@ -16,18 +16,29 @@
 #include <sstream>
 #include <iomanip>
 
+#include <Windows.h>
+#include <psapi.h>
+
 #include "app.hpp"
 
 #include "core/shader_bytecode.hpp"
 #include "core/bitmap.hpp"
 #include "core/texture_compressor.hpp"
 #include "core/file_system.hpp"
+#include "core/io_queue.hpp"
+#include "core/profiler.hpp"
+#include "core/frame_stats.hpp"
+#include "core/benchmark.hpp"
 #include "core/model.hpp"
 #include "core/shader_loader.hpp"
+#include "core/shader_compile_service.hpp"
+#include "core/job_system.hpp"
 #include "core/util.hpp"
+#include "core/virtual_texture/virtual_texture_system.hpp"
 
 #include "renderer/techniques/debug_renderer.hpp"
 
+// What gets loaded when --scene isn't passed
 #define SCENE_BALLS 0
 #define SCENE_SPONZA 0
 #define SCENE_BISTRO 1
@@ -38,12 +49,58 @@
 #define SCENE_TEXTURE_COMPRESSION_TEST 0
 #define SCENE_PLATFORM 0
 
+#define VT_BENCHMARK 0
+// Blocking reads against the IO queue on the loose caches, before the pak is mounted
+#define IO_BENCHMARK 0
+// Compile times of synthetic render graphs and aliasing plans, and the memory aliasing would save at 1080p, 1440p and 4K
+#define RENDER_GRAPH_BENCHMARK 0
+// Descriptor allocation in nearly full heaps, against the linear scan it replaced
+#define DESCRIPTOR_BENCHMARK 0
+
+// Read the caches and glTF files out of a single mapped archive instead of loose files
+#define USE_PAK 1
+#define PAK_PATH ".cache/oni.pak"
+// Left at exit when something the pak has was written while running (shader variants compiled on demand), so that the
+// next launch rebuilds it. Rebuilding at exit would overwrite a file that's still mapped.
+#define PAK_STALE_PATH ".cache/oni.pak.stale"
+
+// Compresses and compiles whatever is stale at startup. Debug builds only: release builds read what oni_cook produced.
+#ifdef ONI_DEBUG
+#define COOK_ON_STARTUP 1
+#else
+#define COOK_ON_STARTUP 0
+#endif
+
+// Writes a Chrome trace of everything from startup to the first frame. F4 captures one while running.
+#define TRACE_STARTUP 0
+#define TRACE_STARTUP_PATH "startup_trace.json"
+#define TRACE_PATH "trace.json"
+
+// F5 writes the command streams of the next frames, for oni_capture to look at
+#define CAPTURE_PATH "capture.ocap"
+#define CAPTURE_FRAMES 60
+
 constexpr int TEST_LIGHT_COUNT = 0;
 
-App::App()
-    : _camera(1920, 1080), _lastFrame(0.0f)
+App::App(const BenchmarkSettings& settings)
+    : _settings(settings), _camera(settings.Width, settings.Height), _lastFrame(0.0f)
 {
-    Logger::Init();
+    Profiler::SetThreadName("Main");
+#if TRACE_STARTUP
+    Profiler::BeginCapture();
+#endif
+
+    if (_settings.Enabled) {
+        _benchmark = std::make_unique<Benchmark>(_settings);
+        _vsync = _settings.VSync;
+        _hideOverlay = true;
+    }
+
+    // Shader hot reloads are polled and compiled on its thread
+    ShaderCompileService::Init();
+
+    // Workers for command recording
+    JobSystem::Init();
 
     // Initializes engine directories if needed
     if (!FileSystem::Exists("screenshots")) {
@@ -53,14 +110,48 @@ App::App()
         FileSystem::CreateDirectoryFromPath("screenshots/engine");
     }
 
+#if IO_BENCHMARK
+    IOQueue::Benchmark(".cache/");
+#endif
+
+#if USE_PAK
+    {
+        PakFile::Ptr pak = std::make_shared<PakFile>(PAK_PATH);
+        if (pak->IsOpen()) {
+            FileSystem::MountPak(pak);
+        }
+    }
+#endif
+
+    uint32_t cooked = 0;
+#if COOK_ON_STARTUP
     // Compress every model texture
-    TextureCompressor::TraverseDirectory("assets/", TextureCompressorFormat::BC7);
+    cooked += TextureCompressor::TraverseDirectory("assets/", TextureCompressorFormat::BC7);
 
     // Load/Cache every shader
-    ShaderLoader::TraverseDirectory("shaders/");
+    cooked += ShaderLoader::TraverseDirectory("shaders/");
+#endif
+
+#if USE_PAK
+    // Whatever got cooked is only on disk for now, and the mounted pak has the stale version of it
+    bool stale = FileSystem::Exists(PAK_STALE_PATH);
+    if (cooked || stale || !FileSystem::GetPak()) {
+        FileSystem::MountPak(nullptr);
+        PakFile::Build(PAK_PATH, {
+            { ".cache/textures/", {} },
+            { ".cache/shaders/", {} },
+            { ".cache/meshes/", {} },
+            { "assets/", { ".gltf", ".glb", ".bin" } }
+        });
+        FileSystem::MountPak(std::make_shared<PakFile>(PAK_PATH));
+        if (stale) {
+            FileSystem::Delete(PAK_STALE_PATH);
+        }
+    }
+#endif
 
     // Make window
-    _window = std::make_shared<Window>(1920, 1080, "Oni");
+    _window = std::make_shared<Window>(_settings.Width, _settings.Height, "Oni", !_settings.Headless);
     _window->OnResize([&](uint32_t width, uint32_t height) {
         _renderContext->Resize(width, height);
         _renderer->Resize(width, height);
@@ -68,17 +159,90 @@ App::App()
     });
 
     // Create render context and renderer
-    _renderContext = std::make_shared<RenderContext>(_window);
+    CommandRecording recording = CommandRecording::Off;
+    if (_settings.RecordOnly) {
+        recording = CommandRecording::RecordOnly;
+    } else if (_settings.ValidateCommands) {
+        recording = CommandRecording::Validate;
+    }
+    _renderContext = std::make_shared<RenderContext>(_window, recording);
     _renderer = std::make_unique<Renderer>(_renderContext);
 
+    // Models only upload their mip tails, the rest streams in while rendering
+    _textureStreamer = std::make_shared<TextureStreamer>(_renderContext);
+    TextureStreamer::SetStreamer(_textureStreamer);
+
     // Push models and lights
-    SetupScene();
+    {
+        Timer sceneTimer;
+        SetupScene();
+        if (_benchmark) {
+            _benchmark->AddLoadTime("scene", sceneTimer.GetElapsed());
+        }
+    }
+
+#if VT_BENCHMARK
+    VirtualTextureSystem::Benchmark(1000);
+#endif
+#if RENDER_GRAPH_BENCHMARK
+    RenderGraph::Benchmark(32, 10000);
+    RenderGraph::Benchmark(1024, 1000);
+    AliasingPlanner::Benchmark(32, 10000);
+    AliasingPlanner::Benchmark(256, 100);
+    _renderer->ReportAliasing();
+#endif
+
+#if DESCRIPTOR_BENCHMARK
+    DescriptorAllocator::Benchmark(1'000'000, 0.9f, 1'000'000);
+    DescriptorAllocator::Benchmark(1'000'000, 0.99f, 1'000'000);
+    DescriptorAllocator::Benchmark(1'000'000, 0.999f, 1'000'000);
+    DescriptorAllocator::Benchmark(1024, 0.99f, 1'000'000);
+#endif
+
+    // Report texture upload throughput
+    {
+        Uploader::Stats& stats = Uploader::GetStats();
+        float gigabytes = stats.TextureBytesCopied / (1024.0f * 1024.0f * 1024.0f);
+        Logger::Info("[UPLOADER] Copied %u textures (%.2f MB) to staging in %.2fms (%.2fms per GB)",
+                     stats.TexturesCopied,
+                     stats.TextureBytesCopied / (1024.0f * 1024.0f),
+                     stats.TextureCopyTime,
+                     gigabytes > 0.0f ? stats.TextureCopyTime / gigabytes : 0.0f);
+    }
+
+    // Compare against USE_PAK 0, and between a cold and a warm file cache
+    {
+        FileSystem::IOStats& stats = FileSystem::GetIOStats();
+        Logger::Info("[APP] Startup took %.2fms (%s): %llu stats, %llu opens, %llu reads, %llu maps, %llu pak hits",
+                     _startupTimer.GetElapsed(),
+                     FileSystem::GetPak() ? "pak" : "loose files",
+                     stats.Stats.load(),
+                     stats.Opens.load(),
+                     stats.Reads.load(),
+                     stats.Maps.load(),
+                     stats.PakHits.load());
+        if (_benchmark) {
+            _benchmark->AddLoadTime("startup", _startupTimer.GetElapsed());
+        }
+    }
 
     _renderContext->WaitForGPU();
 }
 
 App::~App()
 {
+    _renderContext->WaitForGPU();
+    if (!_settings.RecordCameraPath.empty()) {
+        _recordedPath.Save(_settings.RecordCameraPath);
+    }
+    TextureStreamer::SetStreamer(nullptr);
+    ShaderCompileService::Exit();
+#if USE_PAK
+    if (FileSystem::GetShadowedCount()) {
+        FileSystem::CreateFileFromPath(PAK_STALE_PATH);
+    }
+#endif
+    JobSystem::Exit();
     Logger::Exit();
 }
 
@@ -87,8 +251,19 @@ void App::Run()
     while (_window->IsOpen()) {
         OPTICK_FRAME("Oni");
 
+        // Collects the zones of the previous frame
+        Profiler::EndFrame();
+        FrameStats::Update();
+        if (_benchmark) {
+            _benchmark->EndFrame(_textureStreamer->IsIdle());
+            if (_benchmark->IsDone()) {
+                FinishBenchmark();
+                break;
+            }
+        }
+        PROFILE_SCOPE("Frame");
+
         _frameTimer.Restart();
-        auto& stats = _renderer->GetStats();
 
         static float framesPerSecond = 0.0f;
         static float lastTime = 0.0f;
@@ -99,21 +274,45 @@ void App::Run()
             _fps = (int)framesPerSecond;
             framesPerSecond = 0;
         }
-        _pastFps.push_back(_fps);
-        if (_pastFps.size() > _historySize) {
-            _pastFps.erase(_pastFps.begin());
-        }
 
         float time = _dtTimer.GetElapsed();
         float dt = (time - _lastFrame) / 1000.0f;
         _lastFrame = time;
 
+        // Benchmarks are simulated at a fixed step so that every run renders the same frames
+        if (_benchmark) {
+            dt = _settings.Timestep;
+
+            CameraKey key;
+            if (_benchmark->SampleCamera(key)) {
+                _camera.SetPosition(key.Position);
+                _camera.SetRotation(key.Yaw, key.Pitch);
+            }
+        }
+        if (!_settings.RecordCameraPath.empty()) {
+            _recordedPath.Push({ _recordTime, _camera.GetPosition(), _camera.GetYaw(), _camera.GetPitch() });
+            _recordTime += dt;
+        }
+
         _camera.Update(_updateFrustum);
 
         if (ImGui::IsKeyPressed(ImGuiKey_F1)) {
             _showUI = !_showUI;
         }
 
+        // Captures start and stop before the frame is recorded, so that they only ever hold whole frames
+        if (!_captureStarted && !_settings.CapturePath.empty() && (!_benchmark || _benchmark->IsMeasuring())) {
+            _renderContext->BeginCapture(_settings.CapturePath, _settings.CaptureFrames);
+            _captureStarted = true;
+        }
+        if (ImGui::IsKeyPressed(ImGuiKey_F5)) {
+            if (_renderContext->IsCapturing()) {
+                _renderContext->EndCapture();
+            } else {
+                _renderContext->BeginCapture(CAPTURE_PATH, CAPTURE_FRAMES);
+            }
+        }
+
         uint32_t width, height;
         _window->Update();
         _window->GetSize(width, height);
@@ -131,6 +330,13 @@ void App::Run()
         Texture::Ptr texture = _renderContext->GetBackBuffer();
         commandBuffer->Begin();
 
+        // STREAM
+        {
+            OPTICK_EVENT("Stream");
+            PROFILE_SCOPE("Stream");
+            _textureStreamer->Update(commandBuffer, _renderContext->GetBackBufferIndex(), scene.Models, scene.Camera.GetPosition(), height);
+        }
+
         // RENDER
         {
             OPTICK_EVENT("Render");
@@ -140,19 +346,18 @@ void App::Run()
         // UI
         {
             OPTICK_EVENT("UI");
-            stats.PushFrameTime("UI", [this, commandBuffer, texture, width, height]() {
-                commandBuffer->BeginEvent("ImGui");
-                commandBuffer->ImageBarrier(texture, TextureLayout::RenderTarget);
-                commandBuffer->BindRenderTargets({ texture }, nullptr);
-                commandBuffer->BeginImGui(width, height);
-                RenderOverlay();
-                if (!_showUI) {
-                    RenderHelper();
-                }
-                commandBuffer->EndImGui();
-                commandBuffer->ImageBarrier(texture, TextureLayout::Present);
-                commandBuffer->EndEvent();
-            });
+            PROFILE_SCOPE("UI");
+            commandBuffer->BeginEvent("ImGui");
+            commandBuffer->ImageBarrier(texture, TextureLayout::RenderTarget);
+            commandBuffer->BindRenderTargets({ texture }, nullptr);
+            commandBuffer->BeginImGui(width, height);
+            RenderOverlay();
+            if (!_showUI) {
+                RenderHelper();
+            }
+            commandBuffer->EndImGui();
+            commandBuffer->ImageBarrier(texture, TextureLayout::Present);
+            commandBuffer->EndEvent();
         }
 
         if (ImGui::IsKeyPressed(ImGuiKey::ImGuiKey_F2)) {
@@ -161,25 +366,31 @@ void App::Run()
         if (ImGui::IsKeyPressed(ImGuiKey::ImGuiKey_F3)) {
             _hideOverlay = !_hideOverlay;
         }
+        if (ImGui::IsKeyPressed(ImGuiKey::ImGuiKey_F4)) {
+            if (Profiler::IsCapturing()) {
+                Profiler::EndCapture(TRACE_PATH);
+            } else {
+                Profiler::BeginCapture();
+            }
+        }
 
         // SUBMIT
         {
             OPTICK_EVENT("Submit");
             commandBuffer->End();
 
-            stats.PushFrameTime("Submit", [this, commandBuffer] {
+            {
+                PROFILE_SCOPE("Submit");
                 _renderContext->ExecuteCommandBuffers({ commandBuffer }, CommandQueueType::Graphics);
-            });
+            }
         }
 
         // FLUSH
         {
             OPTICK_EVENT("Present");
-
-            stats.PushFrameTime("Present", [this]() {
-                _renderContext->Present(_vsync);
-                _renderContext->Finish();
-            });
+            PROFILE_SCOPE("Present");
+            _renderContext->Present(_vsync);
+            _renderContext->Finish();
         }
 
         // Update matrices
@@ -196,10 +407,31 @@ void App::Run()
 
         DebugRenderer::Get()->Reset();
 
-        if (!_showUI) {
+        if (!_showUI && !_benchmark) {
             _camera.Input(dt);
         }
 
+        if (_frameCount == 0) {
+            Logger::Info("[APP] Time to first frame: %.2fms", _startupTimer.GetElapsed());
+            if (_benchmark) {
+                _benchmark->AddLoadTime("first_frame", _startupTimer.GetElapsed());
+            }
+#if TRACE_STARTUP
+            Profiler::EndCapture(TRACE_STARTUP_PATH);
+#endif
+        }
+        if (!_reportedFullResolution && _textureStreamer->IsIdle()) {
+            TextureStreamer::Stats streamStats = _textureStreamer->GetStats();
+            Logger::Info("[APP] Time to full resolution: %.2fms (%u textures, %.2f MB streamed)",
+                         _startupTimer.GetElapsed(),
+                         streamStats.Completed,
+                         streamStats.BytesStreamed / (1024.0f * 1024.0f));
+            if (_benchmark) {
+                _benchmark->AddLoadTime("full_resolution", _startupTimer.GetElapsed());
+            }
+            _reportedFullResolution = true;
+        }
+
         if ((_updateTimer.GetElapsed() / 1000.0f) > 1.0f) {
             _frameTime = _frameTimer.GetElapsed();
             _updateTimer.Restart();
@@ -233,9 +465,15 @@ void App::RenderOverlay()
                 if (ImGui::MenuItem("Resource Inspector")) {
                     _showResourceInspector = !_showResourceInspector;
                 }
+                if (ImGui::MenuItem("Texture Streaming")) {
+                    _showTextureStreaming = !_showTextureStreaming;
+                }
                 if (ImGui::MenuItem("Renderer Settings")) {
                     _showRendererSettings = !_showRendererSettings;
                 }
+                if (ImGui::MenuItem("Frame Statistics")) {
+                    _showFrameStats = !_showFrameStats;
+                }
                 ImGui::EndMenu();
             }
             ImGui::EndMainMenuBar();
@@ -250,9 +488,15 @@ void App::RenderOverlay()
         if (_showLightEditor) {
             ShowLightEditor();
         }
+        if (_showTextureStreaming) {
+            _textureStreamer->OnUI();
+        }
         if (_showLogger) {
             Logger::OnUI();
         }
+        if (_showFrameStats) {
+            FrameStats::OnUI();
+        }
 
         _renderContext->OnOverlay();
     }
@@ -262,7 +506,6 @@ void App::RenderHelper()
 {
     if (!_hideOverlay) {
         static bool p_open = true;
-        auto stats = _renderer->GetStats();
 
         ImGuiIO& io = ImGui::GetIO();
         ImGuiWindowFlags window_flags = ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_AlwaysAutoResize | ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoFocusOnAppearing | ImGuiWindowFlags_NoNav | ImGuiWindowFlags_NoDocking;
@@ -284,14 +527,24 @@ void App::RenderHelper()
         ImGui::Text("Debug Menu: F1");
         ImGui::Text("Screenshot: F2");
         ImGui::Text("Hide Overlay: F3");
+        ImGui::Text(Profiler::IsCapturing() ? "Stop Capture: F4" : "Capture Trace: F4");
+        ImGui::Text(_renderContext->IsCapturing() ? "Stop Command Capture: F5" : "Capture Commands: F5");
         ImGui::Separator();
         ImGui::Text(_vsync ? "VSYNC: ON" : "VSYNC: OFF");
         ImGui::Text("%d FPS (%.2fms)", _fps, _frameTime);
+        FrameStats::Summary frame = FrameStats::SummarizeFrame();
+        ImGui::Text("P50 %.2fms, P95 %.2fms, P99 %.2fms, Max %.2fms", frame.P50, frame.P95, frame.P99, frame.Max);
         ImGui::Separator();
-        for (auto pair : stats.FrameTimesHistory) {
+        const std::vector<Profiler::ZoneHistory>& history = Profiler::GetHistory();
+        for (uint32_t i = 0; i < history.size(); i++) {
+            if (!history[i].Seen) {
+                continue;
+            }
+            uint32_t last = (history[i].Cursor + PROFILER_HISTORY_SIZE - 1) % PROFILER_HISTORY_SIZE;
+
             char buffer[256] = {};
-            sprintf(buffer, "%s (%.2fms)", pair.first.c_str(), pair.second.back());
-            ImGui::PlotLines(buffer, pair.second.data(), pair.second.size());
+            sprintf(buffer, "%s (%.2fms)", Profiler::GetName(i).c_str(), history[i].Times[last]);
+            ImGui::PlotLines(buffer, history[i].Times.data(), PROFILER_HISTORY_SIZE, history[i].Cursor);
         }
         ImGui::End();
     }
@@ -430,6 +683,29 @@ void App::SetupScene()
 {
     scene = {};
 
+    if (!_settings.Scene.empty()) {
+        Model model = {};
+        model.Load(_renderContext, _settings.Scene);
+
+        scene.Models.push_back(model);
+        scene.Lights.SetSun(glm::vec3(0.0f, 30.0f, 0.0f), glm::vec3(-90.0f, 30.0f, 0.0f), glm::vec4(5.0f));
+    } else {
+        LoadDefaultScene();
+    }
+
+    scene.Bake(_renderContext);
+
+    for (int i = 0; i < TEST_LIGHT_COUNT; i++) {
+        scene.Lights.AddPointLight(PointLight(
+            glm::vec3(util::random_range(-6.0f, 6.0f), util::random_range(1.0f, 8.0f), util::random_range(-6.0f, 6.0f)),
+            glm::vec3(util::random_range(0.0f, 1.0f),  util::random_range(0.0f, 1.0f), util::random_range(0.0f, 1.0f)),
+            1.0f
+        ));
+    }
+}
+
+void App::LoadDefaultScene()
+{
 #if SCENE_SMALL
     Model platform = {};
     platform.Load(_renderContext, "assets/models/platform/Platform.gltf");
@@ -516,14 +792,29 @@ void App::SetupScene()
 
     scene.Models.push_back(bistro);
 #endif
+}
 
-    scene.Bake(_renderContext);
+void App::FinishBenchmark()
+{
+    _renderContext->WaitForGPU();
 
-    for (int i = 0; i < TEST_LIGHT_COUNT; i++) {
-        scene.Lights.AddPointLight(PointLight(
-            glm::vec3(util::random_range(-6.0f, 6.0f), util::random_range(1.0f, 8.0f), util::random_range(-6.0f, 6.0f)),
-            glm::vec3(util::random_range(0.0f, 1.0f),  util::random_range(0.0f, 1.0f), util::random_range(0.0f, 1.0f)),
-            1.0f
-        ));
+    {
+        Allocator::Stats stats = _renderContext->GetAllocator()->GetStats();
+        _benchmark->AddMemory("vram_used", stats.Used);
+        _benchmark->AddMemory("vram_total", stats.Total);
     }
+    {
+        PROCESS_MEMORY_COUNTERS counters = {};
+        GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters));
+        _benchmark->AddMemory("ram_working_set", counters.WorkingSetSize);
+        _benchmark->AddMemory("ram_peak_working_set", counters.PeakWorkingSetSize);
+    }
+    {
+        TextureStreamer::Stats stats = _textureStreamer->GetStats();
+        _benchmark->AddMemory("textures_resident", stats.ResidentBytes);
+        _benchmark->AddMemory("textures_streamed", stats.BytesStreamed);
+    }
+
+    _benchmark->WriteReport(_settings.Output);
+    _window->Close();
 }
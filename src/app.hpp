@@ -11,6 +11,8 @@
 #include "core/camera.hpp"
 #include "core/timer.hpp"
 #include "core/file_watch.hpp"
+#include "core/texture_streamer.hpp"
+#include "core/benchmark.hpp"
 
 #include "rhi/render_context.hpp"
 
@@ -19,7 +21,7 @@
 class App
 {
 public:
-    App();
+    App(const BenchmarkSettings& settings = {});
     ~App();
 
     void Run();
@@ -30,12 +32,23 @@ private:
     void ShowLightEditor();
 
     void SetupScene();
+    void LoadDefaultScene();
+    void FinishBenchmark();
+
+    BenchmarkSettings _settings;
+    std::unique_ptr<Benchmark> _benchmark;
+    CameraPath _recordedPath;
+    float _recordTime = 0.0f;
+    bool _captureStarted = false;
 
     std::shared_ptr<Window> _window;
 
     RenderContext::Ptr _renderContext;
     std::unique_ptr<Renderer> _renderer;
+    TextureStreamer::Ptr _textureStreamer;
 
+    Timer _startupTimer;
+    bool _reportedFullResolution = false;
     Timer _dtTimer;
     Timer _updateTimer;
     Timer _frameTimer;
@@ -51,14 +64,13 @@ private:
 
     bool _showUI = false;
     bool _showResourceInspector = false;
+    bool _showTextureStreaming = false;
     bool _showRendererSettings = false;
     bool _showLightEditor = false;
     bool _showLogger = false;
+    bool _showFrameStats = false;
     bool _updateFrustum = true;
 
-    std::vector<float> _pastFps;
-    int _historySize = 500;
-
     int _fps;
     int _frameCount = 0;
     float _frameTime = 0.0f;
@@ -0,0 +1,565 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 14:47:26
+//
+
+// oni_capture: offline analyzer for the command captures written by F5 or --capture. Builds without the RHI, so that
+// captures from the perf machines can be looked at anywhere.
+//
+// Command lists don't inherit any state, so every stream is looked at on its own: a bind is redundant when the same
+// thing was already bound earlier in the same stream, and a barrier only knows about the barriers before it.
+
+#include "core/log.hpp"
+#include "core/timer.hpp"
+
+#include "rhi/command_stream.hpp"
+#include "rhi/command_capture.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <nlohmann/json.hpp>
+
+#undef min
+#undef max
+
+// Lines printed for the lists that can get long, the JSON report has all of them
+#define CAPTURE_MAX_PRINTED 10
+
+struct AnalyzeSettings
+{
+    std::string Path;
+    std::string JsonPath;
+    int32_t Frame = -1; // Every frame if negative
+};
+
+struct PassStats
+{
+    uint32_t Order = 0; // First time the pass shows up in the frame
+    uint32_t Commands = 0;
+    uint32_t Draws = 0;
+    uint32_t Dispatches = 0;
+    uint32_t Copies = 0;
+    uint32_t Barriers = 0;
+    uint32_t BarrierCalls = 0;
+    uint32_t PushConstantBytes = 0;
+    uint32_t RedundantBinds = 0;
+    uint64_t Hash = 14695981039346656037ull; // Of the command types, to tell which passes changed between frames
+};
+
+struct FrameAnalysis
+{
+    uint64_t Index = 0;
+    std::array<uint32_t, size_t(StreamCommand::Count)> Counts = {};
+    std::array<uint64_t, size_t(StreamCommand::Count)> Bytes = {}; // Headers included
+    std::array<uint32_t, size_t(StreamCommand::Count)> Redundant = {}; // Binds that changed nothing, by command
+
+    uint32_t Streams = 0;
+    uint32_t Commands = 0;
+    uint64_t Size = 0;
+    uint32_t Barriers = 0;
+    uint32_t BarrierCalls = 0; // Barrier requests, a batch is one request
+    uint32_t SplitBarriers = 0; // Requests right after another one, that could have gone in it
+    uint32_t NoOpBarriers = 0; // Transitions to the state the resource is already in
+    uint32_t RedundantTransitions = 0; // A to B and back to A without anything using the resource in between
+    uint32_t RedundantUAVBarriers = 0; // UAV barriers without any work since the last one on that resource
+    uint32_t RedundantBinds = 0;
+    uint32_t PushConstantBytes = 0;
+
+    std::unordered_map<std::string, PassStats> Passes;
+    std::unordered_map<uint64_t, uint32_t> TransitionsByResource; // Redundant transitions and no-op barriers
+};
+
+static uint64_t HashCombine(uint64_t hash, uint64_t value)
+{
+    return (hash ^ value) * 1099511628211ull;
+}
+
+static bool IsWork(StreamCommand type)
+{
+    switch (type) {
+        case StreamCommand::ClearRenderTarget:
+        case StreamCommand::ClearDepth:
+        case StreamCommand::ClearUAV:
+        case StreamCommand::Draw:
+        case StreamCommand::DrawIndexed:
+        case StreamCommand::Dispatch:
+        case StreamCommand::DispatchMesh:
+        case StreamCommand::TraceRays:
+        case StreamCommand::Copy:
+        case StreamCommand::BuildAccelerationStructure:
+        case StreamCommand::RenderImGui:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Binds that can be redundant, and what they are compared with
+struct BoundState
+{
+    StreamBindPipeline Pipeline[2] = {};
+    bool PipelineBound[2] = { false, false };
+    StreamViewport Viewport = {};
+    bool ViewportSet = false;
+    uint32_t Topology = ~0u;
+    StreamRenderTargets Targets = {};
+    bool TargetsBound = false;
+    uint64_t VertexBuffer = 0;
+    uint64_t IndexBuffer = 0;
+    std::map<std::pair<uint32_t, uint32_t>, StreamBindTable> Tables;
+    std::map<std::pair<uint32_t, uint32_t>, std::vector<uint8_t>> Constants;
+};
+
+static void AnalyzeStream(const CommandStream& stream, FrameAnalysis& frame)
+{
+    BoundState bound;
+    std::vector<std::string> events;
+    std::string pass = "(no event)";
+
+    // Last barrier of every subresource, and the work count when it happened
+    struct LastBarrier
+    {
+        uint32_t Before;
+        uint32_t After;
+        uint32_t Work;
+        bool UAV;
+    };
+    std::unordered_map<uint64_t, std::unordered_map<uint32_t, LastBarrier>> barriers;
+    uint32_t work = 0;
+    bool afterBarrier = false;
+
+    frame.Streams++;
+    frame.Size += stream.GetSize();
+
+    stream.ForEach([&](const StreamHeader& header, const uint8_t *payload) {
+        size_t type = size_t(header.Type);
+        frame.Counts[type]++;
+        frame.Bytes[type] += sizeof(StreamHeader) + ((header.Size + 7) & ~7);
+        frame.Commands++;
+
+        if (header.Type == StreamCommand::BeginEvent || header.Type == StreamCommand::EndEvent) {
+            if (header.Type == StreamCommand::BeginEvent) {
+                events.push_back(stream.GetString(reinterpret_cast<const StreamEvent*>(payload)->Name));
+            } else if (!events.empty()) {
+                events.pop_back();
+            }
+            pass.clear();
+            for (auto& event : events) {
+                pass += pass.empty() ? event : "/" + event;
+            }
+            if (pass.empty()) {
+                pass = "(no event)";
+            }
+            return;
+        }
+
+        auto inserted = frame.Passes.try_emplace(pass);
+        PassStats& stats = inserted.first->second;
+        if (inserted.second) {
+            stats.Order = uint32_t(frame.Passes.size());
+        }
+        stats.Commands++;
+        stats.Hash = HashCombine(stats.Hash, type);
+
+        auto redundant = [&](bool same) {
+            if (same) {
+                frame.Redundant[type]++;
+                frame.RedundantBinds++;
+                stats.RedundantBinds++;
+            }
+        };
+
+        bool isBarrier = header.Type == StreamCommand::Barrier || header.Type == StreamCommand::UAVBarrier;
+        if (IsWork(header.Type)) {
+            work++;
+        }
+        if (!isBarrier && header.Type != StreamCommand::Marker) {
+            afterBarrier = false;
+        }
+
+        switch (header.Type) {
+            case StreamCommand::Barrier:
+            case StreamCommand::UAVBarrier: {
+                const StreamBarrier *barrier = reinterpret_cast<const StreamBarrier*>(payload);
+                bool uav = header.Type == StreamCommand::UAVBarrier;
+                frame.Barriers++;
+                stats.Barriers++;
+                if (!barrier->Batched) {
+                    frame.BarrierCalls++;
+                    stats.BarrierCalls++;
+                    if (afterBarrier) {
+                        frame.SplitBarriers++;
+                    }
+                }
+                afterBarrier = true;
+
+                if (!uav && barrier->Before == barrier->After) {
+                    frame.NoOpBarriers++;
+                    frame.TransitionsByResource[barrier->Resource]++;
+                    break;
+                }
+
+                auto& subresources = barriers[barrier->Resource];
+                auto last = subresources.find(barrier->Subresource);
+                if (last != subresources.end() && last->second.Work == work) {
+                    if (uav && last->second.UAV) {
+                        frame.RedundantUAVBarriers++;
+                    } else if (!uav && !last->second.UAV && last->second.Before == barrier->After && last->second.After == barrier->Before) {
+                        frame.RedundantTransitions++;
+                        frame.TransitionsByResource[barrier->Resource]++;
+                    }
+                }
+                subresources[barrier->Subresource] = { barrier->Before, barrier->After, work, uav };
+                break;
+            }
+            case StreamCommand::BindPipeline: {
+                const StreamBindPipeline *pipeline = reinterpret_cast<const StreamBindPipeline*>(payload);
+                uint32_t point = pipeline->Kind == StreamPipeline::Compute || pipeline->Kind == StreamPipeline::Raytracing;
+                redundant(bound.PipelineBound[point] && bound.Pipeline[point].Pipeline == pipeline->Pipeline && bound.Pipeline[point].Signature == pipeline->Signature);
+                // A new root signature throws away the root arguments
+                if (bound.PipelineBound[point] && bound.Pipeline[point].Signature != pipeline->Signature) {
+                    for (auto it = bound.Tables.begin(); it != bound.Tables.end();) {
+                        it = it->first.first == point ? bound.Tables.erase(it) : std::next(it);
+                    }
+                    for (auto it = bound.Constants.begin(); it != bound.Constants.end();) {
+                        it = it->first.first == point ? bound.Constants.erase(it) : std::next(it);
+                    }
+                }
+                bound.Pipeline[point] = *pipeline;
+                bound.PipelineBound[point] = true;
+                break;
+            }
+            case StreamCommand::SetViewport: {
+                const StreamViewport *viewport = reinterpret_cast<const StreamViewport*>(payload);
+                redundant(bound.ViewportSet && !memcmp(&bound.Viewport, viewport, sizeof(StreamViewport)));
+                bound.Viewport = *viewport;
+                bound.ViewportSet = true;
+                break;
+            }
+            case StreamCommand::SetTopology: {
+                const StreamTopology *topology = reinterpret_cast<const StreamTopology*>(payload);
+                redundant(bound.Topology == topology->Topology);
+                bound.Topology = topology->Topology;
+                break;
+            }
+            case StreamCommand::BindRenderTargets: {
+                const StreamRenderTargets *targets = reinterpret_cast<const StreamRenderTargets*>(payload);
+                bool same = bound.TargetsBound && bound.Targets.Count == targets->Count && bound.Targets.Depth == targets->Depth;
+                for (uint32_t i = 0; same && i < targets->Count; i++) {
+                    same = bound.Targets.Targets[i] == targets->Targets[i];
+                }
+                redundant(same);
+                bound.Targets = *targets;
+                bound.TargetsBound = true;
+                break;
+            }
+            case StreamCommand::BindVertexBuffer: {
+                uint64_t resource = reinterpret_cast<const StreamResource*>(payload)->Resource;
+                redundant(bound.VertexBuffer == resource);
+                bound.VertexBuffer = resource;
+                break;
+            }
+            case StreamCommand::BindIndexBuffer: {
+                uint64_t resource = reinterpret_cast<const StreamResource*>(payload)->Resource;
+                redundant(bound.IndexBuffer == resource);
+                bound.IndexBuffer = resource;
+                break;
+            }
+            case StreamCommand::BindTable: {
+                const StreamBindTable *table = reinterpret_cast<const StreamBindTable*>(payload);
+                auto key = std::make_pair(uint32_t(table->Point), table->Index);
+                auto it = bound.Tables.find(key);
+                redundant(it != bound.Tables.end()
+                       && it->second.Resource == table->Resource
+                       && it->second.Subresource == table->Subresource
+                       && it->second.View == table->View);
+                bound.Tables[key] = *table;
+                break;
+            }
+            case StreamCommand::PushConstants: {
+                const StreamPushConstants *constants = reinterpret_cast<const StreamPushConstants*>(payload);
+                const uint8_t *data = payload + sizeof(StreamPushConstants);
+                frame.PushConstantBytes += constants->Size;
+                stats.PushConstantBytes += constants->Size;
+
+                auto key = std::make_pair(uint32_t(constants->Point), constants->Index);
+                std::vector<uint8_t>& previous = bound.Constants[key];
+                redundant(previous.size() == constants->Size && !memcmp(previous.data(), data, constants->Size));
+                previous.assign(data, data + constants->Size);
+                break;
+            }
+            case StreamCommand::Draw:
+            case StreamCommand::DrawIndexed:
+            case StreamCommand::DispatchMesh: {
+                stats.Draws++;
+                break;
+            }
+            case StreamCommand::Dispatch:
+            case StreamCommand::TraceRays: {
+                stats.Dispatches++;
+                break;
+            }
+            case StreamCommand::Copy: {
+                stats.Copies++;
+                break;
+            }
+            default:
+                break;
+        }
+    });
+}
+
+static FrameAnalysis AnalyzeFrame(const CapturedFrame& frame)
+{
+    FrameAnalysis analysis;
+    analysis.Index = frame.Index;
+    for (auto& stream : frame.Streams) {
+        AnalyzeStream(stream.Commands, analysis);
+    }
+    return analysis;
+}
+
+static std::vector<std::pair<std::string, const PassStats*>> SortPasses(const FrameAnalysis& frame)
+{
+    std::vector<std::pair<std::string, const PassStats*>> passes;
+    for (auto& [name, stats] : frame.Passes) {
+        passes.push_back({ name, &stats });
+    }
+    std::sort(passes.begin(), passes.end(), [](auto& a, auto& b) { return a.second->Order < b.second->Order; });
+    return passes;
+}
+
+// Passes that showed up, went away, or recorded something else than in the previous frame
+static nlohmann::json DiffFrames(const FrameAnalysis& previous, const FrameAnalysis& current)
+{
+    nlohmann::json changes = nlohmann::json::array();
+    for (auto& [name, stats] : SortPasses(current)) {
+        auto it = previous.Passes.find(name);
+        if (it == previous.Passes.end()) {
+            changes.push_back({ { "pass", name }, { "change", "added" }, { "commands", stats->Commands } });
+        } else if (it->second.Hash != stats->Hash) {
+            changes.push_back({
+                { "pass", name },
+                { "change", "changed" },
+                { "commands", stats->Commands },
+                { "delta", int64_t(stats->Commands) - int64_t(it->second.Commands) }
+            });
+        }
+    }
+    for (auto& [name, stats] : SortPasses(previous)) {
+        if (!current.Passes.count(name)) {
+            changes.push_back({ { "pass", name }, { "change", "removed" }, { "commands", stats->Commands } });
+        }
+    }
+    return changes;
+}
+
+static void PrintUsage()
+{
+    Logger::Info("Usage: oni_capture <capture> [options]");
+    Logger::Info("    --frame <index>    Only look at this frame (default: every frame, per-pass stats of the first)");
+    Logger::Info("    --json <path>      Also write everything to a JSON report");
+}
+
+static bool ParseArguments(int argc, char **argv, AnalyzeSettings& settings)
+{
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (argument == "--frame" && hasValue) {
+            settings.Frame = std::max(0, atoi(argv[++i]));
+        } else if (argument == "--json" && hasValue) {
+            settings.JsonPath = argv[++i];
+        } else if (argument[0] != '-' && settings.Path.empty()) {
+            settings.Path = argument;
+        } else {
+            Logger::Error("[CAPTURE] Unknown argument %s", argument.c_str());
+            PrintUsage();
+            return false;
+        }
+    }
+    if (settings.Path.empty()) {
+        PrintUsage();
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    Logger::Init();
+
+    AnalyzeSettings settings;
+    if (!ParseArguments(argc, argv, settings)) {
+        return 1;
+    }
+
+    Timer timer;
+    CaptureData capture;
+    if (!CommandCapture::Load(settings.Path, capture)) {
+        return 1;
+    }
+    if (settings.Frame >= 0) {
+        if (uint32_t(settings.Frame) >= capture.Frames.size()) {
+            Logger::Error("[CAPTURE] Frame %d is out of range, the capture has %u frames", settings.Frame, uint32_t(capture.Frames.size()));
+            return 1;
+        }
+        capture.Frames = { capture.Frames[settings.Frame] };
+    }
+    if (capture.Frames.empty()) {
+        Logger::Error("[CAPTURE] %s has no complete frame", settings.Path.c_str());
+        return 1;
+    }
+
+    std::vector<FrameAnalysis> frames;
+    for (auto& frame : capture.Frames) {
+        frames.push_back(AnalyzeFrame(frame));
+    }
+    float frameCount = float(frames.size());
+
+    // Averages over every frame
+    FrameAnalysis total;
+    for (auto& frame : frames) {
+        for (size_t i = 0; i < size_t(StreamCommand::Count); i++) {
+            total.Counts[i] += frame.Counts[i];
+            total.Bytes[i] += frame.Bytes[i];
+            total.Redundant[i] += frame.Redundant[i];
+        }
+        total.Streams += frame.Streams;
+        total.Commands += frame.Commands;
+        total.Size += frame.Size;
+        total.Barriers += frame.Barriers;
+        total.BarrierCalls += frame.BarrierCalls;
+        total.SplitBarriers += frame.SplitBarriers;
+        total.NoOpBarriers += frame.NoOpBarriers;
+        total.RedundantTransitions += frame.RedundantTransitions;
+        total.RedundantUAVBarriers += frame.RedundantUAVBarriers;
+        total.RedundantBinds += frame.RedundantBinds;
+        total.PushConstantBytes += frame.PushConstantBytes;
+        for (auto& [resource, count] : frame.TransitionsByResource) {
+            total.TransitionsByResource[resource] += count;
+        }
+    }
+
+    Logger::Info("[CAPTURE] %u frames, per frame: %.1f command lists, %.1f commands, %.2f KB",
+                 uint32_t(frames.size()), total.Streams / frameCount, total.Commands / frameCount, total.Size / frameCount / 1024.0f);
+    Logger::Info("[CAPTURE] %-28s %10s %10s %10s", "Command", "Count", "KB", "Redundant");
+    nlohmann::json commands = nlohmann::json::object();
+    for (size_t i = 0; i < size_t(StreamCommand::Count); i++) {
+        if (!total.Counts[i]) {
+            continue;
+        }
+        const char *name = CommandStream::GetCommandName(StreamCommand(i));
+        Logger::Info("[CAPTURE] %-28s %10.1f %10.2f %10.1f", name, total.Counts[i] / frameCount, total.Bytes[i] / frameCount / 1024.0f, total.Redundant[i] / frameCount);
+        commands[name] = {
+            { "count", total.Counts[i] / frameCount },
+            { "bytes", total.Bytes[i] / frameCount },
+            { "redundant", total.Redundant[i] / frameCount }
+        };
+    }
+
+    Logger::Info("[CAPTURE] Binds: %.1f redundant per frame", total.RedundantBinds / frameCount);
+    Logger::Info("[CAPTURE] Push constants: %.1f bytes per frame", total.PushConstantBytes / frameCount);
+    Logger::Info("[CAPTURE] Barriers: %.1f in %.1f requests per frame, %.1f requests could have been batched with the previous one",
+                 total.Barriers / frameCount, total.BarrierCalls / frameCount, total.SplitBarriers / frameCount);
+    Logger::Info("[CAPTURE] Barriers: %.1f no-ops, %.1f transitions undone without any work in between, %.1f redundant UAV barriers per frame",
+                 total.NoOpBarriers / frameCount, total.RedundantTransitions / frameCount, total.RedundantUAVBarriers / frameCount);
+
+    std::vector<std::pair<uint64_t, uint32_t>> offenders(total.TransitionsByResource.begin(), total.TransitionsByResource.end());
+    std::sort(offenders.begin(), offenders.end(), [](auto& a, auto& b) { return a.second > b.second; });
+    nlohmann::json wastedBarriers = nlohmann::json::object();
+    for (uint32_t i = 0; i < offenders.size(); i++) {
+        std::string name = capture.GetName(offenders[i].first);
+        if (i < CAPTURE_MAX_PRINTED) {
+            Logger::Info("[CAPTURE]     %s: %.1f wasted barriers per frame", name.c_str(), offenders[i].second / frameCount);
+        }
+        wastedBarriers[name] = offenders[i].second / frameCount;
+    }
+
+    // Per pass, for the first frame looked at
+    const FrameAnalysis& first = frames.front();
+    Logger::Info("[CAPTURE] Passes of frame %llu:", (unsigned long long)first.Index);
+    Logger::Info("[CAPTURE] %-40s %8s %8s %8s %8s %8s %8s %10s", "Pass", "Commands", "Draws", "Dispatch", "Barriers", "Calls", "Redund.", "Push bytes");
+    nlohmann::json passes = nlohmann::json::array();
+    for (auto& [name, stats] : SortPasses(first)) {
+        Logger::Info("[CAPTURE] %-40s %8u %8u %8u %8u %8u %8u %10u",
+                     name.c_str(), stats->Commands, stats->Draws, stats->Dispatches, stats->Barriers, stats->BarrierCalls, stats->RedundantBinds, stats->PushConstantBytes);
+        passes.push_back({
+            { "name", name },
+            { "commands", stats->Commands },
+            { "draws", stats->Draws },
+            { "dispatches", stats->Dispatches },
+            { "copies", stats->Copies },
+            { "barriers", stats->Barriers },
+            { "barrier_calls", stats->BarrierCalls },
+            { "redundant_binds", stats->RedundantBinds },
+            { "push_constant_bytes", stats->PushConstantBytes }
+        });
+    }
+
+    // Frame over frame, a steady scene should record the same thing every frame
+    nlohmann::json diffs = nlohmann::json::array();
+    uint32_t changedFrames = 0;
+    for (size_t i = 1; i < frames.size(); i++) {
+        nlohmann::json changes = DiffFrames(frames[i - 1], frames[i]);
+        if (changes.empty()) {
+            continue;
+        }
+        if (changedFrames++ < CAPTURE_MAX_PRINTED) {
+            Logger::Info("[CAPTURE] Frame %llu: %u passes differ from the previous frame", (unsigned long long)frames[i].Index, uint32_t(changes.size()));
+            for (uint32_t j = 0; j < changes.size() && j < CAPTURE_MAX_PRINTED; j++) {
+                auto& change = changes[j];
+                Logger::Info("[CAPTURE]     %s %s (%u commands)",
+                             change["pass"].get<std::string>().c_str(), change["change"].get<std::string>().c_str(), change["commands"].get<uint32_t>());
+            }
+        }
+        diffs.push_back({ { "frame", frames[i].Index }, { "changes", changes } });
+    }
+    if (frames.size() > 1) {
+        Logger::Info("[CAPTURE] %u of %u frames recorded something else than the frame before", changedFrames, uint32_t(frames.size() - 1));
+    }
+
+    if (!settings.JsonPath.empty()) {
+        nlohmann::json root = {
+            { "capture", settings.Path },
+            { "frames", frames.size() },
+            { "per_frame", {
+                { "command_lists", total.Streams / frameCount },
+                { "commands", total.Commands / frameCount },
+                { "bytes", total.Size / frameCount },
+                { "redundant_binds", total.RedundantBinds / frameCount },
+                { "push_constant_bytes", total.PushConstantBytes / frameCount },
+                { "barriers", total.Barriers / frameCount },
+                { "barrier_calls", total.BarrierCalls / frameCount },
+                { "split_barriers", total.SplitBarriers / frameCount },
+                { "noop_barriers", total.NoOpBarriers / frameCount },
+                { "redundant_transitions", total.RedundantTransitions / frameCount },
+                { "redundant_uav_barriers", total.RedundantUAVBarriers / frameCount }
+            } },
+            { "commands", commands },
+            { "wasted_barriers", wastedBarriers },
+            { "passes", passes },
+            { "diffs", diffs }
+        };
+
+        std::ofstream stream(settings.JsonPath, std::ios::trunc);
+        if (!stream.is_open()) {
+            Logger::Error("[CAPTURE] Failed to open %s for writing", settings.JsonPath.c_str());
+            return 1;
+        }
+        stream << root.dump(4);
+        Logger::Info("[CAPTURE] Wrote report to %s", settings.JsonPath.c_str());
+    }
+
+    Logger::Info("[CAPTURE] Analyzed in %.2fms", timer.GetElapsed());
+    return 0;
+}
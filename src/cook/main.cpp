@@ -0,0 +1,483 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-12 16:20:37
+//
+
+// oni_cook: offline cooker for textures, shaders and meshes. Builds without the RHI, so that the caches (and the pak)
+// can be produced on any machine and the runtime only ever reads cooked data.
+//
+// Every output is recorded in .cache/cook.db with the hash of its inputs and of the settings it was cooked with.
+// A job only runs again when one of those changed, or when its output is gone.
+
+#include "core/log.hpp"
+#include "core/timer.hpp"
+#include "core/util.hpp"
+#include "core/file_system.hpp"
+#include "core/io_queue.hpp"
+#include "core/profiler.hpp"
+#include "core/pak_file.hpp"
+#include "core/texture_compressor.hpp"
+#include "core/shader_loader.hpp"
+#include "core/mesh_cooker.hpp"
+#include "core/job_system.hpp"
+#include "core/virtual_texture/tile_cooker.hpp"
+#include "core/virtual_texture/virtual_texture_system.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+
+#define COOK_DB_PATH ".cache/cook.db"
+// Bump when a cooker changes its output without its settings changing
+#define COOK_VERSION 1
+// util::hash takes a 32 bit length, files are hashed in pieces of this size
+#define COOK_HASH_CHUNK_SIZE (1ull << 30)
+
+enum class CookJobType
+{
+    Texture,
+    Shader,
+    Mesh
+};
+
+struct CookJob
+{
+    CookJobType Type;
+    std::string Source;
+    std::string Output;
+    std::vector<std::string> Dependencies; // Files the output depends on besides the source
+
+    uint64_t Hash = 0;
+    bool Cooked = false;
+    bool Failed = false;
+    float Time = 0.0f;
+};
+
+struct CookSettings
+{
+    std::string AssetDirectory = "assets/";
+    std::string ShaderDirectory = "shaders/";
+    std::string PakPath;
+    std::string VTPath;
+    std::string BenchmarkDirectory;
+    uint32_t VTBenchmarkFrames = 0;
+    std::string TracePath;
+    uint32_t JobCount = 0;
+    bool Force = false;
+
+    TextureCompressorOptions Texture;
+};
+
+static uint64_t HashFile(const std::string& path, uint64_t seed)
+{
+    PROFILE_SCOPE("Hash File");
+
+    FileView view = FileSystem::Map(path);
+    if (!view.IsValid()) {
+        return seed;
+    }
+
+    // The whole 64 bit size goes in first, so that two files sharing their first pieces still differ
+    uint64_t size = view.GetSize();
+    uint64_t hash = util::hash(&size, sizeof(size), seed);
+    for (uint64_t offset = 0; offset < size; offset += COOK_HASH_CHUNK_SIZE) {
+        uint64_t chunk = std::min<uint64_t>(COOK_HASH_CHUNK_SIZE, size - offset);
+        hash = util::hash(view.GetData() + offset, uint32_t(chunk), hash);
+    }
+    return hash;
+}
+
+static uint64_t HashSettings(const CookSettings& settings, CookJobType type)
+{
+    uint64_t values[8] = {};
+    values[0] = COOK_VERSION;
+    values[1] = uint64_t(type);
+    switch (type) {
+        case CookJobType::Texture: {
+            values[2] = uint64_t(settings.Texture.Format);
+            values[3] = settings.Texture.Compress;
+            values[4] = settings.Texture.RDO;
+            memcpy(&values[5], &settings.Texture.RDOLambda, sizeof(float));
+            values[6] = settings.Texture.RDOWindow;
+            break;
+        }
+        case CookJobType::Shader: {
+            values[2] = SHADER_CACHE_VERSION;
+            break;
+        }
+        case CookJobType::Mesh: {
+            values[2] = COOKED_MESH_VERSION;
+            values[3] = MAX_MESHLET_VERTICES;
+            values[4] = MAX_MESHLET_TRIANGLES;
+            break;
+        }
+    }
+    return util::hash(values, sizeof(values), 1000);
+}
+
+// The buffers a glTF points at are part of its inputs
+static std::vector<std::string> GetMeshDependencies(const std::string& path)
+{
+    std::vector<std::string> dependencies;
+
+    cgltf_options options = {};
+    MeshCooker::SetFileCallbacks(options);
+    cgltf_data* data = nullptr;
+    if (cgltf_parse_file(&options, path.c_str(), &data) != cgltf_result_success) {
+        return dependencies;
+    }
+
+    std::string directory = path.substr(0, path.find_last_of('/'));
+    for (int i = 0; i < data->buffers_count; i++) {
+        const char *uri = data->buffers[i].uri;
+        if (uri && strncmp(uri, "data:", 5) != 0) {
+            dependencies.push_back(directory + '/' + uri);
+        }
+    }
+    cgltf_free(data);
+    return dependencies;
+}
+
+static std::unordered_map<std::string, uint64_t> LoadDatabase()
+{
+    std::unordered_map<std::string, uint64_t> database;
+
+    std::ifstream stream(COOK_DB_PATH);
+    std::string output;
+    uint64_t hash;
+    while (stream >> output >> hash) {
+        database[output] = hash;
+    }
+    return database;
+}
+
+static void SaveDatabase(const std::unordered_map<std::string, uint64_t>& database)
+{
+    std::ofstream stream(COOK_DB_PATH);
+    for (auto& entry : database) {
+        stream << entry.first << ' ' << entry.second << '\n';
+    }
+}
+
+static void GatherJobs(const CookSettings& settings, std::vector<CookJob>& jobs)
+{
+    PROFILE_SCOPE("Gather Jobs");
+
+    if (FileSystem::Exists(settings.AssetDirectory)) {
+        for (const auto& dirEntry : std::filesystem::recursive_directory_iterator(settings.AssetDirectory)) {
+            if (dirEntry.is_directory()) {
+                continue;
+            }
+            std::string entryPath = dirEntry.path().string();
+            std::replace(entryPath.begin(), entryPath.end(), '\\', '/');
+
+            std::string extension = FileSystem::GetFileExtension(entryPath);
+            CookJob job;
+            job.Source = entryPath;
+            if (TextureCompressor::IsValidExtension(extension)) {
+                job.Type = CookJobType::Texture;
+                job.Output = TextureCompressor::GetCachedPath(entryPath);
+            } else if (extension == ".gltf" || extension == ".glb") {
+                job.Type = CookJobType::Mesh;
+                job.Output = MeshCooker::GetCachedPath(entryPath);
+            } else {
+                continue;
+            }
+            jobs.push_back(job);
+        }
+    }
+
+    if (FileSystem::Exists(settings.ShaderDirectory)) {
+        for (const auto& dirEntry : std::filesystem::recursive_directory_iterator(settings.ShaderDirectory)) {
+            if (dirEntry.is_directory()) {
+                continue;
+            }
+            std::string entryPath = dirEntry.path().string();
+            std::replace(entryPath.begin(), entryPath.end(), '\\', '/');
+            if (ShaderLoader::GetTypeFromPath(entryPath) == ShaderType::None) {
+                continue;
+            }
+
+            CookJob job;
+            job.Type = CookJobType::Shader;
+            job.Source = entryPath;
+            job.Output = ShaderLoader::GetCachedPath(entryPath);
+            jobs.push_back(job);
+        }
+    }
+}
+
+// Cuts every cooked texture into the tiles of a virtual texture archive. Textures get their ids in the order of their
+// source paths, so that they stay the same from one cook to the next as long as no texture is added or removed.
+static bool CookVirtualTextures(const CookSettings& settings, const std::vector<CookJob>& jobs, std::unordered_map<std::string, uint64_t>& database)
+{
+    PROFILE_SCOPE("Cook Virtual Textures");
+
+    std::vector<const CookJob*> textures;
+    for (auto& job : jobs) {
+        if (job.Type == CookJobType::Texture && !job.Failed && FileSystem::Exists(job.Output)) {
+            textures.push_back(&job);
+        }
+    }
+    std::sort(textures.begin(), textures.end(), [](const CookJob *a, const CookJob *b) {
+        return a->Source < b->Source;
+    });
+
+    uint64_t hash = util::hash(settings.VTPath.c_str(), uint32_t(settings.VTPath.size()), VT_ARCHIVE_VERSION * 1000 + VT_TILE_SIZE);
+    for (const CookJob *job : textures) {
+        hash = util::hash(&job->Hash, sizeof(job->Hash), hash);
+        hash = util::hash(job->Source.c_str(), uint32_t(job->Source.size()), hash);
+    }
+    auto it = database.find(settings.VTPath);
+    if (!settings.Force && FileSystem::Exists(settings.VTPath) && it != database.end() && it->second == hash) {
+        Logger::Info("[COOK] Virtual texture archive %s is up to date", settings.VTPath.c_str());
+        return true;
+    }
+
+    Timer timer;
+    TileCooker cooker;
+    for (const CookJob *job : textures) {
+        if (cooker.AddTextureFile(job->Output) == UINT32_MAX) {
+            database.erase(settings.VTPath);
+            return false;
+        }
+    }
+    if (!cooker.Write(settings.VTPath)) {
+        database.erase(settings.VTPath);
+        return false;
+    }
+    database[settings.VTPath] = hash;
+    Logger::Info("[COOK] Cut %u textures into %s in %.2fms", cooker.GetTextureCount(), settings.VTPath.c_str(), timer.GetElapsed());
+    return true;
+}
+
+static void PrintUsage()
+{
+    Logger::Info("Usage: oni_cook [options]");
+    Logger::Info("    --assets <dir>     Directory with the textures and glTF files (default: assets/)");
+    Logger::Info("    --shaders <dir>    Directory with the shaders (default: shaders/)");
+    Logger::Info("    --pak <path>       Pack the caches and glTF files into an archive once done");
+    Logger::Info("    --vt <path>        Cut the cooked textures into a virtual texture archive once done");
+    Logger::Info("    --jobs <count>     Worker threads (default: hardware threads)");
+    Logger::Info("    --force            Cook everything, even what's up to date");
+    Logger::Info("    --bc1              Compress textures to BC1 instead of BC7");
+    Logger::Info("    --rdo              Run the lossy rate-distortion pass on textures, for smaller files");
+    Logger::Info("    --no-compress      Store texture mips uncompressed");
+    Logger::Info("    --no-cuda          Compress textures on the CPU only");
+    Logger::Info("    --io-benchmark <dir> Compare blocking reads against the IO queue on every file under dir, then exit");
+    Logger::Info("    --vt-benchmark <frames> Run the virtual texture feedback loop on synthetic feedback, then exit");
+    Logger::Info("    --trace <path>     Write a Chrome trace of the whole cook");
+}
+
+static bool ParseArguments(int argc, char **argv, CookSettings& settings)
+{
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (argument == "--assets" && hasValue) {
+            settings.AssetDirectory = argv[++i];
+        } else if (argument == "--shaders" && hasValue) {
+            settings.ShaderDirectory = argv[++i];
+        } else if (argument == "--pak" && hasValue) {
+            settings.PakPath = argv[++i];
+        } else if (argument == "--vt" && hasValue) {
+            settings.VTPath = argv[++i];
+        } else if (argument == "--jobs" && hasValue) {
+            settings.JobCount = std::max(1, atoi(argv[++i]));
+        } else if (argument == "--force") {
+            settings.Force = true;
+        } else if (argument == "--bc1") {
+            settings.Texture.Format = TextureCompressorFormat::BC1;
+        } else if (argument == "--rdo") {
+            settings.Texture.RDO = true;
+        } else if (argument == "--no-compress") {
+            settings.Texture.Compress = false;
+        } else if (argument == "--no-cuda") {
+            settings.Texture.CUDA = false;
+        } else if (argument == "--io-benchmark" && hasValue) {
+            settings.BenchmarkDirectory = argv[++i];
+        } else if (argument == "--vt-benchmark" && hasValue) {
+            settings.VTBenchmarkFrames = std::max(1, atoi(argv[++i]));
+        } else if (argument == "--trace" && hasValue) {
+            settings.TracePath = argv[++i];
+        } else {
+            Logger::Error("[COOK] Unknown argument %s", argument.c_str());
+            PrintUsage();
+            return false;
+        }
+    }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    Logger::Init();
+
+    CookSettings settings;
+    if (!ParseArguments(argc, argv, settings)) {
+        return 1;
+    }
+    if (!settings.JobCount) {
+        settings.JobCount = std::max(1u, std::thread::hardware_concurrency());
+    }
+    if (!settings.BenchmarkDirectory.empty()) {
+        IOQueue::Benchmark(settings.BenchmarkDirectory);
+        return 0;
+    }
+    if (settings.VTBenchmarkFrames) {
+        VirtualTextureSystem::Benchmark(settings.VTBenchmarkFrames);
+        return 0;
+    }
+
+    Profiler::SetThreadName("Main");
+    if (!settings.TracePath.empty()) {
+        Profiler::BeginCapture();
+    }
+    Timer totalTimer;
+
+    // Chunked decompression and the like split their work on it, from inside the cook jobs
+    JobSystem::Init();
+
+    for (const char *directory : { ".cache/", ".cache/textures/", ".cache/shaders/", ".cache/meshes/" }) {
+        if (!FileSystem::Exists(directory)) {
+            FileSystem::CreateDirectoryFromPath(directory);
+        }
+    }
+
+    std::vector<CookJob> jobs;
+    GatherJobs(settings, jobs);
+
+    std::unordered_map<std::string, uint64_t> database = LoadDatabase();
+    std::mutex databaseLock;
+
+    uint64_t settingsHashes[3];
+    for (int i = 0; i < 3; i++) {
+        settingsHashes[i] = HashSettings(settings, CookJobType(i));
+    }
+
+    // Workers pull jobs off a shared counter. Hashing the inputs happens on the workers as well, it reads every source.
+    std::atomic<uint32_t> nextJob = 0;
+    auto worker = [&]() {
+        Profiler::SetThreadName("Cook Worker");
+        std::unique_ptr<nvtt::Context> nvttContext;
+
+        for (uint32_t index = nextJob++; index < jobs.size(); index = nextJob++) {
+            CookJob& job = jobs[index];
+            PROFILE_SCOPE("Cook Job");
+
+            uint64_t seed = settingsHashes[uint32_t(job.Type)];
+            if (job.Type == CookJobType::Mesh) {
+                job.Dependencies = GetMeshDependencies(job.Source);
+            } else if (job.Type == CookJobType::Shader) {
+                std::vector<std::string> includes = ShaderLoader::GetDependencies(job.Source);
+                job.Dependencies.assign(includes.begin() + 1, includes.end());
+                seed ^= ShaderCompiler::GetCompilerHash(ShaderLoader::GetTypeFromPath(job.Source), "Main");
+            }
+            job.Hash = HashFile(job.Source, seed);
+            for (auto& dependency : job.Dependencies) {
+                job.Hash = HashFile(dependency, job.Hash);
+            }
+
+            if (!settings.Force && FileSystem::Exists(job.Output)) {
+                std::lock_guard<std::mutex> lock(databaseLock);
+                auto it = database.find(job.Output);
+                if (it != database.end() && it->second == job.Hash) {
+                    continue;
+                }
+            }
+
+            Timer jobTimer;
+            bool succeeded = false;
+            switch (job.Type) {
+                case CookJobType::Texture: {
+                    if (!nvttContext) {
+                        nvttContext = std::make_unique<nvtt::Context>();
+                        nvttContext->enableCudaAcceleration(settings.Texture.CUDA);
+                    }
+                    succeeded = TextureCompressor::CompressFile(job.Source, settings.Texture, *nvttContext);
+                    break;
+                }
+                case CookJobType::Shader: {
+                    succeeded = ShaderLoader::CacheShader(job.Source);
+                    break;
+                }
+                case CookJobType::Mesh: {
+                    succeeded = MeshCooker::Cook(job.Source);
+                    break;
+                }
+            }
+            job.Time = jobTimer.GetElapsed();
+            job.Cooked = succeeded;
+            job.Failed = !succeeded;
+
+            std::lock_guard<std::mutex> lock(databaseLock);
+            if (succeeded) {
+                database[job.Output] = job.Hash;
+            } else {
+                database.erase(job.Output);
+            }
+        }
+    };
+
+    Timer cookTimer;
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < settings.JobCount; i++) {
+        threads.emplace_back(worker);
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    float cookTime = cookTimer.GetElapsed();
+
+    bool vtFailed = false;
+    if (!settings.VTPath.empty()) {
+        vtFailed = !CookVirtualTextures(settings, jobs, database);
+    }
+
+    SaveDatabase(database);
+
+    const char *typeNames[] = { "textures", "shaders", "meshes" };
+    uint32_t cooked[3] = {};
+    uint32_t failed[3] = {};
+    uint32_t total[3] = {};
+    float time[3] = {};
+    for (auto& job : jobs) {
+        uint32_t type = uint32_t(job.Type);
+        total[type]++;
+        cooked[type] += job.Cooked;
+        failed[type] += job.Failed;
+        time[type] += job.Time;
+    }
+    for (int i = 0; i < 3; i++) {
+        Logger::Info("[COOK] %s: %u/%u cooked, %u failed, %u up to date (%.2fms of work)",
+                     typeNames[i], cooked[i], total[i], failed[i], total[i] - cooked[i] - failed[i], time[i]);
+    }
+    Logger::Info("[COOK] Cooked %u jobs on %u threads in %.2fms", uint32_t(jobs.size()), settings.JobCount, cookTime);
+
+    if (!settings.PakPath.empty()) {
+        PakFile::Build(settings.PakPath, {
+            { ".cache/textures/", {} },
+            { ".cache/shaders/", {} },
+            { ".cache/meshes/", {} },
+            { settings.AssetDirectory, { ".gltf", ".glb", ".bin" } }
+        });
+    }
+
+    Logger::Info("[COOK] Done in %.2fms", totalTimer.GetElapsed());
+    if (!settings.TracePath.empty()) {
+        Profiler::EndCapture(settings.TracePath);
+    }
+
+    JobSystem::Exit();
+
+    uint32_t failedCount = failed[0] + failed[1] + failed[2];
+    return (failedCount || vtFailed) ? 1 : 0;
+}
@@ -0,0 +1,324 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-17 10:31:08
+//
+
+#include "benchmark.hpp"
+#include "profiler.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+
+#include <nlohmann/json.hpp>
+
+#undef min
+#undef max
+
+bool CameraPath::Load(const std::string& path)
+{
+    std::ifstream stream(path);
+    if (!stream.is_open()) {
+        Logger::Error("[BENCHMARK] Failed to open camera path %s", path.c_str());
+        return false;
+    }
+
+    nlohmann::json root = nlohmann::json::parse(stream, nullptr, false);
+    if (root.is_discarded() || !root.contains("keys") || !root["keys"].is_array()) {
+        Logger::Error("[BENCHMARK] %s is not a camera path", path.c_str());
+        return false;
+    }
+
+    _keys.clear();
+    for (auto& entry : root["keys"]) {
+        CameraKey key = {};
+        key.Time = entry.value("time", 0.0f);
+        if (entry.contains("position") && entry["position"].size() == 3) {
+            key.Position = glm::vec3(entry["position"][0].get<float>(), entry["position"][1].get<float>(), entry["position"][2].get<float>());
+        }
+        key.Yaw = entry.value("yaw", -90.0f);
+        key.Pitch = entry.value("pitch", 0.0f);
+        _keys.push_back(key);
+    }
+    std::stable_sort(_keys.begin(), _keys.end(), [](const CameraKey& a, const CameraKey& b) { return a.Time < b.Time; });
+
+    Logger::Info("[BENCHMARK] Loaded camera path %s (%u keys, %.2fs)", path.c_str(), uint32_t(_keys.size()), GetDuration());
+    return true;
+}
+
+bool CameraPath::Save(const std::string& path)
+{
+    nlohmann::json keys = nlohmann::json::array();
+    for (auto& key : _keys) {
+        keys.push_back({
+            { "time", key.Time },
+            { "position", { key.Position.x, key.Position.y, key.Position.z } },
+            { "yaw", key.Yaw },
+            { "pitch", key.Pitch }
+        });
+    }
+
+    std::ofstream stream(path, std::ios::trunc);
+    if (!stream.is_open()) {
+        Logger::Error("[BENCHMARK] Failed to open %s for writing", path.c_str());
+        return false;
+    }
+    stream << nlohmann::json({ { "keys", keys } }).dump(4);
+
+    Logger::Info("[BENCHMARK] Recorded camera path to %s (%u keys, %.2fs)", path.c_str(), uint32_t(_keys.size()), GetDuration());
+    return true;
+}
+
+void CameraPath::Push(const CameraKey& key)
+{
+    _keys.push_back(key);
+}
+
+CameraKey CameraPath::Sample(float time) const
+{
+    if (_keys.empty()) {
+        return {};
+    }
+    if (time <= _keys.front().Time) {
+        return _keys.front();
+    }
+    if (time >= _keys.back().Time) {
+        return _keys.back();
+    }
+
+    auto next = std::upper_bound(_keys.begin(), _keys.end(), time, [](float t, const CameraKey& key) { return t < key.Time; });
+    const CameraKey& a = *(next - 1);
+    const CameraKey& b = *next;
+    float t = (b.Time > a.Time) ? (time - a.Time) / (b.Time - a.Time) : 1.0f;
+
+    CameraKey key;
+    key.Time = time;
+    key.Position = glm::mix(a.Position, b.Position, t);
+    key.Yaw = glm::mix(a.Yaw, b.Yaw, t);
+    key.Pitch = glm::mix(a.Pitch, b.Pitch, t);
+    return key;
+}
+
+Benchmark::Benchmark(const BenchmarkSettings& settings)
+    : _settings(settings)
+{
+    if (!_settings.CameraPath.empty()) {
+        _cameraPath.Load(_settings.CameraPath);
+    }
+    Logger::Info("[BENCHMARK] Running %u frames at %ux%u with a %.2fms timestep", _settings.Frames, _settings.Width, _settings.Height, _settings.Timestep * 1000.0f);
+}
+
+bool Benchmark::ParseArguments(int argc, char **argv, BenchmarkSettings& settings)
+{
+    for (int i = 1; i < argc; i++) {
+        std::string argument = argv[i];
+        bool hasValue = i + 1 < argc;
+
+        if (argument == "--benchmark") {
+            settings.Enabled = true;
+        } else if (argument == "--scene" && hasValue) {
+            settings.Scene = argv[++i];
+        } else if (argument == "--resolution" && hasValue) {
+            uint32_t width = 0, height = 0;
+            if (sscanf(argv[++i], "%ux%u", &width, &height) != 2 || !width || !height) {
+                Logger::Error("[BENCHMARK] Resolution should look like 1920x1080, got %s", argv[i]);
+                return false;
+            }
+            settings.Width = width;
+            settings.Height = height;
+        } else if (argument == "--frames" && hasValue) {
+            settings.Frames = std::max(1, atoi(argv[++i]));
+        } else if (argument == "--warmup" && hasValue) {
+            settings.WarmupFrames = std::max(0, atoi(argv[++i]));
+        } else if (argument == "--timestep" && hasValue) {
+            settings.Timestep = std::max(0.0f, float(atof(argv[++i])));
+        } else if (argument == "--camera" && hasValue) {
+            settings.CameraPath = argv[++i];
+        } else if (argument == "--record-camera" && hasValue) {
+            settings.RecordCameraPath = argv[++i];
+        } else if (argument == "--headless") {
+            settings.Headless = true;
+        } else if (argument == "--vsync") {
+            settings.VSync = true;
+        } else if (argument == "--validate-commands") {
+            settings.ValidateCommands = true;
+        } else if (argument == "--record-only") {
+            settings.RecordOnly = true;
+        } else if (argument == "--capture" && hasValue) {
+            settings.CapturePath = argv[++i];
+        } else if (argument == "--capture-frames" && hasValue) {
+            settings.CaptureFrames = std::max(1, atoi(argv[++i]));
+        } else if (argument == "--output" && hasValue) {
+            settings.Output = argv[++i];
+        } else {
+            Logger::Error("[BENCHMARK] Unknown argument %s", argument.c_str());
+            PrintUsage();
+            return false;
+        }
+    }
+    return true;
+}
+
+void Benchmark::PrintUsage()
+{
+    Logger::Info("Usage: oni [options]");
+    Logger::Info("    --benchmark            Run a fixed number of frames, write a report and exit");
+    Logger::Info("    --scene <gltf>         Load this glTF instead of the built-in scene");
+    Logger::Info("    --resolution <WxH>     Window and render resolution (default: 1920x1080)");
+    Logger::Info("    --frames <count>       Measured frames (default: 1000)");
+    Logger::Info("    --warmup <count>       Frames before measuring, on top of waiting for streaming (default: 60)");
+    Logger::Info("    --timestep <seconds>   Fixed time step of every frame (default: 1/60)");
+    Logger::Info("    --camera <path>        Play back a camera path over the measured frames");
+    Logger::Info("    --record-camera <path> Record the camera to a path, written on exit");
+    Logger::Info("    --headless             Don't show the window");
+    Logger::Info("    --vsync                Present with vsync");
+    Logger::Info("    --validate-commands    Record and validate every command buffer");
+    Logger::Info("    --record-only          Record commands without any GPU work, for the CPU cost of a frame");
+    Logger::Info("    --capture <path>       Capture the command streams of the first measured frames");
+    Logger::Info("    --capture-frames <n>   Frames to capture (default: 60)");
+    Logger::Info("    --output <path>        Where the report goes (default: benchmark.json)");
+}
+
+void Benchmark::EndFrame(bool ready)
+{
+    if (_measuring && !IsDone()) {
+        const std::vector<Profiler::ZoneHistory>& histories = Profiler::GetHistory();
+        if (_zoneTimes.size() < histories.size()) {
+            _zoneTimes.resize(histories.size());
+        }
+        for (uint32_t i = 0; i < histories.size(); i++) {
+            const Profiler::ZoneHistory& history = histories[i];
+            if (!history.Seen) {
+                continue;
+            }
+            // Zones that didn't run on some frames read as zero there
+            _zoneTimes[i].resize(_measuredFrames + 1, 0.0f);
+            _zoneTimes[i][_measuredFrames] = history.Times[(history.Cursor + PROFILER_HISTORY_SIZE - 1) % PROFILER_HISTORY_SIZE];
+        }
+        _measuredFrames++;
+        return;
+    }
+
+    if (_measuring) {
+        return;
+    }
+    _warmupFrames++;
+    if (_warmupFrames < _settings.WarmupFrames) {
+        return;
+    }
+    if (!ready && _warmupFrames < BENCHMARK_MAX_WARMUP_FRAMES) {
+        return;
+    }
+    if (!ready) {
+        Logger::Warn("[BENCHMARK] Still not ready after %u warmup frames, measuring anyway", _warmupFrames);
+    }
+    Logger::Info("[BENCHMARK] Warmed up in %u frames, measuring", _warmupFrames);
+    _measuring = true;
+}
+
+bool Benchmark::SampleCamera(CameraKey& key) const
+{
+    if (_cameraPath.IsEmpty()) {
+        return false;
+    }
+    key = _cameraPath.Sample(GetTime());
+    return true;
+}
+
+void Benchmark::AddLoadTime(const std::string& name, float milliseconds)
+{
+    _loadTimes.push_back({ name, milliseconds });
+}
+
+void Benchmark::AddMemory(const std::string& name, uint64_t bytes)
+{
+    _memory.push_back({ name, bytes });
+}
+
+bool Benchmark::WriteReport(const std::string& path)
+{
+    // Nearest rank, over every measured frame rather than the profiler's window
+    auto summarize = [](std::vector<float> values) {
+        std::sort(values.begin(), values.end());
+        double sum = 0.0;
+        for (float value : values) {
+            sum += value;
+        }
+        auto percentile = [&](float p) {
+            size_t rank = size_t(std::ceil(p * values.size()));
+            return values[std::min(std::max(rank, size_t(1)), values.size()) - 1];
+        };
+        return nlohmann::json({
+            { "mean_ms", float(sum / values.size()) },
+            { "min_ms", values.front() },
+            { "p50_ms", percentile(0.50f) },
+            { "p95_ms", percentile(0.95f) },
+            { "p99_ms", percentile(0.99f) },
+            { "max_ms", values.back() }
+        });
+    };
+
+    nlohmann::json zones = nlohmann::json::object();
+    nlohmann::json summary = nlohmann::json::object();
+    for (uint32_t i = 0; i < _zoneTimes.size(); i++) {
+        if (_zoneTimes[i].empty()) {
+            continue;
+        }
+        _zoneTimes[i].resize(_measuredFrames, 0.0f);
+        std::string name = Profiler::GetName(i);
+        zones[name] = _zoneTimes[i];
+        summary[name] = summarize(_zoneTimes[i]);
+    }
+
+    nlohmann::json loadTimes = nlohmann::json::object();
+    for (auto& [name, milliseconds] : _loadTimes) {
+        loadTimes[name] = milliseconds;
+    }
+    nlohmann::json memory = nlohmann::json::object();
+    for (auto& [name, bytes] : _memory) {
+        memory[name] = bytes;
+    }
+
+    nlohmann::json root = {
+        { "settings", {
+            { "scene", _settings.Scene },
+            { "width", _settings.Width },
+            { "height", _settings.Height },
+            { "frames", _settings.Frames },
+            { "warmup_frames", _warmupFrames },
+            { "timestep", _settings.Timestep },
+            { "camera", _settings.CameraPath },
+            { "headless", _settings.Headless },
+            { "vsync", _settings.VSync },
+            { "validate_commands", _settings.ValidateCommands },
+            { "record_only", _settings.RecordOnly },
+            { "capture", _settings.CapturePath }
+        } },
+        { "measured_frames", _measuredFrames },
+        { "load_ms", loadTimes },
+        { "memory_bytes", memory },
+        { "summary", summary },
+        { "frames_ms", zones }
+    };
+
+    std::ofstream stream(path, std::ios::trunc);
+    if (!stream.is_open()) {
+        Logger::Error("[BENCHMARK] Failed to open %s for writing", path.c_str());
+        return false;
+    }
+    stream << root.dump(4);
+
+    if (summary.contains("Frame")) {
+        Logger::Info("[BENCHMARK] Frame: %.2fms mean, %.2fms P95, %.2fms P99 over %u frames",
+                     summary["Frame"]["mean_ms"].get<float>(),
+                     summary["Frame"]["p95_ms"].get<float>(),
+                     summary["Frame"]["p99_ms"].get<float>(),
+                     _measuredFrames);
+    }
+    Logger::Info("[BENCHMARK] Wrote report to %s", path.c_str());
+    return true;
+}
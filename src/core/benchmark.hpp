@@ -0,0 +1,106 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-17 10:12:44
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+// Frames to give up waiting for the streamer after, so that a broken scene still produces a report
+#define BENCHMARK_MAX_WARMUP_FRAMES 3000
+
+struct BenchmarkSettings
+{
+    bool Enabled = false;
+    std::string Scene; // A single glTF, the SCENE_* define if empty
+    uint32_t Width = 1920;
+    uint32_t Height = 1080;
+    uint32_t Frames = 1000;
+    uint32_t WarmupFrames = 60; // At least, measuring starts once the streamer is idle as well
+    float Timestep = 1.0f / 60.0f; // Seconds, what every frame is simulated with instead of the wall clock
+    std::string CameraPath; // Keyframes to play back, the camera doesn't move if empty
+    std::string RecordCameraPath; // Records the camera while flying around, works without --benchmark
+    bool Headless = false;
+    bool VSync = false;
+    bool ValidateCommands = false; // Records every command buffer and checks it when it ends
+    bool RecordOnly = false; // Records without sending anything to the GPU, to measure the CPU side alone
+    std::string CapturePath; // Captures the command streams of the first measured frames, or from startup without --benchmark
+    uint32_t CaptureFrames = 60;
+    std::string Output = "benchmark.json";
+};
+
+struct CameraKey
+{
+    float Time; // Seconds
+    glm::vec3 Position;
+    float Yaw;
+    float Pitch;
+};
+
+// Keyframed camera path, linearly interpolated and clamped at both ends. Stored as JSON, so that paths can be written
+// by hand as well as recorded.
+class CameraPath
+{
+public:
+    bool Load(const std::string& path);
+    bool Save(const std::string& path);
+
+    // Keys have to be pushed in time order
+    void Push(const CameraKey& key);
+    CameraKey Sample(float time) const;
+
+    bool IsEmpty() const { return _keys.empty(); }
+    float GetDuration() const { return _keys.empty() ? 0.0f : _keys.back().Time; }
+private:
+    std::vector<CameraKey> _keys;
+};
+
+// Runs a scene for a fixed number of frames at a fixed timestep, and writes the per-frame timings of every profiler zone,
+// load times and memory figures to a JSON report that can be diffed between builds.
+class Benchmark
+{
+public:
+    Benchmark(const BenchmarkSettings& settings);
+
+    // Returns false on unknown arguments. Leaves the defaults of whatever wasn't passed.
+    static bool ParseArguments(int argc, char **argv, BenchmarkSettings& settings);
+    static void PrintUsage();
+
+    const BenchmarkSettings& GetSettings() const { return _settings; }
+
+    // Call right after Profiler::EndFrame. Collects the frame that just ended if it was measured, then leaves the warmup
+    // once enough frames went by and ready is true.
+    void EndFrame(bool ready);
+
+    bool IsMeasuring() const { return _measuring; }
+    bool IsDone() const { return _measuredFrames >= _settings.Frames; }
+    // Seconds into the measured run of the frame about to start, zero during the warmup
+    float GetTime() const { return _measuredFrames * _settings.Timestep; }
+    // The camera at the frame about to start, or false if there is no path
+    bool SampleCamera(CameraKey& key) const;
+
+    // Both show up in the report under the given name, in the order they were added
+    void AddLoadTime(const std::string& name, float milliseconds);
+    void AddMemory(const std::string& name, uint64_t bytes);
+
+    bool WriteReport(const std::string& path);
+private:
+    BenchmarkSettings _settings;
+    CameraPath _cameraPath;
+
+    bool _measuring = false;
+    uint32_t _warmupFrames = 0;
+    uint32_t _measuredFrames = 0;
+
+    // Indexed by interned zone name, one entry per measured frame
+    std::vector<std::vector<float>> _zoneTimes;
+
+    std::vector<std::pair<std::string, float>> _loadTimes;
+    std::vector<std::pair<std::string, uint64_t>> _memory;
+};
@@ -0,0 +1,291 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-08 19:30:05
+//
+
+#include "block_codec.hpp"
+#include "job_system.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#undef min
+#undef max
+
+#define BLOCK_CODEC_HASH_BITS 16
+#define BLOCK_CODEC_MIN_MATCH 4
+#define BLOCK_CODEC_MAX_OFFSET 65535
+// Same end of block rules as LZ4: the last match starts at least 12 bytes before the end, the last 5 bytes are literals
+#define BLOCK_CODEC_MF_LIMIT 12
+#define BLOCK_CODEC_LAST_LITERALS 5
+
+static uint32_t Read32(const uint8_t *p)
+{
+    uint32_t value;
+    memcpy(&value, p, sizeof(value));
+    return value;
+}
+
+static uint32_t Hash(uint32_t sequence)
+{
+    return (sequence * 2654435761u) >> (32 - BLOCK_CODEC_HASH_BITS);
+}
+
+static bool WriteLength(uint8_t *&op, uint8_t *oend, size_t length)
+{
+    while (length >= 255) {
+        if (op >= oend) return false;
+        *op++ = 255;
+        length -= 255;
+    }
+    if (op >= oend) return false;
+    *op++ = uint8_t(length);
+    return true;
+}
+
+static bool ReadLength(const uint8_t *&ip, const uint8_t *iend, size_t& length)
+{
+    uint8_t byte;
+    do {
+        if (ip >= iend) return false;
+        byte = *ip++;
+        length += byte;
+    } while (byte == 255);
+    return true;
+}
+
+// Literals, then an optional match. A match length of 0 means this is the last sequence of the block.
+static bool WriteSequence(uint8_t *&op, uint8_t *oend, const uint8_t *literals, size_t literalCount, size_t offset, size_t matchLength)
+{
+    if (op >= oend) return false;
+    uint8_t *token = op++;
+
+    *token = uint8_t(std::min<size_t>(literalCount, 15) << 4);
+    if (literalCount >= 15 && !WriteLength(op, oend, literalCount - 15)) {
+        return false;
+    }
+    if (size_t(oend - op) < literalCount) {
+        return false;
+    }
+    memcpy(op, literals, literalCount);
+    op += literalCount;
+
+    if (matchLength == 0) {
+        return true;
+    }
+
+    if (oend - op < 2) return false;
+    *op++ = uint8_t(offset & 0xFF);
+    *op++ = uint8_t(offset >> 8);
+
+    size_t extra = matchLength - BLOCK_CODEC_MIN_MATCH;
+    *token |= uint8_t(std::min<size_t>(extra, 15));
+    if (extra >= 15 && !WriteLength(op, oend, extra - 15)) {
+        return false;
+    }
+    return true;
+}
+
+size_t BlockCodec::Compress(const uint8_t *src, size_t srcSize, uint8_t *dst, size_t dstCapacity)
+{
+    std::vector<int64_t> table(size_t(1) << BLOCK_CODEC_HASH_BITS, -1);
+
+    uint8_t *op = dst;
+    uint8_t *oend = dst + dstCapacity;
+    size_t anchor = 0;
+    size_t ip = 0;
+    size_t matchLimit = srcSize > BLOCK_CODEC_MF_LIMIT ? srcSize - BLOCK_CODEC_MF_LIMIT : 0;
+    size_t matchEnd = srcSize > BLOCK_CODEC_LAST_LITERALS ? srcSize - BLOCK_CODEC_LAST_LITERALS : 0;
+
+    // Skip faster through data that doesn't compress
+    uint32_t misses = 0;
+    while (ip < matchLimit) {
+        uint32_t sequence = Read32(src + ip);
+        uint32_t hash = Hash(sequence);
+        int64_t candidate = table[hash];
+        table[hash] = int64_t(ip);
+
+        if (candidate < 0 || ip - size_t(candidate) > BLOCK_CODEC_MAX_OFFSET || Read32(src + candidate) != sequence) {
+            ip += 1 + (misses++ >> 6);
+            continue;
+        }
+        misses = 0;
+
+        size_t ref = size_t(candidate);
+        while (ip > anchor && ref > 0 && src[ip - 1] == src[ref - 1]) {
+            ip--;
+            ref--;
+        }
+
+        size_t length = BLOCK_CODEC_MIN_MATCH;
+        while (ip + length < matchEnd && src[ip + length] == src[ref + length]) {
+            length++;
+        }
+
+        if (!WriteSequence(op, oend, src + anchor, ip - anchor, ip - ref, length)) {
+            return 0;
+        }
+        ip += length;
+        anchor = ip;
+    }
+
+    if (!WriteSequence(op, oend, src + anchor, srcSize - anchor, 0, 0)) {
+        return 0;
+    }
+    return size_t(op - dst);
+}
+
+bool BlockCodec::Decompress(const uint8_t *src, size_t srcSize, uint8_t *dst, size_t dstSize)
+{
+    const uint8_t *ip = src;
+    const uint8_t *iend = src + srcSize;
+    uint8_t *op = dst;
+    uint8_t *oend = dst + dstSize;
+
+    while (ip < iend) {
+        uint8_t token = *ip++;
+
+        size_t literalCount = token >> 4;
+        if (literalCount == 15 && !ReadLength(ip, iend, literalCount)) {
+            return false;
+        }
+        if (size_t(iend - ip) < literalCount || size_t(oend - op) < literalCount) {
+            return false;
+        }
+        memcpy(op, ip, literalCount);
+        ip += literalCount;
+        op += literalCount;
+
+        // The last sequence has no match
+        if (ip == iend) {
+            break;
+        }
+
+        if (iend - ip < 2) return false;
+        size_t offset = size_t(ip[0]) | (size_t(ip[1]) << 8);
+        ip += 2;
+        if (offset == 0 || offset > size_t(op - dst)) {
+            return false;
+        }
+
+        size_t matchLength = token & 15;
+        if (matchLength == 15 && !ReadLength(ip, iend, matchLength)) {
+            return false;
+        }
+        matchLength += BLOCK_CODEC_MIN_MATCH;
+        if (size_t(oend - op) < matchLength) {
+            return false;
+        }
+
+        const uint8_t *match = op - offset;
+        if (offset >= matchLength) {
+            memcpy(op, match, matchLength);
+            op += matchLength;
+        } else {
+            // Overlapping copy, has to go forward one byte at a time to repeat the pattern
+            for (size_t i = 0; i < matchLength; i++) {
+                *op++ = *match++;
+            }
+        }
+    }
+
+    return op == oend;
+}
+
+void BlockCodec::CompressChunked(const uint8_t *src, size_t srcSize, std::vector<uint8_t>& out, uint32_t chunkSize)
+{
+    ChunkedHeader header;
+    header.RawSize = srcSize;
+    header.ChunkSize = chunkSize;
+    header.ChunkCount = uint32_t((srcSize + chunkSize - 1) / chunkSize);
+
+    size_t headerOffset = out.size();
+    size_t tableOffset = headerOffset + sizeof(ChunkedHeader);
+    out.resize(tableOffset + header.ChunkCount * sizeof(uint32_t));
+    memcpy(out.data() + headerOffset, &header, sizeof(header));
+
+    std::vector<uint8_t> scratch(GetMaxCompressedSize(chunkSize));
+    for (uint32_t i = 0; i < header.ChunkCount; i++) {
+        const uint8_t *chunk = src + size_t(i) * chunkSize;
+        size_t rawSize = std::min<size_t>(chunkSize, srcSize - size_t(i) * chunkSize);
+
+        size_t size = Compress(chunk, rawSize, scratch.data(), scratch.size());
+        uint32_t stored = uint32_t(rawSize);
+        if (size != 0 && size < rawSize) {
+            stored = uint32_t(size);
+            out.insert(out.end(), scratch.begin(), scratch.begin() + size);
+        } else {
+            out.insert(out.end(), chunk, chunk + rawSize);
+        }
+        memcpy(out.data() + tableOffset + i * sizeof(uint32_t), &stored, sizeof(stored));
+    }
+}
+
+uint64_t BlockCodec::GetChunkedRawSize(const uint8_t *src, size_t srcSize)
+{
+    if (srcSize < sizeof(ChunkedHeader)) {
+        return 0;
+    }
+    ChunkedHeader header;
+    memcpy(&header, src, sizeof(header));
+    return header.RawSize;
+}
+
+bool BlockCodec::DecompressChunked(const uint8_t *src, size_t srcSize, uint8_t *dst, bool parallel)
+{
+    if (srcSize < sizeof(ChunkedHeader)) {
+        return false;
+    }
+    ChunkedHeader header;
+    memcpy(&header, src, sizeof(header));
+    if (header.ChunkSize == 0 || header.ChunkCount != (header.RawSize + header.ChunkSize - 1) / header.ChunkSize) {
+        return false;
+    }
+    // Nothing to write, and dst may well be null
+    if (header.ChunkCount == 0) {
+        return true;
+    }
+
+    size_t tableOffset = sizeof(ChunkedHeader);
+    size_t dataOffset = tableOffset + size_t(header.ChunkCount) * sizeof(uint32_t);
+    if (srcSize < dataOffset) {
+        return false;
+    }
+
+    // Chunks are laid out back to back, so their offsets come from the sizes
+    std::vector<size_t> offsets(header.ChunkCount);
+    std::vector<uint32_t> sizes(header.ChunkCount);
+    memcpy(sizes.data(), src + tableOffset, sizes.size() * sizeof(uint32_t));
+
+    size_t offset = dataOffset;
+    for (uint32_t i = 0; i < header.ChunkCount; i++) {
+        offsets[i] = offset;
+        offset += sizes[i];
+    }
+    if (offset > srcSize) {
+        return false;
+    }
+
+    std::atomic<bool> ok = true;
+    auto chunk = [&](uint32_t i) {
+        uint8_t *out = dst + size_t(i) * header.ChunkSize;
+        size_t rawSize = std::min<uint64_t>(header.ChunkSize, header.RawSize - uint64_t(i) * header.ChunkSize);
+
+        if (sizes[i] == rawSize) {
+            memcpy(out, src + offsets[i], rawSize);
+        } else if (!Decompress(src + offsets[i], sizes[i], out, rawSize)) {
+            ok = false;
+        }
+    };
+
+    if (parallel) {
+        JobSystem::ParallelFor(header.ChunkCount, chunk);
+    } else {
+        for (uint32_t i = 0; i < header.ChunkCount; i++) {
+            chunk(i);
+        }
+    }
+    return ok;
+}
@@ -0,0 +1,40 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-08 19:12:40
+//
+
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+
+#define BLOCK_CODEC_CHUNK_SIZE (256 * 1024)
+
+// Byte oriented LZ77 codec with the same sequence layout as LZ4 (token, literals, 16 bit offset, match length).
+// Streams are cut into independent chunks so that they can be decompressed on several threads.
+class BlockCodec
+{
+public:
+    struct ChunkedHeader
+    {
+        uint64_t RawSize;
+        uint32_t ChunkSize;
+        uint32_t ChunkCount;
+        // Followed by ChunkCount uint32_t compressed sizes, then the chunks.
+        // A chunk whose compressed size equals its raw size is stored as is.
+    };
+
+    // Single block. Returns the compressed size, or 0 if the output buffer is too small.
+    static size_t Compress(const uint8_t *src, size_t srcSize, uint8_t *dst, size_t dstCapacity);
+    // Returns false on malformed input or if the output doesn't come out at exactly dstSize bytes
+    static bool Decompress(const uint8_t *src, size_t srcSize, uint8_t *dst, size_t dstSize);
+    static size_t GetMaxCompressedSize(size_t srcSize) { return srcSize + srcSize / 255 + 16; }
+
+    // Header, chunk table and chunks, appended to out
+    static void CompressChunked(const uint8_t *src, size_t srcSize, std::vector<uint8_t>& out, uint32_t chunkSize = BLOCK_CODEC_CHUNK_SIZE);
+    // dst must hold GetChunkedRawSize() bytes
+    static bool DecompressChunked(const uint8_t *src, size_t srcSize, uint8_t *dst, bool parallel = true);
+    static uint64_t GetChunkedRawSize(const uint8_t *src, size_t srcSize);
+};
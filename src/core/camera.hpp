@@ -51,6 +51,12 @@ public:
     glm::mat4& View() { return _View; }
     glm::mat4& Projection() { return _Projection; }
     glm::vec3& GetPosition() { return _Position; }
+    float GetYaw() { return _Yaw; }
+    float GetPitch() { return _Pitch; }
+
+    // Takes effect on the next Update
+    void SetPosition(const glm::vec3& position) { _Position = position; }
+    void SetRotation(float yaw, float pitch) { _Yaw = yaw; _Pitch = pitch; }
 
     bool InFrustum(AABB aabb);
     glm::vec4 GetPlane(int i);
@@ -0,0 +1,302 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-14 15:52:18
+//
+
+#include "directory_watcher.hpp"
+#include "pak_file.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <filesystem>
+
+#ifndef _WIN32
+#include <limits.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+#undef min
+#undef max
+
+DirectoryWatcher::DirectoryWatcher(const std::string& root)
+    : _root(PakFile::NormalizePath(root))
+{
+    while (_root.size() > 1 && _root.back() == '/') {
+        _root.pop_back();
+    }
+
+#ifdef _WIN32
+    _directory = CreateFileA(_root.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+    if (_directory == INVALID_HANDLE_VALUE) {
+        Logger::Error("[WATCHER] Failed to open directory %s", _root.c_str());
+        return;
+    }
+    _stopEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+    _overlapped.hEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+    _buffer.resize(16 * 1024);
+#else
+    _inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (_inotify < 0 || pipe(_stopPipe) < 0) {
+        Logger::Error("[WATCHER] Failed to start inotify for %s", _root.c_str());
+        return;
+    }
+    AddDirectory(_root);
+    if (_directories.empty()) {
+        return;
+    }
+#endif
+
+    _running = true;
+    _thread = std::thread(&DirectoryWatcher::WatchLoop, this);
+    Logger::Info("[WATCHER] Watching %s", _root.c_str());
+}
+
+DirectoryWatcher::~DirectoryWatcher()
+{
+    if (_running) {
+#ifdef _WIN32
+        SetEvent(_stopEvent);
+#else
+        char stop = 0;
+        write(_stopPipe[1], &stop, 1);
+#endif
+        _thread.join();
+        Logger::Info("[WATCHER] Stopped watching %s: %llu events coalesced into %llu changes", _root.c_str(), _eventCount, _publishCount);
+    }
+
+#ifdef _WIN32
+    if (_overlapped.hEvent) {
+        CloseHandle(_overlapped.hEvent);
+    }
+    if (_stopEvent) {
+        CloseHandle(_stopEvent);
+    }
+    if (_directory != INVALID_HANDLE_VALUE) {
+        CloseHandle(_directory);
+    }
+#else
+    if (_inotify >= 0) {
+        close(_inotify);
+    }
+    for (int fd : _stopPipe) {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+#endif
+}
+
+DirectoryWatcher::Subscription::Ptr DirectoryWatcher::Subscribe(std::function<void()> notify)
+{
+    Subscription::Ptr subscription = std::make_shared<Subscription>();
+    subscription->Notify = notify;
+
+    std::lock_guard<std::mutex> lock(_subscriptionLock);
+    _subscriptions.push_back(subscription);
+    return subscription;
+}
+
+#ifdef _WIN32
+
+void DirectoryWatcher::WatchLoop()
+{
+    bool issued = false;
+    int timeout = -1;
+
+    while (true) {
+        if (!issued) {
+            ResetEvent(_overlapped.hEvent);
+            DWORD filter = FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE;
+            if (!ReadDirectoryChangesW(_directory, _buffer.data(), DWORD(_buffer.size() * sizeof(DWORD)), TRUE, filter, nullptr, &_overlapped, nullptr)) {
+                Logger::Error("[WATCHER] ReadDirectoryChangesW failed on %s, changes are no longer reported", _root.c_str());
+                Overflow();
+                return;
+            }
+            issued = true;
+        }
+
+        HANDLE handles[] = { _stopEvent, _overlapped.hEvent };
+        DWORD result = WaitForMultipleObjects(2, handles, FALSE, timeout < 0 ? INFINITE : DWORD(timeout));
+        if (result == WAIT_OBJECT_0) {
+            break;
+        }
+        if (result == WAIT_OBJECT_0 + 1) {
+            issued = false;
+
+            DWORD bytes = 0;
+            GetOverlappedResult(_directory, &_overlapped, &bytes, FALSE);
+            if (bytes == 0) {
+                // The buffer overflowed, the OS dropped the events
+                Overflow();
+            } else {
+                const uint8_t *cursor = reinterpret_cast<const uint8_t*>(_buffer.data());
+                while (true) {
+                    const FILE_NOTIFY_INFORMATION *info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(cursor);
+
+                    int length = WideCharToMultiByte(CP_UTF8, 0, info->FileName, info->FileNameLength / sizeof(WCHAR), nullptr, 0, nullptr, nullptr);
+                    std::string name(length, '\0');
+                    WideCharToMultiByte(CP_UTF8, 0, info->FileName, info->FileNameLength / sizeof(WCHAR), name.data(), length, nullptr, nullptr);
+                    Queue(_root + "/" + name);
+
+                    if (!info->NextEntryOffset) {
+                        break;
+                    }
+                    cursor += info->NextEntryOffset;
+                }
+            }
+        }
+        timeout = Flush();
+    }
+
+    if (issued) {
+        DWORD bytes;
+        CancelIoEx(_directory, &_overlapped);
+        GetOverlappedResult(_directory, &_overlapped, &bytes, TRUE);
+    }
+}
+
+#else
+
+void DirectoryWatcher::AddDirectory(const std::string& path)
+{
+    // inotify isn't recursive, every directory of the tree gets its own watch
+    uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE | IN_DELETE;
+    int wd = inotify_add_watch(_inotify, path.c_str(), mask);
+    if (wd < 0) {
+        Logger::Error("[WATCHER] Failed to watch directory %s", path.c_str());
+        return;
+    }
+    _directories[wd] = path;
+
+    std::error_code error;
+    for (const auto& entry : std::filesystem::directory_iterator(path, error)) {
+        if (entry.is_directory()) {
+            AddDirectory(PakFile::NormalizePath(entry.path().string()));
+        }
+    }
+}
+
+void DirectoryWatcher::WatchLoop()
+{
+    alignas(inotify_event) char buffer[16 * (sizeof(inotify_event) + NAME_MAX + 1)];
+    int timeout = -1;
+
+    while (true) {
+        pollfd fds[2] = {
+            { _inotify, POLLIN, 0 },
+            { _stopPipe[0], POLLIN, 0 }
+        };
+        if (poll(fds, 2, timeout) < 0) {
+            continue;
+        }
+        if (fds[1].revents & POLLIN) {
+            break;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            ssize_t length;
+            while ((length = read(_inotify, buffer, sizeof(buffer))) > 0) {
+                for (char *cursor = buffer; cursor < buffer + length;) {
+                    const inotify_event *event = reinterpret_cast<const inotify_event*>(cursor);
+                    cursor += sizeof(inotify_event) + event->len;
+
+                    if (event->mask & IN_Q_OVERFLOW) {
+                        Overflow();
+                        continue;
+                    }
+                    if (event->mask & IN_IGNORED) {
+                        _directories.erase(event->wd);
+                        continue;
+                    }
+
+                    auto directory = _directories.find(event->wd);
+                    if (directory == _directories.end() || !event->len) {
+                        continue;
+                    }
+
+                    std::string path = directory->second + "/" + event->name;
+                    if (event->mask & IN_ISDIR) {
+                        if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                            AddDirectory(path);
+                        }
+                        continue;
+                    }
+                    Queue(path);
+                }
+            }
+        }
+        timeout = Flush();
+    }
+}
+
+#endif
+
+void DirectoryWatcher::Queue(const std::string& path)
+{
+    // A later event for the same file pushes its deadline back
+    _pending[PakFile::NormalizePath(path)] = std::chrono::steady_clock::now();
+    _eventCount++;
+}
+
+void DirectoryWatcher::Overflow()
+{
+    for (auto& subscription : GetSubscriptions()) {
+        subscription->Overflowed = true;
+        if (subscription->Notify) {
+            subscription->Notify();
+        }
+    }
+}
+
+int DirectoryWatcher::Flush()
+{
+    using namespace std::chrono;
+
+    steady_clock::time_point now = steady_clock::now();
+    std::vector<std::string> ready;
+    int64_t nextDue = -1;
+
+    for (auto it = _pending.begin(); it != _pending.end();) {
+        int64_t quiet = duration_cast<milliseconds>(now - it->second).count();
+        if (quiet >= WATCHER_DEBOUNCE_TIME) {
+            ready.push_back(it->first);
+            it = _pending.erase(it);
+        } else {
+            int64_t due = WATCHER_DEBOUNCE_TIME - quiet;
+            nextDue = nextDue < 0 ? due : std::min(nextDue, due);
+            ++it;
+        }
+    }
+
+    if (!ready.empty()) {
+        Publish(ready);
+    }
+    return int(nextDue);
+}
+
+void DirectoryWatcher::Publish(std::vector<std::string>& paths)
+{
+    _publishCount += paths.size();
+
+    for (auto& subscription : GetSubscriptions()) {
+        for (auto& path : paths) {
+            std::string copy = path;
+            if (!subscription->Events.Push(std::move(copy))) {
+                subscription->Overflowed = true;
+                break;
+            }
+        }
+        if (subscription->Notify) {
+            subscription->Notify();
+        }
+    }
+}
+
+std::vector<DirectoryWatcher::Subscription::Ptr> DirectoryWatcher::GetSubscriptions()
+{
+    std::lock_guard<std::mutex> lock(_subscriptionLock);
+    return _subscriptions;
+}
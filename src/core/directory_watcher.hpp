@@ -0,0 +1,92 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-14 15:37:09
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+#include "spsc_queue.hpp"
+
+// Milliseconds a file has to stay quiet before its change is published. Editors tend to save in several writes.
+#define WATCHER_DEBOUNCE_TIME 50
+#define WATCHER_QUEUE_SIZE 256
+
+// Watches a directory tree with the OS change notifications (ReadDirectoryChangesW, inotify) on its own thread. Events are
+// debounced and coalesced per file, then fanned out to every subscription. Nothing is ever polled: the thread sleeps until
+// the OS reports a change.
+class DirectoryWatcher
+{
+public:
+    using Ptr = std::shared_ptr<DirectoryWatcher>;
+
+    struct Subscription
+    {
+        using Ptr = std::shared_ptr<Subscription>;
+
+        // Changed files, normalized like pak entries (forward slashes, relative to the working directory).
+        // Only the watcher thread pushes and only the subscriber pops.
+        SPSCQueue<std::string, WATCHER_QUEUE_SIZE> Events;
+        // Raised when events were lost, either by the OS or because the queue was full: rescan everything under the root
+        std::atomic<bool> Overflowed = false;
+        // Called on the watcher thread after a batch was pushed
+        std::function<void()> Notify;
+    };
+
+    DirectoryWatcher(const std::string& root);
+    ~DirectoryWatcher();
+
+    bool IsRunning() { return _running; }
+    const std::string& GetRoot() { return _root; }
+
+    Subscription::Ptr Subscribe(std::function<void()> notify = nullptr);
+private:
+    void WatchLoop();
+
+    // Debouncing, on the watcher thread
+    void Queue(const std::string& path);
+    void Overflow();
+    int Flush(); // Milliseconds until the next pending event is due, -1 if there are none
+    void Publish(std::vector<std::string>& paths);
+    // Copied under the lock, so that subscribers are notified without it: Notify may take locks Subscribe is called under
+    std::vector<Subscription::Ptr> GetSubscriptions();
+
+#ifdef _WIN32
+    HANDLE _directory = INVALID_HANDLE_VALUE;
+    HANDLE _stopEvent = nullptr;
+    OVERLAPPED _overlapped = {};
+    std::vector<DWORD> _buffer; // FILE_NOTIFY_INFORMATION has to be DWORD aligned
+#else
+    void AddDirectory(const std::string& path);
+
+    int _inotify = -1;
+    int _stopPipe[2] = { -1, -1 };
+    std::unordered_map<int, std::string> _directories;
+#endif
+
+    std::string _root;
+    std::thread _thread;
+    bool _running = false;
+
+    std::mutex _subscriptionLock;
+    std::vector<Subscription::Ptr> _subscriptions;
+
+    std::unordered_map<std::string, std::chrono::steady_clock::time_point> _pending;
+    uint64_t _eventCount = 0;
+    uint64_t _publishCount = 0;
+};
@@ -7,14 +7,95 @@
 #include "log.hpp"
 
 #include <sys/stat.h>
+#include <algorithm>
 #include <fstream>
 #include <filesystem>
+#include <cstring>
+#include <mutex>
+#include <unordered_set>
 
+#ifdef _WIN32
 #define WIN32_LEAN_AND_MEAN
 #include <Windows.h>
+#else
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#undef min
+#undef max
+
+static PakFile::Ptr _pak;
+static FileSystem::IOStats _ioStats;
+
+// Cookers write from several threads. Lookups only take the lock once something was shadowed.
+static std::mutex _shadowLock;
+static std::unordered_set<std::string> _shadowed;
+static std::atomic<uint32_t> _shadowedCount = 0;
+
+void FileSystem::MountPak(PakFile::Ptr pak)
+{
+    std::lock_guard<std::mutex> lock(_shadowLock);
+    _pak = pak;
+    _shadowed.clear();
+    _shadowedCount = 0;
+}
+
+void FileSystem::ShadowPak(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(_shadowLock);
+    if (_shadowed.insert(PakFile::NormalizePath(path)).second) {
+        _shadowedCount++;
+    }
+}
+
+uint32_t FileSystem::GetShadowedCount()
+{
+    return _shadowedCount.load();
+}
+
+PakFile::Ptr FileSystem::GetPak()
+{
+    return _pak;
+}
+
+bool FileSystem::FindInPak(const std::string& path, const uint8_t **data, uint64_t *size)
+{
+    if (!_pak) {
+        return false;
+    }
+    if (_shadowedCount.load(std::memory_order_relaxed)) {
+        std::lock_guard<std::mutex> lock(_shadowLock);
+        if (_shadowed.count(PakFile::NormalizePath(path))) {
+            return false;
+        }
+    }
+    const PakEntry *entry = _pak->Find(path);
+    if (!entry) {
+        return false;
+    }
+    _ioStats.PakHits++;
+    *data = _pak->GetData(entry);
+    *size = entry->Size;
+    return true;
+}
+
+FileSystem::IOStats& FileSystem::GetIOStats()
+{
+    return _ioStats;
+}
 
 bool FileSystem::Exists(const std::string& path)
 {
+    const uint8_t *data;
+    uint64_t size;
+    if (FindInPak(path, &data, &size)) {
+        return true;
+    }
+
+    _ioStats.Stats++;
     struct stat statistics;
     if (stat(path.c_str(), &statistics) == -1)
         return false;
@@ -23,25 +104,31 @@ bool FileSystem::Exists(const std::string& path)
 
 bool FileSystem::IsDirectory(const std::string& path)
 {
+    _ioStats.Stats++;
     struct stat statistics;
     if (stat(path.c_str(), &statistics) == -1)
         return false;
     return (statistics.st_mode & S_IFDIR) != 0;
 }
 
+std::string FileSystem::GetFileExtension(const std::string& path)
+{
+    std::filesystem::path fsPath(path);
+    return fsPath.extension().string();
+}
+
 void FileSystem::CreateFileFromPath(const std::string& path)
 {
-    HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
-    if (!handle) {
+    std::ofstream stream(path, std::ios::trunc);
+    if (!stream.is_open()) {
         Logger::Error("Error when creating file %s", path.c_str());
-        return;
     }
-    CloseHandle(handle);
 }
 
 void FileSystem::CreateDirectoryFromPath(const std::string& path)
 {
-    if (!CreateDirectoryA(path.c_str(), nullptr)) {
+    std::error_code error;
+    if (!std::filesystem::create_directory(path, error)) {
         Logger::Error("Error when creating directory %s", path.c_str());
     }
 }
@@ -53,7 +140,8 @@ void FileSystem::Delete(const std::string& path)
         return;
     }
 
-    if (!DeleteFileA(path.c_str())) {
+    std::error_code error;
+    if (!std::filesystem::remove(path, error)) {
         Logger::Error("Failed to delete file %s", path.c_str());
     }
 }
@@ -65,8 +153,10 @@ void FileSystem::Move(const std::string& oldPath, const std::string& newPath)
         return;
     }
 
-    if (!MoveFileA(oldPath.c_str(), newPath.c_str())) {
-        Logger::Error("Failed to move file %s to {1}", oldPath.c_str(), newPath.c_str());
+    std::error_code error;
+    std::filesystem::rename(oldPath, newPath, error);
+    if (error) {
+        Logger::Error("Failed to move file %s to %s", oldPath.c_str(), newPath.c_str());
     }
 }
 
@@ -77,70 +167,191 @@ void FileSystem::Copy(const std::string& oldPath, const std::string& newPath, bo
         return;
     }
 
-    if (!CopyFileA(oldPath.c_str(), newPath.c_str(), !overwrite)) {
-        Logger::Error("Failed to copy file %s to {1}", oldPath.c_str(), newPath.c_str());
+    std::error_code error;
+    std::filesystem::copy_file(oldPath, newPath, overwrite ? std::filesystem::copy_options::overwrite_existing : std::filesystem::copy_options::none, error);
+    if (error) {
+        Logger::Error("Failed to copy file %s to %s", oldPath.c_str(), newPath.c_str());
     }
 }
 
-std::string FileSystem::GetFileExtension(const std::string& path)
-{
-    std::filesystem::path fsPath(path);
-    return fsPath.extension().string();
-}
-
-int FileSystem::GetFileSize(const std::string& path)
+uint64_t FileSystem::GetFileSize(const std::string& path)
 {
-    int result = 0;
+    const uint8_t *data;
+    uint64_t size;
+    if (FindInPak(path, &data, &size)) {
+        return size;
+    }
 
-    HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
-    if (!handle) {
+    _ioStats.Stats++;
+    std::error_code error;
+    uint64_t result = std::filesystem::file_size(path, error);
+    if (error) {
         Logger::Error("File %s does not exist!", path.c_str());
         return 0;
     }
-    result = ::GetFileSize(handle, nullptr);
-    CloseHandle(handle);
     return result;
 }
 
 std::string FileSystem::ReadFile(const std::string& path)
 {
-    HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
-    if (!handle)
-    {
-        Logger::Error("File %s does not exist and cannot be read!", path);
+    FileView view = Map(path);
+    if (!view.IsValid()) {
+        Logger::Error("File %s does not exist and cannot be read!", path.c_str());
         return std::string("");
     }
-    int size = FileSystem::GetFileSize(path);
-    if (size == 0)
-    {
-        Logger::Error("File %s has a size of 0, thus cannot be read!", path);
-        return std::string("");
+    return std::string(reinterpret_cast<const char*>(view.GetData()), view.GetSize());
+}
+
+FileView FileSystem::Map(const std::string& path, MappedFile::Access access)
+{
+    const uint8_t *data;
+    uint64_t size;
+    if (FindInPak(path, &data, &size)) {
+        return FileView(data, size, _pak);
+    }
+
+    _ioStats.Opens++;
+    MappedFile::Ptr file = std::make_shared<MappedFile>(path, access);
+    if (!file->IsOpen()) {
+        return FileView();
+    }
+    _ioStats.Maps++;
+    return FileView(file->GetData(), file->GetSize(), file);
+}
+
+bool FileSystem::ReadRanges(const std::string& path, const std::vector<FileRange>& ranges)
+{
+    if (ranges.empty()) {
+        return true;
+    }
+
+    const uint8_t *data;
+    uint64_t size;
+    if (FindInPak(path, &data, &size)) {
+        for (auto& range : ranges) {
+            if (range.Offset + range.Size > size) {
+                return false;
+            }
+            memcpy(range.Destination, data + range.Offset, range.Size);
+        }
+        return true;
+    }
+
+    _ioStats.Opens++;
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_OVERLAPPED, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+
+    // Every read is issued before waiting on any of them, so the device sees the whole batch at once
+    std::vector<OVERLAPPED> overlapped(ranges.size());
+    std::vector<bool> issued(ranges.size(), false);
+    bool success = true;
+    for (size_t i = 0; i < ranges.size(); i++) {
+        if (ranges[i].Size > MAXDWORD) {
+            success = false;
+            break;
+        }
+        overlapped[i] = {};
+        overlapped[i].Offset = DWORD(ranges[i].Offset);
+        overlapped[i].OffsetHigh = DWORD(ranges[i].Offset >> 32);
+        overlapped[i].hEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+
+        _ioStats.Reads++;
+        if (!::ReadFile(file, ranges[i].Destination, DWORD(ranges[i].Size), nullptr, &overlapped[i]) && GetLastError() != ERROR_IO_PENDING) {
+            CloseHandle(overlapped[i].hEvent);
+            success = false;
+            break;
+        }
+        issued[i] = true;
+    }
+    for (size_t i = 0; i < ranges.size(); i++) {
+        if (!issued[i]) {
+            continue;
+        }
+        DWORD bytesRead = 0;
+        if (!GetOverlappedResult(file, &overlapped[i], &bytesRead, TRUE) || bytesRead != ranges[i].Size) {
+            success = false;
+        }
+        CloseHandle(overlapped[i].hEvent);
+    }
+    CloseHandle(file);
+    return success;
+#else
+    int file = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file < 0) {
+        return false;
+    }
+
+    std::vector<size_t> order(ranges.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&](size_t a, size_t b) { return ranges[a].Offset < ranges[b].Offset; });
+
+    // Ranges that follow each other in the file are read with a single preadv
+    bool success = true;
+    std::vector<iovec> vectors;
+    for (size_t first = 0; first < order.size() && success;) {
+        vectors.clear();
+        uint64_t offset = ranges[order[first]].Offset;
+        uint64_t total = 0;
+
+        size_t last = first;
+        while (last < order.size() && vectors.size() < IOV_MAX) {
+            const FileRange& range = ranges[order[last]];
+            if (range.Offset != offset + total) {
+                break;
+            }
+            vectors.push_back({ range.Destination, size_t(range.Size) });
+            total += range.Size;
+            last++;
+        }
+
+        _ioStats.Reads++;
+        ssize_t result = preadv(file, vectors.data(), int(vectors.size()), off_t(offset));
+        if (result != ssize_t(total)) {
+            // Short read, finish the run one range at a time
+            for (size_t i = first; i < last && success; i++) {
+                const FileRange& range = ranges[order[i]];
+                uint64_t done = 0;
+                while (done < range.Size) {
+                    _ioStats.Reads++;
+                    ssize_t read = pread(file, reinterpret_cast<uint8_t*>(range.Destination) + done, range.Size - done, off_t(range.Offset + done));
+                    if (read <= 0) {
+                        success = false;
+                        break;
+                    }
+                    done += read;
+                }
+            }
+        }
+        first = last;
+    }
+    close(file);
+    return success;
+#endif
+}
+
+uint64_t FileSystem::GetLastWriteTime(const std::string& path)
+{
+    _ioStats.Stats++;
+#ifdef _WIN32
+    // Reads the directory entry, the file itself is never opened
+    WIN32_FILE_ATTRIBUTE_DATA attributes;
+    if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &attributes)) {
+        return 0;
     }
-    int bytesRead = 0;
-    char *buffer = new char[size + 1];
-    ::ReadFile(handle, reinterpret_cast<LPVOID>(buffer), size, reinterpret_cast<LPDWORD>(&bytesRead), nullptr);
-    buffer[size] = '\0';
-    CloseHandle(handle);
-    return std::string(buffer);
-}
-
-void *FileSystem::ReadBytes(const std::string& path)
-{
-    HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
-    if (!handle)
-    {
-        Logger::Error("File %s does not exist and cannot be read!", path);
-        return nullptr;
-    }
-    int size = FileSystem::GetFileSize(path);
-    if (size == 0)
-    {
-        Logger::Error("File %s has a size of 0, thus cannot be read!", path);
-        return nullptr;
-    }
-    int bytesRead = 0;
-    char *buffer = new char[size + 1];
-    ::ReadFile(handle, reinterpret_cast<LPVOID>(buffer), size, reinterpret_cast<LPDWORD>(&bytesRead), nullptr);
-    CloseHandle(handle);
-    return buffer;
+    return (uint64_t(attributes.ftLastWriteTime.dwHighDateTime) << 32) | attributes.ftLastWriteTime.dwLowDateTime;
+#else
+    struct stat statistics;
+    if (stat(path.c_str(), &statistics) == -1) {
+        return 0;
+    }
+
+    // 100ns ticks since 1601, like a FILETIME
+    const uint64_t epochDifference = 11644473600ULL;
+    return (uint64_t(statistics.st_mtim.tv_sec) + epochDifference) * 10000000ULL + statistics.st_mtim.tv_nsec / 100;
+#endif
 }
@@ -6,10 +6,34 @@
 #pragma once
 
 #include <string>
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+#include "pak_file.hpp"
+#include "mapped_file.hpp"
+
+// One piece of a vectored read
+struct FileRange
+{
+    uint64_t Offset;
+    uint64_t Size;
+    void *Destination;
+};
 
 class FileSystem
 {
 public:
+    // Filesystem calls made by the engine, to compare loose files against the pak
+    struct IOStats
+    {
+        std::atomic<uint64_t> Stats = 0;
+        std::atomic<uint64_t> Opens = 0;
+        std::atomic<uint64_t> Reads = 0;
+        std::atomic<uint64_t> Maps = 0;
+        std::atomic<uint64_t> PakHits = 0;
+    };
+
     static bool Exists(const std::string& path);
     static bool IsDirectory(const std::string& path);
     
@@ -22,7 +46,31 @@ public:
 
     static std::string GetFileExtension(const std::string& path);
 
-    static int32_t GetFileSize(const std::string& path);
+    static uint64_t GetFileSize(const std::string& path);
     static std::string ReadFile(const std::string& path);
-    static void *ReadBytes(const std::string& path);
+
+    // Zero copy: points into the mounted pak or into a mapping of the file. Invalid if the file doesn't exist.
+    static FileView Map(const std::string& path, MappedFile::Access access = MappedFile::Access::Sequential);
+
+    // Reads every range in as few calls as the OS allows (overlapped reads in flight together on Windows, preadv on the
+    // ranges that follow each other elsewhere). Fails if any range couldn't be read whole.
+    static bool ReadRanges(const std::string& path, const std::vector<FileRange>& ranges);
+
+    // In 100ns ticks since 1601 (a FILETIME) on every platform, 0 if the file doesn't exist
+    static uint64_t GetLastWriteTime(const std::string& path);
+
+    // Once a pak is mounted, Exists/GetFileSize/ReadFile/Map/ReadRanges look in it before going to the disk.
+    // Mounting another pak (or none) forgets the shadowed files.
+    static void MountPak(PakFile::Ptr pak);
+    static PakFile::Ptr GetPak();
+
+    // Called by whatever writes a file the pak may have an older copy of: the file is read from the disk from then on.
+    // The count is what was written since the pak was mounted, which it's worth rebuilding for.
+    static void ShadowPak(const std::string& path);
+    static uint32_t GetShadowedCount();
+
+    // Points straight into the mounted pak, valid as long as a reference to it is held
+    static bool FindInPak(const std::string& path, const uint8_t **data, uint64_t *size);
+
+    static IOStats& GetIOStats();
 };
@@ -5,48 +5,34 @@
 //
 
 #include "file_watch.hpp"
+#include "file_system.hpp"
+#include "shader_compile_service.hpp"
 #include "log.hpp"
 
 FileWatch::FileWatch(const std::string& file)
 {
-    _file = file;
-   Load(file);
+    Load(file);
 }
 
 FileWatch::~FileWatch()
 {
-    //CloseHandle(_handle);
 }
 
 void FileWatch::Load(const std::string& file)
 {
-    _file = file;
-    _handle = CreateFileA(file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
-    if (!_handle) {
+    _state = std::make_shared<State>();
+    _state->File = file;
+    _state->WriteTime = FileSystem::GetLastWriteTime(file);
+    if (!_state->WriteTime) {
         Logger::Error("Failed to start file watch on path %s", file.c_str());
     }
-
-    GetFileTime(_handle, nullptr, nullptr, &_filetime);
-    CloseHandle(_handle);
+    ShaderCompileService::Watch(_state);
 }
 
 bool FileWatch::Check()
 {
-    if (_checkTimer.GetElapsed() >= 500.0f) {
-        _checkTimer.Restart();
-        _handle = CreateFileA(_file.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
-        if (!_handle) {
-            return false;
-        }
-        FILETIME temp;
-        GetFileTime(_handle, nullptr, nullptr, &temp);
-        CloseHandle(_handle);
-
-        if (_filetime.dwLowDateTime != temp.dwLowDateTime || _filetime.dwHighDateTime != temp.dwHighDateTime) {
-            _filetime = temp;
-            return true;
-        }
+    if (!_state) {
         return false;
     }
-    return false;
+    return _state->Changed.exchange(false);
 }
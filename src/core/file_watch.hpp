@@ -6,14 +6,23 @@
 
 #pragma once
 
+#include <atomic>
+#include <cstdint>
+#include <memory>
 #include <string>
-#include <Windows.h>
-
-#include "timer.hpp"
 
+// Change flag of a file, raised by the shader compile service thread when the file's directory watcher reports it, so checking
+// a watch never touches the disk. Copies share the same state and the file stops being watched once the last copy is gone.
 class FileWatch
 {
 public:
+    struct State
+    {
+        std::string File;
+        uint64_t WriteTime = 0; // Service thread only
+        std::atomic<bool> Changed = false;
+    };
+
     FileWatch() = default;
     FileWatch(const std::string& file);
     ~FileWatch();
@@ -21,8 +30,5 @@ public:
     void Load(const std::string& file);
     bool Check();
 private:
-    std::string _file;
-    Timer _checkTimer;
-    HANDLE _handle;
-    FILETIME _filetime;
+    std::shared_ptr<State> _state;
 };
@@ -0,0 +1,280 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-16 15:58:30
+//
+
+#include "frame_stats.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+
+#include <ImGui/imgui.h>
+#include <nlohmann/json.hpp>
+
+#undef min
+#undef max
+
+FrameStats::FrameStatsData FrameStats::_Data;
+
+static float GetLast(const Profiler::ZoneHistory& history)
+{
+    return history.Times[(history.Cursor + PROFILER_HISTORY_SIZE - 1) % PROFILER_HISTORY_SIZE];
+}
+
+uint32_t FrameStats::GetFrameZone()
+{
+    static const uint32_t zone = Profiler::Intern("Frame");
+    return zone;
+}
+
+FrameStats::Summary FrameStats::Summarize(uint32_t zone, uint32_t window)
+{
+    Summary summary = {};
+    const std::vector<Profiler::ZoneHistory>& histories = Profiler::GetHistory();
+    if (zone >= histories.size()) {
+        return summary;
+    }
+    const Profiler::ZoneHistory& history = histories[zone];
+    uint32_t count = std::min(std::min(window, history.Count), uint32_t(PROFILER_HISTORY_SIZE));
+    if (!count) {
+        return summary;
+    }
+
+    // The newest entries, walking back from the cursor
+    std::vector<float>& values = _Data.Scratch;
+    values.resize(count);
+    double sum = 0.0;
+    for (uint32_t i = 0; i < count; i++) {
+        values[i] = history.Times[(history.Cursor + PROFILER_HISTORY_SIZE - 1 - i) % PROFILER_HISTORY_SIZE];
+        sum += values[i];
+    }
+    std::sort(values.begin(), values.end());
+
+    // Nearest rank
+    auto percentile = [&](float p) {
+        uint32_t rank = uint32_t(std::ceil(p * count));
+        return values[std::min(std::max(rank, 1u), count) - 1];
+    };
+    summary.Samples = count;
+    summary.Last = GetLast(history);
+    summary.Mean = float(sum / count);
+    summary.P50 = percentile(0.50f);
+    summary.P95 = percentile(0.95f);
+    summary.P99 = percentile(0.99f);
+    summary.Max = values.back();
+    return summary;
+}
+
+void FrameStats::Update()
+{
+    _Data.FrameCount++;
+
+    const std::vector<Profiler::ZoneHistory>& histories = Profiler::GetHistory();
+    uint32_t frameZone = GetFrameZone();
+    if (frameZone >= histories.size() || histories[frameZone].Count < FRAME_STATS_MIN_SAMPLES) {
+        return;
+    }
+
+    Summary frame = Summarize(frameZone, _Data.Window);
+    if (frame.Last <= frame.P50 * _Data.HitchFactor) {
+        return;
+    }
+
+    Hitch hitch = {};
+    hitch.Frame = _Data.FrameCount;
+    hitch.Time = frame.Last;
+    hitch.Median = frame.P50;
+
+    // The slowest zones of that frame. Parents are in there with their children, the depth isn't kept in the history.
+    std::vector<HitchZone> zones;
+    for (uint32_t i = 0; i < histories.size(); i++) {
+        if (i != frameZone && histories[i].Seen) {
+            zones.push_back({ i, GetLast(histories[i]) });
+        }
+    }
+    hitch.ZoneCount = std::min(uint32_t(zones.size()), uint32_t(FRAME_STATS_HITCH_ZONES));
+    std::partial_sort(zones.begin(), zones.begin() + hitch.ZoneCount, zones.end(), [](const HitchZone& a, const HitchZone& b) { return a.Time > b.Time; });
+    std::copy(zones.begin(), zones.begin() + hitch.ZoneCount, hitch.Zones.begin());
+
+    uint32_t index = (_Data.HitchStart + _Data.HitchCount) % FRAME_STATS_MAX_HITCHES;
+    if (_Data.HitchCount == FRAME_STATS_MAX_HITCHES) {
+        _Data.HitchStart = (_Data.HitchStart + 1) % FRAME_STATS_MAX_HITCHES;
+    } else {
+        _Data.HitchCount++;
+    }
+    _Data.Hitches[index] = hitch;
+    _Data.TotalHitches++;
+
+    std::string slowest;
+    for (uint32_t i = 0; i < hitch.ZoneCount; i++) {
+        char buffer[128];
+        snprintf(buffer, sizeof(buffer), "%s%s %.2fms", i ? ", " : "", Profiler::GetName(hitch.Zones[i].Name).c_str(), hitch.Zones[i].Time);
+        slowest += buffer;
+    }
+    Logger::Warn("[STATS] Hitch on frame %llu: %.2fms, %.1fx the median of %.2fms (%s)", hitch.Frame, hitch.Time, hitch.Time / hitch.Median, hitch.Median, slowest.c_str());
+}
+
+std::vector<FrameStats::Hitch> FrameStats::GetHitches()
+{
+    std::vector<Hitch> hitches;
+    for (uint32_t i = 0; i < _Data.HitchCount; i++) {
+        hitches.push_back(_Data.Hitches[(_Data.HitchStart + i) % FRAME_STATS_MAX_HITCHES]);
+    }
+    return hitches;
+}
+
+uint64_t FrameStats::GetFrameCount()
+{
+    return _Data.FrameCount;
+}
+
+void FrameStats::SetHitchFactor(float factor)
+{
+    _Data.HitchFactor = factor;
+}
+
+bool FrameStats::ExportCSV(const std::string& path, uint32_t window)
+{
+    std::ofstream stream(path, std::ios::trunc);
+    if (!stream.is_open()) {
+        Logger::Error("[STATS] Failed to open %s for writing", path.c_str());
+        return false;
+    }
+
+    stream << "zone,samples,mean_ms,p50_ms,p95_ms,p99_ms,max_ms\n";
+    for (uint32_t i = 0; i < Profiler::GetHistory().size(); i++) {
+        Summary summary = Summarize(i, window);
+        if (summary.Max <= 0.0f) {
+            continue;
+        }
+        stream << '"' << Profiler::GetName(i) << '"' << ','
+               << summary.Samples << ','
+               << summary.Mean << ','
+               << summary.P50 << ','
+               << summary.P95 << ','
+               << summary.P99 << ','
+               << summary.Max << '\n';
+    }
+
+    Logger::Info("[STATS] Wrote frame statistics to %s", path.c_str());
+    return true;
+}
+
+bool FrameStats::ExportJSON(const std::string& path, uint32_t window)
+{
+    nlohmann::json zones = nlohmann::json::object();
+    for (uint32_t i = 0; i < Profiler::GetHistory().size(); i++) {
+        Summary summary = Summarize(i, window);
+        if (summary.Max <= 0.0f) {
+            continue;
+        }
+        zones[Profiler::GetName(i)] = {
+            { "samples", summary.Samples },
+            { "mean_ms", summary.Mean },
+            { "p50_ms", summary.P50 },
+            { "p95_ms", summary.P95 },
+            { "p99_ms", summary.P99 },
+            { "max_ms", summary.Max }
+        };
+    }
+
+    nlohmann::json hitches = nlohmann::json::array();
+    for (auto& hitch : GetHitches()) {
+        nlohmann::json slowest = nlohmann::json::array();
+        for (uint32_t i = 0; i < hitch.ZoneCount; i++) {
+            slowest.push_back({ { "zone", Profiler::GetName(hitch.Zones[i].Name) }, { "ms", hitch.Zones[i].Time } });
+        }
+        hitches.push_back({ { "frame", hitch.Frame }, { "ms", hitch.Time }, { "median_ms", hitch.Median }, { "slowest", slowest } });
+    }
+
+    // The raw frame times of the window, oldest first, for plotting runs against each other
+    nlohmann::json frames = nlohmann::json::array();
+    const std::vector<Profiler::ZoneHistory>& histories = Profiler::GetHistory();
+    if (GetFrameZone() < histories.size()) {
+        const Profiler::ZoneHistory& frame = histories[GetFrameZone()];
+        uint32_t count = std::min(window, frame.Count);
+        for (uint32_t i = count; i > 0; i--) {
+            frames.push_back(frame.Times[(frame.Cursor + PROFILER_HISTORY_SIZE - i) % PROFILER_HISTORY_SIZE]);
+        }
+    }
+
+    nlohmann::json root = {
+        { "frame_count", _Data.FrameCount },
+        { "window", window },
+        { "hitch_factor", _Data.HitchFactor },
+        { "total_hitches", _Data.TotalHitches },
+        { "zones", zones },
+        { "hitches", hitches },
+        { "frame_ms", frames }
+    };
+
+    std::ofstream stream(path, std::ios::trunc);
+    if (!stream.is_open()) {
+        Logger::Error("[STATS] Failed to open %s for writing", path.c_str());
+        return false;
+    }
+    stream << root.dump(4);
+
+    Logger::Info("[STATS] Wrote frame statistics to %s", path.c_str());
+    return true;
+}
+
+void FrameStats::OnUI()
+{
+    ImGui::Begin("Frame Statistics");
+
+    int window = int(_Data.Window);
+    if (ImGui::SliderInt("Window", &window, 16, PROFILER_HISTORY_SIZE)) {
+        _Data.Window = uint32_t(window);
+    }
+    ImGui::SliderFloat("Hitch Factor", &_Data.HitchFactor, 1.25f, 10.0f, "%.2fx the median");
+    if (ImGui::Button("Export CSV")) {
+        ExportCSV("frame_stats.csv", _Data.Window);
+    }
+    ImGui::SameLine();
+    if (ImGui::Button("Export JSON")) {
+        ExportJSON("frame_stats.json", _Data.Window);
+    }
+    ImGui::Separator();
+
+    if (ImGui::BeginTable("Zones", 6, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingFixedFit)) {
+        ImGui::TableSetupColumn("Zone");
+        ImGui::TableSetupColumn("Mean");
+        ImGui::TableSetupColumn("P50");
+        ImGui::TableSetupColumn("P95");
+        ImGui::TableSetupColumn("P99");
+        ImGui::TableSetupColumn("Max");
+        ImGui::TableHeadersRow();
+        for (uint32_t i = 0; i < Profiler::GetHistory().size(); i++) {
+            Summary summary = Summarize(i, _Data.Window);
+            if (summary.Max <= 0.0f) {
+                continue;
+            }
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(Profiler::GetName(i).c_str());
+            for (float value : { summary.Mean, summary.P50, summary.P95, summary.P99, summary.Max }) {
+                ImGui::TableNextColumn();
+                ImGui::Text("%.2fms", value);
+            }
+        }
+        ImGui::EndTable();
+    }
+
+    ImGui::Separator();
+    ImGui::Text("Hitches: %llu", _Data.TotalHitches);
+    std::vector<Hitch> hitches = GetHitches();
+    for (auto it = hitches.rbegin(); it != hitches.rend(); it++) {
+        if (ImGui::TreeNode((void*)(intptr_t)it->Frame, "Frame %llu: %.2fms (%.1fx)", it->Frame, it->Time, it->Time / it->Median)) {
+            for (uint32_t i = 0; i < it->ZoneCount; i++) {
+                ImGui::Text("%s: %.2fms", Profiler::GetName(it->Zones[i].Name).c_str(), it->Zones[i].Time);
+            }
+            ImGui::TreePop();
+        }
+    }
+
+    ImGui::End();
+}
@@ -0,0 +1,89 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-16 15:40:12
+//
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "profiler.hpp"
+
+// Frames a hitch is measured against
+#define FRAME_STATS_MIN_SAMPLES 60
+// A frame slower than this many times the median is a hitch
+#define FRAME_STATS_HITCH_FACTOR 2.0f
+#define FRAME_STATS_MAX_HITCHES 64
+// Slowest zones kept with a hitch
+#define FRAME_STATS_HITCH_ZONES 4
+
+// Aggregates over the profiler's per-zone histories: percentiles over a sliding window of frames, hitches, and exports to
+// compare runs. The counter for the whole frame is the "Frame" zone. Main thread only.
+class FrameStats
+{
+public:
+    struct Summary
+    {
+        uint32_t Samples;
+        float Last;
+        float Mean;
+        float P50;
+        float P95;
+        float P99;
+        float Max;
+    };
+
+    struct HitchZone
+    {
+        uint32_t Name;
+        float Time;
+    };
+
+    struct Hitch
+    {
+        uint64_t Frame;
+        float Time;
+        float Median;
+        std::array<HitchZone, FRAME_STATS_HITCH_ZONES> Zones;
+        uint32_t ZoneCount;
+    };
+
+    // Call right after Profiler::EndFrame
+    static void Update();
+
+    // Over the last window frames of the zone, at most PROFILER_HISTORY_SIZE
+    static Summary Summarize(uint32_t zone, uint32_t window = PROFILER_HISTORY_SIZE);
+    static Summary SummarizeFrame(uint32_t window = PROFILER_HISTORY_SIZE) { return Summarize(GetFrameZone(), window); }
+    static uint32_t GetFrameZone();
+
+    // Oldest first
+    static std::vector<Hitch> GetHitches();
+    static uint64_t GetFrameCount();
+
+    static void SetHitchFactor(float factor);
+
+    // One row per zone that ran in the window, then the hitches
+    static bool ExportCSV(const std::string& path, uint32_t window = PROFILER_HISTORY_SIZE);
+    static bool ExportJSON(const std::string& path, uint32_t window = PROFILER_HISTORY_SIZE);
+
+    static void OnUI();
+private:
+    struct FrameStatsData
+    {
+        uint64_t FrameCount = 0;
+        float HitchFactor = FRAME_STATS_HITCH_FACTOR;
+        uint32_t Window = PROFILER_HISTORY_SIZE;
+
+        std::array<Hitch, FRAME_STATS_MAX_HITCHES> Hitches;
+        uint32_t HitchStart = 0;
+        uint32_t HitchCount = 0;
+        uint64_t TotalHitches = 0;
+
+        std::vector<float> Scratch;
+    };
+    static FrameStatsData _Data;
+};
@@ -0,0 +1,719 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-15 14:31:26
+//
+
+#include "io_queue.hpp"
+#include "file_system.hpp"
+#include "timer.hpp"
+#include "log.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#endif
+
+#undef min
+#undef max
+
+#ifndef _WIN32
+
+// The raw ring, set up with the syscalls directly so that liburing isn't needed
+struct IOQueue::Ring
+{
+    int Fd = -1;
+
+    void *SubmissionMap = nullptr;
+    size_t SubmissionMapSize = 0;
+    void *CompletionMap = nullptr;
+    size_t CompletionMapSize = 0;
+    io_uring_sqe *Entries = nullptr;
+    size_t EntriesSize = 0;
+
+    unsigned *SubmissionHead; // Moved by the kernel as it takes entries
+    unsigned *SubmissionTail;
+    unsigned *SubmissionMask;
+    unsigned *SubmissionArray;
+    unsigned *CompletionHead;
+    unsigned *CompletionTail;
+    unsigned *CompletionMask;
+    io_uring_cqe *Completions;
+
+    ~Ring()
+    {
+        if (Entries) {
+            munmap(Entries, EntriesSize);
+        }
+        if (CompletionMap && CompletionMap != SubmissionMap) {
+            munmap(CompletionMap, CompletionMapSize);
+        }
+        if (SubmissionMap) {
+            munmap(SubmissionMap, SubmissionMapSize);
+        }
+        if (Fd >= 0) {
+            close(Fd);
+        }
+    }
+};
+
+bool IOQueue::CreateRing()
+{
+    io_uring_params params = {};
+    int fd = int(syscall(__NR_io_uring_setup, _depth, &params));
+    if (fd < 0) {
+        Logger::Warn("[IO] io_uring is unavailable (%s), using the thread pool", strerror(errno));
+        return false;
+    }
+
+    Ring *ring = new Ring;
+    ring->Fd = fd;
+    ring->SubmissionMapSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->CompletionMapSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->SubmissionMapSize = std::max(ring->SubmissionMapSize, ring->CompletionMapSize);
+    }
+
+    ring->SubmissionMap = mmap(nullptr, ring->SubmissionMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+    if (ring->SubmissionMap == MAP_FAILED) {
+        ring->SubmissionMap = nullptr;
+        delete ring;
+        return false;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->CompletionMap = ring->SubmissionMap;
+    } else {
+        ring->CompletionMap = mmap(nullptr, ring->CompletionMapSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+        if (ring->CompletionMap == MAP_FAILED) {
+            ring->CompletionMap = nullptr;
+            delete ring;
+            return false;
+        }
+    }
+    ring->EntriesSize = params.sq_entries * sizeof(io_uring_sqe);
+    void *entries = mmap(nullptr, ring->EntriesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+    if (entries == MAP_FAILED) {
+        delete ring;
+        return false;
+    }
+    ring->Entries = reinterpret_cast<io_uring_sqe*>(entries);
+
+    uint8_t *submission = reinterpret_cast<uint8_t*>(ring->SubmissionMap);
+    uint8_t *completion = reinterpret_cast<uint8_t*>(ring->CompletionMap);
+    ring->SubmissionHead = reinterpret_cast<unsigned*>(submission + params.sq_off.head);
+    ring->SubmissionTail = reinterpret_cast<unsigned*>(submission + params.sq_off.tail);
+    ring->SubmissionMask = reinterpret_cast<unsigned*>(submission + params.sq_off.ring_mask);
+    ring->SubmissionArray = reinterpret_cast<unsigned*>(submission + params.sq_off.array);
+    ring->CompletionHead = reinterpret_cast<unsigned*>(completion + params.cq_off.head);
+    ring->CompletionTail = reinterpret_cast<unsigned*>(completion + params.cq_off.tail);
+    ring->CompletionMask = reinterpret_cast<unsigned*>(completion + params.cq_off.ring_mask);
+    ring->Completions = reinterpret_cast<io_uring_cqe*>(completion + params.cq_off.cqes);
+
+    _depth = std::min(_depth, params.sq_entries);
+    _uring = ring;
+    return true;
+}
+
+void IOQueue::RingLoop()
+{
+    Profiler::SetThreadName("IO");
+
+    struct Slot
+    {
+        IORequest Request;
+        uint64_t Done;
+        iovec Vector;
+        int File;
+    };
+    std::vector<Slot> slots(_depth);
+    std::vector<uint32_t> freeSlots;
+    for (uint32_t i = 0; i < _depth; i++) {
+        freeSlots.push_back(_depth - 1 - i);
+    }
+
+    // READV rather than READ, it's been there since the first kernel with io_uring
+    auto prepare = [&](uint32_t index) {
+        Slot& slot = slots[index];
+        slot.Vector.iov_base = reinterpret_cast<uint8_t*>(slot.Request.Destination) + slot.Done;
+        slot.Vector.iov_len = size_t(std::min<uint64_t>(slot.Request.Size - slot.Done, 1u << 30));
+
+        unsigned tail = *_uring->SubmissionTail;
+        unsigned entryIndex = tail & *_uring->SubmissionMask;
+        io_uring_sqe& entry = _uring->Entries[entryIndex];
+        memset(&entry, 0, sizeof(entry));
+        entry.opcode = IORING_OP_READV;
+        entry.fd = slot.File;
+        entry.off = slot.Request.Offset + slot.Done;
+        entry.addr = reinterpret_cast<uint64_t>(&slot.Vector);
+        entry.len = 1;
+        entry.user_data = index;
+        _uring->SubmissionArray[entryIndex] = entryIndex;
+        __atomic_store_n(_uring->SubmissionTail, tail + 1, __ATOMIC_RELEASE);
+    };
+
+    uint32_t inFlight = 0;
+    auto finish = [&](uint32_t index, bool success) {
+        Slot& slot = slots[index];
+        ReleaseFile(slot.Request.Path);
+        Complete(slot.Request, success);
+        slot.Request = {};
+        freeSlots.push_back(index);
+        inFlight--;
+    };
+
+    // Entries the kernel hasn't taken yet, they go out with the next io_uring_enter
+    auto unsubmitted = [&]() {
+        return *_uring->SubmissionTail - __atomic_load_n(_uring->SubmissionHead, __ATOMIC_ACQUIRE);
+    };
+    // Takes back the entries the kernel never took and fails their requests
+    auto failUnsubmitted = [&]() {
+        unsigned head = __atomic_load_n(_uring->SubmissionHead, __ATOMIC_ACQUIRE);
+        for (unsigned i = head; i != *_uring->SubmissionTail; i++) {
+            unsigned entryIndex = _uring->SubmissionArray[i & *_uring->SubmissionMask];
+            finish(uint32_t(_uring->Entries[entryIndex].user_data), false);
+        }
+        __atomic_store_n(_uring->SubmissionTail, head, __ATOMIC_RELEASE);
+    };
+
+    std::vector<IORequest> taken;
+    while (true) {
+        taken.clear();
+        {
+            std::unique_lock<std::mutex> lock(_lock);
+            if (!inFlight) {
+                _wakeUp.wait(lock, [this]() { return !_running || !_pending.empty(); });
+                if (!_running && _pending.empty()) {
+                    return;
+                }
+            }
+            while (!_pending.empty() && inFlight + taken.size() < _depth) {
+                taken.push_back(std::move(_pending.front()));
+                _pending.pop_front();
+            }
+        }
+
+        uint32_t submitted = 0;
+        for (auto& request : taken) {
+            int file = OpenFile(request.Path);
+            if (file < 0 || !request.Size) {
+                if (file >= 0) {
+                    ReleaseFile(request.Path);
+                }
+                Complete(request, file >= 0);
+                continue;
+            }
+            uint32_t index = freeSlots.back();
+            freeSlots.pop_back();
+            slots[index] = { std::move(request), 0, {}, file };
+            prepare(index);
+            submitted++;
+        }
+        inFlight += submitted;
+        if (submitted) {
+            std::lock_guard<std::mutex> lock(_lock);
+            _stats.PeakInFlight = std::max(_stats.PeakInFlight, inFlight);
+        }
+        if (!inFlight) {
+            continue;
+        }
+
+        // Submits the new reads and waits for at least one completion, in the same call when reads are in the kernel
+        // already. With none, waiting after a short submission would never return.
+        uint32_t pending = unsubmitted();
+        uint32_t inKernel = inFlight - pending;
+        bool waited = false;
+        if (pending) {
+            bool wait = inKernel > 0;
+            int result = int(syscall(__NR_io_uring_enter, _uring->Fd, pending, wait ? 1 : 0, wait ? IORING_ENTER_GETEVENTS : 0, nullptr, 0));
+            if (result >= 0) {
+                inKernel += uint32_t(result);
+                waited = wait;
+            } else if (errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                Logger::Error("[IO] io_uring_enter failed to submit %u reads: %s", pending, strerror(errno));
+                failUnsubmitted();
+            }
+        }
+        if (!waited && inKernel) {
+            int result = int(syscall(__NR_io_uring_enter, _uring->Fd, 0, 1, IORING_ENTER_GETEVENTS, nullptr, 0));
+            if (result < 0 && errno != EINTR && errno != EAGAIN && errno != EBUSY) {
+                Logger::Error("[IO] io_uring_enter failed: %s", strerror(errno));
+            }
+        } else if (!inKernel && unsubmitted()) {
+            // The kernel is short on resources and has none of our reads to finish, try again
+            std::this_thread::yield();
+        }
+
+        unsigned head = *_uring->CompletionHead;
+        while (head != __atomic_load_n(_uring->CompletionTail, __ATOMIC_ACQUIRE)) {
+            const io_uring_cqe& completion = _uring->Completions[head & *_uring->CompletionMask];
+            uint32_t index = uint32_t(completion.user_data);
+            int bytes = completion.res;
+            head++;
+
+            // Retries and the rest of short reads go out with the next submission
+            Slot& slot = slots[index];
+            if (bytes == -EAGAIN || bytes == -EINTR) {
+                prepare(index);
+                continue;
+            }
+            if (bytes > 0) {
+                slot.Done += bytes;
+                if (slot.Done < slot.Request.Size) {
+                    prepare(index);
+                    continue;
+                }
+            }
+            finish(index, bytes > 0);
+        }
+        __atomic_store_n(_uring->CompletionHead, head, __ATOMIC_RELEASE);
+    }
+}
+
+#endif
+
+IOQueue::IOQueue(IOBackend backend, uint32_t depth)
+    : _depth(depth)
+{
+#ifndef _WIN32
+    if (backend == IOBackend::Default && CreateRing()) {
+        _threads.emplace_back(&IOQueue::RingLoop, this);
+        return;
+    }
+#endif
+    for (int i = 0; i < IO_QUEUE_WORKER_COUNT; i++) {
+        _threads.emplace_back(&IOQueue::WorkerLoop, this);
+    }
+}
+
+IOQueue::~IOQueue()
+{
+    Flush();
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        _running = false;
+    }
+    _wakeUp.notify_all();
+    for (auto& thread : _threads) {
+        thread.join();
+    }
+
+#ifndef _WIN32
+    delete _uring;
+#endif
+    for (auto& file : _files) {
+        CloseFile(file.second.File);
+    }
+}
+
+IOQueue& IOQueue::Get()
+{
+    static IOQueue queue;
+    return queue;
+}
+
+IOQueue::NativeFile IOQueue::OpenFile(const std::string& path)
+{
+    // Handles stay open between reads, loaders read the same files over and over
+    std::lock_guard<std::mutex> lock(_fileLock);
+    auto it = _files.find(path);
+    if (it != _files.end()) {
+        it->second.Users++;
+        it->second.LastUse = ++_fileClock;
+        return it->second.File;
+    }
+
+    FileSystem::GetIOStats().Opens++;
+#ifdef _WIN32
+    // Cached handles must not keep the cookers from rewriting or deleting the file
+    NativeFile file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+#else
+    NativeFile file = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+#endif
+    if (!IsValid(file)) {
+        Logger::Error("[IO] Failed to open %s", path.c_str());
+        return file;
+    }
+    _files[path] = { file, 1, ++_fileClock };
+    TrimFiles(IO_QUEUE_MAX_OPEN_FILES);
+    return file;
+}
+
+void IOQueue::ReleaseFile(const std::string& path)
+{
+    std::lock_guard<std::mutex> lock(_fileLock);
+    auto it = _files.find(path);
+    if (it != _files.end() && it->second.Users) {
+        it->second.Users--;
+    }
+    TrimFiles(IO_QUEUE_MAX_OPEN_FILES);
+}
+
+void IOQueue::TrimFiles(size_t maxOpen)
+{
+    // A scan is fine at this size, and it only happens once the cache is full
+    while (_files.size() > maxOpen) {
+        auto oldest = _files.end();
+        for (auto it = _files.begin(); it != _files.end(); ++it) {
+            if (!it->second.Users && (oldest == _files.end() || it->second.LastUse < oldest->second.LastUse)) {
+                oldest = it;
+            }
+        }
+        if (oldest == _files.end()) {
+            return;
+        }
+        CloseFile(oldest->second.File);
+        _files.erase(oldest);
+    }
+}
+
+void IOQueue::CloseIdleFiles()
+{
+    std::lock_guard<std::mutex> lock(_fileLock);
+    TrimFiles(0);
+}
+
+void IOQueue::CloseFile(NativeFile file)
+{
+#ifdef _WIN32
+    CloseHandle(file);
+#else
+    close(file);
+#endif
+}
+
+bool IOQueue::DropFromCache(const std::string& path)
+{
+#ifdef _WIN32
+    // Opening a file unbuffered throws its pages out of the system cache
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_EXISTING, FILE_FLAG_NO_BUFFERING, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return false;
+    }
+    CloseHandle(file);
+    return true;
+#else
+    int file = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (file < 0) {
+        return false;
+    }
+    bool dropped = posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED) == 0;
+    close(file);
+    return dropped;
+#endif
+}
+
+bool IOQueue::IsValid(NativeFile file)
+{
+#ifdef _WIN32
+    return file != INVALID_HANDLE_VALUE;
+#else
+    return file >= 0;
+#endif
+}
+
+bool IOQueue::ReadBlocking(NativeFile file, uint64_t offset, uint64_t size, void *destination)
+{
+    uint64_t done = 0;
+    while (done < size) {
+        uint8_t *cursor = reinterpret_cast<uint8_t*>(destination) + done;
+        uint32_t chunk = uint32_t(std::min<uint64_t>(size - done, 1u << 30));
+#ifdef _WIN32
+        // Positioned read on a synchronous handle, the workers can share it
+        OVERLAPPED overlapped = {};
+        overlapped.Offset = DWORD(offset + done);
+        overlapped.OffsetHigh = DWORD((offset + done) >> 32);
+        DWORD read = 0;
+        if (!::ReadFile(file, cursor, chunk, &read, &overlapped) || !read) {
+            return false;
+        }
+#else
+        ssize_t read = pread(file, cursor, chunk, off_t(offset + done));
+        if (read < 0 && errno == EINTR) {
+            continue;
+        }
+        if (read <= 0) {
+            return false;
+        }
+#endif
+        done += read;
+    }
+    return true;
+}
+
+void IOQueue::Complete(IORequest& request, bool success)
+{
+    FileSystem::GetIOStats().Reads++;
+    if (request.OnComplete) {
+        request.OnComplete(success);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        _stats.Completed++;
+        if (success) {
+            _stats.Bytes += request.Size;
+        } else {
+            _stats.Failed++;
+        }
+    }
+    _idle.notify_all();
+}
+
+void IOQueue::Submit(IORequest request)
+{
+    std::vector<IORequest> requests;
+    requests.push_back(std::move(request));
+    Submit(requests);
+}
+
+void IOQueue::Submit(std::vector<IORequest>& requests)
+{
+    uint32_t queued = 0;
+    for (auto& request : requests) {
+        {
+            std::lock_guard<std::mutex> lock(_lock);
+            _stats.Submitted++;
+        }
+
+        // Already mapped, a copy is all it takes
+        const uint8_t *data;
+        uint64_t size;
+        if (FileSystem::FindInPak(request.Path, &data, &size)) {
+            bool inside = request.Offset + request.Size <= size;
+            if (inside) {
+                memcpy(request.Destination, data + request.Offset, request.Size);
+            }
+            Complete(request, inside);
+            continue;
+        }
+
+        std::lock_guard<std::mutex> lock(_lock);
+        _pending.push_back(std::move(request));
+        queued++;
+    }
+    requests.clear();
+
+    if (queued > 1) {
+        _wakeUp.notify_all();
+    } else if (queued) {
+        _wakeUp.notify_one();
+    }
+}
+
+std::future<bool> IOQueue::Read(const std::string& path, uint64_t offset, uint64_t size, void *destination)
+{
+    std::shared_ptr<std::promise<bool>> promise = std::make_shared<std::promise<bool>>();
+    std::future<bool> future = promise->get_future();
+
+    IORequest request;
+    request.Path = path;
+    request.Offset = offset;
+    request.Size = size;
+    request.Destination = destination;
+    request.OnComplete = [promise](bool success) {
+        promise->set_value(success);
+    };
+    Submit(std::move(request));
+    return future;
+}
+
+std::future<bool> IOQueue::ReadFile(const std::string& path, std::vector<uint8_t>& destination)
+{
+    if (!FileSystem::Exists(path)) {
+        std::promise<bool> promise;
+        promise.set_value(false);
+        return promise.get_future();
+    }
+    destination.resize(FileSystem::GetFileSize(path));
+    return Read(path, 0, destination.size(), destination.data());
+}
+
+void IOQueue::Flush()
+{
+    std::unique_lock<std::mutex> lock(_lock);
+    _idle.wait(lock, [this]() { return _stats.Completed == _stats.Submitted; });
+}
+
+IOQueue::Stats IOQueue::GetStats()
+{
+    Stats stats;
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        stats = _stats;
+    }
+    std::lock_guard<std::mutex> lock(_fileLock);
+    stats.OpenFiles = uint32_t(_files.size());
+    return stats;
+}
+
+void IOQueue::WorkerLoop()
+{
+    Profiler::SetThreadName("IO");
+
+    while (true) {
+        IORequest request;
+        {
+            std::unique_lock<std::mutex> lock(_lock);
+            _wakeUp.wait(lock, [this]() { return !_running || !_pending.empty(); });
+            if (!_running && _pending.empty()) {
+                return;
+            }
+            request = std::move(_pending.front());
+            _pending.pop_front();
+            _inFlight++;
+            _stats.PeakInFlight = std::max(_stats.PeakInFlight, _inFlight);
+        }
+
+        bool success;
+        {
+            PROFILE_SCOPE("Read");
+            NativeFile file = OpenFile(request.Path);
+            success = IsValid(file) && ReadBlocking(file, request.Offset, request.Size, request.Destination);
+            if (IsValid(file)) {
+                ReleaseFile(request.Path);
+            }
+        }
+        {
+            std::lock_guard<std::mutex> lock(_lock);
+            _inFlight--;
+        }
+        Complete(request, success);
+    }
+}
+
+void IOQueue::Benchmark(const std::string& directory, uint64_t blockSize)
+{
+    struct Block
+    {
+        std::string Path;
+        uint64_t Offset;
+        uint64_t Size;
+    };
+    std::vector<Block> blocks;
+    uint64_t totalBytes = 0;
+    uint32_t fileCount = 0;
+
+    std::error_code error;
+    for (const auto& entry : std::filesystem::recursive_directory_iterator(directory, error)) {
+        if (!entry.is_regular_file()) {
+            continue;
+        }
+        std::string path = entry.path().string();
+        uint64_t size = entry.file_size();
+        for (uint64_t offset = 0; offset < size; offset += blockSize) {
+            blocks.push_back({ path, offset, std::min(blockSize, size - offset) });
+        }
+        totalBytes += size;
+        fileCount++;
+    }
+    if (blocks.empty()) {
+        Logger::Warn("[IO] Benchmark: nothing to read in %s", directory.c_str());
+        return;
+    }
+
+    // Reused for every block, only the reads are measured
+    std::vector<uint8_t> scratch(blocks.size() * blockSize > (1ull << 30) ? 0 : blocks.size() * blockSize);
+    auto destination = [&](size_t i) {
+        return scratch.empty() ? nullptr : scratch.data() + i * blockSize;
+    };
+    if (scratch.empty()) {
+        Logger::Warn("[IO] Benchmark: %s holds more than 1GB, only reading the first GB", directory.c_str());
+        blocks.resize((1ull << 30) / blockSize);
+        scratch.resize(blocks.size() * blockSize);
+        totalBytes = 0;
+        for (auto& block : blocks) {
+            totalBytes += block.Size;
+        }
+    }
+    float megabytes = totalBytes / (1024.0f * 1024.0f);
+    Logger::Info("[IO] Benchmark: %u files, %.2f MB in %llu blocks of %llu KB", fileCount, megabytes, uint64_t(blocks.size()), blockSize / 1024);
+
+    // Every method reads the same files, whoever goes first would pay for the disk and the others would read memory.
+    // So each one runs right after the files were dropped from the OS cache, then once more with them cached.
+    std::vector<std::string> paths;
+    for (auto& block : blocks) {
+        if (paths.empty() || paths.back() != block.Path) {
+            paths.push_back(block.Path);
+        }
+    }
+    uint32_t dropFailures = 0;
+    auto dropCache = [&]() {
+        for (auto& path : paths) {
+            dropFailures += !DropFromCache(path);
+        }
+    };
+
+    // What the loaders used to do: open, read, close, one file after the other
+    auto readBlocking = [&]() {
+        Timer timer;
+        std::string open;
+        FILE *file = nullptr;
+        for (size_t i = 0; i < blocks.size(); i++) {
+            if (blocks[i].Path != open) {
+                if (file) {
+                    fclose(file);
+                }
+                open = blocks[i].Path;
+                file = fopen(open.c_str(), "rb");
+            }
+            if (file) {
+                fseek(file, long(blocks[i].Offset), SEEK_SET);
+                fread(destination(i), 1, blocks[i].Size, file);
+            }
+        }
+        if (file) {
+            fclose(file);
+        }
+        return timer.GetElapsed();
+    };
+
+    dropCache();
+    float syncCold = readBlocking();
+    float syncWarm = readBlocking();
+    Logger::Info("[IO] Benchmark: blocking reads: cold %.2fms (%.2f MB/s), warm %.2fms (%.2f MB/s)",
+                 syncCold, megabytes / (syncCold / 1000.0f),
+                 syncWarm, megabytes / (syncWarm / 1000.0f));
+
+    for (IOBackend backend : { IOBackend::Default, IOBackend::ThreadPool }) {
+        IOQueue queue(backend);
+
+        auto readQueued = [&]() {
+            Timer timer;
+            std::vector<IORequest> requests;
+            for (size_t i = 0; i < blocks.size(); i++) {
+                requests.push_back({ blocks[i].Path, blocks[i].Offset, blocks[i].Size, destination(i), nullptr });
+            }
+            queue.Submit(requests);
+            queue.Flush();
+            return timer.GetElapsed();
+        };
+
+        dropCache();
+        float cold = readQueued();
+        float warm = readQueued();
+
+        Stats stats = queue.GetStats();
+        Logger::Info("[IO] Benchmark: %s: cold %.2fms (%.2f MB/s, %.2fx), warm %.2fms (%.2f MB/s, %.2fx), peak %u reads in flight, %llu failed",
+                     queue.GetBackendName(),
+                     cold, megabytes / (cold / 1000.0f), syncCold / cold,
+                     warm, megabytes / (warm / 1000.0f), syncWarm / warm,
+                     stats.PeakInFlight,
+                     stats.Failed);
+        // Without a ring the default queue already was the thread pool
+        if (!queue._uring) {
+            break;
+        }
+    }
+    if (dropFailures) {
+        Logger::Warn("[IO] Benchmark: %u files couldn't be dropped from the OS cache, their cold reads were warm", dropFailures);
+    }
+}
@@ -0,0 +1,141 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-15 14:08:51
+//
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+// Reads in flight at once. NVMe drives want a deep queue to reach their bandwidth.
+#define IO_QUEUE_DEPTH 64
+#define IO_QUEUE_WORKER_COUNT 8
+// Handles kept open between reads. Past that, the least recently used ones no read is using get closed.
+#define IO_QUEUE_MAX_OPEN_FILES 64
+#define IO_QUEUE_BENCHMARK_BLOCK (1024 * 1024)
+
+enum class IOBackend
+{
+    Default, // io_uring when the kernel has it, the thread pool otherwise
+    ThreadPool
+};
+
+struct IORequest
+{
+    std::string Path;
+    uint64_t Offset;
+    uint64_t Size;
+    void *Destination;
+    // Runs on an IO thread, or inline for files found in the mounted pak. Keep it short.
+    std::function<void(bool success)> OnComplete;
+};
+
+// Asynchronous reads. Requests are (file, offset, size, destination) and complete through a callback or a future. On Linux
+// they go through an io_uring so that the whole batch is in flight with a single syscall, elsewhere a pool of threads does
+// blocking positioned reads.
+class IOQueue
+{
+public:
+    struct Stats
+    {
+        uint64_t Submitted;
+        uint64_t Completed;
+        uint64_t Failed;
+        uint64_t Bytes;
+        uint32_t PeakInFlight;
+        uint32_t OpenFiles; // Handles cached right now
+    };
+
+    IOQueue(IOBackend backend = IOBackend::Default, uint32_t depth = IO_QUEUE_DEPTH);
+    IOQueue(const IOQueue&) = delete;
+    IOQueue& operator=(const IOQueue&) = delete;
+    ~IOQueue();
+
+    // Shared queue, started on first use
+    static IOQueue& Get();
+
+    void Submit(IORequest request);
+    void Submit(std::vector<IORequest>& requests);
+
+    // The destination has to stay alive until the future is ready
+    std::future<bool> Read(const std::string& path, uint64_t offset, uint64_t size, void *destination);
+    // Resizes the destination to the size of the file first
+    std::future<bool> ReadFile(const std::string& path, std::vector<uint8_t>& destination);
+
+    // Waits for everything submitted so far
+    void Flush();
+    // Closes the handles no read is using, for callers that read a set of files once and don't want them held open
+    void CloseIdleFiles();
+
+    const char *GetBackendName() { return _uring ? "io_uring" : "thread pool"; }
+    Stats GetStats();
+
+    // Reads every file under the directory in blocks, one blocking read at a time and then through the queues, and logs the
+    // throughput of each. Every method runs cold, with the files dropped from the OS cache first, then warm.
+    static void Benchmark(const std::string& directory, uint64_t blockSize = IO_QUEUE_BENCHMARK_BLOCK);
+private:
+#ifdef _WIN32
+    using NativeFile = HANDLE;
+#else
+    using NativeFile = int;
+#endif
+
+    // Takes a reference on the handle, given back with ReleaseFile once the read is done
+    NativeFile OpenFile(const std::string& path);
+    void ReleaseFile(const std::string& path);
+    // Closes idle handles, the least recently used first, until at most maxOpen are left. Call with _fileLock held.
+    void TrimFiles(size_t maxOpen);
+    static void CloseFile(NativeFile file);
+    static bool DropFromCache(const std::string& path);
+    bool IsValid(NativeFile file);
+    bool ReadBlocking(NativeFile file, uint64_t offset, uint64_t size, void *destination);
+    void Complete(IORequest& request, bool success);
+
+    void WorkerLoop();
+
+#ifndef _WIN32
+    struct Ring;
+    bool CreateRing();
+    void RingLoop();
+
+    Ring *_uring = nullptr;
+#else
+    void *_uring = nullptr;
+#endif
+
+    uint32_t _depth;
+    std::vector<std::thread> _threads;
+    std::mutex _lock;
+    std::condition_variable _wakeUp;
+    std::condition_variable _idle;
+    bool _running = true;
+    std::deque<IORequest> _pending;
+
+    struct OpenedFile
+    {
+        NativeFile File;
+        uint32_t Users; // Reads in progress
+        uint64_t LastUse;
+    };
+
+    std::mutex _fileLock;
+    std::unordered_map<std::string, OpenedFile> _files;
+    uint64_t _fileClock = 0;
+
+    uint32_t _inFlight = 0;
+    Stats _stats = {};
+};
@@ -0,0 +1,126 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 17:40:51
+//
+
+#include "job_system.hpp"
+#include "log.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <string>
+
+#undef min
+#undef max
+
+JobSystem::JobData JobSystem::_Data;
+
+void JobSystem::Init(uint32_t workerCount)
+{
+    std::lock_guard<std::mutex> lock(_Data.Lock);
+    if (_Data.Running) {
+        return;
+    }
+    if (workerCount == 0) {
+        uint32_t cores = std::thread::hardware_concurrency();
+        workerCount = cores > 1 ? cores - 1 : 0;
+    }
+    workerCount = std::min(workerCount, uint32_t(JOB_MAX_WORKERS));
+
+    _Data.Running = true;
+    for (uint32_t i = 0; i < workerCount; i++) {
+        _Data.Threads.emplace_back(&JobSystem::WorkerLoop, i);
+    }
+    Logger::Info("[JOBS] Started %u workers", workerCount);
+}
+
+void JobSystem::Exit()
+{
+    {
+        std::lock_guard<std::mutex> lock(_Data.Lock);
+        if (!_Data.Running) {
+            return;
+        }
+        _Data.Running = false;
+    }
+    _Data.WakeUp.notify_all();
+    for (std::thread& thread : _Data.Threads) {
+        thread.join();
+    }
+    _Data.Threads.clear();
+}
+
+void JobSystem::ParallelFor(uint32_t count, const std::function<void(uint32_t)>& job)
+{
+    if (count == 0) {
+        return;
+    }
+    std::unique_lock<std::mutex> busy(_Data.Busy, std::defer_lock);
+    if (count == 1 || _Data.Threads.empty() || !busy.try_lock()) {
+        for (uint32_t i = 0; i < count; i++) {
+            job(i);
+        }
+        return;
+    }
+
+    uint32_t generation;
+    {
+        std::lock_guard<std::mutex> lock(_Data.Lock);
+        generation = ++_Data.Generation;
+        _Data.Count = count;
+        _Data.Job = &job;
+        _Data.Remaining.store(count);
+        _Data.Next.store(uint64_t(generation) << 32);
+    }
+    _Data.WakeUp.notify_all();
+
+    RunJobs(generation, count, &job);
+
+    // Jobs taken by the workers may still be running
+    std::unique_lock<std::mutex> lock(_Data.Lock);
+    _Data.Done.wait(lock, []() { return _Data.Remaining.load() == 0; });
+}
+
+void JobSystem::RunJobs(uint32_t generation, uint32_t count, const std::function<void(uint32_t)> *job)
+{
+    uint64_t next = _Data.Next.load();
+    while (uint32_t(next >> 32) == generation && uint32_t(next) < count) {
+        if (!_Data.Next.compare_exchange_weak(next, next + 1)) {
+            continue;
+        }
+        (*job)(uint32_t(next));
+        if (_Data.Remaining.fetch_sub(1) == 1) {
+            std::lock_guard<std::mutex> lock(_Data.Lock);
+            _Data.Done.notify_all();
+        }
+        next = _Data.Next.load();
+    }
+}
+
+void JobSystem::WorkerLoop(uint32_t index)
+{
+    Profiler::SetThreadName("Job Worker " + std::to_string(index));
+
+    uint32_t seen;
+    {
+        std::lock_guard<std::mutex> lock(_Data.Lock);
+        seen = _Data.Generation;
+    }
+
+    while (true) {
+        uint32_t count;
+        const std::function<void(uint32_t)> *job;
+        {
+            std::unique_lock<std::mutex> lock(_Data.Lock);
+            _Data.WakeUp.wait(lock, [&]() { return !_Data.Running || _Data.Generation != seen; });
+            if (!_Data.Running) {
+                return;
+            }
+            seen = _Data.Generation;
+            count = _Data.Count;
+            job = _Data.Job;
+        }
+        RunJobs(seen, count, job);
+    }
+}
@@ -0,0 +1,58 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 17:32:14
+//
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define JOB_MAX_WORKERS 15
+
+// Pool of worker threads for work a thread splits up and waits on, like recording command buffers or copying texture
+// rows. The calling thread takes jobs as well instead of sleeping. Only one ParallelFor uses the workers at a time: a
+// call made while another one runs, from a job included, runs its jobs inline on the calling thread.
+class JobSystem
+{
+public:
+    // No count starts one worker per core, minus the frame thread
+    static void Init(uint32_t workerCount = 0);
+    static void Exit();
+
+    static uint32_t GetWorkerCount() { return uint32_t(_Data.Threads.size()); }
+    // Workers and the calling thread
+    static uint32_t GetThreadCount() { return GetWorkerCount() + 1; }
+
+    // Calls job(i) for every i below count, spread over the workers, and returns once they all ran
+    static void ParallelFor(uint32_t count, const std::function<void(uint32_t)>& job);
+private:
+    static void WorkerLoop(uint32_t index);
+    // Runs jobs of the given generation until there are none left to take
+    static void RunJobs(uint32_t generation, uint32_t count, const std::function<void(uint32_t)> *job);
+
+    struct JobData
+    {
+        std::vector<std::thread> Threads;
+        std::mutex Busy; // Held by the ParallelFor using the workers
+        std::mutex Lock;
+        std::condition_variable WakeUp;
+        std::condition_variable Done;
+        bool Running = false;
+
+        // Generation in the high half, next job to take in the low half, so that a worker late for one ParallelFor
+        // can't take a job of the next one
+        std::atomic<uint64_t> Next = 0;
+        std::atomic<uint32_t> Remaining = 0;
+        uint32_t Generation = 0;
+        uint32_t Count = 0;
+        const std::function<void(uint32_t)> *Job = nullptr;
+    };
+    static JobData _Data;
+};
@@ -5,13 +5,13 @@
 
 #include "log.hpp"
 
-#include <ImGui/imgui.h>
-
+#include <algorithm>
 #include <exception>
-#include <sstream>
-#include <iomanip>
+#include <stdexcept>
+#include <chrono>
 #include <ctime>
-#include <iostream>
+#include <cstdio>
+#include <cstdlib>
 #include <cstdarg>
 
 Logger::LoggerData Logger::_Data;
@@ -22,10 +22,31 @@ void Logger::Init()
     if (!_Data.LogFile.is_open()) {
         throw std::runtime_error("Failed to create log file!");
     }
+
+    _Data.Running = true;
+    _Data.FlushThread = std::thread(&Logger::FlushLoop);
+
+    // Tools return from main without calling Exit, the thread still has to be joined and the queue written
+    static bool registered = false;
+    if (!registered) {
+        std::atexit(&Logger::Exit);
+        registered = true;
+    }
 }
 
 void Logger::Exit()
 {
+    if (_Data.Running.exchange(false)) {
+        {
+            std::lock_guard<std::mutex> lock(_Data.WakeLock);
+        }
+        _Data.WakeUp.notify_one();
+        _Data.FlushThread.join();
+    }
+
+    // Whatever was pushed while the thread was stopping
+    Drain();
+    _Data.Flushed.notify_all();
     if (_Data.LogFile.is_open()) {
         _Data.LogFile.close();
     }
@@ -33,102 +54,159 @@ void Logger::Exit()
 
 void Logger::Info(const char *fmt, ...)
 {
-    std::stringstream ss;
-    auto t = std::time(nullptr);
-    auto tm = *std::localtime(&t);
-    char buf[4096];
     va_list vl;
-    
     va_start(vl, fmt);
-    vsnprintf(buf, sizeof(buf), fmt, vl);
+    Log(LogLevel::Info, fmt, vl);
     va_end(vl);
-    ss << std::put_time(&tm, "[%d-%m-%Y %H:%M:%S] ");
-    ss << "[INFO] ";
-    ss << buf << std::endl;
-    std::cout << "\033[32m";
-    std::cout << ss.str();
-    std::cout << "\033[39m";
-    _Data.LogFile << ss.str();
-
-    _Data.LogRecord.push_back({ ss.str(), LogLevel::Info });
 }
 
 void Logger::Warn(const char *fmt, ...)
 {
-    std::stringstream ss;
-    auto t = std::time(nullptr);
-    auto tm = *std::localtime(&t);
-    char buf[4096];
     va_list vl;
-    
     va_start(vl, fmt);
-    vsnprintf(buf, sizeof(buf), fmt, vl);
+    Log(LogLevel::Warn, fmt, vl);
     va_end(vl);
-    ss << std::put_time(&tm, "[%d-%m-%Y %H:%M:%S] ");
-    ss << "[WARN] ";
-    ss << buf << std::endl;
-    std::cout << "\033[33m";
-    std::cout << ss.str();
-    std::cout << "\033[39m";
-    _Data.LogFile << ss.str();
-
-    _Data.LogRecord.push_back({ ss.str(), LogLevel::Warn });
 }
 
 void Logger::Error(const char *fmt, ...)
 {
-    std::stringstream ss;
-    auto t = std::time(nullptr);
-    auto tm = *std::localtime(&t);
-    char buf[4096];
     va_list vl;
-    
     va_start(vl, fmt);
-    vsnprintf(buf, sizeof(buf), fmt, vl);
+    Log(LogLevel::Error, fmt, vl);
     va_end(vl);
-    ss << std::put_time(&tm, "[%d-%m-%Y %H:%M:%S] ");
-    ss << "[ERROR] ";
-    ss << buf << std::endl;
-    std::cout << "\033[31m";
-    std::cout << ss.str();
-    std::cout << "\033[39m";
-    _Data.LogFile << ss.str();
-
-    _Data.LogRecord.push_back({ ss.str(), LogLevel::Error });
 }
 
-void Logger::OnUI()
+void Logger::SetLevelEnabled(LogLevel level, bool enabled)
 {
-    if (_Data.LogRecord.size() > 1000) {
-        _Data.LogRecord.erase(_Data.LogRecord.begin());
+    if (enabled) {
+        _Data.EnabledLevels.fetch_or(1u << uint32_t(level), std::memory_order_relaxed);
+    } else {
+        _Data.EnabledLevels.fetch_and(~(1u << uint32_t(level)), std::memory_order_relaxed);
     }
+}
+
+bool Logger::IsLevelEnabled(LogLevel level)
+{
+    return _Data.EnabledLevels.load(std::memory_order_relaxed) & (1u << uint32_t(level));
+}
 
-    ImGui::Begin("Log");
-    if (ImGui::Button("Clear")) {
-        _Data.LogRecord.clear();
+void Logger::Log(LogLevel level, const char *fmt, va_list args)
+{
+    if (!IsLevelEnabled(level)) {
+        return;
     }
-    ImGui::Separator();
-
-    if (ImGui::BeginChild("scrolling", ImVec2(0, 0), ImGuiChildFlags_None, ImGuiWindowFlags_HorizontalScrollbar)) {
-        for (auto& text : _Data.LogRecord) {
-            switch (text.second) {
-                case LogLevel::Info:
-                    ImGui::TextColored(ImVec4(0.0f, 1.0f, 0.0f, 1.0f), text.first.c_str());
-                    break;
-                case LogLevel::Warn:
-                    ImGui::TextColored(ImVec4(1.0f, 1.0f, 0.0f, 1.0f), text.first.c_str());
-                    break;
-                case LogLevel::Error:
-                    ImGui::TextColored(ImVec4(1.0f, 0.0f, 0.0f, 1.0f), text.first.c_str());
-                    break;
-            }
+    int64_t time = std::chrono::system_clock::now().time_since_epoch().count();
+
+    // The arguments are formatted here, pointers passed for %s don't outlive the call. The rest waits for the flush thread.
+    auto write = [&](Message& message) {
+        message.Level = level;
+        message.Time = time;
+        int length = vsnprintf(message.Text, sizeof(message.Text), fmt, args);
+        message.Length = length < 0 ? 0 : std::min(uint32_t(length), uint32_t(sizeof(message.Text) - 1));
+    };
+    while (!_Data.Queue.Push(write)) {
+        if (_Data.Running) {
+            _Data.WakeUp.notify_one();
+            std::this_thread::yield();
+        } else {
+            Drain();
         }
-        
-        if (ImGui::GetScrollY() >= ImGui::GetScrollMaxY())
-            ImGui::SetScrollHereY(1.0f);
-        
-        ImGui::EndChild();
     }
+    _Data.Pushed.fetch_add(1, std::memory_order_relaxed);
+
+    // Before Init and after Exit, messages are written right away
+    if (!_Data.Running) {
+        Drain();
+        return;
+    }
+    // Errors go out as soon as possible, in case they're followed by a crash
+    if (level == LogLevel::Error || _Data.Queue.Size() > LOG_QUEUE_CAPACITY / 2) {
+        _Data.WakeUp.notify_one();
+    }
+}
+
+void Logger::Drain()
+{
+    static const char *levelNames[] = { "[INFO] ", "[WARN] ", "[ERROR] ", "" };
+    static const char *levelColors[] = { "\033[32m", "\033[33m", "\033[31m", "\033[39m" };
+
+    std::lock_guard<std::mutex> lock(_Data.FlushLock);
+
+    // The date only changes once a second, so it's only formatted then
+    static std::time_t lastSecond = -1;
+    static char date[32] = {};
+    static std::string line;
+
+    uint64_t count = 0;
+    while (_Data.Queue.Pop([&](Message& message) {
+        std::chrono::system_clock::time_point time{ std::chrono::system_clock::duration(message.Time) };
+        std::time_t second = std::chrono::system_clock::to_time_t(time);
+        if (second != lastSecond) {
+            std::tm tm = *std::localtime(&second);
+            std::strftime(date, sizeof(date), "[%d-%m-%Y %H:%M:%S] ", &tm);
+            lastSecond = second;
+        }
+
+        line.assign(date);
+        line.append(levelNames[uint32_t(message.Level)]);
+        line.append(message.Text, message.Length);
+        line.push_back('\n');
 
-    ImGui::End();
+        fputs(levelColors[uint32_t(message.Level)], stdout);
+        fwrite(line.data(), 1, line.size(), stdout);
+        fputs("\033[39m", stdout);
+        if (_Data.LogFile.is_open()) {
+            _Data.LogFile.write(line.data(), line.size());
+        }
+
+        std::lock_guard<std::mutex> historyLock(_Data.HistoryLock);
+        uint32_t index = (_Data.HistoryStart + _Data.HistoryCount) % LOG_HISTORY_SIZE;
+        if (_Data.HistoryCount == LOG_HISTORY_SIZE) {
+            _Data.HistoryStart = (_Data.HistoryStart + 1) % LOG_HISTORY_SIZE;
+        } else {
+            _Data.HistoryCount++;
+        }
+        _Data.History[index].Text.assign(line.data(), line.size() - 1);
+        _Data.History[index].Level = message.Level;
+    })) {
+        count++;
+    }
+    if (!count) {
+        return;
+    }
+
+    fflush(stdout);
+    if (_Data.LogFile.is_open()) {
+        _Data.LogFile.flush();
+    }
+    {
+        std::lock_guard<std::mutex> wakeLock(_Data.WakeLock);
+        _Data.Written += count;
+    }
+    _Data.Flushed.notify_all();
+}
+
+void Logger::Flush()
+{
+    if (!_Data.Running) {
+        Drain();
+        return;
+    }
+
+    uint64_t target = _Data.Pushed.load();
+    _Data.WakeUp.notify_one();
+    std::unique_lock<std::mutex> lock(_Data.WakeLock);
+    _Data.Flushed.wait(lock, [target]() { return _Data.Written >= target || !_Data.Running; });
+}
+
+void Logger::FlushLoop()
+{
+    while (_Data.Running) {
+        {
+            // Producers only wake the thread up for errors and when the queue fills up, everything else waits for the timeout
+            std::unique_lock<std::mutex> lock(_Data.WakeLock);
+            _Data.WakeUp.wait_for(lock, std::chrono::milliseconds(LOG_FLUSH_INTERVAL));
+        }
+        Drain();
+    }
 }
@@ -9,30 +9,93 @@
 #include <fstream>
 #include <vector>
 #include <utility>
+#include <mutex>
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstdarg>
+#include <cstdint>
+#include <string>
+#include <thread>
 
+#include "mpsc_queue.hpp"
+
+// Messages longer than this are truncated
+#define LOG_MESSAGE_SIZE 1024
+// Messages waiting for the flush thread. Callers wait for room when it's full rather than losing anything.
+#define LOG_QUEUE_CAPACITY 1024
+// Lines kept for the log window
+#define LOG_HISTORY_SIZE 1024
+// How long the flush thread sleeps when nothing wakes it up
+#define LOG_FLUSH_INTERVAL 10
+
+// Info/Warn/Error can be called from any thread. They only format the message into a lock-free queue; timestamps, colours,
+// stdout, log.txt and the window history are handled by a background thread.
 class Logger
 {
 public:
+    enum class LogLevel
+    {
+        Info,
+        Warn,
+        Error,
+        Other
+    };
+
     static void Init();
     static void Exit();
     static void Info(const char *fmt, ...);
     static void Warn(const char *fmt, ...);
     static void Error(const char *fmt, ...);
 
+    // Filtered messages are dropped before being formatted
+    static void SetLevelEnabled(LogLevel level, bool enabled);
+    static bool IsLevelEnabled(LogLevel level);
+
+    // Waits until everything logged so far is written
+    static void Flush();
+
+    // Lives in log_ui.cpp so that tools can link the logger without ImGui
     static void OnUI();
 private:
-    enum class LogLevel
+    struct Message
     {
-        Info,
-        Warn,
-        Error,
-        Other
+        LogLevel Level;
+        uint32_t Length;
+        int64_t Time; // System clock ticks, turned into a date by the flush thread
+        char Text[LOG_MESSAGE_SIZE];
     };
 
+    struct HistoryLine
+    {
+        std::string Text;
+        LogLevel Level;
+    };
+
+    static void Log(LogLevel level, const char *fmt, va_list args);
+    static void Drain();
+    static void FlushLoop();
+
     struct LoggerData
     {
+        MPSCQueue<Message, LOG_QUEUE_CAPACITY> Queue;
+        std::atomic<uint32_t> EnabledLevels = ~0u;
+        std::atomic<uint64_t> Pushed = 0;
+        std::atomic<uint64_t> Written = 0;
+
+        std::thread FlushThread;
+        std::mutex FlushLock; // Held by whoever is draining, there's only one consumer
+        std::mutex WakeLock;
+        std::condition_variable WakeUp;
+        std::condition_variable Flushed;
+        std::atomic<bool> Running = false;
         std::ofstream LogFile;
-        std::vector<std::pair<std::string, LogLevel>> LogRecord;
+
+        // Fixed ring for the window, written by the flush thread
+        std::mutex HistoryLock;
+        std::array<HistoryLine, LOG_HISTORY_SIZE> History;
+        uint32_t HistoryStart = 0;
+        uint32_t HistoryCount = 0;
     };
     static LoggerData _Data;
 };
@@ -0,0 +1,56 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-12 11:20:42
+//
+
+#include "log.hpp"
+
+#include <ImGui/imgui.h>
+
+void Logger::OnUI()
+{
+    ImGui::Begin("Log");
+
+    static const char *levelNames[] = { "Info", "Warn", "Error" };
+    for (uint32_t i = 0; i < 3; i++) {
+        bool enabled = IsLevelEnabled(LogLevel(i));
+        if (ImGui::Checkbox(levelNames[i], &enabled)) {
+            SetLevelEnabled(LogLevel(i), enabled);
+        }
+        ImGui::SameLine();
+    }
+
+    std::lock_guard<std::mutex> lock(_Data.HistoryLock);
+    if (ImGui::Button("Clear")) {
+        _Data.HistoryStart = 0;
+        _Data.HistoryCount = 0;
+    }
+    ImGui::Separator();
+
+    if (ImGui::BeginChild("scrolling", ImVec2(0, 0), ImGuiChildFlags_None, ImGuiWindowFlags_HorizontalScrollbar)) {
+        for (uint32_t i = 0; i < _Data.HistoryCount; i++) {
+            HistoryLine& line = _Data.History[(_Data.HistoryStart + i) % LOG_HISTORY_SIZE];
+            switch (line.Level) {
+                case LogLevel::Info:
+                    ImGui::TextColored(ImVec4(0.0f, 1.0f, 0.0f, 1.0f), "%s", line.Text.c_str());
+                    break;
+                case LogLevel::Warn:
+                    ImGui::TextColored(ImVec4(1.0f, 1.0f, 0.0f, 1.0f), "%s", line.Text.c_str());
+                    break;
+                case LogLevel::Error:
+                    ImGui::TextColored(ImVec4(1.0f, 0.0f, 0.0f, 1.0f), "%s", line.Text.c_str());
+                    break;
+                default:
+                    break;
+            }
+        }
+        
+        if (ImGui::GetScrollY() >= ImGui::GetScrollMaxY())
+            ImGui::SetScrollHereY(1.0f);
+        
+        ImGui::EndChild();
+    }
+
+    ImGui::End();
+}
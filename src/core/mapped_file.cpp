@@ -0,0 +1,118 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-15 09:26:03
+//
+
+#include "mapped_file.hpp"
+#include "log.hpp"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& path, Access access)
+{
+#ifdef _WIN32
+    DWORD flags = FILE_ATTRIBUTE_NORMAL | (access == Access::Sequential ? FILE_FLAG_SEQUENTIAL_SCAN : FILE_FLAG_RANDOM_ACCESS);
+    _file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, flags, nullptr);
+    if (_file == INVALID_HANDLE_VALUE) {
+        return;
+    }
+
+    LARGE_INTEGER size;
+    GetFileSizeEx(_file, &size);
+    _size = size.QuadPart;
+    if (!_size) {
+        _open = true;
+        return;
+    }
+
+    _mapping = CreateFileMappingA(_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!_mapping) {
+        Logger::Error("[FILE] Failed to create file mapping for %s", path.c_str());
+        return;
+    }
+    _view = MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+    if (!_view) {
+        Logger::Error("[FILE] Failed to map view of %s", path.c_str());
+        return;
+    }
+#else
+    _file = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (_file < 0) {
+        return;
+    }
+
+    struct stat statistics;
+    if (fstat(_file, &statistics) < 0) {
+        return;
+    }
+    _size = statistics.st_size;
+    if (!_size) {
+        _open = true;
+        return;
+    }
+
+    void *view = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _file, 0);
+    if (view == MAP_FAILED) {
+        Logger::Error("[FILE] Failed to map %s", path.c_str());
+        return;
+    }
+    _view = view;
+    madvise(_view, _size, access == Access::Sequential ? MADV_SEQUENTIAL : MADV_RANDOM);
+#endif
+    _open = true;
+}
+
+MappedFile::~MappedFile()
+{
+#ifdef _WIN32
+    if (_view) {
+        UnmapViewOfFile(_view);
+    }
+    if (_mapping) {
+        CloseHandle(_mapping);
+    }
+    if (_file != INVALID_HANDLE_VALUE) {
+        CloseHandle(_file);
+    }
+#else
+    if (_view) {
+        munmap(_view, _size);
+    }
+    if (_file >= 0) {
+        close(_file);
+    }
+#endif
+}
+
+void MappedFile::Prefetch(const void *address, uint64_t size)
+{
+    if (!address || !size) {
+        return;
+    }
+
+#ifdef _WIN32
+    WIN32_MEMORY_RANGE_ENTRY range;
+    range.VirtualAddress = const_cast<void*>(address);
+    range.NumberOfBytes = size;
+    PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+    // madvise wants a page aligned start
+    uintptr_t pageSize = uintptr_t(sysconf(_SC_PAGESIZE));
+    uintptr_t start = reinterpret_cast<uintptr_t>(address) & ~(pageSize - 1);
+    uintptr_t end = reinterpret_cast<uintptr_t>(address) + size;
+    madvise(reinterpret_cast<void*>(start), end - start, MADV_WILLNEED);
+#endif
+}
+
+void FileView::Reset()
+{
+    _data = nullptr;
+    _size = 0;
+    _owner.reset();
+}
@@ -0,0 +1,74 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-15 09:12:40
+//
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+// Read-only mapping of a whole file, unmapped and closed when destroyed. Empty files open fine but have no data.
+class MappedFile
+{
+public:
+    using Ptr = std::shared_ptr<MappedFile>;
+
+    // Passed to the OS as a read-ahead hint
+    enum class Access
+    {
+        Sequential,
+        Random
+    };
+
+    MappedFile(const std::string& path, Access access = Access::Sequential);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile();
+
+    bool IsOpen() { return _open; }
+    const uint8_t *GetData() { return reinterpret_cast<const uint8_t*>(_view); }
+    uint64_t GetSize() { return _size; }
+
+    // Starts paging the range in without waiting for it
+    static void Prefetch(const void *address, uint64_t size);
+private:
+#ifdef _WIN32
+    HANDLE _file = INVALID_HANDLE_VALUE;
+    HANDLE _mapping = nullptr;
+#else
+    int _file = -1;
+#endif
+    void *_view = nullptr;
+    uint64_t _size = 0;
+    bool _open = false;
+};
+
+// Bytes of a file wherever they live (the mounted pak, a mapping of the loose file), without copying them. The view keeps
+// what backs it alive, so the pointer stays valid for as long as a copy of the view exists.
+class FileView
+{
+public:
+    FileView() = default;
+    FileView(const uint8_t *data, uint64_t size, std::shared_ptr<void> owner)
+        : _data(data), _size(size), _owner(std::move(owner))
+    {
+    }
+
+    bool IsValid() { return _owner != nullptr; }
+    const uint8_t *GetData() { return _data; }
+    uint64_t GetSize() { return _size; }
+
+    void Prefetch() { MappedFile::Prefetch(_data, _size); }
+    void Reset();
+private:
+    const uint8_t *_data = nullptr;
+    uint64_t _size = 0;
+    std::shared_ptr<void> _owner;
+};
@@ -0,0 +1,358 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-12 15:02:10
+//
+
+#include "mesh_cooker.hpp"
+
+#include "core/log.hpp"
+#include "core/util.hpp"
+#include "core/file_system.hpp"
+#include "profiler.hpp"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <cfloat>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+
+#undef min
+#undef max
+
+bool MeshData::Build(cgltf_primitive *primitive)
+{
+    if (primitive->type != cgltf_primitive_type_triangles) {
+        Logger::Warn("[CGLTF] GLTF primitive isn't a triangle list, discarding.");
+        return false;
+    }
+
+    // Get attributes
+    cgltf_attribute* pos_attribute = nullptr;
+    cgltf_attribute* uv_attribute = nullptr;
+    cgltf_attribute* norm_attribute = nullptr;
+
+    for (int i = 0; i < primitive->attributes_count; i++) {
+        if (!strcmp(primitive->attributes[i].name, "POSITION")) {
+            pos_attribute = &primitive->attributes[i];
+        }
+        if (!strcmp(primitive->attributes[i].name, "TEXCOORD_0")) {
+            uv_attribute = &primitive->attributes[i];
+        }
+        if (!strcmp(primitive->attributes[i].name, "NORMAL")) {
+            norm_attribute = &primitive->attributes[i];
+        }
+    }
+    if (!pos_attribute || !uv_attribute || !norm_attribute) {
+        Logger::Warn("[CGLTF] Didn't find all GLTF attributes, discarding.");
+        return false;
+    }
+
+    // Load vertices
+    int vertexCount = pos_attribute->data->count;
+    int indexCount = primitive->indices->count;
+
+    Vertices.clear();
+    Indices.clear();
+
+    for (int i = 0; i < vertexCount; i++) {
+        Vertex vertex;
+
+        if (!cgltf_accessor_read_float(pos_attribute->data, i, glm::value_ptr(vertex.Position), 4)) {
+            Logger::Warn("[CGLTF] Failed to read all position attributes!");
+        }
+        if (!cgltf_accessor_read_float(uv_attribute->data, i, glm::value_ptr(vertex.UV), 4)) {
+            Logger::Warn("[CGLTF] Failed to read all UV attributes!");
+        }
+        if (!cgltf_accessor_read_float(norm_attribute->data, i, glm::value_ptr(vertex.Normals), 4)) {
+            Logger::Warn("[CGLTF] Failed to read all normal attributes!");
+        }
+
+        Vertices.push_back(vertex);
+    }
+
+    for (int i = 0; i < indexCount; i++) {
+        Indices.push_back(cgltf_accessor_read_index(primitive->indices, i));
+    }
+
+    BoundingBox.Min = glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX);
+    BoundingBox.Max = glm::vec3(FLT_MIN, FLT_MIN, FLT_MIN);
+
+    for (uint32_t j = 0; j < Vertices.size(); ++j) {
+        BoundingBox.Min = glm::min(BoundingBox.Min, Vertices[j].Position);
+        BoundingBox.Max = glm::max(BoundingBox.Max, Vertices[j].Position);
+    }
+
+    BoundingBox.Center = (BoundingBox.Min + BoundingBox.Max) / glm::vec3(2);
+    BoundingBox.Extent = (BoundingBox.Max - BoundingBox.Min);
+
+    // Generate meshlets
+    std::vector<uint8_t> meshletTriangles = {};
+
+    const size_t kMaxTriangles = MAX_MESHLET_TRIANGLES;
+    const size_t kMaxVertices = MAX_MESHLET_VERTICES;
+    const float kConeWeight = 0.0f;
+
+    size_t maxMeshlets = meshopt_buildMeshletsBound(Indices.size(), kMaxVertices, kMaxTriangles);
+
+    Meshlets.resize(maxMeshlets);
+    MeshletVertices.resize(maxMeshlets * kMaxVertices);
+    meshletTriangles.resize(maxMeshlets * kMaxTriangles * 3);
+
+    size_t meshletCount = meshopt_buildMeshlets(
+            Meshlets.data(),
+            MeshletVertices.data(),
+            meshletTriangles.data(),
+            reinterpret_cast<const uint32_t*>(Indices.data()),
+            Indices.size(),
+            reinterpret_cast<const float*>(Vertices.data()),
+            Vertices.size(),
+            sizeof(Vertex),
+            kMaxVertices,
+            kMaxTriangles,
+            kConeWeight);
+
+    const meshopt_Meshlet& last = Meshlets[meshletCount - 1];
+    MeshletVertices.resize(last.vertex_offset + last.vertex_count);
+    meshletTriangles.resize(last.triangle_offset + ((last.triangle_count * 3 + 3) & ~3));
+    Meshlets.resize(meshletCount);
+
+    Bounds.clear();
+    for (auto& m : Meshlets) {
+        meshopt_optimizeMeshlet(&MeshletVertices[m.vertex_offset], &meshletTriangles[m.triangle_offset], m.triangle_count, m.vertex_count);
+
+        // Generate bounds
+        meshopt_Bounds meshopt_bounds = meshopt_computeMeshletBounds(&MeshletVertices[m.vertex_offset], &meshletTriangles[m.triangle_offset],
+                                                                     m.triangle_count, &Vertices[0].Position.x, Vertices.size(), sizeof(Vertex));
+
+        MeshletBounds bounds;
+        memcpy(glm::value_ptr(bounds.center), meshopt_bounds.center, sizeof(float) * 3);
+        memcpy(glm::value_ptr(bounds.cone_apex), meshopt_bounds.cone_apex, sizeof(float) * 3);
+        memcpy(glm::value_ptr(bounds.cone_axis), meshopt_bounds.cone_axis, sizeof(float) * 3);
+
+        bounds.radius = meshopt_bounds.radius;
+        bounds.cone_cutoff = meshopt_bounds.cone_cutoff;
+        Bounds.push_back(bounds);
+    }
+
+    MeshletTriangles.clear();
+    for (auto& val : meshletTriangles) {
+        MeshletTriangles.push_back(static_cast<uint32_t>(val));
+    }
+    return true;
+}
+
+// cgltf only hands the pointer back on release, the views it points into are kept alive here until then
+static std::mutex sOpenFilesLock;
+static std::unordered_multimap<const void*, FileView> sOpenFiles;
+
+static cgltf_result ReadGLTFFile(const cgltf_memory_options *memoryOptions, const cgltf_file_options *fileOptions, const char *path, cgltf_size *size, void **data)
+{
+    FileView view = FileSystem::Map(path);
+    if (!view.IsValid()) {
+        return cgltf_result_file_not_found;
+    }
+    if (!view.GetData()) {
+        return cgltf_result_io_error;
+    }
+    *size = view.GetSize();
+    *data = const_cast<uint8_t*>(view.GetData());
+
+    std::lock_guard<std::mutex> lock(sOpenFilesLock);
+    sOpenFiles.emplace(view.GetData(), view);
+    return cgltf_result_success;
+}
+
+static void ReleaseGLTFFile(const cgltf_memory_options *memoryOptions, const cgltf_file_options *fileOptions, void *data)
+{
+    std::lock_guard<std::mutex> lock(sOpenFilesLock);
+    auto it = sOpenFiles.find(data);
+    if (it != sOpenFiles.end()) {
+        sOpenFiles.erase(it);
+    }
+}
+
+void MeshCooker::SetFileCallbacks(cgltf_options& options)
+{
+    options.file.read = ReadGLTFFile;
+    options.file.release = ReleaseGLTFFile;
+}
+
+static void CountNode(cgltf_node *node, uint32_t& count)
+{
+    if (node->mesh) {
+        count += node->mesh->primitives_count;
+    }
+    for (int i = 0; i < node->children_count; i++) {
+        CountNode(node->children[i], count);
+    }
+}
+
+uint32_t MeshCooker::CountPrimitives(cgltf_data *data)
+{
+    uint32_t count = 0;
+    for (int i = 0; i < data->scene->nodes_count; i++) {
+        CountNode(data->scene->nodes[i], count);
+    }
+    return count;
+}
+
+static void CookNode(cgltf_node *node, std::vector<MeshData>& meshes)
+{
+    if (node->mesh) {
+        for (int i = 0; i < node->mesh->primitives_count; i++) {
+            MeshData mesh;
+            if (!mesh.Build(&node->mesh->primitives[i])) {
+                mesh = MeshData();
+            }
+            meshes.push_back(std::move(mesh));
+        }
+    }
+    for (int i = 0; i < node->children_count; i++) {
+        CookNode(node->children[i], meshes);
+    }
+}
+
+template<typename T>
+static void WriteArray(std::ofstream& stream, const std::vector<T>& array)
+{
+    stream.write(reinterpret_cast<const char*>(array.data()), array.size() * sizeof(T));
+}
+
+template<typename T>
+static bool ReadArray(const uint8_t *&cursor, const uint8_t *end, uint32_t count, std::vector<T>& array)
+{
+    if (uint64_t(end - cursor) < uint64_t(count) * sizeof(T)) {
+        return false;
+    }
+    array.resize(count);
+    memcpy(array.data(), cursor, count * sizeof(T));
+    cursor += count * sizeof(T);
+    return true;
+}
+
+bool MeshCooker::Cook(const std::string& path)
+{
+    PROFILE_SCOPE("Cook Mesh");
+
+    cgltf_options options = {};
+    SetFileCallbacks(options);
+    cgltf_data* data = nullptr;
+
+    if (cgltf_parse_file(&options, path.c_str(), &data) != cgltf_result_success) {
+        Logger::Error("[CGLTF] Failed to parse GLTF %s", path.c_str());
+        return false;
+    }
+    if (cgltf_load_buffers(&options, data, path.c_str()) != cgltf_result_success || !data->scene) {
+        Logger::Error("[CGLTF] Failed to load buffers %s", path.c_str());
+        cgltf_free(data);
+        return false;
+    }
+
+    std::vector<MeshData> meshes;
+    for (int i = 0; i < data->scene->nodes_count; i++) {
+        CookNode(data->scene->nodes[i], meshes);
+    }
+    cgltf_free(data);
+
+    std::string cached = GetCachedPath(path);
+    std::ofstream stream(cached, std::ios::binary);
+    if (!stream.is_open()) {
+        Logger::Error("[MESH CACHE] Failed to open %s for writing", cached.c_str());
+        return false;
+    }
+
+    CookedMeshHeader header = {};
+    header.Magic = COOKED_MESH_MAGIC;
+    header.Version = COOKED_MESH_VERSION;
+    header.PrimitiveCount = uint32_t(meshes.size());
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+    for (auto& mesh : meshes) {
+        uint32_t counts[] = {
+            uint32_t(mesh.Vertices.size()),
+            uint32_t(mesh.Indices.size()),
+            uint32_t(mesh.Meshlets.size()),
+            uint32_t(mesh.MeshletVertices.size()),
+            uint32_t(mesh.MeshletTriangles.size()),
+            uint32_t(mesh.Bounds.size())
+        };
+        stream.write(reinterpret_cast<const char*>(counts), sizeof(counts));
+        stream.write(reinterpret_cast<const char*>(&mesh.BoundingBox), sizeof(AABB));
+
+        WriteArray(stream, mesh.Vertices);
+        WriteArray(stream, mesh.Indices);
+        WriteArray(stream, mesh.Meshlets);
+        WriteArray(stream, mesh.MeshletVertices);
+        WriteArray(stream, mesh.MeshletTriangles);
+        WriteArray(stream, mesh.Bounds);
+    }
+    stream.close();
+    FileSystem::ShadowPak(cached);
+
+    Logger::Info("[MESH CACHE] Cooked %u primitives of %s to %s", header.PrimitiveCount, path.c_str(), cached.c_str());
+    return true;
+}
+
+bool MeshCooker::Read(const std::string& cachedPath, std::vector<MeshData>& meshes)
+{
+    FileView view = FileSystem::Map(cachedPath);
+    if (!view.IsValid()) {
+        return false;
+    }
+    return Parse(view.GetData(), view.GetSize(), meshes);
+}
+
+bool MeshCooker::Parse(const uint8_t *contents, uint64_t contentSize, std::vector<MeshData>& meshes)
+{
+    PROFILE_SCOPE("Parse Cooked Mesh");
+
+    const uint8_t *cursor = contents;
+    const uint8_t *end = contents + contentSize;
+
+    CookedMeshHeader header;
+    if (contentSize < sizeof(header)) {
+        return false;
+    }
+    memcpy(&header, cursor, sizeof(header));
+    cursor += sizeof(header);
+    if (header.Magic != COOKED_MESH_MAGIC || header.Version != COOKED_MESH_VERSION) {
+        return false;
+    }
+
+    meshes.resize(header.PrimitiveCount);
+    for (auto& mesh : meshes) {
+        uint32_t counts[6];
+        if (uint64_t(end - cursor) < sizeof(counts) + sizeof(AABB)) {
+            return false;
+        }
+        memcpy(counts, cursor, sizeof(counts));
+        cursor += sizeof(counts);
+        memcpy(&mesh.BoundingBox, cursor, sizeof(AABB));
+        cursor += sizeof(AABB);
+
+        if (!ReadArray(cursor, end, counts[0], mesh.Vertices) ||
+            !ReadArray(cursor, end, counts[1], mesh.Indices) ||
+            !ReadArray(cursor, end, counts[2], mesh.Meshlets) ||
+            !ReadArray(cursor, end, counts[3], mesh.MeshletVertices) ||
+            !ReadArray(cursor, end, counts[4], mesh.MeshletTriangles) ||
+            !ReadArray(cursor, end, counts[5], mesh.Bounds)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::string MeshCooker::GetCachedPath(const std::string& path)
+{
+    std::stringstream path_ss;
+
+    const char *key = path.c_str();
+    uint64_t hash = util::hash(key, path.length(), 1000);
+    path_ss << ".cache/meshes/" << hash << ".oni";
+
+    return path_ss.str();
+}
@@ -0,0 +1,89 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-12 14:47:31
+//
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <cgltf/cgltf.h>
+#include <meshopt/meshoptimizer.h>
+
+#define MAX_MESHLET_TRIANGLES 124
+#define MAX_MESHLET_VERTICES 64
+
+#define COOKED_MESH_MAGIC 0x48534D4F // 'OMSH'
+#define COOKED_MESH_VERSION 1
+
+struct AABB
+{
+    glm::vec3 Min;
+    glm::vec3 Max;
+
+    glm::vec3 Center;
+    glm::vec3 Extent;
+};
+
+struct Vertex
+{
+    glm::vec3 Position;
+    glm::vec2 UV;
+    glm::vec3 Normals;
+};
+
+struct MeshletBounds
+{
+    /* bounding sphere, useful for frustum and occlusion culling */
+	glm::vec3 center;
+	float radius;
+
+	/* normal cone, useful for backface culling */
+	glm::vec3 cone_apex;
+	glm::vec3 cone_axis;
+	float cone_cutoff; /* = cos(angle/2) */
+};
+
+// CPU side of a primitive, ready to be uploaded
+struct MeshData
+{
+    std::vector<Vertex> Vertices;
+    std::vector<uint32_t> Indices;
+    std::vector<meshopt_Meshlet> Meshlets;
+    std::vector<uint32_t> MeshletVertices;
+    std::vector<uint32_t> MeshletTriangles; // One uint32_t per index, which is what the mesh shaders read
+    std::vector<MeshletBounds> Bounds;
+    AABB BoundingBox;
+
+    // Reads the attributes and builds the meshlets. Returns false for primitives the renderer can't draw.
+    bool Build(cgltf_primitive *primitive);
+};
+
+struct CookedMeshHeader
+{
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t PrimitiveCount;
+    uint32_t Pad;
+};
+
+// Cooked meshes hold the MeshData of every primitive of a glTF, in the order Model visits them (scene nodes depth first).
+// Primitives that can't be drawn are kept as empty entries so that the order still matches.
+class MeshCooker
+{
+public:
+    static bool Cook(const std::string& path);
+    static bool Read(const std::string& cachedPath, std::vector<MeshData>& meshes);
+    // Same, out of a cooked file already in memory
+    static bool Parse(const uint8_t *contents, uint64_t contentSize, std::vector<MeshData>& meshes);
+
+    // glTF and buffer files go through FileSystem::Map, so they come out of the pak when there is one and are never copied
+    static void SetFileCallbacks(cgltf_options& options);
+
+    static uint32_t CountPrimitives(cgltf_data *data);
+    static std::string GetCachedPath(const std::string& path);
+};
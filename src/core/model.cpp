@@ -8,171 +8,101 @@
 #include "core/bitmap.hpp"
 #include "core/log.hpp"
 #include "core/texture_compressor.hpp"
+#include "core/texture_file.hpp"
+#include "core/texture_streamer.hpp"
+#include "core/file_system.hpp"
+#include "core/io_queue.hpp"
+#include "core/profiler.hpp"
 
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
-#include <meshopt/meshoptimizer.h>
-
 #undef min
 #undef max
 
-void Model::ProcessPrimitive(RenderContext::Ptr context, cgltf_primitive *primitive, Transform transform, std::string name)
+Texture::Ptr Model::LoadTexture(RenderContext::Ptr context, Uploader& uploader, std::string texturePath)
 {
-    // Start
-    if (primitive->type != cgltf_primitive_type_triangles) {
-        Logger::Warn("[CGLTF] GLTF primitive isn't a triangle list, discarding.");
-        return;
+    std::replace(texturePath.begin(), texturePath.end(), '\\', '/');
+    if (TextureCache.count(texturePath) != 0) {
+        return TextureCache[texturePath];
     }
 
-    Primitive out;
-    out.Transform = transform;
-    if (name.empty()) {
-        out.Name = "GLTF Node";
-    } else {
-        out.Name = name;
-    }
-
-    // Get attributes
-    cgltf_attribute* pos_attribute = nullptr;
-    cgltf_attribute* uv_attribute = nullptr;
-    cgltf_attribute* norm_attribute = nullptr;
-
-    for (int i = 0; i < primitive->attributes_count; i++) {
-        if (!strcmp(primitive->attributes[i].name, "POSITION")) {
-            pos_attribute = &primitive->attributes[i];
-        }
-        if (!strcmp(primitive->attributes[i].name, "TEXCOORD_0")) {
-            uv_attribute = &primitive->attributes[i];
+    std::vector<uint8_t> contents;
+    auto preloaded = _preloaded.find(texturePath);
+    if (preloaded != _preloaded.end()) {
+        if (preloaded->second.Ready.get()) {
+            contents = std::move(preloaded->second.Contents);
         }
-        if (!strcmp(primitive->attributes[i].name, "NORMAL")) {
-            norm_attribute = &primitive->attributes[i];
-        }
-    }
-    if (!pos_attribute || !uv_attribute || !norm_attribute) {
-        Logger::Warn("[CGLTF] Didn't find all GLTF attributes, discarding.");
-        return;
+        _preloaded.erase(preloaded);
     }
 
-    // Load vertices
-    int vertexCount = pos_attribute->data->count;
-    int indexCount = primitive->indices->count;
-
-    std::vector<Vertex> vertices = {};
-    std::vector<uint32_t> indices = {};
-
-    for (int i = 0; i < vertexCount; i++) {
-        Vertex vertex;
-
-        if (!cgltf_accessor_read_float(pos_attribute->data, i, glm::value_ptr(vertex.Position), 4)) {
-            Logger::Warn("[CGLTF] Failed to read all position attributes!");
-        }
-        if (!cgltf_accessor_read_float(uv_attribute->data, i, glm::value_ptr(vertex.UV), 4)) {
-            Logger::Warn("[CGLTF] Failed to read all UV attributes!");
-        }
-        if (!cgltf_accessor_read_float(norm_attribute->data, i, glm::value_ptr(vertex.Normals), 4)) {
-            Logger::Warn("[CGLTF] Failed to read all normal attributes!");
+    // The streamer deduplicates across models and only uploads the mip tail with the primitive
+    Texture::Ptr texture;
+    if (TextureStreamer::Get()) {
+        texture = TextureStreamer::Get()->Load(TextureCompressor::GetCachedPath(texturePath), uploader, texturePath, std::move(contents));
+    } else {
+        TextureFile image;
+        if (contents.empty()) {
+            image.Load(TextureCompressor::GetCachedPath(texturePath));
+        } else {
+            image.Load(TextureCompressor::GetCachedPath(texturePath), std::move(contents));
         }
 
-        vertices.push_back(vertex);
-    }
-
-    for (int i = 0; i < indexCount; i++) {
-        indices.push_back(cgltf_accessor_read_index(primitive->indices, i));
-    }
-
-    out.VertexCount = vertices.size();
-    out.IndexCount = indices.size();
-
-    out.BoundingBox.Min = glm::vec3(FLT_MAX, FLT_MAX, FLT_MAX);
-    out.BoundingBox.Max = glm::vec3(FLT_MIN, FLT_MIN, FLT_MIN);
+        texture = context->CreateTexture(image.Width(), image.Height(), image.Format(), TextureUsage::ShaderResource, true, texturePath);
+        texture->BuildShaderResource();
 
-    for (uint32_t j = 0; j < vertices.size(); ++j) {
-        out.BoundingBox.Min = glm::min(out.BoundingBox.Min, vertices[j].Position);
-        out.BoundingBox.Max = glm::max(out.BoundingBox.Max, vertices[j].Position);
+        uploader.CopyHostToDeviceCompressedTexture(&image, texture);
     }
+    TextureCache[texturePath] = texture;
+    return texture;
+}
 
-    out.BoundingBox.Center = (out.BoundingBox.Min + out.BoundingBox.Max) / glm::vec3(2);
-    out.BoundingBox.Extent = (out.BoundingBox.Max - out.BoundingBox.Min);
-
-    // Generate meshlets
-    std::vector<meshopt_Meshlet> meshlets = {};
-    std::vector<uint32_t> meshletVertices = {};
-    std::vector<uint8_t> meshletTriangles = {};
-    std::vector<MeshletBounds> meshletBounds = {};
-
-    const size_t kMaxTriangles = MAX_MESHLET_TRIANGLES;
-    const size_t kMaxVertices = MAX_MESHLET_VERTICES;
-    const float kConeWeight = 0.0f;
-
-    size_t maxMeshlets = meshopt_buildMeshletsBound(indices.size(), kMaxVertices, kMaxTriangles);
-
-    meshlets.resize(maxMeshlets);
-    meshletVertices.resize(maxMeshlets * kMaxVertices);
-    meshletTriangles.resize(maxMeshlets * kMaxTriangles * 3);
-
-    size_t meshletCount = meshopt_buildMeshlets(
-            meshlets.data(),
-            meshletVertices.data(),
-            meshletTriangles.data(),
-            reinterpret_cast<const uint32_t*>(indices.data()),
-            indices.size(),
-            reinterpret_cast<const float*>(vertices.data()),
-            vertices.size(),
-            sizeof(Vertex),
-            kMaxVertices,
-            kMaxTriangles,
-            kConeWeight);
-
-    const meshopt_Meshlet& last = meshlets[meshletCount - 1];
-    meshletVertices.resize(last.vertex_offset + last.vertex_count);
-    meshletTriangles.resize(last.triangle_offset + ((last.triangle_count * 3 + 3) & ~3));
-    meshlets.resize(meshletCount);
-
-    for (auto& m : meshlets) {
-        meshopt_optimizeMeshlet(&meshletVertices[m.vertex_offset], &meshletTriangles[m.triangle_offset], m.triangle_count, m.vertex_count);
-    
-        // Generate bounds
-        meshopt_Bounds meshopt_bounds = meshopt_computeMeshletBounds(&meshletVertices[m.vertex_offset], &meshletTriangles[m.triangle_offset],
-                                                                     m.triangle_count, &vertices[0].Position.x, vertices.size(), sizeof(Vertex));
-        
-        MeshletBounds bounds;
-        memcpy(glm::value_ptr(bounds.center), meshopt_bounds.center, sizeof(float) * 3);
-        memcpy(glm::value_ptr(bounds.cone_apex), meshopt_bounds.cone_apex, sizeof(float) * 3);
-        memcpy(glm::value_ptr(bounds.cone_axis), meshopt_bounds.cone_axis, sizeof(float) * 3);
-
-        bounds.radius = meshopt_bounds.radius;
-        bounds.cone_cutoff = meshopt_bounds.cone_cutoff;
-        meshletBounds.push_back(bounds);
+void Model::ProcessPrimitive(RenderContext::Ptr context, cgltf_primitive *primitive, Transform transform, std::string name)
+{
+    // Cooked meshes have an entry for every primitive, empty for the ones that can't be drawn
+    MeshData built;
+    MeshData *mesh = &built;
+    if (!_cookedMeshes.empty()) {
+        mesh = &_cookedMeshes[_nextCookedMesh++];
+        if (mesh->Vertices.empty()) {
+            return;
+        }
+    } else if (!built.Build(primitive)) {
+        return;
     }
 
-    // PUSH
-    std::vector<uint32_t> meshletPrimitives;
-    for (auto& val : meshletTriangles) {
-        meshletPrimitives.push_back(static_cast<uint32_t>(val));
+    Primitive out;
+    out.Transform = transform;
+    if (name.empty()) {
+        out.Name = "GLTF Node";
+    } else {
+        out.Name = name;
     }
 
-    out.MeshletCount = meshlets.size();
+    out.VertexCount = mesh->Vertices.size();
+    out.IndexCount = mesh->Indices.size();
+    out.MeshletCount = mesh->Meshlets.size();
+    out.BoundingBox = mesh->BoundingBox;
 
     // GPU UPLOADING
 
-    out.VertexBuffer = context->CreateBuffer(vertices.size() * sizeof(Vertex), sizeof(Vertex), BufferType::Vertex, false, "Vertex Buffer");
+    out.VertexBuffer = context->CreateBuffer(mesh->Vertices.size() * sizeof(Vertex), sizeof(Vertex), BufferType::Vertex, false, "Vertex Buffer");
     out.VertexBuffer->BuildShaderResource();
 
-    out.IndexBuffer = context->CreateBuffer(indices.size() * sizeof(uint32_t), sizeof(uint32_t), BufferType::Index, false, "Index Buffer");
+    out.IndexBuffer = context->CreateBuffer(mesh->Indices.size() * sizeof(uint32_t), sizeof(uint32_t), BufferType::Index, false, "Index Buffer");
     out.IndexBuffer->BuildShaderResource();
 
-    out.MeshletBuffer = context->CreateBuffer(meshlets.size() * sizeof(meshopt_Meshlet), sizeof(meshopt_Meshlet), BufferType::Storage, false, "Meshlet Buffer");
+    out.MeshletBuffer = context->CreateBuffer(mesh->Meshlets.size() * sizeof(meshopt_Meshlet), sizeof(meshopt_Meshlet), BufferType::Storage, false, "Meshlet Buffer");
     out.MeshletBuffer->BuildShaderResource();
 
-    out.MeshletVertices = context->CreateBuffer(meshletVertices.size() * sizeof(uint32_t), sizeof(uint32_t), BufferType::Storage, false, "Meshlet Vertices");
+    out.MeshletVertices = context->CreateBuffer(mesh->MeshletVertices.size() * sizeof(uint32_t), sizeof(uint32_t), BufferType::Storage, false, "Meshlet Vertices");
     out.MeshletVertices->BuildShaderResource();
 
-    out.MeshletTriangles = context->CreateBuffer(meshletPrimitives.size() * sizeof(uint32_t), sizeof(uint32_t), BufferType::Storage, false, "Meshlet Triangle Buffer");
+    out.MeshletTriangles = context->CreateBuffer(mesh->MeshletTriangles.size() * sizeof(uint32_t), sizeof(uint32_t), BufferType::Storage, false, "Meshlet Triangle Buffer");
     out.MeshletTriangles->BuildShaderResource();
 
-    out.MeshletBounds = context->CreateBuffer(meshletBounds.size() * sizeof(MeshletBounds), sizeof(MeshletBounds), BufferType::Storage, false, "Meshlet Bounds Buffer");
+    out.MeshletBounds = context->CreateBuffer(mesh->Bounds.size() * sizeof(MeshletBounds), sizeof(MeshletBounds), BufferType::Storage, false, "Meshlet Bounds Buffer");
     out.MeshletBounds->BuildShaderResource();
 
     if (context->GetDevice()->GetFeatures().Raytracing) {
@@ -190,23 +120,17 @@ void Model::ProcessPrimitive(RenderContext::Ptr context, cgltf_primitive *primit
     Material meshMaterial = {};
     out.MaterialIndex = Materials.size();
 
-    TextureFile albedoImage = {};
-    TextureFile normalImage = {};
-    TextureFile pbrImage = {};
-    TextureFile emissiveImage = {};
-    TextureFile aoImage = {};
-
     glm::vec3 flatColor(1.0f, 1.0f, 1.0f);
     meshMaterial.FlatColor = glm::vec3(flatColor.r, flatColor.g, flatColor.b);
 
     Uploader uploader = context->CreateUploader();
 
-    uploader.CopyHostToDeviceLocal(vertices.data(), vertices.size() * sizeof(Vertex), out.VertexBuffer);
-    uploader.CopyHostToDeviceLocal(indices.data(), indices.size() * sizeof(uint32_t), out.IndexBuffer);
-    uploader.CopyHostToDeviceLocal(meshlets.data(), meshlets.size() * sizeof(meshopt_Meshlet), out.MeshletBuffer);
-    uploader.CopyHostToDeviceLocal(meshletVertices.data(), meshletVertices.size() * sizeof(uint32_t), out.MeshletVertices);
-    uploader.CopyHostToDeviceLocal(meshletPrimitives.data(), meshletPrimitives.size() * sizeof(uint32_t), out.MeshletTriangles);
-    uploader.CopyHostToDeviceLocal(meshletBounds.data(), meshletBounds.size() * sizeof(MeshletBounds), out.MeshletBounds);
+    uploader.CopyHostToDeviceLocal(mesh->Vertices.data(), mesh->Vertices.size() * sizeof(Vertex), out.VertexBuffer);
+    uploader.CopyHostToDeviceLocal(mesh->Indices.data(), mesh->Indices.size() * sizeof(uint32_t), out.IndexBuffer);
+    uploader.CopyHostToDeviceLocal(mesh->Meshlets.data(), mesh->Meshlets.size() * sizeof(meshopt_Meshlet), out.MeshletBuffer);
+    uploader.CopyHostToDeviceLocal(mesh->MeshletVertices.data(), mesh->MeshletVertices.size() * sizeof(uint32_t), out.MeshletVertices);
+    uploader.CopyHostToDeviceLocal(mesh->MeshletTriangles.data(), mesh->MeshletTriangles.size() * sizeof(uint32_t), out.MeshletTriangles);
+    uploader.CopyHostToDeviceLocal(mesh->Bounds.data(), mesh->Bounds.size() * sizeof(MeshletBounds), out.MeshletBounds);
     uploader.BuildBLAS(out.BottomLevelAS);
 
     out.RTInstance.AccelerationStructure = out.BottomLevelAS->Address();
@@ -221,17 +145,7 @@ void Model::ProcessPrimitive(RenderContext::Ptr context, cgltf_primitive *primit
             std::string texturePath = Directory + '/' + std::string(material->pbr_metallic_roughness.base_color_texture.texture->image->uri);
             meshMaterial.AlbedoPath = texturePath;
             meshMaterial.HasAlbedo = true;
-            if (TextureCache.count(texturePath) != 0)  {
-                meshMaterial.AlbedoTexture = TextureCache[texturePath];
-            } else {
-                albedoImage.Load(TextureCompressor::GetCachedPath(texturePath));
-
-                meshMaterial.AlbedoTexture = context->CreateTexture(albedoImage.Width(), albedoImage.Height(), albedoImage.Format(), TextureUsage::ShaderResource, true, meshMaterial.AlbedoPath);
-                meshMaterial.AlbedoTexture->BuildShaderResource();
-
-                uploader.CopyHostToDeviceCompressedTexture(&albedoImage, meshMaterial.AlbedoTexture);
-                TextureCache[texturePath] = meshMaterial.AlbedoTexture;
-            }
+            meshMaterial.AlbedoTexture = LoadTexture(context, uploader, texturePath);
         }
     }
     
@@ -241,17 +155,7 @@ void Model::ProcessPrimitive(RenderContext::Ptr context, cgltf_primitive *primit
             std::string texturePath = Directory + '/' + std::string(material->normal_texture.texture->image->uri);
             meshMaterial.NormalPath = texturePath;
             meshMaterial.HasNormal = true;
-            if (TextureCache.count(texturePath) != 0) {
-                meshMaterial.NormalTexture = TextureCache[texturePath];
-            } else {
-                std::replace(texturePath.begin(), texturePath.end(), '\\', '/');
-                normalImage.Load(TextureCompressor::GetCachedPath(texturePath));
-                meshMaterial.NormalTexture = context->CreateTexture(normalImage.Width(), normalImage.Height(), normalImage.Format(), TextureUsage::ShaderResource, true, meshMaterial.NormalPath);
-                meshMaterial.NormalTexture->BuildShaderResource();
-
-                uploader.CopyHostToDeviceCompressedTexture(&normalImage, meshMaterial.NormalTexture);
-                TextureCache[texturePath] = meshMaterial.NormalTexture;
-            }
+            meshMaterial.NormalTexture = LoadTexture(context, uploader, texturePath);
         }
     }
     
@@ -261,32 +165,12 @@ void Model::ProcessPrimitive(RenderContext::Ptr context, cgltf_primitive *primit
             std::string texturePath = Directory + '/' + std::string(material->pbr_metallic_roughness.metallic_roughness_texture.texture->image->uri);
             meshMaterial.MetallicRoughnessPath = texturePath;
             meshMaterial.HasMetallicRoughness = true;
-            if (TextureCache.count(texturePath) != 0) {
-                meshMaterial.PBRTexture = TextureCache[texturePath];
-            } else{
-                std::replace(texturePath.begin(), texturePath.end(), '\\', '/');
-                pbrImage.Load(TextureCompressor::GetCachedPath(texturePath));
-                meshMaterial.PBRTexture = context->CreateTexture(pbrImage.Width(), pbrImage.Height(), pbrImage.Format(), TextureUsage::ShaderResource, true, meshMaterial.MetallicRoughnessPath);
-                meshMaterial.PBRTexture->BuildShaderResource();
-
-                uploader.CopyHostToDeviceCompressedTexture(&pbrImage, meshMaterial.PBRTexture);
-                TextureCache[texturePath] = meshMaterial.PBRTexture;
-            }
+            meshMaterial.PBRTexture = LoadTexture(context, uploader, texturePath);
         } else if (material->specular.specular_texture.texture) {
             std::string texturePath = Directory + '/' + std::string(material->specular.specular_texture.texture->image->uri);
             meshMaterial.MetallicRoughnessPath = texturePath;
             meshMaterial.HasMetallicRoughness = true;
-            if (TextureCache.count(texturePath) != 0) {
-                meshMaterial.PBRTexture = TextureCache[texturePath];
-            } else{
-                std::replace(texturePath.begin(), texturePath.end(), '\\', '/');
-                pbrImage.Load(TextureCompressor::GetCachedPath(texturePath));
-                meshMaterial.PBRTexture = context->CreateTexture(pbrImage.Width(), pbrImage.Height(), pbrImage.Format(), TextureUsage::ShaderResource, true, meshMaterial.MetallicRoughnessPath);
-                meshMaterial.PBRTexture->BuildShaderResource();
-
-                uploader.CopyHostToDeviceCompressedTexture(&pbrImage, meshMaterial.PBRTexture);
-                TextureCache[texturePath] = meshMaterial.PBRTexture;
-            }
+            meshMaterial.PBRTexture = LoadTexture(context, uploader, texturePath);
         }
     }
     
@@ -296,17 +180,7 @@ void Model::ProcessPrimitive(RenderContext::Ptr context, cgltf_primitive *primit
             std::string texturePath = Directory + '/' + std::string(material->emissive_texture.texture->image->uri);
             meshMaterial.EmissivePath = texturePath;
             meshMaterial.HasEmissive = true;
-            if (TextureCache.count(meshMaterial.EmissivePath) != 0) {
-                meshMaterial.EmissiveTexture = TextureCache[texturePath];
-            } else {
-                std::replace(texturePath.begin(), texturePath.end(), '\\', '/');
-                emissiveImage.Load(TextureCompressor::GetCachedPath(texturePath));
-                meshMaterial.EmissiveTexture = context->CreateTexture(emissiveImage.Width(), emissiveImage.Height(), emissiveImage.Format(), TextureUsage::ShaderResource, true, meshMaterial.EmissivePath);
-                meshMaterial.EmissiveTexture->BuildShaderResource();
-
-                uploader.CopyHostToDeviceCompressedTexture(&emissiveImage, meshMaterial.EmissiveTexture);
-                TextureCache[texturePath] = meshMaterial.EmissiveTexture;
-            }
+            meshMaterial.EmissiveTexture = LoadTexture(context, uploader, texturePath);
         }
     }
     
@@ -316,17 +190,7 @@ void Model::ProcessPrimitive(RenderContext::Ptr context, cgltf_primitive *primit
             std::string texturePath = Directory + '/' + std::string(material->occlusion_texture.texture->image->uri);
             meshMaterial.AOPath = texturePath;
             meshMaterial.HasAO = true;
-            if (TextureCache.count(meshMaterial.AOPath) != 0) {
-                meshMaterial.AOTexture = TextureCache[meshMaterial.AOPath];
-            } else {
-                std::replace(texturePath.begin(), texturePath.end(), '\\', '/');
-                aoImage.Load(TextureCompressor::GetCachedPath(texturePath));
-                meshMaterial.AOTexture = context->CreateTexture(aoImage.Width(), aoImage.Height(), aoImage.Format(), TextureUsage::ShaderResource, true, meshMaterial.AOPath);
-                meshMaterial.AOTexture->BuildShaderResource();
-
-                uploader.CopyHostToDeviceCompressedTexture(&aoImage, meshMaterial.AOTexture);
-                TextureCache[texturePath] = meshMaterial.AOTexture;
-            }
+            meshMaterial.AOTexture = LoadTexture(context, uploader, texturePath);
         }
     }
 
@@ -406,27 +270,94 @@ void Model::ProcessNode(RenderContext::Ptr context, cgltf_node *node, Transform
     }
 }
 
+void Model::PreloadTextures(cgltf_data *data)
+{
+    // Every cooked texture the model points to goes in flight at once, so that the drive has a deep queue while the
+    // primitives are uploaded. Files in the pak are already mapped and skipped.
+    uint64_t budget = MODEL_TEXTURE_PRELOAD_BUDGET;
+    for (int i = 0; i < data->images_count; i++) {
+        if (!data->images[i].uri) {
+            continue;
+        }
+        std::string texturePath = Directory + '/' + std::string(data->images[i].uri);
+        std::replace(texturePath.begin(), texturePath.end(), '\\', '/');
+        if (TextureCache.count(texturePath) || _preloaded.count(texturePath)) {
+            continue;
+        }
+
+        std::string cachedPath = TextureCompressor::GetCachedPath(texturePath);
+        const uint8_t *pakData;
+        uint64_t pakSize;
+        if (FileSystem::FindInPak(cachedPath, &pakData, &pakSize) || (TextureStreamer::Get() && TextureStreamer::Get()->IsLoaded(cachedPath))) {
+            continue;
+        }
+        if (!FileSystem::Exists(cachedPath)) {
+            continue;
+        }
+        uint64_t size = FileSystem::GetFileSize(cachedPath);
+        if (!size || size > budget) {
+            continue;
+        }
+        budget -= size;
+
+        PreloadedTexture& preloaded = _preloaded[texturePath];
+        preloaded.Ready = IOQueue::Get().ReadFile(cachedPath, preloaded.Contents).share();
+    }
+}
+
 void Model::Load(RenderContext::Ptr renderContext, const std::string& path)
 {
+    PROFILE_SCOPE("Load Model");
+
     Name = path;
 
     cgltf_options options = {};
+    MeshCooker::SetFileCallbacks(options);
     cgltf_data* data = nullptr;
 
+    // The cooked mesh is read while cgltf parses the glTF. Out of the pak it's mapped instead, there's nothing to wait for.
+    std::string cachedMesh = MeshCooker::GetCachedPath(path);
+    std::vector<uint8_t> cookedMesh;
+    std::future<bool> cookedMeshRead;
+    const uint8_t *pakData;
+    uint64_t pakSize;
+    if (!FileSystem::FindInPak(cachedMesh, &pakData, &pakSize)) {
+        cookedMeshRead = IOQueue::Get().ReadFile(cachedMesh, cookedMesh);
+    }
+
     if (cgltf_parse_file(&options, path.c_str(), &data) != cgltf_result_success) {
         Logger::Error("[CGLTF] Failed to parse GLTF %s", path.c_str());
     }
-    if (cgltf_load_buffers(&options, data, path.c_str()) != cgltf_result_success) {
-        Logger::Error("[CGLTF] Failed to load buffers %s", path.c_str());
+
+    // With a cooked mesh the glTF is only needed for the node hierarchy and the materials, the buffers are never read
+    _cookedMeshes.clear();
+    _nextCookedMesh = 0;
+    bool cooked = cookedMeshRead.valid() ? cookedMeshRead.get() && MeshCooker::Parse(cookedMesh.data(), cookedMesh.size(), _cookedMeshes)
+                                         : MeshCooker::Read(cachedMesh, _cookedMeshes);
+    cookedMesh.clear();
+    cookedMesh.shrink_to_fit();
+    if (!cooked || _cookedMeshes.size() != MeshCooker::CountPrimitives(data)) {
+        _cookedMeshes.clear();
+        if (cgltf_load_buffers(&options, data, path.c_str()) != cgltf_result_success) {
+            Logger::Error("[CGLTF] Failed to load buffers %s", path.c_str());
+        }
     }
     cgltf_scene* scene = data->scene;
 
     Directory = path.substr(0, path.find_last_of('/'));
+    PreloadTextures(data);
     for (int i = 0; i < scene->nodes_count; i++) {
         ProcessNode(renderContext, scene->nodes[i], Transform());
     }
-    Logger::Info("[CGLTF] Successfully loaded model at path %s", path.c_str());
+
+    // Images no material used are still in flight into their buffers
+    for (auto& preloaded : _preloaded) {
+        preloaded.second.Ready.wait();
+    }
+    _preloaded.clear();
+    Logger::Info("[CGLTF] Successfully loaded model at path %s%s", path.c_str(), _cookedMeshes.empty() ? "" : " (cooked)");
     cgltf_free(data);
+    _cookedMeshes.clear();
 }
 
 void Model::ApplyTransform(glm::mat4 transform)
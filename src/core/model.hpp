@@ -7,31 +7,17 @@
 
 #include <string>
 #include <array>
+#include <future>
 #include <queue>
 #include <glm/glm.hpp>
 #include <cgltf/cgltf.h>
 
 #include "rhi/render_context.hpp"
 #include "core/transform.hpp"
+#include "core/mesh_cooker.hpp"
 
-#define MAX_MESHLET_TRIANGLES 124
-#define MAX_MESHLET_VERTICES 64
-
-struct AABB
-{
-    glm::vec3 Min;
-    glm::vec3 Max;
-
-    glm::vec3 Center;
-    glm::vec3 Extent;
-};
-
-struct Vertex
-{
-    glm::vec3 Position;
-    glm::vec2 UV;
-    glm::vec3 Normals;
-};
+// Cooked textures read ahead through the IOQueue while the model loads, at most this many bytes of them at once
+#define MODEL_TEXTURE_PRELOAD_BUDGET (512ull * 1024 * 1024)
 
 struct Material
 {
@@ -56,18 +42,6 @@ struct Material
     glm::vec3 FlatColor;
 };
 
-struct MeshletBounds
-{
-    /* bounding sphere, useful for frustum and occlusion culling */
-	glm::vec3 center;
-	float radius;
-
-	/* normal cone, useful for backface culling */
-	glm::vec3 cone_apex;
-	glm::vec3 cone_axis;
-	float cone_cutoff; /* = cos(angle/2) */
-};
-
 struct RaytracingInstance
 {
     glm::mat3x4 Transform;
@@ -125,6 +99,18 @@ public:
 
     void ApplyTransform(glm::mat4 transform);
 private:
+    Texture::Ptr LoadTexture(RenderContext::Ptr context, Uploader& uploader, std::string texturePath);
     void ProcessPrimitive(RenderContext::Ptr context, cgltf_primitive *primitive, Transform transform, std::string name);
     void ProcessNode(RenderContext::Ptr context, cgltf_node *node, Transform transform);
+    void PreloadTextures(cgltf_data *data);
+
+    struct PreloadedTexture
+    {
+        std::vector<uint8_t> Contents;
+        std::shared_future<bool> Ready; // Shared so that models stay copyable
+    };
+
+    std::vector<MeshData> _cookedMeshes;
+    uint32_t _nextCookedMesh = 0;
+    std::unordered_map<std::string, PreloadedTexture> _preloaded;
 };
@@ -0,0 +1,81 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-15 18:12:07
+//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Bounded ring between any number of producer threads and one consumer thread, without locks. Every slot carries a sequence
+// number telling whose turn it is, so producers only contend on the tail and never wait on each other's writes.
+// Elements are written and read in place, which keeps large ones from being copied twice.
+template<typename T, uint32_t Capacity>
+class MPSCQueue
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "MPSCQueue capacity must be a power of two");
+public:
+    MPSCQueue()
+    {
+        for (uint32_t i = 0; i < Capacity; i++) {
+            _slots[i].Sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // Calls write(T&) on a free slot. Fails when the ring is full.
+    template<typename F>
+    bool Push(F&& write)
+    {
+        uint64_t tail = _tail.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = _slots[tail & (Capacity - 1)];
+            int64_t difference = int64_t(slot.Sequence.load(std::memory_order_acquire)) - int64_t(tail);
+            if (difference == 0) {
+                if (_tail.compare_exchange_weak(tail, tail + 1, std::memory_order_relaxed)) {
+                    write(slot.Value);
+                    slot.Sequence.store(tail + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                tail = _tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Calls read(T&) on the oldest element, if it's been fully written
+    template<typename F>
+    bool Pop(F&& read)
+    {
+        uint64_t head = _head.load(std::memory_order_relaxed);
+        Slot& slot = _slots[head & (Capacity - 1)];
+        if (slot.Sequence.load(std::memory_order_acquire) != head + 1) {
+            return false;
+        }
+        read(slot.Value);
+        slot.Sequence.store(head + Capacity, std::memory_order_release);
+        _head.store(head + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // Approximate when producers are pushing
+    uint32_t Size()
+    {
+        return uint32_t(_tail.load(std::memory_order_relaxed) - _head.load(std::memory_order_relaxed));
+    }
+private:
+    struct Slot
+    {
+        std::atomic<uint64_t> Sequence;
+        T Value;
+    };
+    std::array<Slot, Capacity> _slots;
+
+    // Only the consumer writes the head
+    alignas(64) std::atomic<uint64_t> _head = 0;
+    alignas(64) std::atomic<uint64_t> _tail = 0;
+};
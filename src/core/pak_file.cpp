@@ -0,0 +1,243 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-10 21:02:48
+//
+
+#include "pak_file.hpp"
+#include "io_queue.hpp"
+#include "log.hpp"
+#include "util.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+#undef min
+#undef max
+
+PakFile::PakFile(const std::string& path)
+    : _file(path, MappedFile::Access::Random)
+{
+    if (!_file.IsOpen()) {
+        return;
+    }
+    if (_file.GetSize() < sizeof(PakHeader)) {
+        Logger::Error("[PAK] %s is too small to be an archive!", path.c_str());
+        return;
+    }
+
+    _base = _file.GetData();
+    _size = _file.GetSize();
+
+    const PakHeader *header = reinterpret_cast<const PakHeader*>(_base);
+    uint64_t tocEnd = sizeof(PakHeader) + uint64_t(header->EntryCount) * sizeof(PakEntry);
+    if (header->Magic != PAK_MAGIC || header->Version != PAK_VERSION || tocEnd > _size) {
+        Logger::Error("[PAK] %s is not a valid archive (or was built by another version)", path.c_str());
+        return;
+    }
+    if (header->NamesOffset < tocEnd || header->NamesOffset > _size || header->NamesSize > _size - header->NamesOffset) {
+        Logger::Error("[PAK] %s is corrupt, its names are out of the file", path.c_str());
+        return;
+    }
+
+    // Readers get pointers straight into the mapping, so every entry has to be in it. Checked once here rather than on
+    // every lookup. Sizes are subtracted rather than added so that nothing can overflow.
+    const PakEntry *entries = reinterpret_cast<const PakEntry*>(_base + sizeof(PakHeader));
+    for (uint32_t i = 0; i < header->EntryCount; i++) {
+        const PakEntry& entry = entries[i];
+        bool dataInFile = entry.Offset <= _size && entry.Size <= _size - entry.Offset;
+        bool nameInFile = entry.NameOffset <= header->NamesSize && entry.NameLength <= header->NamesSize - entry.NameOffset;
+        bool sorted = i == 0 || entries[i - 1].Hash <= entry.Hash;
+        if (!dataInFile || !nameInFile || !sorted) {
+            Logger::Error("[PAK] %s is corrupt, entry %u is %s", path.c_str(), i, !sorted ? "out of order" : "out of the file");
+            return;
+        }
+    }
+
+    _header = header;
+    _entries = entries;
+    _names = reinterpret_cast<const char*>(_base + _header->NamesOffset);
+
+    // The table of contents is hit on every lookup, get it in memory now
+    MappedFile::Prefetch(_base, _header->NamesOffset + _header->NamesSize);
+}
+
+PakFile::~PakFile()
+{
+}
+
+std::string PakFile::NormalizePath(const std::string& path)
+{
+    std::string result = path;
+    std::replace(result.begin(), result.end(), '\\', '/');
+    while (result.rfind("./", 0) == 0) {
+        result.erase(0, 2);
+    }
+    return result;
+}
+
+uint64_t PakFile::HashPath(const std::string& normalized)
+{
+    return util::hash(normalized.c_str(), uint32_t(normalized.length()), 1000);
+}
+
+const PakEntry *PakFile::Find(const std::string& path)
+{
+    if (!_header) {
+        return nullptr;
+    }
+
+    std::string normalized = NormalizePath(path);
+    uint64_t hash = HashPath(normalized);
+
+    const PakEntry *end = _entries + _header->EntryCount;
+    const PakEntry *entry = std::lower_bound(_entries, end, hash, [](const PakEntry& e, uint64_t h) { return e.Hash < h; });
+    for (; entry != end && entry->Hash == hash; entry++) {
+        if (entry->NameLength == normalized.length() && !memcmp(_names + entry->NameOffset, normalized.data(), normalized.length())) {
+            return entry;
+        }
+    }
+    return nullptr;
+}
+
+bool PakFile::Build(const std::string& path, const std::vector<PakSource>& sources)
+{
+    PROFILE_SCOPE("Build Pak");
+
+    struct File
+    {
+        std::string Path;
+        std::string Name;
+        PakEntry Entry;
+    };
+    std::vector<File> files;
+
+    for (auto& source : sources) {
+        if (!std::filesystem::exists(source.Directory)) {
+            continue;
+        }
+        for (const auto& dirEntry : std::filesystem::recursive_directory_iterator(source.Directory)) {
+            if (dirEntry.is_directory()) {
+                continue;
+            }
+            std::string extension = dirEntry.path().extension().string();
+            if (!source.Extensions.empty() && std::find(source.Extensions.begin(), source.Extensions.end(), extension) == source.Extensions.end()) {
+                continue;
+            }
+
+            File file;
+            file.Path = dirEntry.path().string();
+            file.Name = NormalizePath(file.Path);
+            file.Entry = {};
+            file.Entry.Hash = HashPath(file.Name);
+            file.Entry.Size = dirEntry.file_size();
+            files.push_back(file);
+        }
+    }
+    std::sort(files.begin(), files.end(), [](const File& a, const File& b) { return a.Entry.Hash < b.Entry.Hash; });
+
+    auto align = [](uint64_t offset) {
+        return (offset + PAK_ALIGNMENT - 1) & ~uint64_t(PAK_ALIGNMENT - 1);
+    };
+
+    PakHeader header = {};
+    header.Magic = PAK_MAGIC;
+    header.Version = PAK_VERSION;
+    header.EntryCount = uint32_t(files.size());
+    header.NamesOffset = sizeof(PakHeader) + files.size() * sizeof(PakEntry);
+
+    std::string names;
+    for (auto& file : files) {
+        file.Entry.NameOffset = uint32_t(names.size());
+        file.Entry.NameLength = uint32_t(file.Name.size());
+        names += file.Name;
+    }
+    header.NamesSize = names.size();
+
+    uint64_t offset = align(header.NamesOffset + header.NamesSize);
+    for (auto& file : files) {
+        file.Entry.Offset = offset;
+        offset = align(offset + file.Entry.Size);
+    }
+
+    // Only a complete archive replaces the previous one, a build that stops halfway leaves nothing that would open
+    std::string temporary = path + ".tmp";
+    std::ofstream stream(temporary, std::ios::binary | std::ios::trunc);
+    if (!stream.is_open()) {
+        Logger::Error("[PAK] Failed to open %s for writing", temporary.c_str());
+        return false;
+    }
+    auto discard = [&]() {
+        stream.close();
+        std::error_code error;
+        std::filesystem::remove(temporary, error);
+        return false;
+    };
+
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    for (auto& file : files) {
+        stream.write(reinterpret_cast<const char*>(&file.Entry), sizeof(PakEntry));
+    }
+    stream.write(names.data(), names.size());
+
+    // Inputs are read through the IO queue a window at a time, and written in order as they come back
+    IOQueue& queue = IOQueue::Get();
+    for (size_t first = 0; first < files.size();) {
+        size_t last = first;
+        uint64_t windowSize = 0;
+        while (last < files.size() && (last == first || windowSize + files[last].Entry.Size <= PAK_BUILD_WINDOW)) {
+            windowSize += files[last].Entry.Size;
+            last++;
+        }
+
+        std::vector<std::vector<char>> buffers(last - first);
+        std::vector<std::future<bool>> reads;
+        for (size_t i = first; i < last; i++) {
+            buffers[i - first].resize(files[i].Entry.Size);
+            reads.push_back(queue.Read(files[i].Path, 0, files[i].Entry.Size, buffers[i - first].data()));
+        }
+
+        bool failed = false;
+        for (size_t i = first; i < last; i++) {
+            if (!reads[i - first].get()) {
+                Logger::Error("[PAK] Failed to read %s", files[i].Path.c_str());
+                failed = true;
+                continue;
+            }
+            stream.seekp(files[i].Entry.Offset);
+            stream.write(buffers[i - first].data(), buffers[i - first].size());
+        }
+        // Every read of the window has to be done before its buffers go away
+        if (failed) {
+            queue.CloseIdleFiles();
+            return discard();
+        }
+        first = last;
+    }
+    // Each input was read once, holding on to their handles would only keep them from being rewritten
+    queue.CloseIdleFiles();
+
+    // Pad the end so that the last entry is a whole number of sectors as well
+    if (stream.tellp() < std::streamoff(offset)) {
+        stream.seekp(offset - 1);
+        stream.put(0);
+    }
+
+    stream.close();
+    if (stream.fail()) {
+        Logger::Error("[PAK] Failed to write %s", temporary.c_str());
+        return discard();
+    }
+    std::error_code error;
+    std::filesystem::rename(temporary, path, error);
+    if (error) {
+        Logger::Error("[PAK] Failed to replace %s: %s", path.c_str(), error.message().c_str());
+        return discard();
+    }
+
+    Logger::Info("[PAK] Packed %u files (%.2f MB) into %s", header.EntryCount, offset / (1024.0f * 1024.0f), path.c_str());
+    return true;
+}
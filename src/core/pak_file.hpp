@@ -0,0 +1,80 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-10 20:41:16
+//
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "mapped_file.hpp"
+
+#define PAK_MAGIC 0x4B41504F // 'OPAK'
+#define PAK_VERSION 1
+// Same as D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT, so that entries can be copied from the mapping without realigning
+#define PAK_ALIGNMENT 512
+// Bytes of input files in flight at once while building
+#define PAK_BUILD_WINDOW (256ull * 1024 * 1024)
+
+struct PakHeader
+{
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t EntryCount;
+    uint32_t Pad;
+    uint64_t NamesOffset;
+    uint64_t NamesSize;
+};
+
+// The table of contents follows the header and is sorted by hash, names come right after it
+struct PakEntry
+{
+    uint64_t Hash;
+    uint64_t Offset;
+    uint64_t Size;
+    uint32_t NameOffset;
+    uint32_t NameLength;
+};
+
+struct PakSource
+{
+    std::string Directory;
+    std::vector<std::string> Extensions; // Everything if empty
+};
+
+// Read-only archive opened and mapped once. Lookups are a binary search in the mapped table of contents, so reading an
+// entry doesn't cost a single syscall.
+class PakFile
+{
+public:
+    using Ptr = std::shared_ptr<PakFile>;
+
+    PakFile(const std::string& path);
+    ~PakFile();
+
+    bool IsOpen() { return _header != nullptr; }
+    uint32_t GetEntryCount() { return _header ? _header->EntryCount : 0; }
+    uint64_t GetSize() { return _size; }
+
+    // Returns nullptr if the archive doesn't have the file
+    const PakEntry *Find(const std::string& path);
+    const uint8_t *GetData(const PakEntry *entry) { return _base + entry->Offset; }
+
+    // Packs every file under the given directories. Names are stored as found, with forward slashes.
+    static bool Build(const std::string& path, const std::vector<PakSource>& sources);
+
+    static std::string NormalizePath(const std::string& path);
+    static uint64_t HashPath(const std::string& normalized);
+private:
+    MappedFile _file;
+
+    const uint8_t *_base = nullptr;
+    uint64_t _size = 0;
+    const PakHeader *_header = nullptr;
+    const PakEntry *_entries = nullptr;
+    const char *_names = nullptr;
+};
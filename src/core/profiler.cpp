@@ -0,0 +1,245 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-16 10:21:55
+//
+
+#include "profiler.hpp"
+#include "log.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+
+#include <nlohmann/json.hpp>
+
+Profiler::ProfilerData Profiler::_Data;
+
+namespace
+{
+    thread_local uint32_t t_depth = 0;
+
+    // Marks the thread's buffer as retired when the thread exits
+    struct ThreadBufferOwner
+    {
+        std::atomic<bool> *Retired = nullptr;
+
+        ~ThreadBufferOwner()
+        {
+            if (Retired) {
+                Retired->store(true);
+            }
+        }
+    };
+    thread_local ThreadBufferOwner t_owner;
+}
+
+uint32_t Profiler::Intern(const std::string& name)
+{
+    std::lock_guard<std::mutex> lock(_Data.NameLock);
+    auto it = _Data.NameLookup.find(name);
+    if (it != _Data.NameLookup.end()) {
+        return it->second;
+    }
+    uint32_t id = uint32_t(_Data.Names.size());
+    _Data.Names.push_back(name);
+    _Data.NameLookup[name] = id;
+    return id;
+}
+
+std::string Profiler::GetName(uint32_t name)
+{
+    std::lock_guard<std::mutex> lock(_Data.NameLock);
+    return name < _Data.Names.size() ? _Data.Names[name] : std::string();
+}
+
+Profiler::ThreadBuffer *Profiler::GetThreadBuffer()
+{
+    thread_local ThreadBuffer *buffer = nullptr;
+    if (buffer) {
+        return buffer;
+    }
+
+    std::lock_guard<std::mutex> lock(_Data.ThreadLock);
+    for (auto& thread : _Data.Threads) {
+        // Collect runs under the same lock, so an empty retired buffer stays empty
+        if (thread->Retired && thread->Zones.Empty()) {
+            buffer = thread.get();
+            break;
+        }
+    }
+    if (!buffer) {
+        _Data.Threads.push_back(std::make_unique<ThreadBuffer>());
+        buffer = _Data.Threads.back().get();
+    }
+    buffer->Id = uint32_t(_Data.ThreadNames.size());
+    buffer->Retired = false;
+    _Data.ThreadNames.push_back("Thread " + std::to_string(buffer->Id));
+    t_owner.Retired = &buffer->Retired;
+    return buffer;
+}
+
+void Profiler::SetThreadName(const std::string& name)
+{
+    ThreadBuffer *buffer = GetThreadBuffer();
+    std::lock_guard<std::mutex> lock(_Data.ThreadLock);
+    _Data.ThreadNames[buffer->Id] = name;
+}
+
+int64_t Profiler::Now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void Profiler::Record(const Zone& zone)
+{
+    ThreadBuffer *buffer = GetThreadBuffer();
+    Zone copy = zone;
+    if (!buffer->Zones.Push(std::move(copy))) {
+        buffer->Dropped.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void Profiler::Collect(bool frame)
+{
+    std::lock_guard<std::mutex> lock(_Data.ThreadLock);
+    bool capturing = _Data.Capturing;
+
+    if (frame) {
+        _Data.FrameTimes.assign(_Data.FrameTimes.size(), 0.0f);
+    }
+    for (auto& thread : _Data.Threads) {
+        Zone zone;
+        while (thread->Zones.Pop(zone)) {
+            if (frame) {
+                if (zone.Name >= _Data.FrameTimes.size()) {
+                    _Data.FrameTimes.resize(zone.Name + 1, 0.0f);
+                }
+                _Data.FrameTimes[zone.Name] += (zone.End - zone.Start) / 1000000.0f;
+            }
+            if (capturing && zone.End >= _Data.CaptureStart) {
+                _Data.Capture.push_back({ zone, thread->Id });
+            }
+        }
+    }
+    if (!frame) {
+        return;
+    }
+
+    // Every zone gets an entry each frame, zero when it didn't run, so that the plots of all of them stay aligned
+    if (_Data.History.size() < _Data.FrameTimes.size()) {
+        _Data.History.resize(_Data.FrameTimes.size());
+    }
+    for (uint32_t i = 0; i < _Data.History.size(); i++) {
+        ZoneHistory& history = _Data.History[i];
+        float time = i < _Data.FrameTimes.size() ? _Data.FrameTimes[i] : 0.0f;
+        history.Times[history.Cursor] = time;
+        history.Cursor = (history.Cursor + 1) % PROFILER_HISTORY_SIZE;
+        history.Count = std::min(history.Count + 1, uint32_t(PROFILER_HISTORY_SIZE));
+        history.Seen = time > 0.0f;
+    }
+}
+
+void Profiler::EndFrame()
+{
+    Collect(true);
+}
+
+const std::vector<Profiler::ZoneHistory>& Profiler::GetHistory()
+{
+    return _Data.History;
+}
+
+void Profiler::BeginCapture()
+{
+    // Zones still in the buffers from before the capture are left out
+    Collect(false);
+
+    std::lock_guard<std::mutex> lock(_Data.ThreadLock);
+    _Data.Capture.clear();
+    _Data.CaptureStart = Now();
+    for (auto& thread : _Data.Threads) {
+        thread->Dropped = 0;
+    }
+    _Data.Capturing = true;
+}
+
+bool Profiler::IsCapturing()
+{
+    return _Data.Capturing;
+}
+
+bool Profiler::EndCapture(const std::string& path)
+{
+    if (!_Data.Capturing) {
+        return false;
+    }
+    Collect(false);
+    _Data.Capturing = false;
+
+    std::vector<CapturedZone> capture;
+    std::vector<std::string> threadNames;
+    uint64_t dropped = 0;
+    {
+        std::lock_guard<std::mutex> lock(_Data.ThreadLock);
+        capture.swap(_Data.Capture);
+        threadNames = _Data.ThreadNames;
+        for (auto& thread : _Data.Threads) {
+            dropped += thread->Dropped;
+        }
+    }
+    std::sort(capture.begin(), capture.end(), [](const CapturedZone& a, const CapturedZone& b) { return a.Data.Start < b.Data.Start; });
+
+    // Chrome's trace event format: complete events ("X") in microseconds, plus the thread names as metadata
+    nlohmann::json events = nlohmann::json::array();
+    for (uint32_t i = 0; i < threadNames.size(); i++) {
+        events.push_back({
+            { "name", "thread_name" },
+            { "ph", "M" },
+            { "pid", 0 },
+            { "tid", i },
+            { "args", { { "name", threadNames[i] } } }
+        });
+    }
+    std::vector<std::string> names;
+    {
+        std::lock_guard<std::mutex> lock(_Data.NameLock);
+        names = _Data.Names;
+    }
+    for (auto& zone : capture) {
+        events.push_back({
+            { "name", names[zone.Data.Name] },
+            { "ph", "X" },
+            { "pid", 0 },
+            { "tid", zone.Thread },
+            { "ts", (zone.Data.Start - _Data.CaptureStart) / 1000.0 },
+            { "dur", (zone.Data.End - zone.Data.Start) / 1000.0 }
+        });
+    }
+
+    std::ofstream stream(path, std::ios::trunc);
+    if (!stream.is_open()) {
+        Logger::Error("[PROFILER] Failed to open %s for writing", path.c_str());
+        return false;
+    }
+    nlohmann::json trace = { { "traceEvents", events }, { "displayTimeUnit", "ms" } };
+    stream << trace.dump();
+
+    Logger::Info("[PROFILER] Wrote %llu zones to %s", uint64_t(capture.size()), path.c_str());
+    if (dropped) {
+        Logger::Warn("[PROFILER] %llu zones were dropped, threads recorded more than %u between two collections", dropped, PROFILER_THREAD_CAPACITY);
+    }
+    return true;
+}
+
+ProfileScope::ProfileScope(uint32_t name)
+    : _name(name), _start(Profiler::Now())
+{
+    t_depth++;
+}
+
+ProfileScope::~ProfileScope()
+{
+    t_depth--;
+    Profiler::Record({ _name, t_depth, _start, Profiler::Now() });
+}
@@ -0,0 +1,118 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-16 10:04:38
+//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "spsc_queue.hpp"
+
+// Zones a thread can record between two collections, the rest are dropped and counted
+#define PROFILER_THREAD_CAPACITY 16384
+// Frames of per-zone timings kept for the overlay
+#define PROFILER_HISTORY_SIZE 512
+
+#define PROFILER_CONCAT_INNER(a, b) a##b
+#define PROFILER_CONCAT(a, b) PROFILER_CONCAT_INNER(a, b)
+
+// Times the rest of the enclosing scope. The name is interned once, the first time the line runs.
+#define PROFILE_SCOPE(name) \
+    static const uint32_t PROFILER_CONCAT(_profileZone, __LINE__) = Profiler::Intern(name); \
+    ProfileScope PROFILER_CONCAT(_profileScope, __LINE__)(PROFILER_CONCAT(_profileZone, __LINE__))
+
+// Scoped CPU zones from any thread. Every thread records into its own lock-free buffer, which the main thread drains once a
+// frame (EndFrame) for the overlay, or when a capture is written out as a Chrome trace (chrome://tracing, ui.perfetto.dev).
+class Profiler
+{
+public:
+    struct Zone
+    {
+        uint32_t Name;
+        uint32_t Depth;
+        int64_t Start; // Nanoseconds on the steady clock
+        int64_t End;
+    };
+
+    struct ZoneHistory
+    {
+        std::array<float, PROFILER_HISTORY_SIZE> Times; // Milliseconds per frame, summed over every thread
+        uint32_t Cursor = 0; // Oldest entry
+        uint32_t Count = 0; // Entries written so far, up to PROFILER_HISTORY_SIZE
+        bool Seen = false; // Recorded during the last frame
+    };
+
+    static uint32_t Intern(const std::string& name);
+    static std::string GetName(uint32_t name);
+
+    // Shows up in traces instead of the thread's number
+    static void SetThreadName(const std::string& name);
+
+    static void Record(const Zone& zone);
+    static int64_t Now();
+
+    // Drains every thread and pushes this frame's zone timings to the history. Main thread only, like GetHistory.
+    static void EndFrame();
+    // Indexed by interned name
+    static const std::vector<ZoneHistory>& GetHistory();
+
+    static void BeginCapture();
+    // Writes everything recorded since BeginCapture. Returns false if there was no capture or the file couldn't be written.
+    static bool EndCapture(const std::string& path);
+    static bool IsCapturing();
+private:
+    struct ThreadBuffer
+    {
+        uint32_t Id; // New for every thread, buffers are reused
+        std::atomic<bool> Retired = false; // The thread exited, the buffer can go to a new one once drained
+        std::atomic<uint64_t> Dropped = 0;
+        SPSCQueue<Zone, PROFILER_THREAD_CAPACITY> Zones;
+    };
+
+    struct CapturedZone
+    {
+        Zone Data;
+        uint32_t Thread;
+    };
+
+    static ThreadBuffer *GetThreadBuffer();
+    static void Collect(bool frame);
+
+    struct ProfilerData
+    {
+        std::mutex NameLock;
+        std::vector<std::string> Names;
+        std::unordered_map<std::string, uint32_t> NameLookup;
+
+        std::mutex ThreadLock; // Registration, and whoever is draining
+        std::vector<std::unique_ptr<ThreadBuffer>> Threads;
+        std::vector<std::string> ThreadNames; // Indexed by thread id
+
+        std::vector<float> FrameTimes;
+        std::vector<ZoneHistory> History;
+
+        std::atomic<bool> Capturing = false;
+        std::vector<CapturedZone> Capture;
+        int64_t CaptureStart = 0;
+    };
+    static ProfilerData _Data;
+};
+
+class ProfileScope
+{
+public:
+    ProfileScope(uint32_t name);
+    ~ProfileScope();
+private:
+    uint32_t _name;
+    int64_t _start;
+};
@@ -7,11 +7,23 @@
 
 #include <core/file_system.hpp>
 #include <core/log.hpp>
+#include <core/util.hpp>
 
+#include <mutex>
 #include <string>
+
+#ifdef _WIN32
 #include <atlbase.h>
 #include <dxcapi.h>
 #include <wrl/client.h>
+#else
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#endif
 
 const char *GetProfileFromType(ShaderType type)
 {
@@ -38,53 +50,92 @@ const char *GetProfileFromType(ShaderType type)
     return "???";
 }
 
-bool ShaderCompiler::CompileShader(const std::string& path, const std::string& entryPoint, ShaderType type, ShaderBytecode& bytecode)
-{
-    using namespace Microsoft::WRL;
+#ifdef _WIN32
 
-    std::string source = FileSystem::ReadFile(path);
+// Creating the DXC instances costs more than compiling most of our shaders, so each thread keeps its own
+struct DxcThreadContext
+{
+    Microsoft::WRL::ComPtr<IDxcUtils> Utils;
+    Microsoft::WRL::ComPtr<IDxcCompiler> Compiler;
+    Microsoft::WRL::ComPtr<IDxcIncludeHandler> IncludeHandler;
+};
 
-    wchar_t wideTarget[512];
-    swprintf_s(wideTarget, 512, L"%hs", GetProfileFromType(type));
-    
-    wchar_t wideEntry[512];
-    swprintf_s(wideEntry, 512, L"%hs", entryPoint.c_str());
+static DxcThreadContext *GetThreadContext()
+{
+    thread_local DxcThreadContext context;
+    if (context.Compiler) {
+        return &context;
+    }
 
-    ComPtr<IDxcUtils> pUtils;
-    ComPtr<IDxcCompiler> pCompiler;
-    if (!SUCCEEDED(DxcCreateInstance(CLSID_DxcUtils, IID_PPV_ARGS(&pUtils)))) {
+    if (!SUCCEEDED(DxcCreateInstance(CLSID_DxcUtils, IID_PPV_ARGS(&context.Utils)))) {
         Logger::Error("DXC: Failed to create DXC utils instance!");
-        return false;
+        return nullptr;
     }
-    if (!SUCCEEDED(DxcCreateInstance(CLSID_DxcCompiler, IID_PPV_ARGS(&pCompiler)))) {
+    if (!SUCCEEDED(context.Utils->CreateDefaultIncludeHandler(&context.IncludeHandler))) {
+        Logger::Error("DXC: Failed to create default include handler!");
+        return nullptr;
+    }
+    if (!SUCCEEDED(DxcCreateInstance(CLSID_DxcCompiler, IID_PPV_ARGS(&context.Compiler)))) {
         Logger::Error("DXC: Failed to create DXC compiler instance!");
-        return false;
+        return nullptr;
     }
+    return &context;
+}
 
-    ComPtr<IDxcIncludeHandler> pIncludeHandler;
-    if (!SUCCEEDED(pUtils->CreateDefaultIncludeHandler(&pIncludeHandler))) {
-        Logger::Error("DXC: Failed to create default include handler!");
+static LPCWSTR sArguments[] = {
+    L"-Zi",
+    L"-Fd",
+    L"-Fre",
+    L"-Qembed_debug",
+    L"-Wno-payload-access-perf",
+    L"-Wno-payload-access-shader"
+};
+
+bool ShaderCompiler::CompileShader(const std::string& path, const std::string& entryPoint, ShaderType type, ShaderBytecode& bytecode, const std::vector<std::string>& defines)
+{
+    using namespace Microsoft::WRL;
+
+    DxcThreadContext *context = GetThreadContext();
+    if (!context) {
         return false;
     }
 
+    std::string source = FileSystem::ReadFile(path);
+
+    wchar_t wideTarget[512];
+    swprintf_s(wideTarget, 512, L"%hs", GetProfileFromType(type));
+    
+    wchar_t wideEntry[512];
+    swprintf_s(wideEntry, 512, L"%hs", entryPoint.c_str());
+
     ComPtr<IDxcBlobEncoding> pSourceBlob;
-    if (!SUCCEEDED(pUtils->CreateBlob(source.c_str(), source.size(), 0, &pSourceBlob))) {
+    if (!SUCCEEDED(context->Utils->CreateBlob(source.c_str(), source.size(), 0, &pSourceBlob))) {
         Logger::Error("DXC: Failed to create output blob!");
         return false;
     }
 
-    LPCWSTR pArgs[] = {
-        L"-Zi",
-        L"-Fd",
-        L"-Fre",
-        L"-Qembed_debug",
-        L"-Wno-payload-access-perf",
-        L"-Wno-payload-access-shader"
-    };
+    // DxcDefine only points at the strings, keep them alive until the compile is done
+    std::vector<std::wstring> wideDefines;
+    for (auto& define : defines) {
+        wideDefines.push_back(std::wstring(define.begin(), define.end()));
+    }
+    std::vector<DxcDefine> dxcDefines;
+    for (auto& define : wideDefines) {
+        size_t equal = define.find(L'=');
+        DxcDefine dxcDefine;
+        dxcDefine.Name = define.c_str();
+        dxcDefine.Value = nullptr;
+        if (equal != std::wstring::npos) {
+            define[equal] = L'\0';
+            dxcDefine.Value = define.c_str() + equal + 1;
+        }
+        dxcDefines.push_back(dxcDefine);
+    }
 
     ComPtr<IDxcOperationResult> pResult;
-    if (!SUCCEEDED(pCompiler->Compile(pSourceBlob.Get(), L"Shader", wideEntry, wideTarget, pArgs, ARRAYSIZE(pArgs), nullptr, 0, pIncludeHandler.Get(), &pResult))) {
+    if (!SUCCEEDED(context->Compiler->Compile(pSourceBlob.Get(), L"Shader", wideEntry, wideTarget, sArguments, ARRAYSIZE(sArguments), dxcDefines.data(), dxcDefines.size(), context->IncludeHandler.Get(), &pResult))) {
         Logger::Error("[DXC] DXC: Failed to compile shader!");
+        return false;
     }
 
     ComPtr<IDxcBlobEncoding> pErrors;
@@ -111,3 +162,136 @@ bool ShaderCompiler::CompileShader(const std::string& path, const std::string& e
     Logger::Info("[DXC] Compiled shader %s", path.c_str());
     return true;
 }
+
+static std::string GetCompilerVersion()
+{
+    DxcThreadContext *context = GetThreadContext();
+    if (!context) {
+        return "";
+    }
+
+    Microsoft::WRL::ComPtr<IDxcVersionInfo> pVersion;
+    if (!SUCCEEDED(context->Compiler.As(&pVersion))) {
+        return "";
+    }
+
+    UINT32 major = 0;
+    UINT32 minor = 0;
+    pVersion->GetVersion(&major, &minor);
+
+    std::string version = std::to_string(major) + "." + std::to_string(minor);
+
+    Microsoft::WRL::ComPtr<IDxcVersionInfo2> pVersion2;
+    if (SUCCEEDED(context->Compiler.As(&pVersion2))) {
+        UINT32 commitCount = 0;
+        char *commitHash = nullptr;
+        if (SUCCEEDED(pVersion2->GetCommitInfo(&commitCount, &commitHash)) && commitHash) {
+            version += std::string(" ") + commitHash;
+            CoTaskMemFree(commitHash);
+        }
+    }
+    return version;
+}
+
+static std::string GetArgumentString()
+{
+    std::string arguments;
+    for (LPCWSTR argument : sArguments) {
+        char narrow[128];
+        snprintf(narrow, sizeof(narrow), " %ls", argument);
+        arguments += narrow;
+    }
+    return arguments;
+}
+
+#else
+
+static const char *sArguments = "-I . -Zi -Qembed_debug -Wno-payload-access-perf -Wno-payload-access-shader";
+
+static const char *GetCompilerPath()
+{
+    const char *dxc = getenv("ONI_DXC");
+    return dxc ? dxc : "dxc";
+}
+
+// Runs the compiler and returns what it wrote to stdout and stderr
+static int RunCompiler(const std::string& arguments, const std::string& logPath, std::string& log)
+{
+    std::stringstream command;
+    command << GetCompilerPath() << " " << arguments << " > \"" << logPath << "\" 2>&1";
+
+    int result = std::system(command.str().c_str());
+
+    std::ifstream logStream(logPath);
+    log = std::string((std::istreambuf_iterator<char>(logStream)), std::istreambuf_iterator<char>());
+    logStream.close();
+    std::filesystem::remove(logPath);
+    return result;
+}
+
+// No dxcompiler to link against here: run the dxc executable (ONI_DXC, or whatever is on the PATH) with the same arguments.
+// Nothing is shared between calls, so there's no per thread state to keep.
+bool ShaderCompiler::CompileShader(const std::string& path, const std::string& entryPoint, ShaderType type, ShaderBytecode& bytecode, const std::vector<std::string>& defines)
+{
+    // Unique per thread, the cooker compiles several shaders at once
+    std::stringstream name;
+    name << "oni_" << std::hash<std::thread::id>()(std::this_thread::get_id()) << "_" << std::hash<std::string>()(path);
+    std::filesystem::path temp = std::filesystem::temp_directory_path() / name.str();
+    std::string output = temp.string() + ".dxil";
+
+    std::stringstream arguments;
+    arguments << "-T " << GetProfileFromType(type)
+              << " -E " << entryPoint
+              << " " << sArguments;
+    for (auto& define : defines) {
+        arguments << " -D " << define;
+    }
+    arguments << " -Fo \"" << output << "\"" << " \"" << path << "\"";
+
+    std::string errors;
+    int result = RunCompiler(arguments.str(), temp.string() + ".log", errors);
+
+    std::ifstream outputStream(output, std::ios::binary);
+    if (result != 0 || !outputStream.is_open()) {
+        Logger::Error("[DXC] Shader errors:%s", errors.c_str());
+        return false;
+    }
+    std::vector<char> blob((std::istreambuf_iterator<char>(outputStream)), std::istreambuf_iterator<char>());
+    outputStream.close();
+    std::filesystem::remove(output);
+
+    bytecode.type = type;
+    bytecode.bytecode.resize(blob.size() / sizeof(uint32_t));
+    memcpy(bytecode.bytecode.data(), blob.data(), blob.size());
+
+    Logger::Info("[DXC] Compiled shader %s", path.c_str());
+    return true;
+}
+
+static std::string GetCompilerVersion()
+{
+    std::string version;
+    std::filesystem::path logPath = std::filesystem::temp_directory_path() / "oni_dxc_version.log";
+    RunCompiler("--version", logPath.string(), version);
+    return version;
+}
+
+static std::string GetArgumentString()
+{
+    return sArguments;
+}
+
+#endif
+
+uint64_t ShaderCompiler::GetCompilerHash(ShaderType type, const std::string& entryPoint)
+{
+    // Asking the compiler for its version isn't free, and it won't change while we run
+    static std::once_flag versionFlag;
+    static std::string version;
+    std::call_once(versionFlag, []() {
+        version = GetCompilerVersion();
+    });
+
+    std::string key = version + "|" + GetProfileFromType(type) + "|" + entryPoint + "|" + GetArgumentString();
+    return util::hash(key.c_str(), key.length(), 1000);
+}
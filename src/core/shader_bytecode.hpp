@@ -30,5 +30,10 @@ struct ShaderBytecode
 class ShaderCompiler
 {
 public:
-    static bool CompileShader(const std::string& path, const std::string& entryPoint, ShaderType type, ShaderBytecode& bytecode);
+    // Every compiling thread gets its own compiler instance, so this can be called from several threads at once.
+    // Defines are passed as NAME=VALUE.
+    static bool CompileShader(const std::string& path, const std::string& entryPoint, ShaderType type, ShaderBytecode& bytecode, const std::vector<std::string>& defines = {});
+
+    // Compiler version, profile, entry point and arguments: anything that changes the output for the same source
+    static uint64_t GetCompilerHash(ShaderType type, const std::string& entryPoint);
 };
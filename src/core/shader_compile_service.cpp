@@ -0,0 +1,260 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-14 10:34:02
+//
+
+#include "shader_compile_service.hpp"
+#include "file_system.hpp"
+#include "pak_file.hpp"
+#include "timer.hpp"
+#include "log.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <chrono>
+
+#undef min
+#undef max
+
+ShaderCompileService::ServiceData ShaderCompileService::_Data;
+
+void ShaderCompileService::Init()
+{
+    std::lock_guard<std::mutex> lock(_Data.Lock);
+    if (_Data.Running) {
+        return;
+    }
+    _Data.Running = true;
+    _Data.Thread = std::thread(&ShaderCompileService::ServiceLoop);
+}
+
+void ShaderCompileService::Exit()
+{
+    std::unordered_map<std::string, WatchedRoot> roots;
+    {
+        std::lock_guard<std::mutex> lock(_Data.Lock);
+        if (!_Data.Running) {
+            return;
+        }
+        _Data.Running = false;
+        _Data.Jobs.clear();
+        roots = std::move(_Data.Roots);
+        _Data.Roots.clear();
+    }
+    _Data.WakeUp.notify_all();
+    _Data.Thread.join();
+
+    // The watcher threads notify under our lock, so they are stopped without holding it
+    roots.clear();
+
+    Logger::Info("[SHADER SERVICE] Stopped after %llu file events, %llu polls and %llu compile jobs", _Data.EventCount, _Data.PollCount, _Data.JobCount);
+}
+
+void ShaderCompileService::Watch(std::shared_ptr<FileWatch::State> state)
+{
+    std::string path = PakFile::NormalizePath(state->File);
+    size_t slash = path.find('/');
+    std::string root = slash == std::string::npos ? "." : path.substr(0, slash);
+
+    {
+        std::lock_guard<std::mutex> lock(_Data.Lock);
+
+        auto it = _Data.Roots.find(root);
+        if (it == _Data.Roots.end()) {
+            WatchedRoot watched;
+            watched.Watcher = std::make_shared<DirectoryWatcher>(root);
+            if (watched.Watcher->IsRunning()) {
+                watched.Subscription = watched.Watcher->Subscribe([]() {
+                    {
+                        std::lock_guard<std::mutex> lock(_Data.Lock);
+                        _Data.EventsPending = true;
+                    }
+                    _Data.WakeUp.notify_one();
+                });
+            } else {
+                Logger::Warn("[SHADER SERVICE] Can't watch %s, its shaders are polled every %.0fms", root.c_str(), SHADER_WATCH_INTERVAL);
+            }
+            it = _Data.Roots.emplace(root, watched).first;
+        }
+
+        if (it->second.Subscription) {
+            _Data.Watches[path].push_back(state);
+        } else {
+            _Data.Polled.push_back(state);
+        }
+    }
+
+    // The service may be sleeping without a timeout
+    _Data.WakeUp.notify_one();
+}
+
+void ShaderCompileService::Submit(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(_Data.Lock);
+        _Data.Jobs.push_back(std::move(job));
+    }
+    _Data.WakeUp.notify_one();
+}
+
+ShaderCompileService::Stats ShaderCompileService::GetStats()
+{
+    std::lock_guard<std::mutex> lock(_Data.Lock);
+
+    Stats stats;
+    stats.Watched = 0;
+    for (auto& watches : _Data.Watches) {
+        stats.Watched += uint32_t(watches.second.size());
+    }
+    stats.Polled = uint32_t(_Data.Polled.size());
+    stats.Pending = uint32_t(_Data.Jobs.size());
+    stats.Events = _Data.EventCount;
+    stats.Polls = _Data.PollCount;
+    stats.Jobs = _Data.JobCount;
+    return stats;
+}
+
+void ShaderCompileService::ServiceLoop()
+{
+    Profiler::SetThreadName("Shader Compile");
+
+    Timer pollTimer;
+
+    while (true) {
+        std::function<void()> job;
+        bool events;
+        {
+            std::unique_lock<std::mutex> lock(_Data.Lock);
+            auto ready = [] {
+                return !_Data.Running || !_Data.Jobs.empty() || _Data.EventsPending;
+            };
+
+            // Without polled files there is nothing to do until a watcher or a pipeline wakes us up
+            if (_Data.Polled.empty()) {
+                _Data.WakeUp.wait(lock, ready);
+            } else {
+                float untilPoll = std::max(SHADER_WATCH_INTERVAL - pollTimer.GetElapsed(), 0.0f);
+                _Data.WakeUp.wait_for(lock, std::chrono::milliseconds(int(untilPoll)), ready);
+            }
+            if (!_Data.Running) {
+                return;
+            }
+
+            events = _Data.EventsPending;
+            _Data.EventsPending = false;
+            if (!_Data.Jobs.empty()) {
+                job = std::move(_Data.Jobs.front());
+                _Data.Jobs.pop_front();
+                _Data.JobCount++;
+            }
+        }
+
+        // Events first, a save that lands while a job is queued is submitted right after it
+        if (events) {
+            DrainEvents();
+        }
+        if (job) {
+            job();
+        }
+
+        if (pollTimer.GetElapsed() >= SHADER_WATCH_INTERVAL) {
+            pollTimer.Restart();
+            Poll();
+        }
+    }
+}
+
+void ShaderCompileService::DrainEvents()
+{
+    std::vector<std::shared_ptr<FileWatch::State>> changed;
+    {
+        std::lock_guard<std::mutex> lock(_Data.Lock);
+
+        auto collect = [&](WatchList& watches) {
+            for (size_t i = 0; i < watches.size();) {
+                if (auto state = watches[i].lock()) {
+                    changed.push_back(state);
+                    i++;
+                } else {
+                    watches[i] = watches.back();
+                    watches.pop_back();
+                }
+            }
+        };
+
+        for (auto& root : _Data.Roots) {
+            if (!root.second.Subscription) {
+                continue;
+            }
+
+            // Lost events: every file under the root has to be checked
+            if (root.second.Subscription->Overflowed.exchange(false)) {
+                Logger::Warn("[SHADER SERVICE] Lost file events under %s, rescanning", root.first.c_str());
+                std::string prefix = root.first + "/";
+                for (auto& watches : _Data.Watches) {
+                    if (root.first == "." || watches.first.rfind(prefix, 0) == 0) {
+                        collect(watches.second);
+                    }
+                }
+            }
+
+            std::string path;
+            while (root.second.Subscription->Events.Pop(path)) {
+                _Data.EventCount++;
+
+                // Most events are for files nobody watches, they stop here
+                auto it = _Data.Watches.find(path);
+                if (it == _Data.Watches.end()) {
+                    continue;
+                }
+                collect(it->second);
+                if (it->second.empty()) {
+                    _Data.Watches.erase(it);
+                }
+            }
+        }
+    }
+
+    for (auto& state : changed) {
+        Refresh(*state);
+    }
+}
+
+void ShaderCompileService::Poll()
+{
+    std::vector<std::shared_ptr<FileWatch::State>> watches;
+    {
+        std::lock_guard<std::mutex> lock(_Data.Lock);
+        if (_Data.Polled.empty()) {
+            return;
+        }
+
+        watches.reserve(_Data.Polled.size());
+        for (size_t i = 0; i < _Data.Polled.size();) {
+            if (auto state = _Data.Polled[i].lock()) {
+                watches.push_back(state);
+                i++;
+            } else {
+                _Data.Polled[i] = _Data.Polled.back();
+                _Data.Polled.pop_back();
+            }
+        }
+        _Data.PollCount++;
+    }
+
+    for (auto& state : watches) {
+        Refresh(*state);
+    }
+}
+
+void ShaderCompileService::Refresh(FileWatch::State& state)
+{
+    // Drops what the watcher couldn't coalesce: an event for a file that is already up to date, or a rescan of unchanged files
+    uint64_t writeTime = FileSystem::GetLastWriteTime(state.File);
+    if (writeTime && writeTime != state.WriteTime) {
+        state.WriteTime = writeTime;
+        state.Changed = true;
+        _Data.ChangeCount.fetch_add(1, std::memory_order_release);
+    }
+}
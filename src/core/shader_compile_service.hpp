@@ -0,0 +1,87 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-14 10:21:37
+//
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "file_watch.hpp"
+#include "directory_watcher.hpp"
+
+// Milliseconds between two polls of the files the OS can't watch
+#define SHADER_WATCH_INTERVAL 500.0f
+
+// Background thread behind shader hot reloading. Watched files are grouped by their top directory, which gets a
+// DirectoryWatcher: the thread only wakes up for the files that changed, and runs the compile jobs the pipelines submit, so
+// that saving a shader never stalls the frame thread. Files under a directory the OS refuses to watch are polled instead.
+class ShaderCompileService
+{
+public:
+    struct Stats
+    {
+        uint32_t Watched;
+        uint32_t Polled;
+        uint32_t Pending;
+        uint64_t Events;
+        uint64_t Polls;
+        uint64_t Jobs;
+    };
+
+    static void Init();
+    static void Exit();
+
+    static void Watch(std::shared_ptr<FileWatch::State> state);
+
+    // Bumped every time a watch is raised. Checking it first keeps the per-frame cost proportional to the changes.
+    static uint64_t GetChangeCount() { return _Data.ChangeCount.load(std::memory_order_acquire); }
+
+    // Jobs run one after the other, in submission order. Anything they share with the frame thread has to be locked.
+    static void Submit(std::function<void()> job);
+
+    static Stats GetStats();
+private:
+    static void ServiceLoop();
+    static void DrainEvents();
+    static void Poll();
+    static void Refresh(FileWatch::State& state);
+
+    using WatchList = std::vector<std::weak_ptr<FileWatch::State>>;
+
+    struct WatchedRoot
+    {
+        DirectoryWatcher::Ptr Watcher;
+        DirectoryWatcher::Subscription::Ptr Subscription;
+    };
+
+    struct ServiceData
+    {
+        std::thread Thread;
+        std::mutex Lock;
+        std::condition_variable WakeUp;
+        bool Running = false;
+        bool EventsPending = false;
+
+        std::unordered_map<std::string, WatchedRoot> Roots;
+        std::unordered_map<std::string, WatchList> Watches; // By normalized path
+        WatchList Polled;
+        std::deque<std::function<void()>> Jobs;
+
+        std::atomic<uint64_t> ChangeCount = 0;
+        uint64_t EventCount = 0;
+        uint64_t PollCount = 0;
+        uint64_t JobCount = 0;
+    };
+    static ServiceData _Data;
+};
@@ -10,12 +10,17 @@
 #include <filesystem>
 #include <stdlib.h>
 #include <algorithm>
+#include <atomic>
+#include <cstring>
 
 #include "util.hpp"
 #include "file_system.hpp"
 #include "log.hpp"
+#include "timer.hpp"
+#include "profiler.hpp"
+#include "job_system.hpp"
 
-void ShaderLoader::TraverseDirectory(const std::string& path)
+uint32_t ShaderLoader::TraverseDirectory(const std::string& path)
 {
     if (!FileSystem::Exists(".cache")) {
         FileSystem::CreateDirectoryFromPath(".cache/");
@@ -24,65 +29,150 @@ void ShaderLoader::TraverseDirectory(const std::string& path)
         FileSystem::CreateDirectoryFromPath(".cache/shaders/");
     }
 
+    Timer checkTimer;
+
+    // Most shaders include the same few files, only hash them once
+    HashCache hashes;
+    uint32_t shaderCount = 0;
+    std::vector<std::string> stale;
+
     for (const auto& dirEntry : std::filesystem::recursive_directory_iterator(path)) {
         if (dirEntry.is_directory()) {
             continue;
         }
 
         std::string entryPath = dirEntry.path().string();
-        std::string cached = GetCachedPath(entryPath);
-
         std::replace(entryPath.begin(), entryPath.end(), '\\', '/');
 
         if (GetTypeFromPath(entryPath) == ShaderType::None) {
             continue;
         }
+        shaderCount++;
 
-        if (ExistsInCache(entryPath)) {
-            if (!ShouldReCache(entryPath)) {
-                Logger::Info("[SHADER CACHE] %s is already cached -- skipping.", entryPath.c_str());
-                continue;
-            }
+        if (!ShouldReCache(entryPath, {}, &hashes)) {
+            continue;
         }
-        
-        CacheShader(entryPath);
+        stale.push_back(entryPath);
     }
+    float checkTime = checkTimer.GetElapsed();
+
+    // Same scheme as the uploader: one job per shader on the job system's workers
+    Timer compileTimer;
+    std::atomic<uint32_t> failed = 0;
+    uint32_t threadCount = std::min<uint32_t>(JobSystem::GetThreadCount(), uint32_t(stale.size()));
+
+    JobSystem::ParallelFor(uint32_t(stale.size()), [&](uint32_t index) {
+        if (!CacheShader(stale[index])) {
+            failed++;
+        }
+    });
+
+    // A cold cache compiles everything, a warm one should only pay for the check
+    Logger::Info("[SHADER CACHE] %u/%u shaders stale (checked in %.2fms), compiled on %u threads in %.2fms, %u failed",
+                 uint32_t(stale.size()),
+                 shaderCount,
+                 checkTime,
+                 threadCount,
+                 compileTimer.GetElapsed(),
+                 failed.load());
+
+    return stale.size();
 }
 
-bool ShaderLoader::ExistsInCache(const std::string& path)
+bool ShaderLoader::ExistsInCache(const std::string& path, const std::vector<std::string>& defines)
 {
-    return FileSystem::Exists(GetCachedPath(path));
+    return FileSystem::Exists(GetCachedPath(path, defines));
 }
 
-ShaderBytecode ShaderLoader::GetFromCache(const std::string& path)
+ShaderBytecode ShaderLoader::GetFromCache(const std::string& path, const std::vector<std::string>& defines)
 {
     ShaderBytecode bytecode;
 
-    if (!ExistsInCache(path)) {
+    if (!defines.empty()) {
+        ShaderPermutationStats& stats = GetPermutationStats();
+        stats.Requests++;
+
+        // Without the sources (or if they don't compile) whatever is in the cache is still better than nothing
+        if (ShouldReCache(path, defines) && CacheShader(path, defines)) {
+            stats.Compiles++;
+        } else {
+            stats.CacheHits++;
+        }
+    } else if (!ExistsInCache(path)) {
         CacheShader(path);
-    } else {
-        OniShaderHeader header;
+    }
 
-        // Read header
-        FILE* f = fopen(GetCachedPath(path).c_str(), "rb");
-        fread(&header, sizeof(header), 1, f);
+    OniShaderHeader header;
+    if (ReadCache(GetCachedPath(path, defines), header, nullptr, &bytecode.bytecode)) {
+        bytecode.type = header.Type;
+    }
+    return bytecode;
+}
 
-        // Read bytecode
-        bytecode.bytecode = std::vector<uint32_t>(header.BytecodeSize);
-        fread(bytecode.bytecode.data(), bytecode.bytecode.size() * sizeof(uint32_t), 1, f);
+ShaderPermutationStats& ShaderLoader::GetPermutationStats()
+{
+    static ShaderPermutationStats stats;
+    return stats;
+}
 
-        fclose(f);
+static bool ReadDependencies(const uint8_t *table, const OniShaderHeader& header, std::vector<OniShaderDependency>& dependencies)
+{
+    const uint8_t *cursor = table;
+    const uint8_t *end = table + header.DependencySize;
+
+    dependencies.resize(header.DependencyCount);
+    for (auto& dependency : dependencies) {
+        uint32_t length;
+        if (uint64_t(end - cursor) < sizeof(uint64_t) + sizeof(uint32_t)) {
+            return false;
+        }
+        memcpy(&dependency.Hash, cursor, sizeof(uint64_t));
+        memcpy(&length, cursor + sizeof(uint64_t), sizeof(uint32_t));
+        cursor += sizeof(uint64_t) + sizeof(uint32_t);
+
+        if (uint64_t(end - cursor) < length) {
+            return false;
+        }
+        dependency.Path = std::string(reinterpret_cast<const char*>(cursor), length);
+        cursor += length;
+    }
+    return true;
+}
+
+bool ShaderLoader::ReadCache(const std::string& cached, OniShaderHeader& header, std::vector<OniShaderDependency> *dependencies, std::vector<uint32_t> *bytecode)
+{
+    FileView view = FileSystem::Map(cached);
+    if (!view.IsValid() || view.GetSize() < sizeof(header)) {
+        return false;
     }
 
-    return bytecode;
+    const uint8_t *contents = view.GetData();
+    memcpy(&header, contents, sizeof(header));
+    if (header.Magic != SHADER_CACHE_MAGIC || header.Version != SHADER_CACHE_VERSION) {
+        return false;
+    }
+    if (view.GetSize() < sizeof(header) + header.DependencySize + header.BytecodeSize * sizeof(uint32_t)) {
+        return false;
+    }
+    if (dependencies && !ReadDependencies(contents + sizeof(header), header, *dependencies)) {
+        return false;
+    }
+    if (bytecode) {
+        bytecode->resize(header.BytecodeSize);
+        memcpy(bytecode->data(), contents + sizeof(header) + header.DependencySize, header.BytecodeSize * sizeof(uint32_t));
+    }
+    return true;
 }
 
-std::string ShaderLoader::GetCachedPath(const std::string& path)
+std::string ShaderLoader::GetCachedPath(const std::string& path, const std::vector<std::string>& defines)
 {
     std::stringstream path_ss;
 
     const char *key = path.c_str();
     uint64_t hash = util::hash(key, path.length(), 1000);
+    for (auto& define : defines) {
+        hash = util::hash(define.c_str(), define.length(), hash);
+    }
     path_ss << ".cache/shaders/" << hash << ".oni";
 
     return path_ss.str();
@@ -119,66 +209,141 @@ ShaderType ShaderLoader::GetTypeFromPath(const std::string& path)
     return ShaderType::None;
 }
 
-bool ShaderLoader::ShouldReCache(const std::string& path)
+static void GatherDependencies(const std::string& path, std::vector<std::string>& dependencies)
 {
-    if (!ExistsInCache(path)) {
-        return true;
+    if (std::find(dependencies.begin(), dependencies.end(), path) != dependencies.end()) {
+        return;
+    }
+    dependencies.push_back(path);
+
+    std::string directory = path.substr(0, path.find_last_of('/') + 1);
+    std::stringstream source(FileSystem::ReadFile(path));
+    std::string line;
+    while (std::getline(source, line)) {
+        size_t directive = line.find_first_not_of(" \t");
+        if (directive == std::string::npos || line.compare(directive, 8, "#include") != 0) {
+            continue;
+        }
+        size_t open = line.find_first_of("\"<", directive + 8);
+        if (open == std::string::npos) {
+            continue;
+        }
+        size_t close = line.find_first_of("\">", open + 1);
+        if (close == std::string::npos) {
+            continue;
+        }
+
+        std::string include = line.substr(open + 1, close - open - 1);
+        std::replace(include.begin(), include.end(), '\\', '/');
+        if (FileSystem::Exists(directory + include)) {
+            GatherDependencies(directory + include, dependencies);
+        } else if (FileSystem::Exists(include)) {
+            GatherDependencies(include, dependencies);
+        }
     }
+}
 
-    // Get file write of uncached shader
-    HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
-    if (!handle) {
-        Logger::Info("What the fuck? 1");
-        return true;
+std::vector<std::string> ShaderLoader::GetDependencies(const std::string& path)
+{
+    std::vector<std::string> dependencies;
+    GatherDependencies(path, dependencies);
+    return dependencies;
+}
+
+uint64_t ShaderLoader::HashDependency(const std::string& path, HashCache *hashes)
+{
+    if (hashes) {
+        auto it = hashes->find(path);
+        if (it != hashes->end()) {
+            return it->second;
+        }
     }
-    FILETIME temp;
-    GetFileTime(handle, nullptr, nullptr, &temp);
-    CloseHandle(handle);
 
-    // Get shader header
-    std::string cached = GetCachedPath(path);
-    FILE* f = fopen(cached.c_str(), "rb");
-    if (!f) {
-        Logger::Error("What the fuck? 2");
+    // A missing file hashes to 0, which no cached dependency has
+    uint64_t hash = 0;
+    if (FileSystem::Exists(path)) {
+        std::string contents = FileSystem::ReadFile(path);
+        hash = util::hash(contents.data(), contents.size(), 1000) | 1;
+    }
+
+    if (hashes) {
+        (*hashes)[path] = hash;
+    }
+    return hash;
+}
+
+bool ShaderLoader::ShouldReCache(const std::string& path, const std::vector<std::string>& defines, HashCache *hashes)
+{
+    if (!ExistsInCache(path, defines)) {
         return true;
     }
 
+    // Older caches, or one that was cut short, don't have what we need to tell
     OniShaderHeader header;
-    fread(&header, sizeof(header), 1, f);
-    fclose(f);
-
-    // Check if file times are different
-    if (temp.dwLowDateTime != header.LowFileTime || temp.dwHighDateTime != header.HighFileTime) {
+    std::vector<OniShaderDependency> dependencies;
+    if (!ReadCache(GetCachedPath(path, defines), header, &dependencies, nullptr)) {
+        return true;
+    }
+    if (header.CompilerHash != ShaderCompiler::GetCompilerHash(GetTypeFromPath(path), "Main")) {
         return true;
     }
+
+    // Only the files the last compile saw matter: adding an include means editing one of them
+    for (auto& dependency : dependencies) {
+        if (HashDependency(dependency.Path, hashes) != dependency.Hash) {
+            return true;
+        }
+    }
     return false;
 }
 
-void ShaderLoader::CacheShader(const std::string& path)
+bool ShaderLoader::CacheShader(const std::string& path, const std::vector<std::string>& defines)
 {
-    std::string cached = GetCachedPath(path);
+    PROFILE_SCOPE("Compile Shader");
+
+    std::string cached = GetCachedPath(path, defines);
 
     ShaderType type = GetTypeFromPath(path);
     ShaderBytecode bytecode;
 
-    ShaderCompiler::CompileShader(path, "Main", type, bytecode);
+    // Hash before compiling, so that an edit made during the compile gets picked up next time
+    std::vector<std::string> dependencies = GetDependencies(path);
+    std::vector<uint8_t> table;
+    for (auto& dependency : dependencies) {
+        uint64_t hash = HashDependency(dependency, nullptr);
+        uint32_t length = dependency.length();
+
+        size_t offset = table.size();
+        table.resize(offset + sizeof(hash) + sizeof(length) + length);
+        memcpy(table.data() + offset, &hash, sizeof(hash));
+        memcpy(table.data() + offset + sizeof(hash), &length, sizeof(length));
+        memcpy(table.data() + offset + sizeof(hash) + sizeof(length), dependency.data(), length);
+    }
 
-    // Get file time
-    HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
-    FILETIME temp;
-    GetFileTime(handle, nullptr, nullptr, &temp);
-    CloseHandle(handle);
+    if (!ShaderCompiler::CompileShader(path, "Main", type, bytecode, defines)) {
+        return false;
+    }
 
     OniShaderHeader header;
+    header.Magic = SHADER_CACHE_MAGIC;
+    header.Version = SHADER_CACHE_VERSION;
     header.Type = type;
-    header.LowFileTime = temp.dwLowDateTime;
-    header.HighFileTime = temp.dwHighDateTime;
+    header.DependencyCount = dependencies.size();
+    header.CompilerHash = ShaderCompiler::GetCompilerHash(type, "Main");
+    header.DependencySize = table.size();
     header.BytecodeSize = bytecode.bytecode.size();
 
     FILE* f = fopen(cached.c_str(), "wb+");
+    if (!f) {
+        Logger::Error("[SHADER CACHE] Failed to open %s for writing", cached.c_str());
+        return false;
+    }
     fwrite(&header, sizeof(header), 1, f);
+    fwrite(table.data(), table.size(), 1, f);
     fwrite(bytecode.bytecode.data(), bytecode.bytecode.size() * sizeof(uint32_t), 1, f);
     fclose(f);
+    FileSystem::ShadowPak(cached);
 
-    Logger::Info("[SHADER CACHE] Cached shader %s in %s", path.c_str(), cached.c_str());
+    Logger::Info("[SHADER CACHE] Cached shader %s (%u dependencies) in %s", path.c_str(), header.DependencyCount, cached.c_str());
+    return true;
 }
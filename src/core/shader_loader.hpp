@@ -6,31 +6,72 @@
 
 #pragma once
 
+#include <atomic>
 #include <string>
-#include <Windows.h>
+#include <unordered_map>
+#include <vector>
 
 #include "shader_bytecode.hpp"
 
+#define SHADER_CACHE_MAGIC 0x4448534F // 'OSHD'
+#define SHADER_CACHE_VERSION 2
+
 struct OniShaderHeader
 {
+    uint32_t Magic;
+    uint32_t Version;
     ShaderType Type;
-    DWORD LowFileTime;
-    DWORD HighFileTime;
+    uint32_t DependencyCount;
+    uint64_t CompilerHash; // See ShaderCompiler::GetCompilerHash
+    uint32_t DependencySize; // Bytes taken by the dependency table
     uint32_t BytecodeSize;
+    // Followed by the dependency table (per file: uint64_t content hash, uint32_t path length, path), then the bytecode
+};
+
+// A file the cached bytecode was compiled from: the shader itself first, then everything it includes
+struct OniShaderDependency
+{
+    std::string Path;
+    uint64_t Hash;
+};
+
+// Permutations are cached next to the base shader, under a path that also hashes their defines
+struct ShaderPermutationStats
+{
+    std::atomic<uint32_t> Requests = 0;
+    std::atomic<uint32_t> CacheHits = 0;
+    std::atomic<uint32_t> Compiles = 0;
 };
 
 class ShaderLoader
 {
 public:
-    static void TraverseDirectory(const std::string& path);
+    // Recompiles every stale shader on a pool of threads, returns how many shaders had to be (re)cached
+    static uint32_t TraverseDirectory(const std::string& path);
 
-    static bool ExistsInCache(const std::string& path);
-    static ShaderBytecode GetFromCache(const std::string& path);
+    static bool ExistsInCache(const std::string& path, const std::vector<std::string>& defines = {});
 
-    static std::string GetCachedPath(const std::string& path);
+    // Base shaders are kept up to date by TraverseDirectory (or oni_cook). Permutations aren't known to either, so they
+    // are checked and compiled here when they are stale.
+    static ShaderBytecode GetFromCache(const std::string& path, const std::vector<std::string>& defines = {});
 
-private:
-    static bool ShouldReCache(const std::string& path);
-    static void CacheShader(const std::string& path);
+    static std::string GetCachedPath(const std::string& path, const std::vector<std::string>& defines = {});
+
+    // Compiles the shader and writes it to the cache, returns false if it didn't compile
+    static bool CacheShader(const std::string& path, const std::vector<std::string>& defines = {});
     static ShaderType GetTypeFromPath(const std::string& path);
+
+    // The shader and every file it includes, recursively. Includes are looked up next to the including file,
+    // then from the working directory like the compiler does.
+    static std::vector<std::string> GetDependencies(const std::string& path);
+
+    static ShaderPermutationStats& GetPermutationStats();
+private:
+    using HashCache = std::unordered_map<std::string, uint64_t>;
+
+    static bool ShouldReCache(const std::string& path, const std::vector<std::string>& defines = {}, HashCache *hashes = nullptr);
+    static uint64_t HashDependency(const std::string& path, HashCache *hashes);
+
+    // Header and optionally dependencies and bytecode of a cached shader, from the mounted pak or the disk
+    static bool ReadCache(const std::string& cached, OniShaderHeader& header, std::vector<OniShaderDependency> *dependencies, std::vector<uint32_t> *bytecode);
 };
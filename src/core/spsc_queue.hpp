@@ -0,0 +1,52 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-14 16:02:44
+//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+// Bounded ring between exactly one producer thread and one consumer thread, without locks. Push fails when the ring is full,
+// the producer decides what losing the element means.
+template<typename T, uint32_t Capacity>
+class SPSCQueue
+{
+    static_assert((Capacity & (Capacity - 1)) == 0, "SPSCQueue capacity must be a power of two");
+public:
+    bool Push(T&& value)
+    {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail - _head.load(std::memory_order_acquire) == Capacity) {
+            return false;
+        }
+        _slots[tail & (Capacity - 1)] = std::move(value);
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool Pop(T& value)
+    {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        if (head == _tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = std::move(_slots[head & (Capacity - 1)]);
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool Empty()
+    {
+        return _head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire);
+    }
+private:
+    std::array<T, Capacity> _slots;
+
+    // On their own cache lines, each side only writes one of them
+    alignas(64) std::atomic<uint32_t> _head = 0;
+    alignas(64) std::atomic<uint32_t> _tail = 0;
+};
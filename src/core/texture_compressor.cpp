@@ -12,7 +12,17 @@
 #include "util.hpp"
 #include "file_system.hpp"
 #include "log.hpp"
-#include "texture_file.hpp"
+#include "texture_file_header.hpp"
+#include "block_codec.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+
+#undef min
+#undef max
 
 class NVTTErrorHandler : nvtt::ErrorHandler
 {
@@ -58,38 +68,210 @@ public:
 class OniTextureFileWriter : nvtt::OutputHandler
 {
 public:
-    OniTextureFileWriter(const std::string& path, int width, int height, int mipCount, int mode) {
-        f = fopen(path.c_str(), "wb+");
+    // The whole mip chain is kept in memory so that the RDO pass can rewrite blocks before anything hits the disk
+    OniTextureFileWriter(int width, int height, int mipCount, int mode) {
+        _header.width = width;
+        _header.height = height;
+        _header.mipCount = mipCount;
+        _header.mode = mode;
+    }
+
+    virtual void beginImage(int size, int width, int height, int depth, int face, int miplevel) override {
+        _mipStart = _data.size();
+        _data.reserve(_data.size() + size);
+    }
+    virtual void endImage() override {}
+
+    virtual bool writeData(const void * data, int size) override {
+        const uint8_t *bytes = reinterpret_cast<const uint8_t*>(data);
+        _data.insert(_data.end(), bytes, bytes + size);
+        return true;
+    }
+
+    uint8_t *GetLastMip() { return _data.data() + _mipStart; }
+    uint64_t GetRawSize() { return _data.size(); }
+
+    // Returns the size of the file, or 0 if it couldn't be written
+    uint64_t Write(const std::string& path, bool compress) {
+        FILE *f = fopen(path.c_str(), "wb+");
         if (!f) {
             Logger::Error("Failed to fopen file %s", path.c_str());
+            return 0;
         }
 
-        TextureFile::Header header;
-        header.width = width;
-        header.height = height;
-        header.mipCount = mipCount;
-        header.mode = mode;
-        
-        fwrite(&header, sizeof(header), 1, f);
-    }
+        TextureFileHeader header = _header;
+        std::vector<uint8_t> compressed;
+        if (compress) {
+            header.mode |= TEXTURE_FILE_COMPRESSED_FLAG;
+            BlockCodec::CompressChunked(_data.data(), _data.size(), compressed);
+        }
+        const std::vector<uint8_t>& payload = compress ? compressed : _data;
 
-    ~OniTextureFileWriter() {
+        fwrite(&header, sizeof(header), 1, f);
+        fwrite(payload.data(), payload.size(), 1, f);
         fclose(f);
+        FileSystem::ShadowPak(path);
+
+        return sizeof(header) + payload.size();
     }
 
-    virtual void beginImage(int size, int width, int height, int depth, int face, int miplevel) override {}
-    virtual void endImage() override {}
+private:
+    TextureFileHeader _header = {};
+    std::vector<uint8_t> _data;
+    size_t _mipStart = 0;
+};
 
-    virtual bool writeData(const void * data, int size) override {
-        fwrite(data, size, 1, f);
-        return true;
+struct RDOStats
+{
+    double BaseError = 0.0;
+    double Error = 0.0;
+    uint64_t Texels = 0;
+    uint32_t Blocks = 0;
+    uint32_t Substituted = 0;
+
+    static float PSNR(double error, uint64_t texels) {
+        double mse = error / std::max<double>(texels * 4.0, 1.0);
+        return mse <= 0.0 ? 99.0f : float(10.0 * log10(255.0 * 255.0 / mse));
     }
+};
 
-private:
-    FILE *f;
+// 4x4 RGBA texels in the 0-255 range. Only texels inside the image are filled in.
+struct RDOBlock
+{
+    float Texels[16][4];
+    uint32_t Count;
 };
 
-void TextureCompressor::TraverseDirectory(const std::string& path, TextureCompressorFormat format)
+static void ReadBlock(const nvtt::Surface& surface, uint32_t bx, uint32_t by, RDOBlock& block)
+{
+    int width = surface.width();
+    int height = surface.height();
+    const float *channels[4] = { surface.channel(0), surface.channel(1), surface.channel(2), surface.channel(3) };
+
+    block.Count = 0;
+    for (uint32_t y = 0; y < 4; y++) {
+        for (uint32_t x = 0; x < 4; x++) {
+            int px = bx * 4 + x;
+            int py = by * 4 + y;
+            if (px >= width || py >= height) {
+                continue;
+            }
+            for (int c = 0; c < 4; c++) {
+                block.Texels[y * 4 + x][c] = std::clamp(channels[c][py * width + px], 0.0f, 1.0f) * 255.0f;
+            }
+            block.Count++;
+        }
+    }
+}
+
+// Squared error, giving up as soon as it goes above the limit
+static float BlockError(const RDOBlock& a, const RDOBlock& b, float limit = FLT_MAX)
+{
+    float error = 0.0f;
+    for (uint32_t i = 0; i < a.Count; i++) {
+        for (int c = 0; c < 4; c++) {
+            float d = a.Texels[i][c] - b.Texels[i][c];
+            error += d * d;
+        }
+        if (error > limit) {
+            break;
+        }
+    }
+    return error;
+}
+
+// Runs over the encoded blocks of one mip, replacing a block with a recently seen one when the extra error is small enough.
+// Candidates are the last RDOWindow distinct blocks, which all sit well within the codec's 64KB match distance.
+static void OptimizeMip(uint8_t *blocks, const nvtt::Surface& source, nvtt::Format format, const TextureCompressorOptions& options, RDOStats& stats)
+{
+    uint32_t width = source.width();
+    uint32_t height = source.height();
+    uint32_t blocksX = (width + 3) / 4;
+    uint32_t blocksY = (height + 3) / 4;
+    uint32_t blockSize = format == nvtt::Format_BC1 ? 8 : 16;
+
+    nvtt::Surface decoded;
+    if (!decoded.setImage2D(format, width, height, blocks)) {
+        Logger::Warn("[TEXTURE CACHE] Failed to decode mip for the RDO pass, leaving it as is");
+        return;
+    }
+
+    struct Candidate
+    {
+        uint32_t Index;
+        RDOBlock Decoded;
+    };
+    std::vector<Candidate> window;
+    window.reserve(options.RDOWindow);
+    uint32_t windowHead = 0;
+
+    RDOBlock original;
+    RDOBlock encoded;
+    for (uint32_t by = 0; by < blocksY; by++) {
+        for (uint32_t bx = 0; bx < blocksX; bx++) {
+            uint32_t index = by * blocksX + bx;
+            uint8_t *block = blocks + index * blockSize;
+
+            ReadBlock(source, bx, by, original);
+            ReadBlock(decoded, bx, by, encoded);
+
+            float baseError = BlockError(original, encoded);
+            stats.BaseError += baseError;
+            stats.Texels += original.Count;
+            stats.Blocks++;
+
+            // Partial blocks at the edges don't have all their texels to compare, leave them alone
+            if (original.Count != 16) {
+                stats.Error += baseError;
+                continue;
+            }
+
+            // Already a repeat of a recent block, nothing to gain
+            bool repeated = false;
+            int best = -1;
+            float bestError = baseError + options.RDOLambda * 16.0f;
+            for (uint32_t i = 0; i < window.size(); i++) {
+                if (memcmp(blocks + window[i].Index * blockSize, block, blockSize) == 0) {
+                    repeated = true;
+                    break;
+                }
+                float error = BlockError(original, window[i].Decoded, bestError);
+                if (error <= bestError) {
+                    best = int(i);
+                    bestError = error;
+                }
+            }
+
+            if (!repeated && best >= 0) {
+                memcpy(block, blocks + window[best].Index * blockSize, blockSize);
+                stats.Error += bestError;
+                stats.Substituted++;
+                continue;
+            }
+            stats.Error += baseError;
+            if (repeated) {
+                continue;
+            }
+
+            Candidate candidate = { index, encoded };
+            if (window.size() < options.RDOWindow) {
+                window.push_back(candidate);
+            } else if (!window.empty()) {
+                window[windowHead] = candidate;
+                windowHead = (windowHead + 1) % options.RDOWindow;
+            }
+        }
+    }
+}
+
+uint32_t TextureCompressor::TraverseDirectory(const std::string& path, TextureCompressorFormat format)
+{
+    TextureCompressorOptions options;
+    options.Format = format;
+    return TraverseDirectory(path, options);
+}
+
+uint32_t TextureCompressor::TraverseDirectory(const std::string& path, const TextureCompressorOptions& options)
 {
     if (!FileSystem::Exists(".cache")) {
         FileSystem::CreateDirectoryFromPath(".cache/");
@@ -98,10 +280,8 @@ void TextureCompressor::TraverseDirectory(const std::string& path, TextureCompre
         FileSystem::CreateDirectoryFromPath(".cache/textures/");
     }
 
-    NVTTErrorHandler errorHandler;
-
     nvtt::Context context;
-    context.enableCudaAcceleration(true);
+    context.enableCudaAcceleration(options.CUDA);
     
     if (context.isCudaAccelerationEnabled()) {
         Logger::Info("[TEXTURE CACHE] Thankfully for you, NVTT found a CUDA context! Enjoy the blazingly fast caching process.");
@@ -109,17 +289,14 @@ void TextureCompressor::TraverseDirectory(const std::string& path, TextureCompre
         Logger::Info("[TEXTURE CACHE] No CUDA for you. Maybe update drivers, and if you have an AMD card... I'm sorry :(");
     }
 
-    nvtt::CompressionOptions compressionOptions;
-    compressionOptions.setFormat(nvtt::Format(format));
-
-    int mode = format == TextureCompressorFormat::BC1 ? 1 : 7;
+    uint64_t totalRaw = 0;
+    uint64_t totalWritten = 0;
+    uint32_t compressedCount = 0;
 
     for (const auto& dirEntry : std::filesystem::recursive_directory_iterator(path)) {
         std::string entryPath = dirEntry.path().string();
         std::replace(entryPath.begin(), entryPath.end(), '\\', '/');
         
-        std::string cached = GetCachedPath(entryPath);
-        
         if (!IsValidExtension(FileSystem::GetFileExtension(entryPath))) {
             continue;
         }
@@ -129,38 +306,99 @@ void TextureCompressor::TraverseDirectory(const std::string& path, TextureCompre
             continue;
         }
 
-        nvtt::Surface image;
-        if (!image.load(entryPath.c_str())) {
-            Logger::Error("nvtt: Failed to load texture");
+        uint64_t rawSize;
+        uint64_t diskSize;
+        if (!CompressFile(entryPath, options, context, &rawSize, &diskSize)) {
+            continue;
         }
+        totalRaw += rawSize;
+        totalWritten += diskSize;
+        compressedCount++;
+    }
+
+    if (compressedCount) {
+        Logger::Info("[TEXTURE CACHE] Compressed %u textures: %.2f MB of blocks, %.2f MB on disk (%.2fx)",
+                     compressedCount, totalRaw / (1024.0f * 1024.0f), totalWritten / (1024.0f * 1024.0f),
+                     float(totalRaw) / float(totalWritten));
+    }
+    return compressedCount;
+}
 
-        int mipCount = image.countMipmaps();
+bool TextureCompressor::CompressFile(const std::string& path, const TextureCompressorOptions& options, nvtt::Context& context, uint64_t *rawSize, uint64_t *diskSize)
+{
+    PROFILE_SCOPE("Compress Texture");
 
-        OniTextureFileWriter writer(cached, image.width(), image.height(), mipCount, mode);
+    std::string cached = GetCachedPath(path);
 
-        nvtt::OutputOptions outputOptions;
-        outputOptions.setErrorHandler(reinterpret_cast<nvtt::ErrorHandler*>(&errorHandler));
-        outputOptions.setOutputHandler(reinterpret_cast<nvtt::OutputHandler*>(&writer));
+    NVTTErrorHandler errorHandler;
 
-        for (int i = 0; i < mipCount; i++) {
-            if (!context.compress(image, 0, i, compressionOptions, outputOptions)) {
-                Logger::Error("Failed to compress texture!");
-            }
+    nvtt::CompressionOptions compressionOptions;
+    compressionOptions.setFormat(nvtt::Format(options.Format));
 
-            if (i == mipCount - 1) break;
+    int mode = options.Format == TextureCompressorFormat::BC1 ? 1 : 7;
 
-            // Prepare the next mip:
-            image.toLinearFromSrgb();
-            image.premultiplyAlpha();
+    nvtt::Surface image;
+    if (!image.load(path.c_str())) {
+        Logger::Error("nvtt: Failed to load texture");
+        return false;
+    }
 
-            image.buildNextMipmap(nvtt::MipmapFilter_Box);
-        
-            image.demultiplyAlpha();
-            image.toSrgb();
+    int mipCount = image.countMipmaps();
+
+    OniTextureFileWriter writer(image.width(), image.height(), mipCount, mode);
+    RDOStats rdo;
+
+    nvtt::OutputOptions outputOptions;
+    outputOptions.setErrorHandler(reinterpret_cast<nvtt::ErrorHandler*>(&errorHandler));
+    outputOptions.setOutputHandler(reinterpret_cast<nvtt::OutputHandler*>(&writer));
+
+    for (int i = 0; i < mipCount; i++) {
+        if (!context.compress(image, 0, i, compressionOptions, outputOptions)) {
+            Logger::Error("Failed to compress texture!");
         }
+        if (options.RDO) {
+            OptimizeMip(writer.GetLastMip(), image, nvtt::Format(options.Format), options, rdo);
+        }
+
+        if (i == mipCount - 1) break;
+
+        // Prepare the next mip:
+        image.toLinearFromSrgb();
+        image.premultiplyAlpha();
+
+        image.buildNextMipmap(nvtt::MipmapFilter_Box);
+    
+        image.demultiplyAlpha();
+        image.toSrgb();
+    }
 
-        Logger::Info("Compressed %s to %s", entryPath.c_str(), cached.c_str());
+    uint64_t written = writer.Write(cached, options.Compress);
+    if (!written) {
+        return false;
     }
+
+    float ratio = float(writer.GetRawSize()) / float(written);
+    if (options.RDO) {
+        float basePSNR = RDOStats::PSNR(rdo.BaseError, rdo.Texels);
+        float psnr = RDOStats::PSNR(rdo.Error, rdo.Texels);
+        Logger::Info("[TEXTURE CACHE] Compressed %s to %s: %.2f MB -> %.2f MB (%.2fx), PSNR %.2f dB -> %.2f dB (-%.2f dB), %u/%u blocks reused",
+                     path.c_str(), cached.c_str(),
+                     writer.GetRawSize() / (1024.0f * 1024.0f), written / (1024.0f * 1024.0f), ratio,
+                     basePSNR, psnr, basePSNR - psnr,
+                     rdo.Substituted, rdo.Blocks);
+    } else {
+        Logger::Info("[TEXTURE CACHE] Compressed %s to %s: %.2f MB -> %.2f MB (%.2fx)",
+                     path.c_str(), cached.c_str(),
+                     writer.GetRawSize() / (1024.0f * 1024.0f), written / (1024.0f * 1024.0f), ratio);
+    }
+
+    if (rawSize) {
+        *rawSize = writer.GetRawSize();
+    }
+    if (diskSize) {
+        *diskSize = written;
+    }
+    return true;
 }
 
 bool TextureCompressor::ExistsInCache(const std::string& path)
@@ -179,18 +417,6 @@ std::string TextureCompressor::GetCachedPath(const std::string& path)
     return path_ss.str();
 }
 
-TextureFile TextureCompressor::GetFromCache(const std::string& path)
-{
-    // Sanitize in case
-    if (!ExistsInCache(path)) {
-        Logger::Error("Texture %s is uncached. Please restart Oni.", path.c_str());
-    }
-    
-    std::string cached = GetCachedPath(path);
-    Logger::Info("[TEXTURE CACHE] Getting texture %s (cached : %s)", path.c_str(), cached.c_str());
-    return TextureFile(cached);
-}
-
 bool TextureCompressor::IsValidExtension(const std::string& extension)
 {
     if (extension == ".png")
@@ -9,7 +9,6 @@
 #include <string>
 
 #include "bitmap.hpp"
-#include "texture_file.hpp"
 
 #include <nvtt/nvtt.h>
 
@@ -19,17 +18,38 @@ enum class TextureCompressorFormat
     BC7 = nvtt::Format_BC7
 };
 
+struct TextureCompressorOptions
+{
+    TextureCompressorFormat Format = TextureCompressorFormat::BC7;
+
+    // Store the mip chain through BlockCodec instead of as raw blocks
+    bool Compress = true;
+
+    // Rate-distortion pass: a block can be swapped for one of the last few distinct blocks of its mip if that costs
+    // at most RDOLambda of extra squared error per texel (summed over RGBA, 0-255 range). Repeated blocks are what the
+    // codec feeds on. It's lossy, so it has to be asked for.
+    bool RDO = false;
+    float RDOLambda = 12.0f;
+    uint32_t RDOWindow = 32;
+
+    bool CUDA = true;
+};
+
+class TextureFile;
+
 class TextureCompressor
 {
 public:
-    // Compresses every texture file in given directory
-    static void TraverseDirectory(const std::string& path, TextureCompressorFormat format);
+    // Compresses every texture file in given directory, returns how many weren't cached yet
+    static uint32_t TraverseDirectory(const std::string& path, TextureCompressorFormat format);
+    static uint32_t TraverseDirectory(const std::string& path, const TextureCompressorOptions& options);
+
+    // Compresses a single texture to its cached path. Sizes are those of the raw blocks and of the file.
+    static bool CompressFile(const std::string& path, const TextureCompressorOptions& options, nvtt::Context& context, uint64_t *rawSize = nullptr, uint64_t *diskSize = nullptr);
 
     static bool ExistsInCache(const std::string& path);
     static TextureFile GetFromCache(const std::string& path);
 
     static std::string GetCachedPath(const std::string& path);
-
-private:
     static bool IsValidExtension(const std::string& extension);
 };
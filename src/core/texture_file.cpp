@@ -7,36 +7,146 @@
 #include "texture_file.hpp"
 #include "file_system.hpp"
 #include "log.hpp"
+#include "block_codec.hpp"
+#include "texture_compressor.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+
+#undef min
+#undef max
 
 TextureFile::TextureFile(const std::string& path)
 {
     Load(path);
 }
 
+TextureFile::TextureFile(const std::string& path, std::vector<uint8_t>&& contents)
+{
+    Load(path, std::move(contents));
+}
+
 TextureFile::~TextureFile()
 {
-    if (_bytes != nullptr) {
-        free(_bytes);
-    }
+    Unload();
 }
 
 void TextureFile::Load(const std::string& path)
 {
-    if (!FileSystem::Exists(path)) {
+    Unload();
+
+    // Cooked textures are read front to back by the uploader, either out of the pak or out of a mapping of the loose file
+    _view = FileSystem::Map(path, MappedFile::Access::Sequential);
+    if (!_view.IsValid()) {
         Logger::Error("[TEXTURE FILE] %s doesn't exist!", path.c_str());
+        return;
     }
 
-    uint64_t size = FileSystem::GetFileSize(path);
-    _byteSize = size - sizeof(Header);
+    // Ask the kernel to start paging in the whole file, the uploader is going to touch every byte of it anyway.
+    _view.Prefetch();
+    Parse(path);
+}
 
-    _bytes = malloc(_byteSize);
+void TextureFile::Load(const std::string& path, std::vector<uint8_t>&& contents)
+{
+    Unload();
 
-    // used to inspect the raw string in remedybg
-    const char* debugString = path.c_str();
-    FILE* f = fopen(debugString, "rb+");
-    fread(&_header, sizeof(_header), 1, f);
-    fread(_bytes, _byteSize, 1, f);
-    fclose(f);
+    // The view owns the buffer, so raw mip chains can point into it just like they point into a mapping
+    std::shared_ptr<std::vector<uint8_t>> owner = std::make_shared<std::vector<uint8_t>>(std::move(contents));
+    _view = FileView(owner->data(), owner->size(), owner);
+    Parse(path);
+}
+
+void TextureFile::Parse(const std::string& path)
+{
+    PROFILE_SCOPE("Parse Texture File");
+
+    const uint8_t *contents = _view.GetData();
+    uint64_t contentSize = _view.GetSize();
+    if (contentSize < sizeof(Header)) {
+        Logger::Error("[TEXTURE FILE] %s is too small to be a cooked texture!", path.c_str());
+        Unload();
+        return;
+    }
+
+    memcpy(&_header, contents, sizeof(Header));
+    _bytes = const_cast<uint8_t*>(contents) + sizeof(Header);
+    _byteSize = contentSize - sizeof(Header);
+
+    // A 32 bit side has at most 32 mips, anything else would send the offset math off the end of the chain
+    if (_header.mipCount == 0 || _header.mipCount > 32) {
+        Logger::Error("[TEXTURE FILE] %s has %u mips!", path.c_str(), _header.mipCount);
+        Unload();
+        return;
+    }
+
+    if (IsCompressed()) {
+        const uint8_t *compressed = reinterpret_cast<uint8_t*>(_bytes);
+
+        uint64_t rawSize = GetMipOffset(_header.mipCount);
+        if (BlockCodec::GetChunkedRawSize(compressed, _byteSize) != rawSize) {
+            Logger::Error("[TEXTURE FILE] %s has a mip chain of the wrong size!", path.c_str());
+            Unload();
+            return;
+        }
+
+        _decompressed.resize(rawSize);
+        if (!BlockCodec::DecompressChunked(compressed, _byteSize, _decompressed.data())) {
+            Logger::Error("[TEXTURE FILE] %s is corrupted!", path.c_str());
+            Unload();
+            return;
+        }
+        CloseMapping();
+
+        _bytes = _decompressed.data();
+        _byteSize = _decompressed.size();
+    } else if (_byteSize < GetMipOffset(_header.mipCount)) {
+        Logger::Error("[TEXTURE FILE] %s has a mip chain of the wrong size!", path.c_str());
+        Unload();
+        return;
+    }
+}
+
+void TextureFile::Unload()
+{
+    CloseMapping();
+    _decompressed.clear();
+    _decompressed.shrink_to_fit();
+    _bytes = nullptr;
+    _byteSize = 0;
+}
+
+void TextureFile::CloseMapping()
+{
+    _view.Reset();
+}
+
+uint64_t TextureFile::GetMipSize(uint32_t mip)
+{
+    uint64_t width = std::max(_header.width >> mip, 1u);
+    uint64_t height = std::max(_header.height >> mip, 1u);
+    uint64_t blockSize = Format() == TextureFormat::BC1 ? 8 : 16;
+
+    return ((width + 3) / 4) * ((height + 3) / 4) * blockSize;
+}
+
+uint64_t TextureFile::GetMipOffset(uint32_t mip)
+{
+    uint64_t offset = 0;
+    for (uint32_t i = 0; i < mip; i++) {
+        offset += GetMipSize(i);
+    }
+    return offset;
+}
+
+uint32_t TextureFile::GetMipTailStart(uint32_t maxSize)
+{
+    for (uint32_t i = 0; i < _header.mipCount; i++) {
+        if (std::max(_header.width >> i, _header.height >> i) <= maxSize) {
+            return i;
+        }
+    }
+    return _header.mipCount - 1;
 }
 
 Bitmap TextureFile::ToBitmap()
@@ -47,10 +157,21 @@ Bitmap TextureFile::ToBitmap()
     result.Mips = _header.mipCount;
     result.HDR = false;
     result.Delete = false;
-    result.Bytes = reinterpret_cast<char*>(malloc(_byteSize + 1));
+    result.Bytes = reinterpret_cast<char*>(_bytes);
     result.BufferSize = _byteSize;
 
-    memcpy(result.Bytes, _bytes, _byteSize);
-
     return result;
 }
+
+// Defined here rather than with the compressor, which has to build without the RHI
+TextureFile TextureCompressor::GetFromCache(const std::string& path)
+{
+    // Sanitize in case
+    if (!ExistsInCache(path)) {
+        Logger::Error("Texture %s is uncached. Please restart Oni.", path.c_str());
+    }
+    
+    std::string cached = GetCachedPath(path);
+    Logger::Info("[TEXTURE CACHE] Getting texture %s (cached : %s)", path.c_str(), cached.c_str());
+    return TextureFile(cached);
+}
@@ -7,37 +7,62 @@
 #pragma once
 
 #include <cstdint>
+#include <vector>
 
 #include "bitmap.hpp"
 #include "rhi/texture.hpp"
+#include "core/mapped_file.hpp"
+#include "core/texture_file_header.hpp"
 
 class TextureFile
 {
 public:
-    struct Header
-    {
-        uint32_t width;
-        uint32_t height;
-        uint32_t mipCount;
-        uint32_t mode;
-    };
+    using Header = TextureFileHeader;
 
     TextureFile() {}
     TextureFile(const std::string& path);
+    TextureFile(const std::string& path, std::vector<uint8_t>&& contents);
+    TextureFile(const TextureFile&) = delete;
+    TextureFile& operator=(const TextureFile&) = delete;
     ~TextureFile();
 
+    // Maps the cooked file in memory, or finds it in the mounted pak. Raw mip chains are never copied to the heap: they
+    // point straight into the view. Compressed ones are decompressed in parallel into a buffer owned by the file, and the
+    // mapping is closed right after.
     void Load(const std::string& path);
+    // Same, with the contents of the file already read (through the IOQueue). The file keeps the buffer.
+    void Load(const std::string& path, std::vector<uint8_t>&& contents);
+    void Unload();
+
+    // False when the file was missing or failed to parse, in which case nothing below is meaningful
+    bool IsValid() { return _bytes != nullptr; }
 
     uint32_t Width() { return _header.width; }
     uint32_t Height() { return _header.height; }
     uint32_t MipCount() { return _header.mipCount; }
-    TextureFormat Format() { return _header.mode == 1 ? TextureFormat::BC1 : TextureFormat::BC7; }
+    TextureFormat Format() { return (_header.mode & TEXTURE_FILE_MODE_MASK) == 1 ? TextureFormat::BC1 : TextureFormat::BC7; }
+    bool IsCompressed() { return _header.mode & TEXTURE_FILE_COMPRESSED_FLAG; }
 
     void *GetMipChainStart() { return _bytes; }
+    uint64_t GetMipChainSize() { return _byteSize; }
+
+    // Size and offset from the start of the mip chain of the given mip, in bytes
+    uint64_t GetMipSize(uint32_t mip);
+    uint64_t GetMipOffset(uint32_t mip);
+
+    // First mip whose largest side is at most the given size
+    uint32_t GetMipTailStart(uint32_t maxSize);
 
+    // The returned bitmap aliases the mapping, so it must not outlive this file.
     Bitmap ToBitmap();
 private:
-    Header _header;
+    void Parse(const std::string& path);
+    void CloseMapping();
+
+    Header _header = {};
     void *_bytes = nullptr;
-    uint64_t _byteSize;
+    uint64_t _byteSize = 0;
+    std::vector<uint8_t> _decompressed;
+
+    FileView _view;
 };
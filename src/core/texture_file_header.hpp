@@ -0,0 +1,22 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-12 13:05:19
+//
+
+#pragma once
+
+#include <cstdint>
+
+// Set in TextureFileHeader::mode when the mip chain is stored through BlockCodec::CompressChunked
+#define TEXTURE_FILE_COMPRESSED_FLAG (1 << 8)
+#define TEXTURE_FILE_MODE_MASK 0xFF
+
+// Start of every cooked .oni texture. Kept apart from TextureFile so that the cooker doesn't need the RHI.
+struct TextureFileHeader
+{
+    uint32_t width;
+    uint32_t height;
+    uint32_t mipCount;
+    uint32_t mode; // 1 for BC1, 7 for BC7, plus TEXTURE_FILE_COMPRESSED_FLAG
+};
@@ -0,0 +1,473 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-02 19:30:07
+//
+
+#include "texture_streamer.hpp"
+
+#include "core/model.hpp"
+#include "core/log.hpp"
+#include "core/texture_file.hpp"
+#include "core/profiler.hpp"
+
+#include <ImGui/imgui.h>
+
+#include <algorithm>
+#include <cmath>
+
+#undef min
+#undef max
+
+static TextureStreamer::Ptr Streamer;
+
+void TextureStreamer::SetStreamer(Ptr streamer)
+{
+    Streamer = streamer;
+}
+
+TextureStreamer::Ptr TextureStreamer::Get()
+{
+    return Streamer;
+}
+
+TextureStreamer::TextureStreamer(RenderContext::Ptr context, uint64_t budget)
+    : _context(context), _stagingUploader(context->CreateUploader()), _budget(budget)
+{
+    for (int i = 0; i < STREAMER_WORKER_COUNT; i++) {
+        _workers.emplace_back(&TextureStreamer::WorkerLoop, this);
+    }
+}
+
+TextureStreamer::~TextureStreamer()
+{
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        _running = false;
+    }
+    _wakeUp.notify_all();
+    for (auto& worker : _workers) {
+        worker.join();
+    }
+
+    // Whatever the workers staged never made it to a texture
+    for (auto& result : _results) {
+        Texture::Retired retired;
+        retired.Resource = result.Resource;
+        retired.Release();
+    }
+    for (auto& retiredList : _retired) {
+        for (auto& retired : retiredList) {
+            retired.Release();
+        }
+    }
+}
+
+Texture::Ptr TextureStreamer::Load(const std::string& path, Uploader& uploader, const std::string& name, std::vector<uint8_t> contents)
+{
+    PROFILE_SCOPE("Load Texture");
+
+    auto it = _lookup.find(path);
+    if (it != _lookup.end()) {
+        return _entries[it->second].Texture;
+    }
+
+    if (!_started) {
+        _timer.Restart();
+        _started = true;
+    }
+
+    TextureFile file;
+    if (contents.empty()) {
+        file.Load(path);
+    } else {
+        file.Load(path, std::move(contents));
+    }
+
+    Entry entry = {};
+    entry.Path = path;
+    entry.Name = name;
+    entry.Width = file.Width();
+    entry.Height = file.Height();
+    entry.MipCount = file.MipCount();
+    entry.Format = file.Format();
+    for (uint32_t i = 0; i < entry.MipCount; i++) {
+        entry.MipBytes.push_back(file.GetMipSize(i));
+    }
+    entry.LastUsed.resize(entry.MipCount, 0);
+
+    // Block compressed resources need their top mip to be a whole number of blocks
+    entry.TailMip = file.GetMipTailStart(STREAMER_MIP_TAIL_SIZE);
+    while (!IsValidBaseMip(entry, entry.TailMip)) {
+        entry.TailMip--;
+    }
+    entry.ResidentMip = entry.TailMip;
+    entry.RequestedMip = entry.TailMip;
+
+    entry.Texture = _context->CreateTexture(std::max(entry.Width >> entry.TailMip, 1u), std::max(entry.Height >> entry.TailMip, 1u), entry.Format, TextureUsage::ShaderResource, true, name);
+    entry.Texture->SetResidentMip(entry.TailMip);
+    entry.Texture->BuildShaderResource();
+    uploader.CopyHostToDeviceCompressedTexture(&file, entry.Texture, entry.TailMip);
+
+    _residentBytes += BytesFrom(entry, entry.TailMip);
+    _lookup[path] = _entries.size();
+    _textureLookup[entry.Texture.get()] = _entries.size();
+    _entries.push_back(entry);
+    _stats.Textures++;
+
+    return entry.Texture;
+}
+
+void TextureStreamer::WorkerLoop()
+{
+    Profiler::SetThreadName("Texture Streamer");
+
+    while (true) {
+        Request request;
+        {
+            std::unique_lock<std::mutex> lock(_lock);
+            _wakeUp.wait(lock, [this]() { return !_running || !_requests.empty(); });
+            if (!_running) {
+                return;
+            }
+
+            auto highest = std::max_element(_requests.begin(), _requests.end(), [](const Request& a, const Request& b) {
+                return a.Priority < b.Priority;
+            });
+            request = std::move(*highest);
+            _requests.erase(highest);
+            _inProgress++;
+        }
+
+        TextureFile file(request.Path);
+        uint32_t mipCount = request.ResidentMip - request.TargetMip;
+
+        Result result;
+        result.Index = request.Index;
+        result.TargetMip = request.TargetMip;
+
+        // The file is read again from disk, and may have been re-cooked or damaged since the texture was created. The
+        // offsets below trust its header, so it has to describe the same mip chain.
+        bool matches = file.IsValid()
+                    && file.MipCount() == request.TargetMip + request.Desc.MipLevels
+                    && std::max(file.Width() >> request.TargetMip, 1u) == request.Desc.Width
+                    && std::max(file.Height() >> request.TargetMip, 1u) == request.Desc.Height
+                    && DXGI_FORMAT(file.Format()) == request.Desc.Format;
+        if (matches) {
+            result.Size = file.GetMipOffset(request.ResidentMip) - file.GetMipOffset(request.TargetMip);
+            result.Resource = AllocateMips(request.Desc, request.Name);
+            result.Staging = _stagingUploader.StageCompressedTexture(&file, request.Desc, request.TargetMip, mipCount);
+        } else {
+            Logger::Error("[STREAMER] %s doesn't match the texture it was loaded as, skipping its stream in", request.Path.c_str());
+            result.Size = 0;
+            result.Resource = nullptr;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(_lock);
+            _results.push_back(std::move(result));
+            _inProgress--;
+        }
+    }
+}
+
+void TextureStreamer::EstimateUsage(const std::vector<Model>& models, glm::vec3 cameraPosition, uint32_t viewportHeight)
+{
+    for (auto& entry : _entries) {
+        entry.RequestedMip = entry.TailMip;
+        entry.Priority = 0.0f;
+    }
+
+    // Approximate the on screen size of every primitive with its bounding sphere, and assume its UVs span the texture once
+    for (auto& model : models) {
+        for (auto& primitive : model.Primitives) {
+            const Material& material = model.Materials[primitive.MaterialIndex];
+
+            glm::vec3 center = glm::vec3(primitive.Transform.Matrix * glm::vec4(primitive.BoundingBox.Center, 1.0f));
+            float scale = std::max({ glm::length(glm::vec3(primitive.Transform.Matrix[0])),
+                                     glm::length(glm::vec3(primitive.Transform.Matrix[1])),
+                                     glm::length(glm::vec3(primitive.Transform.Matrix[2])) });
+            float radius = glm::length(primitive.BoundingBox.Extent) * 0.5f * scale;
+            float distance = std::max(glm::length(center - cameraPosition) - radius, 0.1f);
+            float coverage = radius / distance;
+            float pixels = std::max(coverage * viewportHeight, 1.0f);
+
+            for (auto& texture : { material.AlbedoTexture, material.NormalTexture, material.PBRTexture, material.EmissiveTexture, material.AOTexture }) {
+                if (!texture) {
+                    continue;
+                }
+                auto it = _textureLookup.find(texture.get());
+                if (it == _textureLookup.end()) {
+                    continue;
+                }
+                Entry& entry = _entries[it->second];
+
+                float texels = float(std::max(entry.Width, entry.Height));
+                uint32_t mip = uint32_t(std::clamp(std::floor(std::log2(texels / pixels)), 0.0f, float(entry.TailMip)));
+
+                entry.RequestedMip = std::min(entry.RequestedMip, mip);
+                entry.Priority = std::max(entry.Priority, coverage);
+                for (uint32_t i = mip; i < entry.MipCount; i++) {
+                    entry.LastUsed[i] = _frame;
+                }
+            }
+        }
+    }
+
+    _stats.RequestedBytes = 0;
+    for (auto& entry : _entries) {
+        while (!IsValidBaseMip(entry, entry.RequestedMip)) {
+            entry.RequestedMip--;
+        }
+        _stats.RequestedBytes += BytesFrom(entry, entry.RequestedMip);
+    }
+}
+
+void TextureStreamer::ApplyResults(CommandBuffer::Ptr cmdBuf, uint32_t frameIndex)
+{
+    std::vector<Result> results;
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+
+        uint64_t budget = 0;
+        auto it = _results.begin();
+        while (it != _results.end() && budget < STREAMER_FRAME_BUDGET) {
+            budget += it->Size;
+            results.push_back(std::move(*it));
+            it++;
+        }
+        _results.erase(_results.begin(), it);
+    }
+
+    for (auto& result : results) {
+        Entry& entry = _entries[result.Index];
+        if (!result.Resource) {
+            // Nothing to upload, give the reserved memory back and stop asking for the file
+            _pendingBytes -= BytesFrom(entry, result.TargetMip) - BytesFrom(entry, entry.ResidentMip);
+            entry.Busy = false;
+            entry.Broken = true;
+            _stats.Failed++;
+            continue;
+        }
+        uint32_t streamedMips = entry.ResidentMip - result.TargetMip;
+
+        // The new resource gets the streamed mips on top, and a copy of what was already resident below
+        cmdBuf->ImageBarrier(entry.Texture, TextureLayout::CopySource);
+        Texture::Retired retired = entry.Texture->ReplaceResource(result.Resource, result.TargetMip);
+        cmdBuf->CopyTextureFileToTexture(entry.Texture, result.Staging, 0, streamedMips);
+        cmdBuf->CopyTextureMips(result.Resource, streamedMips, retired.Resource, 0, entry.MipCount - entry.ResidentMip);
+        cmdBuf->ImageBarrier(entry.Texture, TextureLayout::ShaderResource);
+
+        _inFlightStaging[frameIndex].push_back(result.Staging);
+        _retired[frameIndex].push_back(std::move(retired));
+
+        _pendingBytes -= result.Size;
+        _residentBytes += result.Size;
+        entry.ResidentMip = result.TargetMip;
+        entry.Busy = false;
+
+        _stats.Completed++;
+        _stats.BytesStreamed += result.Size;
+    }
+}
+
+void TextureStreamer::EvictUntil(CommandBuffer::Ptr cmdBuf, uint32_t frameIndex, uint64_t target)
+{
+    while (_residentBytes + _pendingBytes > target) {
+        // Least recently used top mip among the ones the view doesn't ask for anymore
+        Entry *victim = nullptr;
+        for (auto& entry : _entries) {
+            if (entry.Busy || entry.ResidentMip >= entry.RequestedMip) {
+                continue;
+            }
+            if (!victim || entry.LastUsed[entry.ResidentMip] < victim->LastUsed[victim->ResidentMip]) {
+                victim = &entry;
+            }
+        }
+        if (!victim) {
+            return;
+        }
+
+        // Drop one mip at a time so that the next least recently used texture gets a chance to give memory back first
+        uint32_t newMip = victim->ResidentMip + 1;
+        while (newMip < victim->RequestedMip && !IsValidBaseMip(*victim, newMip)) {
+            newMip++;
+        }
+        if (!IsValidBaseMip(*victim, newMip)) {
+            newMip = victim->RequestedMip;
+        }
+
+        uint64_t freed = BytesFrom(*victim, victim->ResidentMip) - BytesFrom(*victim, newMip);
+
+        D3D12_RESOURCE_DESC desc = MakeDesc(*victim, newMip);
+        GPUResource *resource = AllocateMips(desc, victim->Name);
+
+        cmdBuf->ImageBarrier(victim->Texture, TextureLayout::CopySource);
+        Texture::Retired retired = victim->Texture->ReplaceResource(resource, newMip);
+        cmdBuf->CopyTextureMips(resource, 0, retired.Resource, newMip - victim->ResidentMip, desc.MipLevels);
+        cmdBuf->ImageBarrier(victim->Texture, TextureLayout::ShaderResource);
+
+        _retired[frameIndex].push_back(std::move(retired));
+
+        victim->ResidentMip = newMip;
+        _residentBytes -= freed;
+
+        _stats.Evictions++;
+        _stats.BytesEvicted += freed;
+    }
+}
+
+void TextureStreamer::RequestMips()
+{
+    std::vector<Entry*> candidates;
+    for (auto& entry : _entries) {
+        if (!entry.Busy && !entry.Broken && entry.RequestedMip < entry.ResidentMip) {
+            candidates.push_back(&entry);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [](Entry *a, Entry *b) {
+        return a->Priority > b->Priority;
+    });
+
+    std::vector<Request> requests;
+    for (auto entry : candidates) {
+        // Settle for fewer mips when the whole request doesn't fit
+        uint32_t target = entry->RequestedMip;
+        uint64_t needed = BytesFrom(*entry, target) - BytesFrom(*entry, entry->ResidentMip);
+        while (target < entry->ResidentMip && (!IsValidBaseMip(*entry, target) || _residentBytes + _pendingBytes + needed > _budget)) {
+            target++;
+            needed = BytesFrom(*entry, target) - BytesFrom(*entry, entry->ResidentMip);
+        }
+        if (target == entry->ResidentMip) {
+            continue;
+        }
+
+        Request request;
+        request.Index = uint32_t(entry - _entries.data());
+        request.Path = entry->Path;
+        request.Name = entry->Name;
+        request.Desc = MakeDesc(*entry, target);
+        request.TargetMip = target;
+        request.ResidentMip = entry->ResidentMip;
+        request.Priority = entry->Priority;
+        requests.push_back(request);
+
+        entry->Busy = true;
+        _pendingBytes += needed;
+        _stats.Requested++;
+    }
+
+    std::lock_guard<std::mutex> lock(_lock);
+    for (auto& request : requests) {
+        _requests.push_back(std::move(request));
+    }
+    _wakeUp.notify_all();
+}
+
+void TextureStreamer::Update(CommandBuffer::Ptr cmdBuf, uint32_t frameIndex, const std::vector<Model>& models, glm::vec3 cameraPosition, uint32_t viewportHeight)
+{
+    _frame++;
+
+    // The GPU is done with this frame slot
+    for (auto& retired : _retired[frameIndex]) {
+        retired.Release();
+    }
+    _retired[frameIndex].clear();
+    _inFlightStaging[frameIndex].clear();
+
+    EstimateUsage(models, cameraPosition, viewportHeight);
+    ApplyResults(cmdBuf, frameIndex);
+    EvictUntil(cmdBuf, frameIndex, _budget);
+    RequestMips();
+
+    _stats.ResidentBytes = _residentBytes;
+    _stats.Budget = _budget;
+
+    if (_started && _stats.TimeToFullResolution == 0.0f && IsIdle()) {
+        _stats.TimeToFullResolution = _timer.GetElapsed();
+    }
+}
+
+bool TextureStreamer::IsIdle()
+{
+    for (auto& entry : _entries) {
+        if (entry.Busy || (!entry.Broken && entry.RequestedMip < entry.ResidentMip)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+TextureStreamer::Stats TextureStreamer::GetStats()
+{
+    return _stats;
+}
+
+void TextureStreamer::OnUI()
+{
+    ImGui::Begin("Texture Streaming");
+
+    int budget = int(_budget / (1024 * 1024));
+    if (ImGui::SliderInt("Budget (MB)", &budget, 64, 8192)) {
+        _budget = uint64_t(budget) * 1024 * 1024;
+    }
+    ImGui::Separator();
+
+    float resident = _stats.ResidentBytes / (1024.0f * 1024.0f);
+    float requested = _stats.RequestedBytes / (1024.0f * 1024.0f);
+    ImGui::Text("Textures: %u", _stats.Textures);
+    ImGui::Text("Resident: %.2f MB", resident);
+    ImGui::ProgressBar(_budget > 0 ? float(_stats.ResidentBytes) / float(_budget) : 0.0f);
+    ImGui::Text("Requested: %.2f MB", requested);
+    ImGui::ProgressBar(_budget > 0 ? std::min(float(_stats.RequestedBytes) / float(_budget), 1.0f) : 0.0f);
+    ImGui::Separator();
+    ImGui::Text("Streamed: %u mip chains (%.2f MB)", _stats.Completed, _stats.BytesStreamed / (1024.0f * 1024.0f));
+    ImGui::Text("Evicted: %u times (%.2f MB)", _stats.Evictions, _stats.BytesEvicted / (1024.0f * 1024.0f));
+    ImGui::Text("In flight: %.2f MB", _pendingBytes / (1024.0f * 1024.0f));
+    ImGui::Text("Failed: %u", _stats.Failed);
+
+    ImGui::End();
+}
+
+bool TextureStreamer::IsValidBaseMip(const Entry& entry, uint32_t mip)
+{
+    if (mip == 0) {
+        return true;
+    }
+    return (entry.Width >> mip) % 4 == 0 && (entry.Height >> mip) % 4 == 0 && (entry.Width >> mip) > 0 && (entry.Height >> mip) > 0;
+}
+
+uint64_t TextureStreamer::BytesFrom(const Entry& entry, uint32_t mip)
+{
+    uint64_t bytes = 0;
+    for (uint32_t i = mip; i < entry.MipCount; i++) {
+        bytes += entry.MipBytes[i];
+    }
+    return bytes;
+}
+
+D3D12_RESOURCE_DESC TextureStreamer::MakeDesc(const Entry& entry, uint32_t baseMip)
+{
+    D3D12_RESOURCE_DESC ResourceDesc = {};
+    ResourceDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
+    ResourceDesc.Alignment = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+    ResourceDesc.Width = std::max(entry.Width >> baseMip, 1u);
+    ResourceDesc.Height = std::max(entry.Height >> baseMip, 1u);
+    ResourceDesc.DepthOrArraySize = 1;
+    ResourceDesc.Format = DXGI_FORMAT(entry.Format);
+    ResourceDesc.SampleDesc.Count = 1;
+    ResourceDesc.SampleDesc.Quality = 0;
+    ResourceDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
+    ResourceDesc.Flags = D3D12_RESOURCE_FLAG_NONE;
+    ResourceDesc.MipLevels = entry.MipCount - baseMip;
+    return ResourceDesc;
+}
+
+GPUResource *TextureStreamer::AllocateMips(const D3D12_RESOURCE_DESC& desc, const std::string& name)
+{
+    D3D12MA::ALLOCATION_DESC AllocationDesc = {};
+    AllocationDesc.HeapType = D3D12_HEAP_TYPE_DEFAULT;
+
+    D3D12_RESOURCE_DESC ResourceDesc = desc;
+    return _context->GetAllocator()->Allocate(&AllocationDesc, &ResourceDesc, D3D12_RESOURCE_STATE_COPY_DEST, name);
+}
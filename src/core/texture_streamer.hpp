@@ -0,0 +1,158 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-02 19:12:41
+//
+
+#pragma once
+
+#include <array>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <glm/glm.hpp>
+
+#include "rhi/render_context.hpp"
+#include "core/timer.hpp"
+
+// Mips at or below this size are uploaded when the texture is created and never evicted
+#define STREAMER_MIP_TAIL_SIZE 64
+#define STREAMER_WORKER_COUNT 2
+// Maximum amount of streamed texels copied to the GPU in one frame
+#define STREAMER_FRAME_BUDGET (64 * 1024 * 1024)
+#define STREAMER_DEFAULT_BUDGET (1024ull * 1024 * 1024)
+
+class Model;
+
+// Global texture residency manager. Every cooked texture is loaded through it, deduplicated by path, and only keeps the mips
+// the camera needs: higher mips are streamed in on worker threads and the least recently used ones are evicted when the
+// budget is exceeded.
+class TextureStreamer
+{
+public:
+    using Ptr = std::shared_ptr<TextureStreamer>;
+
+    struct Stats
+    {
+        uint32_t Textures = 0;
+        uint32_t Requested = 0;
+        uint32_t Completed = 0;
+        uint32_t Evictions = 0;
+        uint32_t Failed = 0; // Stream ins dropped because the file didn't match what was loaded
+        uint64_t BytesStreamed = 0;
+        uint64_t BytesEvicted = 0;
+        uint64_t ResidentBytes = 0;
+        uint64_t RequestedBytes = 0; // What the current view would need at full quality
+        uint64_t Budget = 0;
+        float TimeToFullResolution = 0.0f; // In milliseconds, since the first request
+    };
+
+    static void SetStreamer(Ptr streamer);
+    static Ptr Get();
+
+    TextureStreamer(RenderContext::Ptr context, uint64_t budget = STREAMER_DEFAULT_BUDGET);
+    ~TextureStreamer();
+
+    // Returns the texture if it's already loaded. Otherwise creates it with only its mip tail, recorded in the given uploader.
+    // Contents are the cooked file when it was already read ahead, the file is mapped otherwise.
+    Texture::Ptr Load(const std::string& path, Uploader& uploader, const std::string& name, std::vector<uint8_t> contents = {});
+    bool IsLoaded(const std::string& path) { return _lookup.count(path) != 0; }
+
+    // Estimates the mips every texture needs, evicts what doesn't fit in the budget and records the copies of the mips that
+    // finished staging. Call after the frame's command buffer has begun.
+    void Update(CommandBuffer::Ptr cmdBuf, uint32_t frameIndex, const std::vector<Model>& models, glm::vec3 cameraPosition, uint32_t viewportHeight);
+
+    void SetBudget(uint64_t budget) { _budget = budget; }
+
+    // True once every texture has the mips the view asks for
+    bool IsIdle();
+    Stats GetStats();
+
+    void OnUI();
+private:
+    struct Entry
+    {
+        Texture::Ptr Texture;
+        std::string Path;
+        std::string Name;
+        uint32_t Width;
+        uint32_t Height;
+        uint32_t MipCount;
+        TextureFormat Format;
+
+        uint32_t TailMip;
+        uint32_t ResidentMip;
+        uint32_t RequestedMip;
+        float Priority;
+        bool Busy; // A stream in is in flight, the resident mip can't change under it
+        bool Broken; // The file stopped matching the texture, it stays at its resident mip
+
+        std::vector<uint64_t> MipBytes;
+        std::vector<uint64_t> LastUsed; // Frame each mip was last asked for
+    };
+
+    struct Request
+    {
+        uint32_t Index;
+        std::string Path;
+        std::string Name;
+        D3D12_RESOURCE_DESC Desc;
+        uint32_t TargetMip;
+        uint32_t ResidentMip;
+        float Priority;
+    };
+
+    struct Result
+    {
+        uint32_t Index;
+        GPUResource *Resource; // Null when the file couldn't be streamed from
+        Buffer::Ptr Staging;
+        uint32_t TargetMip;
+        uint64_t Size;
+    };
+
+    void WorkerLoop();
+
+    void EstimateUsage(const std::vector<Model>& models, glm::vec3 cameraPosition, uint32_t viewportHeight);
+    void ApplyResults(CommandBuffer::Ptr cmdBuf, uint32_t frameIndex);
+    void EvictUntil(CommandBuffer::Ptr cmdBuf, uint32_t frameIndex, uint64_t target);
+    void RequestMips();
+
+    bool IsValidBaseMip(const Entry& entry, uint32_t mip);
+    uint64_t BytesFrom(const Entry& entry, uint32_t mip);
+    D3D12_RESOURCE_DESC MakeDesc(const Entry& entry, uint32_t baseMip);
+    GPUResource *AllocateMips(const D3D12_RESOURCE_DESC& desc, const std::string& name);
+
+    RenderContext::Ptr _context;
+    Uploader _stagingUploader;
+
+    std::vector<std::thread> _workers;
+    std::mutex _lock;
+    std::condition_variable _wakeUp;
+    bool _running = true;
+
+    // Main thread only
+    std::vector<Entry> _entries;
+    std::unordered_map<std::string, uint32_t> _lookup;
+    std::unordered_map<Texture*, uint32_t> _textureLookup;
+    uint64_t _budget;
+    uint64_t _residentBytes = 0;
+    uint64_t _pendingBytes = 0;
+    uint64_t _frame = 0;
+
+    // Shared with the workers
+    std::vector<Request> _requests;
+    std::vector<Result> _results;
+    uint32_t _inProgress = 0;
+
+    // Staging buffers and swapped out resources waiting for the GPU to be done with the frame that used them
+    std::array<std::vector<Buffer::Ptr>, FRAMES_IN_FLIGHT> _inFlightStaging;
+    std::array<std::vector<Texture::Retired>, FRAMES_IN_FLIGHT> _retired;
+
+    Timer _timer;
+    bool _started = false;
+    Stats _stats;
+};
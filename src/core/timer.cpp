@@ -7,6 +7,8 @@
 
 #include <ctime>
 
+#ifdef _WIN32
+
 Timer::Timer()
 {
     QueryPerformanceFrequency(&_frequency);
@@ -26,3 +28,23 @@ void Timer::Restart()
 {
     QueryPerformanceCounter(&_start);
 }
+
+#else
+
+Timer::Timer()
+{
+    _start = std::chrono::steady_clock::now();
+}
+
+float Timer::GetElapsed()
+{
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - _start;
+    return float(elapsed.count());
+}
+
+void Timer::Restart()
+{
+    _start = std::chrono::steady_clock::now();
+}
+
+#endif
@@ -0,0 +1,65 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-06 15:40:12
+//
+
+#include "feedback.hpp"
+
+#include <algorithm>
+
+#undef min
+#undef max
+
+uint32_t FeedbackParser::Pack(uint32_t texture, uint32_t mip, uint32_t x, uint32_t y)
+{
+    return ((texture & 0xFFF) << 20) | ((mip & 0xF) << 16) | ((y & 0xFF) << 8) | (x & 0xFF);
+}
+
+PageId FeedbackParser::Unpack(uint32_t entry)
+{
+    return vt::make_page(entry >> 20, (entry >> 16) & 0xF, entry & 0xFF, (entry >> 8) & 0xFF);
+}
+
+void FeedbackParser::Parse(const uint32_t *feedback, size_t count, PageTable& table, PageCache& cache, std::vector<PageId>& requests, uint32_t maxRequests)
+{
+    // Neighbouring pixels almost always ask for the same page, sorting once is cheaper than hashing every entry
+    _scratch.assign(feedback, feedback + count);
+    std::sort(_scratch.begin(), _scratch.end());
+    _scratch.erase(std::unique(_scratch.begin(), _scratch.end()), _scratch.end());
+    if (!_scratch.empty() && _scratch.back() == VT_FEEDBACK_EMPTY) {
+        _scratch.pop_back();
+    }
+
+    _stats.EntriesParsed += count;
+    _stats.UniquePages += _scratch.size();
+
+    _candidates.clear();
+    for (uint32_t entry : _scratch) {
+        PageId page = Unpack(entry);
+
+        // Also ask for every missing ancestor, the sampler needs them as fallbacks
+        while (table.IsValid(page)) {
+            if (cache.Touch(page) != VT_INVALID_SLOT || _pending.count(page)) {
+                break;
+            }
+            _candidates.push_back(page);
+            page = vt::page_parent(page);
+        }
+    }
+
+    std::sort(_candidates.begin(), _candidates.end(), [](PageId a, PageId b) {
+        if (vt::page_mip(a) != vt::page_mip(b)) {
+            return vt::page_mip(a) > vt::page_mip(b);
+        }
+        return a < b;
+    });
+    _candidates.erase(std::unique(_candidates.begin(), _candidates.end()), _candidates.end());
+
+    size_t requestCount = std::min<size_t>(_candidates.size(), maxRequests);
+    for (size_t i = 0; i < requestCount; i++) {
+        requests.push_back(_candidates[i]);
+        _pending.insert(_candidates[i]);
+    }
+    _stats.Requests += requestCount;
+}
@@ -0,0 +1,44 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-06 15:21:40
+//
+
+#pragma once
+
+#include <unordered_set>
+#include <vector>
+
+#include "page_table.hpp"
+#include "page_cache.hpp"
+
+// Written by the feedback pass for texels that didn't get any page: texture (12 bits), mip (4 bits), y (8 bits), x (8 bits)
+#define VT_FEEDBACK_EMPTY UINT32_MAX
+
+class FeedbackParser
+{
+public:
+    struct Stats
+    {
+        uint64_t EntriesParsed = 0;
+        uint64_t UniquePages = 0;
+        uint64_t Requests = 0;
+    };
+
+    static uint32_t Pack(uint32_t texture, uint32_t mip, uint32_t x, uint32_t y);
+    static PageId Unpack(uint32_t entry);
+
+    // Turns a raw feedback buffer into the pages to load, coarsest mips first so that parents are there before their children.
+    // Resident pages are touched in the cache, pages already being loaded are skipped.
+    void Parse(const uint32_t *feedback, size_t count, PageTable& table, PageCache& cache, std::vector<PageId>& requests, uint32_t maxRequests);
+
+    // Called by the owner once a requested page made it to the cache (or failed to load)
+    void Complete(PageId page) { _pending.erase(page); }
+
+    Stats& GetStats() { return _stats; }
+private:
+    std::vector<uint32_t> _scratch;
+    std::vector<PageId> _candidates;
+    std::unordered_set<PageId> _pending;
+    Stats _stats;
+};
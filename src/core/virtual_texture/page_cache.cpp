@@ -0,0 +1,91 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-06 14:58:33
+//
+
+#include "page_cache.hpp"
+
+PageCache::PageCache(uint32_t slotCount)
+    : _pages(slotCount, VT_INVALID_PAGE), _prev(slotCount, VT_INVALID_SLOT), _next(slotCount, VT_INVALID_SLOT), _pinned(slotCount, false)
+{
+    _lookup.reserve(slotCount);
+}
+
+uint32_t PageCache::Touch(PageId page)
+{
+    auto it = _lookup.find(page);
+    if (it == _lookup.end()) {
+        return VT_INVALID_SLOT;
+    }
+
+    uint32_t slot = it->second;
+    if (slot != _head) {
+        Unlink(slot);
+        PushFront(slot);
+    }
+    return slot;
+}
+
+uint32_t PageCache::Allocate(PageId page, PageId& evicted)
+{
+    evicted = VT_INVALID_PAGE;
+
+    uint32_t slot = VT_INVALID_SLOT;
+    if (_used < _pages.size()) {
+        slot = _used++;
+    } else {
+        for (uint32_t candidate = _tail; candidate != VT_INVALID_SLOT; candidate = _prev[candidate]) {
+            if (!_pinned[candidate]) {
+                slot = candidate;
+                break;
+            }
+        }
+        if (slot == VT_INVALID_SLOT) {
+            return VT_INVALID_SLOT;
+        }
+
+        evicted = _pages[slot];
+        _lookup.erase(evicted);
+        Unlink(slot);
+    }
+
+    _pages[slot] = page;
+    _lookup[page] = slot;
+    PushFront(slot);
+    return slot;
+}
+
+void PageCache::Pin(uint32_t slot, bool pinned)
+{
+    _pinned[slot] = pinned;
+}
+
+void PageCache::Unlink(uint32_t slot)
+{
+    if (_prev[slot] != VT_INVALID_SLOT) {
+        _next[_prev[slot]] = _next[slot];
+    } else {
+        _head = _next[slot];
+    }
+    if (_next[slot] != VT_INVALID_SLOT) {
+        _prev[_next[slot]] = _prev[slot];
+    } else {
+        _tail = _prev[slot];
+    }
+    _prev[slot] = VT_INVALID_SLOT;
+    _next[slot] = VT_INVALID_SLOT;
+}
+
+void PageCache::PushFront(uint32_t slot)
+{
+    _prev[slot] = VT_INVALID_SLOT;
+    _next[slot] = _head;
+    if (_head != VT_INVALID_SLOT) {
+        _prev[_head] = slot;
+    }
+    _head = slot;
+    if (_tail == VT_INVALID_SLOT) {
+        _tail = slot;
+    }
+}
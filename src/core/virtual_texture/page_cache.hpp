@@ -0,0 +1,48 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-06 14:41:09
+//
+
+#pragma once
+
+#include <unordered_map>
+#include <vector>
+
+#include "page_table.hpp"
+
+// Fixed pool of physical page slots with least recently used replacement.
+// The LRU list is intrusive (prev/next arrays indexed by slot) so that touching a page never allocates.
+class PageCache
+{
+public:
+    PageCache(uint32_t slotCount);
+
+    uint32_t GetSlotCount() { return uint32_t(_pages.size()); }
+    uint32_t GetUsedSlots() { return _used; }
+
+    // Returns the slot holding the page, or VT_INVALID_SLOT. Marks it as most recently used.
+    uint32_t Touch(PageId page);
+
+    // Finds a slot for the page, evicting the least recently used unpinned page if the cache is full.
+    // The evicted page, if any, is written to `evicted` so the caller can unmap it.
+    uint32_t Allocate(PageId page, PageId& evicted);
+
+    // Pinned pages are never evicted, used for the lowest mip of every texture so that sampling always has a fallback
+    void Pin(uint32_t slot, bool pinned);
+
+    PageId GetPage(uint32_t slot) { return _pages[slot]; }
+private:
+    void Unlink(uint32_t slot);
+    void PushFront(uint32_t slot);
+
+    std::vector<PageId> _pages;
+    std::vector<uint32_t> _prev;
+    std::vector<uint32_t> _next;
+    std::vector<bool> _pinned;
+    std::unordered_map<PageId, uint32_t> _lookup;
+
+    uint32_t _head = VT_INVALID_SLOT; // Most recently used
+    uint32_t _tail = VT_INVALID_SLOT; // Least recently used
+    uint32_t _used = 0;
+};
@@ -0,0 +1,96 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-06 14:20:51
+//
+
+#include "page_table.hpp"
+
+#include <algorithm>
+
+#undef min
+#undef max
+
+uint32_t PageTable::AddTexture(uint32_t width, uint32_t height, uint32_t mipCount, uint32_t tileSize)
+{
+    VirtualTexture texture;
+    for (uint32_t i = 0; i < mipCount; i++) {
+        uint32_t mipWidth = std::max(width >> i, 1u);
+        uint32_t mipHeight = std::max(height >> i, 1u);
+
+        Mip mip;
+        mip.TilesX = (mipWidth + tileSize - 1) / tileSize;
+        mip.TilesY = (mipHeight + tileSize - 1) / tileSize;
+        mip.Slots.resize(mip.TilesX * mip.TilesY, VT_INVALID_SLOT);
+        texture.Mips.push_back(std::move(mip));
+    }
+
+    _textures.push_back(std::move(texture));
+    return uint32_t(_textures.size() - 1);
+}
+
+uint32_t *PageTable::Find(PageId page)
+{
+    uint32_t texture = vt::page_texture(page);
+    uint32_t mip = vt::page_mip(page);
+    if (texture >= _textures.size() || mip >= _textures[texture].Mips.size()) {
+        return nullptr;
+    }
+
+    Mip& level = _textures[texture].Mips[mip];
+    uint32_t x = vt::page_x(page);
+    uint32_t y = vt::page_y(page);
+    if (x >= level.TilesX || y >= level.TilesY) {
+        return nullptr;
+    }
+    return &level.Slots[y * level.TilesX + x];
+}
+
+bool PageTable::IsValid(PageId page)
+{
+    return Find(page) != nullptr;
+}
+
+uint32_t PageTable::Lookup(PageId page)
+{
+    uint32_t *slot = Find(page);
+    return slot ? *slot : VT_INVALID_SLOT;
+}
+
+void PageTable::Map(PageId page, uint32_t slot)
+{
+    uint32_t *entry = Find(page);
+    if (entry) {
+        *entry = slot;
+        _dirty.push_back(page);
+    }
+}
+
+void PageTable::Unmap(PageId page)
+{
+    uint32_t *entry = Find(page);
+    if (entry) {
+        *entry = VT_INVALID_SLOT;
+        _dirty.push_back(page);
+    }
+}
+
+PageId PageTable::FindResidentAncestor(PageId page)
+{
+    while (IsValid(page)) {
+        if (Lookup(page) != VT_INVALID_SLOT) {
+            return page;
+        }
+        page = vt::page_parent(page);
+    }
+    return VT_INVALID_PAGE;
+}
+
+void PageTable::TakeDirty(std::vector<PageId>& dirty)
+{
+    std::sort(_dirty.begin(), _dirty.end());
+    _dirty.erase(std::unique(_dirty.begin(), _dirty.end()), _dirty.end());
+
+    dirty.swap(_dirty);
+    _dirty.clear();
+}
@@ -0,0 +1,78 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-06 14:02:18
+//
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// A page is one tile of one mip of one virtual texture, packed as texture (16 bits), mip (8 bits), y (20 bits), x (20 bits)
+using PageId = uint64_t;
+
+#define VT_INVALID_PAGE UINT64_MAX
+#define VT_INVALID_SLOT UINT32_MAX
+
+namespace vt
+{
+    inline PageId make_page(uint32_t texture, uint32_t mip, uint32_t x, uint32_t y)
+    {
+        return (uint64_t(texture) << 48) | (uint64_t(mip) << 40) | (uint64_t(y & 0xFFFFF) << 20) | uint64_t(x & 0xFFFFF);
+    }
+
+    inline uint32_t page_texture(PageId page) { return uint32_t(page >> 48); }
+    inline uint32_t page_mip(PageId page) { return uint32_t(page >> 40) & 0xFF; }
+    inline uint32_t page_y(PageId page) { return uint32_t(page >> 20) & 0xFFFFF; }
+    inline uint32_t page_x(PageId page) { return uint32_t(page) & 0xFFFFF; }
+
+    // The page covering the same area one mip down
+    inline PageId page_parent(PageId page)
+    {
+        return make_page(page_texture(page), page_mip(page) + 1, page_x(page) / 2, page_y(page) / 2);
+    }
+}
+
+// Maps the pages of every virtual texture to the physical cache slot holding them.
+// This is the CPU copy of the indirection texture: the dirty list is what has to be written to the GPU.
+class PageTable
+{
+public:
+    // Returns the id of the new virtual texture
+    uint32_t AddTexture(uint32_t width, uint32_t height, uint32_t mipCount, uint32_t tileSize);
+
+    uint32_t GetTextureCount() { return uint32_t(_textures.size()); }
+    uint32_t GetMipCount(uint32_t texture) { return uint32_t(_textures[texture].Mips.size()); }
+    uint32_t GetTilesX(uint32_t texture, uint32_t mip) { return _textures[texture].Mips[mip].TilesX; }
+    uint32_t GetTilesY(uint32_t texture, uint32_t mip) { return _textures[texture].Mips[mip].TilesY; }
+
+    bool IsValid(PageId page);
+
+    uint32_t Lookup(PageId page);
+    void Map(PageId page, uint32_t slot);
+    void Unmap(PageId page);
+
+    // Walks down the mip chain until a resident page is found, which is what the sampler falls back to
+    PageId FindResidentAncestor(PageId page);
+
+    void TakeDirty(std::vector<PageId>& dirty);
+private:
+    struct Mip
+    {
+        uint32_t TilesX;
+        uint32_t TilesY;
+        std::vector<uint32_t> Slots;
+    };
+
+    struct VirtualTexture
+    {
+        std::vector<Mip> Mips;
+    };
+
+    uint32_t *Find(PageId page);
+
+    std::vector<VirtualTexture> _textures;
+    std::vector<PageId> _dirty;
+};
@@ -0,0 +1,192 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-06 16:31:02
+//
+
+#include "tile_cooker.hpp"
+
+#include "core/log.hpp"
+#include "core/file_system.hpp"
+#include "core/block_codec.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#undef min
+#undef max
+
+static uint32_t BlocksFor(uint32_t size, uint32_t mip)
+{
+    return (std::max(size >> mip, 1u) + 3) / 4;
+}
+
+uint32_t vt::tile_index(uint32_t width, uint32_t height, uint32_t tileSize, uint32_t mip, uint32_t x, uint32_t y)
+{
+    uint32_t index = 0;
+    for (uint32_t i = 0; i < mip; i++) {
+        uint32_t tilesX = (std::max(width >> i, 1u) + tileSize - 1) / tileSize;
+        uint32_t tilesY = (std::max(height >> i, 1u) + tileSize - 1) / tileSize;
+        index += tilesX * tilesY;
+    }
+    uint32_t tilesX = (std::max(width >> mip, 1u) + tileSize - 1) / tileSize;
+    return index + y * tilesX + x;
+}
+
+uint64_t TileCooker::GetMipChainSize(uint32_t width, uint32_t height, uint32_t mipCount, uint32_t mode)
+{
+    uint64_t size = 0;
+    for (uint32_t i = 0; i < mipCount; i++) {
+        size += uint64_t(BlocksFor(width, i)) * BlocksFor(height, i) * GetBlockSize(mode);
+    }
+    return size;
+}
+
+uint32_t TileCooker::AddTexture(const Source& source)
+{
+    Source masked = source;
+    masked.Mode &= TEXTURE_FILE_MODE_MASK;
+    _sources.push_back(masked);
+    return uint32_t(_sources.size() - 1);
+}
+
+uint32_t TileCooker::AddTextureFile(const std::string& path)
+{
+    FileView view = FileSystem::Map(path);
+    if (!view.IsValid() || view.GetSize() < sizeof(TextureFileHeader)) {
+        Logger::Error("[VT] Failed to read cooked texture %s", path.c_str());
+        return UINT32_MAX;
+    }
+
+    TextureFileHeader header;
+    memcpy(&header, view.GetData(), sizeof(header));
+    const uint8_t *payload = view.GetData() + sizeof(header);
+    uint64_t payloadSize = view.GetSize() - sizeof(header);
+    uint64_t rawSize = GetMipChainSize(header.width, header.height, header.mipCount, header.mode);
+
+    Source source = {};
+    source.Width = header.width;
+    source.Height = header.height;
+    source.MipCount = header.mipCount;
+    source.Mode = header.mode;
+
+    if (header.mode & TEXTURE_FILE_COMPRESSED_FLAG) {
+        if (BlockCodec::GetChunkedRawSize(payload, payloadSize) != rawSize) {
+            Logger::Error("[VT] Compressed mip chain of %s doesn't match its header", path.c_str());
+            return UINT32_MAX;
+        }
+        auto decompressed = std::make_shared<std::vector<uint8_t>>(rawSize);
+        if (!BlockCodec::DecompressChunked(payload, payloadSize, decompressed->data())) {
+            Logger::Error("[VT] Failed to decompress the mip chain of %s", path.c_str());
+            return UINT32_MAX;
+        }
+        source.MipChain = decompressed->data();
+        _buffers.push_back(decompressed);
+    } else {
+        if (payloadSize < rawSize) {
+            Logger::Error("[VT] Cooked texture %s is truncated", path.c_str());
+            return UINT32_MAX;
+        }
+        source.MipChain = payload;
+        _buffers.push_back(std::make_shared<FileView>(view));
+    }
+    return AddTexture(source);
+}
+
+void TileCooker::CutTile(const Source& source, const uint8_t *mip, uint32_t mipIndex, uint32_t x, uint32_t y, std::vector<uint8_t>& tile)
+{
+    uint32_t blockSize = GetBlockSize(source.Mode);
+    uint32_t tileBlocks = VT_TILE_SIZE / 4;
+    uint32_t blocksX = BlocksFor(source.Width, mipIndex);
+    uint32_t blocksY = BlocksFor(source.Height, mipIndex);
+
+    uint32_t firstX = x * tileBlocks;
+    uint32_t copyBlocks = std::min(tileBlocks, blocksX - firstX);
+
+    std::fill(tile.begin(), tile.end(), 0);
+    for (uint32_t row = 0; row < tileBlocks; row++) {
+        uint32_t sourceRow = y * tileBlocks + row;
+        if (sourceRow >= blocksY) {
+            break;
+        }
+        memcpy(tile.data() + row * tileBlocks * blockSize, mip + (sourceRow * blocksX + firstX) * blockSize, copyBlocks * blockSize);
+    }
+}
+
+bool TileCooker::Write(const std::string& path)
+{
+    std::ofstream stream(path, std::ios::binary);
+    if (!stream.is_open()) {
+        Logger::Error("[VT] Failed to open archive %s for writing", path.c_str());
+        return false;
+    }
+
+    std::vector<VTTextureDesc> textures;
+    uint32_t tileCount = 0;
+    for (auto& source : _sources) {
+        VTTextureDesc desc = {};
+        desc.Width = source.Width;
+        desc.Height = source.Height;
+        desc.MipCount = source.MipCount;
+        desc.Mode = source.Mode;
+        desc.FirstTile = tileCount;
+        desc.TileCount = vt::tile_index(source.Width, source.Height, VT_TILE_SIZE, source.MipCount, 0, 0);
+        desc.TileBytes = (VT_TILE_SIZE / 4) * (VT_TILE_SIZE / 4) * GetBlockSize(source.Mode);
+        textures.push_back(desc);
+
+        tileCount += desc.TileCount;
+    }
+
+    VTArchiveHeader header = {};
+    header.Magic = VT_ARCHIVE_MAGIC;
+    header.Version = VT_ARCHIVE_VERSION;
+    header.TileSize = VT_TILE_SIZE;
+    header.TextureCount = uint32_t(textures.size());
+    header.TileCount = tileCount;
+
+    // Lay the tiles out after the tables, each on its own sector
+    auto align = [](uint64_t offset) {
+        return (offset + VT_TILE_ALIGNMENT - 1) & ~uint64_t(VT_TILE_ALIGNMENT - 1);
+    };
+
+    std::vector<VTTileDesc> tiles(tileCount);
+    uint64_t offset = align(sizeof(VTArchiveHeader) + textures.size() * sizeof(VTTextureDesc) + tiles.size() * sizeof(VTTileDesc));
+    for (auto& texture : textures) {
+        for (uint32_t i = 0; i < texture.TileCount; i++) {
+            tiles[texture.FirstTile + i].Offset = offset;
+            offset = align(offset + texture.TileBytes);
+        }
+    }
+
+    stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    stream.write(reinterpret_cast<const char*>(textures.data()), textures.size() * sizeof(VTTextureDesc));
+    stream.write(reinterpret_cast<const char*>(tiles.data()), tiles.size() * sizeof(VTTileDesc));
+
+    std::vector<uint8_t> tile;
+    for (uint32_t t = 0; t < _sources.size(); t++) {
+        const Source& source = _sources[t];
+        const VTTextureDesc& desc = textures[t];
+        tile.resize(desc.TileBytes);
+
+        const uint8_t *mip = source.MipChain;
+        for (uint32_t m = 0; m < source.MipCount; m++) {
+            uint32_t tilesX = (std::max(source.Width >> m, 1u) + VT_TILE_SIZE - 1) / VT_TILE_SIZE;
+            uint32_t tilesY = (std::max(source.Height >> m, 1u) + VT_TILE_SIZE - 1) / VT_TILE_SIZE;
+
+            for (uint32_t y = 0; y < tilesY; y++) {
+                for (uint32_t x = 0; x < tilesX; x++) {
+                    CutTile(source, mip, m, x, y, tile);
+
+                    uint32_t index = desc.FirstTile + vt::tile_index(source.Width, source.Height, VT_TILE_SIZE, m, x, y);
+                    stream.seekp(tiles[index].Offset);
+                    stream.write(reinterpret_cast<const char*>(tile.data()), tile.size());
+                }
+            }
+            mip += BlocksFor(source.Width, m) * BlocksFor(source.Height, m) * GetBlockSize(source.Mode);
+        }
+    }
+
+    Logger::Info("[VT] Cooked %u textures into %u tiles (%.2f MB) at %s", header.TextureCount, tileCount, offset / (1024.0f * 1024.0f), path.c_str());
+    return true;
+}
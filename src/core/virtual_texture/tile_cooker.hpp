@@ -0,0 +1,86 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-06 16:05:27
+//
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "core/texture_file_header.hpp"
+
+// Tile size in texels. Has to be a multiple of 4 so that tiles are made of whole BC blocks.
+#define VT_TILE_SIZE 128
+// Tiles start on sector boundaries so that they can be read without buffering
+#define VT_TILE_ALIGNMENT 512
+#define VT_ARCHIVE_MAGIC 0x41545656 // 'VVTA'
+#define VT_ARCHIVE_VERSION 1
+
+struct VTArchiveHeader
+{
+    uint32_t Magic;
+    uint32_t Version;
+    uint32_t TileSize;
+    uint32_t TextureCount;
+    uint32_t TileCount;
+    uint32_t Pad;
+};
+
+struct VTTextureDesc
+{
+    uint32_t Width;
+    uint32_t Height;
+    uint32_t MipCount;
+    uint32_t Mode; // Same as TextureFile::Header::mode, without TEXTURE_FILE_COMPRESSED_FLAG
+    uint32_t FirstTile;
+    uint32_t TileCount;
+    uint32_t TileBytes;
+    uint32_t Pad;
+};
+
+struct VTTileDesc
+{
+    uint64_t Offset;
+};
+
+namespace vt
+{
+    // Index of a tile inside its texture: mips one after the other, tiles in row order inside a mip
+    uint32_t tile_index(uint32_t width, uint32_t height, uint32_t tileSize, uint32_t mip, uint32_t x, uint32_t y);
+}
+
+// Cuts block compressed mip chains into fixed size tiles and writes them to a virtual texture archive:
+// header, texture descriptions, tile offsets, then the tiles themselves. Edge tiles are padded with empty blocks.
+class TileCooker
+{
+public:
+    struct Source
+    {
+        uint32_t Width;
+        uint32_t Height;
+        uint32_t MipCount;
+        uint32_t Mode;
+        const uint8_t *MipChain; // Tightly packed, uncompressed mips. Must stay alive until Write.
+    };
+
+    // Returns the id of the texture in the archive
+    uint32_t AddTexture(const Source& source);
+    // Adds a cooked .oni texture, decompressing its mip chain if it was stored compressed. Returns UINT32_MAX on failure.
+    uint32_t AddTextureFile(const std::string& path);
+    bool Write(const std::string& path);
+
+    uint32_t GetTextureCount() { return uint32_t(_sources.size()); }
+
+    static uint32_t GetBlockSize(uint32_t mode) { return (mode & TEXTURE_FILE_MODE_MASK) == 1 ? 8 : 16; }
+    // Bytes of a tightly packed mip chain
+    static uint64_t GetMipChainSize(uint32_t width, uint32_t height, uint32_t mipCount, uint32_t mode);
+private:
+    void CutTile(const Source& source, const uint8_t *mip, uint32_t mipIndex, uint32_t x, uint32_t y, std::vector<uint8_t>& tile);
+
+    std::vector<Source> _sources;
+    std::vector<std::shared_ptr<void>> _buffers; // Whatever backs the sources added from files
+};
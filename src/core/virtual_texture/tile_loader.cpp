@@ -0,0 +1,158 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-06 17:32:19
+//
+
+#include "tile_loader.hpp"
+
+#include "core/log.hpp"
+#include "core/file_system.hpp"
+#include "core/profiler.hpp"
+
+#include <algorithm>
+
+#undef min
+#undef max
+
+TileLoader::TileLoader(const std::string& archive)
+    : _path(archive)
+{
+    if (!FileSystem::Exists(archive)) {
+        Logger::Error("[VT] Failed to open archive %s", archive.c_str());
+        return;
+    }
+
+    if (!FileSystem::ReadRanges(archive, { { 0, sizeof(_header), &_header } }) || _header.Magic != VT_ARCHIVE_MAGIC || _header.Version != VT_ARCHIVE_VERSION || !_header.TileSize) {
+        Logger::Error("[VT] %s isn't a virtual texture archive, or it was cooked by another version", archive.c_str());
+        return;
+    }
+
+    _textures.resize(_header.TextureCount);
+    _tiles.resize(_header.TileCount);
+    uint64_t texturesSize = _textures.size() * sizeof(VTTextureDesc);
+    uint64_t tilesSize = _tiles.size() * sizeof(VTTileDesc);
+    if (!FileSystem::ReadRanges(archive, { { sizeof(_header), texturesSize, _textures.data() }, { sizeof(_header) + texturesSize, tilesSize, _tiles.data() } })) {
+        Logger::Error("[VT] Archive %s is truncated", archive.c_str());
+        return;
+    }
+    _open = true;
+
+    for (int i = 0; i < VT_LOADER_WORKER_COUNT; i++) {
+        _workers.emplace_back(&TileLoader::WorkerLoop, this);
+    }
+}
+
+TileLoader::~TileLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        _running = false;
+    }
+    _wakeUp.notify_all();
+    for (auto& worker : _workers) {
+        worker.join();
+    }
+}
+
+void TileLoader::Submit(const std::vector<PageId>& pages)
+{
+    if (pages.empty()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_lock);
+        _queue.insert(_queue.end(), pages.begin(), pages.end());
+    }
+    _wakeUp.notify_all();
+}
+
+void TileLoader::Poll(std::vector<Tile>& tiles)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    for (auto& tile : _done) {
+        tiles.push_back(std::move(tile));
+    }
+    _done.clear();
+}
+
+bool TileLoader::Read(PageId page, std::vector<uint8_t>& data)
+{
+    std::vector<Tile> tiles(1);
+    tiles[0].Page = page;
+    ReadBatch(tiles);
+
+    data = std::move(tiles[0].Data);
+    return !data.empty();
+}
+
+void TileLoader::ReadBatch(std::vector<Tile>& tiles)
+{
+    PROFILE_SCOPE("Read Tiles");
+
+    std::vector<FileRange> ranges;
+    for (auto& tile : tiles) {
+        uint32_t texture = vt::page_texture(tile.Page);
+        if (texture >= _textures.size()) {
+            continue;
+        }
+
+        // Pages come from the GPU feedback, a corrupt one must not read past the tables
+        const VTTextureDesc& desc = _textures[texture];
+        uint32_t mip = vt::page_mip(tile.Page);
+        uint32_t x = vt::page_x(tile.Page);
+        uint32_t y = vt::page_y(tile.Page);
+        if (mip >= desc.MipCount) {
+            continue;
+        }
+        uint32_t tilesX = (std::max(desc.Width >> mip, 1u) + _header.TileSize - 1) / _header.TileSize;
+        uint32_t tilesY = (std::max(desc.Height >> mip, 1u) + _header.TileSize - 1) / _header.TileSize;
+        if (x >= tilesX || y >= tilesY) {
+            continue;
+        }
+        uint64_t index = uint64_t(desc.FirstTile) + vt::tile_index(desc.Width, desc.Height, _header.TileSize, mip, x, y);
+        if (index >= _tiles.size()) {
+            Logger::Error("[VT] Page of texture %u points at tile %llu, past the %u tiles of %s", texture, index, uint32_t(_tiles.size()), _path.c_str());
+            continue;
+        }
+
+        tile.Data.resize(desc.TileBytes);
+        ranges.push_back({ _tiles[index].Offset, tile.Data.size(), tile.Data.data() });
+    }
+
+    // The whole batch fails together, the pages are simply requested again
+    if (!FileSystem::ReadRanges(_path, ranges)) {
+        for (auto& tile : tiles) {
+            tile.Data.clear();
+        }
+    }
+}
+
+void TileLoader::WorkerLoop()
+{
+    Profiler::SetThreadName("Tile Loader");
+
+    while (true) {
+        std::vector<Tile> tiles;
+        {
+            std::unique_lock<std::mutex> lock(_lock);
+            _wakeUp.wait(lock, [this]() { return !_running || !_queue.empty(); });
+            if (!_running) {
+                return;
+            }
+            while (!_queue.empty() && tiles.size() < VT_LOADER_BATCH_SIZE) {
+                Tile tile;
+                tile.Page = _queue.front();
+                tiles.push_back(std::move(tile));
+                _queue.pop_front();
+            }
+        }
+
+        ReadBatch(tiles);
+
+        std::lock_guard<std::mutex> lock(_lock);
+        for (auto& tile : tiles) {
+            _done.push_back(std::move(tile));
+        }
+    }
+}
@@ -0,0 +1,65 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-06 17:10:44
+//
+
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "page_table.hpp"
+#include "tile_cooker.hpp"
+
+#define VT_LOADER_WORKER_COUNT 2
+// Pages a worker takes off the queue at once, read with a single vectored read
+#define VT_LOADER_BATCH_SIZE 16
+
+// Reads tiles out of a virtual texture archive on worker threads
+class TileLoader
+{
+public:
+    struct Tile
+    {
+        PageId Page;
+        std::vector<uint8_t> Data; // Empty if the read failed
+    };
+
+    TileLoader(const std::string& archive);
+    ~TileLoader();
+
+    bool IsOpen() { return _open; }
+
+    uint32_t GetTextureCount() { return uint32_t(_textures.size()); }
+    const VTTextureDesc& GetTexture(uint32_t texture) { return _textures[texture]; }
+    uint32_t GetTileSize() { return _header.TileSize; }
+
+    void Submit(const std::vector<PageId>& pages);
+    void Poll(std::vector<Tile>& tiles);
+
+    // Synchronous read, used for the pages that have to be there before the first frame
+    bool Read(PageId page, std::vector<uint8_t>& data);
+private:
+    void WorkerLoop();
+    void ReadBatch(std::vector<Tile>& tiles);
+
+    std::string _path;
+    bool _open = false;
+
+    VTArchiveHeader _header = {};
+    std::vector<VTTextureDesc> _textures;
+    std::vector<VTTileDesc> _tiles;
+
+    std::vector<std::thread> _workers;
+    std::mutex _lock;
+    std::condition_variable _wakeUp;
+    bool _running = true;
+
+    std::deque<PageId> _queue;
+    std::vector<Tile> _done;
+};
@@ -0,0 +1,164 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-06 18:24:37
+//
+
+#include "virtual_texture_system.hpp"
+
+#include "core/log.hpp"
+#include "core/timer.hpp"
+#include "core/util.hpp"
+
+#include <algorithm>
+
+#undef min
+#undef max
+
+VirtualTextureSystem::VirtualTextureSystem(const std::string& archive, uint32_t physicalSlots, uint32_t maxRequestsPerFrame)
+    : _loader(archive), _cache(physicalSlots), _maxRequests(maxRequestsPerFrame)
+{
+    if (!_loader.IsOpen()) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < _loader.GetTextureCount(); i++) {
+        const VTTextureDesc& desc = _loader.GetTexture(i);
+        _table.AddTexture(desc.Width, desc.Height, desc.MipCount, _loader.GetTileSize());
+    }
+
+    // The last mip of every texture is loaded upfront and pinned, so that there is always something to fall back to
+    for (uint32_t i = 0; i < _table.GetTextureCount(); i++) {
+        PageId page = vt::make_page(i, _table.GetMipCount(i) - 1, 0, 0);
+
+        std::vector<uint8_t> data;
+        if (!_loader.Read(page, data) || !MapPage(page, std::move(data), _pinnedUploads)) {
+            Logger::Error("[VT] Failed to load the fallback page of virtual texture %u", i);
+            continue;
+        }
+        _cache.Pin(_pinnedUploads.back().Slot, true);
+    }
+}
+
+bool VirtualTextureSystem::MapPage(PageId page, std::vector<uint8_t>&& data, std::vector<PageUpload>& uploads)
+{
+    PageId evicted;
+    uint32_t slot = _cache.Allocate(page, evicted);
+    if (slot == VT_INVALID_SLOT) {
+        return false;
+    }
+    if (evicted != VT_INVALID_PAGE) {
+        _table.Unmap(evicted);
+        _stats.PagesEvicted++;
+    }
+    _table.Map(page, slot);
+
+    PageUpload upload;
+    upload.Page = page;
+    upload.Slot = slot;
+    upload.Data = std::move(data);
+    uploads.push_back(std::move(upload));
+    return true;
+}
+
+void VirtualTextureSystem::ProcessFeedback(const uint32_t *feedback, size_t count)
+{
+    Timer timer;
+
+    _requests.clear();
+    _parser.Parse(feedback, count, _table, _cache, _requests, _maxRequests);
+    _loader.Submit(_requests);
+
+    _stats.FeedbackTime += timer.GetElapsed();
+}
+
+void VirtualTextureSystem::Update(std::vector<PageUpload>& uploads)
+{
+    for (auto& upload : _pinnedUploads) {
+        uploads.push_back(std::move(upload));
+    }
+    _pinnedUploads.clear();
+
+    _tiles.clear();
+    _loader.Poll(_tiles);
+
+    for (auto& tile : _tiles) {
+        _parser.Complete(tile.Page);
+        if (tile.Data.empty()) {
+            _stats.PagesFailed++;
+            continue;
+        }
+        if (MapPage(tile.Page, std::move(tile.Data), uploads)) {
+            _stats.PagesLoaded++;
+        }
+    }
+}
+
+void VirtualTextureSystem::Benchmark(uint32_t frames)
+{
+    const uint32_t textureCount = 64;
+    const uint32_t textureSize = 16384;
+    const uint32_t mipCount = 15;
+    const uint32_t feedbackWidth = 1920 / 16;
+    const uint32_t feedbackHeight = 1080 / 16;
+
+    PageTable table;
+    for (uint32_t i = 0; i < textureCount; i++) {
+        table.AddTexture(textureSize, textureSize, mipCount, VT_TILE_SIZE);
+    }
+    PageCache cache(4096);
+    FeedbackParser parser;
+
+    // A camera slowly panning over a handful of textures: every frame mostly asks for the pages of the previous one
+    std::vector<uint32_t> feedback(feedbackWidth * feedbackHeight);
+    std::vector<PageId> requests;
+    float panX = 0.0f;
+    float panY = 0.0f;
+
+    uint64_t evictions = 0;
+    Timer timer;
+    for (uint32_t frame = 0; frame < frames; frame++) {
+        panX += 0.35f;
+        panY += 0.15f;
+
+        for (uint32_t y = 0; y < feedbackHeight; y++) {
+            for (uint32_t x = 0; x < feedbackWidth; x++) {
+                uint32_t texture = (x / 24 + (y / 24) * 5) % textureCount;
+                uint32_t mip = std::min(uint32_t(y / 12), mipCount - 1);
+                uint32_t tiles = std::max((textureSize >> mip) / VT_TILE_SIZE, 1u);
+                uint32_t tileX = uint32_t(panX + x / 4 + util::random_range(0.0f, 2.0f)) % tiles;
+                uint32_t tileY = uint32_t(panY + y / 4) % tiles;
+
+                feedback[y * feedbackWidth + x] = FeedbackParser::Pack(texture, mip, tileX, tileY);
+            }
+        }
+
+        requests.clear();
+        parser.Parse(feedback.data(), feedback.size(), table, cache, requests, UINT32_MAX);
+
+        // Pretend every load finished right away
+        for (PageId page : requests) {
+            PageId evicted;
+            uint32_t slot = cache.Allocate(page, evicted);
+            if (evicted != VT_INVALID_PAGE) {
+                table.Unmap(evicted);
+                evictions++;
+            }
+            table.Map(page, slot);
+            parser.Complete(page);
+        }
+
+        std::vector<PageId> dirty;
+        table.TakeDirty(dirty);
+    }
+    float elapsed = timer.GetElapsed();
+
+    FeedbackParser::Stats& stats = parser.GetStats();
+    float seconds = std::max(elapsed / 1000.0f, 0.0001f);
+    Logger::Info("[VT] Benchmark: %u frames in %.2fms (%.3fms per frame)", frames, elapsed, elapsed / frames);
+    Logger::Info("[VT] Benchmark: %.0f feedback entries/s, %.0f unique pages/s, %.0f page requests/s, %llu evictions",
+                 stats.EntriesParsed / seconds,
+                 stats.UniquePages / seconds,
+                 stats.Requests / seconds,
+                 evictions);
+}
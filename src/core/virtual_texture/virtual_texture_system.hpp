@@ -0,0 +1,69 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-06 18:02:55
+//
+
+#pragma once
+
+#include <memory>
+
+#include "page_table.hpp"
+#include "page_cache.hpp"
+#include "feedback.hpp"
+#include "tile_loader.hpp"
+
+// CPU side of the virtual texturing: feedback in, page uploads out.
+// Creating the physical texture, the indirection texture and the feedback pass is up to the renderer.
+class VirtualTextureSystem
+{
+public:
+    using Ptr = std::shared_ptr<VirtualTextureSystem>;
+
+    struct PageUpload
+    {
+        PageId Page;
+        uint32_t Slot;
+        std::vector<uint8_t> Data;
+    };
+
+    struct Stats
+    {
+        uint64_t PagesLoaded = 0;
+        uint64_t PagesEvicted = 0;
+        uint64_t PagesFailed = 0;
+        float FeedbackTime = 0.0f; // In milliseconds, accumulated
+    };
+
+    VirtualTextureSystem(const std::string& archive, uint32_t physicalSlots, uint32_t maxRequestsPerFrame = 64);
+
+    bool IsOpen() { return _loader.IsOpen(); }
+
+    // Parses the feedback buffer of the last frame and queues the loads
+    void ProcessFeedback(const uint32_t *feedback, size_t count);
+
+    // Maps the tiles that finished loading and returns what has to be copied to the physical texture
+    void Update(std::vector<PageUpload>& uploads);
+
+    PageTable& GetPageTable() { return _table; }
+    PageCache& GetCache() { return _cache; }
+    FeedbackParser::Stats& GetFeedbackStats() { return _parser.GetStats(); }
+    Stats& GetStats() { return _stats; }
+
+    // Runs the page table, cache and feedback parser on synthetic feedback without touching the disk or the GPU, and logs
+    // how many page requests per second they get through
+    static void Benchmark(uint32_t frames);
+private:
+    bool MapPage(PageId page, std::vector<uint8_t>&& data, std::vector<PageUpload>& uploads);
+
+    TileLoader _loader;
+    PageTable _table;
+    PageCache _cache;
+    FeedbackParser _parser;
+    uint32_t _maxRequests;
+
+    std::vector<PageId> _requests;
+    std::vector<TileLoader::Tile> _tiles;
+    std::vector<PageUpload> _pinnedUploads;
+    Stats _stats;
+};
@@ -11,7 +11,7 @@
 
 extern LRESULT ImGui_ImplWin32_WndProcHandler(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam);
 
-Window::Window(int width, int height, const std::string& title)
+Window::Window(int width, int height, const std::string& title, bool visible)
 {
     WNDCLASSA windowClass = {};
     windowClass.lpszClassName = "OniWindowClass";
@@ -33,7 +33,7 @@ Window::Window(int width, int height, const std::string& title)
     SetWindowLongPtr(_hwnd, GWLP_USERDATA, reinterpret_cast<LONG_PTR>(this));
 
     _open = true;
-    ShowWindow(_hwnd, SW_SHOW);
+    ShowWindow(_hwnd, visible ? SW_SHOW : SW_HIDE);
 
     Logger::Info("[WINDOW] Created window '%s' with dimensions (%d, %d)", title.c_str(), rect.right, rect.bottom);
 }
@@ -13,7 +13,8 @@
 class Window
 {
 public:
-    Window(int width, int height, const std::string& title);
+    // Hidden windows still get a swap chain, for runs that don't need to be watched
+    Window(int width, int height, const std::string& title, bool visible = true);
     ~Window();
 
     void Update();
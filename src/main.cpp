@@ -5,8 +5,15 @@
 
 #include "app.hpp"
 
-int main(void)
+int main(int argc, char **argv)
 {
-    App app = {};
+    Logger::Init();
+
+    BenchmarkSettings settings;
+    if (!Benchmark::ParseArguments(argc, argv, settings)) {
+        return 1;
+    }
+
+    App app(settings);
     app.Run();
 }
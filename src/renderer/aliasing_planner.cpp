@@ -0,0 +1,352 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 16:48:35
+//
+
+#include "aliasing_planner.hpp"
+
+#include <core/log.hpp>
+#include <core/timer.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <random>
+
+static uint64_t AlignUp(uint64_t value, uint64_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static bool Overlaps(const AliasingRequest& a, const AliasingRequest& b)
+{
+    return a.First <= b.Last && b.First <= a.Last;
+}
+
+AliasingPlan AliasingPlanner::Plan(const std::vector<AliasingRequest>& requests, uint64_t maxHeapSize)
+{
+    Timer timer;
+
+    AliasingPlan plan;
+    plan.Placements.resize(requests.size(), { UINT32_MAX, 0 });
+
+    std::vector<uint32_t> order(requests.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        if (requests[a].Size != requests[b].Size) {
+            return requests[a].Size > requests[b].Size;
+        }
+        return requests[a].First < requests[b].First;
+    });
+
+    std::vector<std::pair<uint64_t, uint64_t>> taken;
+    for (uint32_t index : order) {
+        const AliasingRequest& request = requests[index];
+        plan.DedicatedSize += AlignUp(request.Size, request.Alignment);
+
+        uint32_t bestHeap = UINT32_MAX;
+        uint64_t bestOffset = 0;
+        uint64_t bestGrowth = UINT64_MAX;
+        for (uint32_t h = 0; h < plan.Heaps.size(); h++) {
+            const AliasingHeap& heap = plan.Heaps[h];
+
+            // Ranges of the resources already in the heap that are alive at the same time
+            taken.clear();
+            for (uint32_t other : heap.Resources) {
+                if (Overlaps(request, requests[other])) {
+                    taken.push_back({ plan.Placements[other].Offset, plan.Placements[other].Offset + requests[other].Size });
+                }
+            }
+            std::sort(taken.begin(), taken.end());
+
+            // Lowest gap that fits, past the last range otherwise
+            uint64_t offset = 0;
+            for (auto& range : taken) {
+                if (AlignUp(offset, request.Alignment) + request.Size <= range.first) {
+                    break;
+                }
+                offset = std::max(offset, range.second);
+            }
+            offset = AlignUp(offset, request.Alignment);
+
+            uint64_t end = offset + request.Size;
+            if (end > maxHeapSize) {
+                continue;
+            }
+            uint64_t growth = end > heap.Size ? end - heap.Size : 0;
+            if (growth < bestGrowth || (growth == bestGrowth && offset < bestOffset)) {
+                bestHeap = h;
+                bestOffset = offset;
+                bestGrowth = growth;
+            }
+        }
+
+        // Resources bigger than a heap get one of their own
+        if (bestHeap == UINT32_MAX) {
+            plan.Heaps.emplace_back();
+            bestHeap = uint32_t(plan.Heaps.size() - 1);
+            bestOffset = 0;
+        }
+
+        AliasingHeap& heap = plan.Heaps[bestHeap];
+        heap.Resources.push_back(index);
+        heap.Size = std::max(heap.Size, bestOffset + request.Size);
+        plan.Placements[index] = { bestHeap, bestOffset };
+    }
+
+    for (AliasingHeap& heap : plan.Heaps) {
+        heap.Size = AlignUp(heap.Size, ALIASING_DEFAULT_ALIGNMENT);
+        plan.AliasedSize += heap.Size;
+    }
+    plan.PlanTime = timer.GetElapsed();
+    return plan;
+}
+
+bool AliasingPlanner::Validate(const std::vector<AliasingRequest>& requests, const AliasingPlan& plan, std::string *error)
+{
+    char buffer[256];
+    auto fail = [&](const char *message) {
+        if (error) {
+            *error = message;
+        }
+        return false;
+    };
+
+    if (plan.Placements.size() != requests.size()) {
+        return fail("Not every resource was placed");
+    }
+    for (uint32_t i = 0; i < requests.size(); i++) {
+        const AliasingPlacement& placement = plan.Placements[i];
+        if (placement.Heap >= plan.Heaps.size()) {
+            snprintf(buffer, sizeof(buffer), "Resource %u isn't in a heap", i);
+            return fail(buffer);
+        }
+        if (placement.Offset % requests[i].Alignment) {
+            snprintf(buffer, sizeof(buffer), "Resource %u isn't aligned to %llu bytes", i, (unsigned long long)requests[i].Alignment);
+            return fail(buffer);
+        }
+        if (placement.Offset + requests[i].Size > plan.Heaps[placement.Heap].Size) {
+            snprintf(buffer, sizeof(buffer), "Resource %u goes past the end of heap %u", i, placement.Heap);
+            return fail(buffer);
+        }
+        for (uint32_t j = i + 1; j < requests.size(); j++) {
+            const AliasingPlacement& other = plan.Placements[j];
+            if (other.Heap != placement.Heap || !Overlaps(requests[i], requests[j])) {
+                continue;
+            }
+            if (placement.Offset < other.Offset + requests[j].Size && other.Offset < placement.Offset + requests[i].Size) {
+                snprintf(buffer, sizeof(buffer), "Resources %u and %u are alive at the same time and share memory", i, j);
+                return fail(buffer);
+            }
+        }
+    }
+    return true;
+}
+
+uint64_t AliasingPlanner::EstimateTextureSize(uint32_t width, uint32_t height, uint32_t bytesPerPixel, uint32_t mips)
+{
+    uint64_t size = 0;
+    for (uint32_t mip = 0; mip < std::max(mips, 1u); mip++) {
+        uint64_t mipWidth = std::max(width >> mip, 1u);
+        uint64_t mipHeight = std::max(height >> mip, 1u);
+        size += mipWidth * mipHeight * bytesPerPixel;
+    }
+    return AlignUp(size, ALIASING_DEFAULT_ALIGNMENT);
+}
+
+std::vector<AliasingRequest> AliasingPlanner::GatherRequests(const RenderGraph& graph, const BytesPerPixel& bytesPerPixel, std::vector<uint32_t>& resources)
+{
+    std::vector<AliasingRequest> requests;
+    resources.clear();
+    for (uint32_t i = 0; i < graph.GetResourceCount(); i++) {
+        const RenderGraphTextureDesc& desc = graph.GetDesc(i);
+        const RenderGraphLifetime& lifetime = graph.GetLifetime(i);
+        if (!desc.Width || graph.IsOutput(i) || lifetime.First == RENDER_GRAPH_INVALID) {
+            continue;
+        }
+
+        AliasingRequest request;
+        request.Size = EstimateTextureSize(desc.Width, desc.Height, bytesPerPixel(desc.Format), desc.Mips);
+        request.First = lifetime.First;
+        request.Last = lifetime.Last;
+        requests.push_back(request);
+        resources.push_back(i);
+    }
+    return requests;
+}
+
+const std::vector<AliasingResolution>& AliasingPlanner::GetReportResolutions()
+{
+    static const std::vector<AliasingResolution> resolutions = {
+        { "1080p", 1920, 1080 },
+        { "1440p", 2560, 1440 },
+        { "4K", 3840, 2160 }
+    };
+    return resolutions;
+}
+
+void AliasingPlanner::Report(const std::string& label, const RenderGraph& graph, const std::vector<uint32_t>& resources, const AliasingPlan& plan)
+{
+    uint64_t saved = plan.DedicatedSize - plan.AliasedSize;
+    Logger::Info("[ALIASING] %s: %u textures take %.2f MB on their own, %.2f MB aliased in %u heaps: %.2f MB saved (%.1f%%), planned in %.3fms",
+                 label.c_str(),
+                 uint32_t(resources.size()),
+                 plan.DedicatedSize / (1024.0f * 1024.0f),
+                 plan.AliasedSize / (1024.0f * 1024.0f),
+                 uint32_t(plan.Heaps.size()),
+                 saved / (1024.0f * 1024.0f),
+                 plan.DedicatedSize ? saved * 100.0f / plan.DedicatedSize : 0.0f,
+                 plan.PlanTime);
+    for (uint32_t i = 0; i < resources.size(); i++) {
+        const RenderGraphLifetime& lifetime = graph.GetLifetime(resources[i]);
+        Logger::Info("[ALIASING]     %-12s heap %u at %7.2f MB, passes %u to %u",
+                     graph.GetResourceName(resources[i]).c_str(),
+                     plan.Placements[i].Heap,
+                     plan.Placements[i].Offset / (1024.0f * 1024.0f),
+                     lifetime.First,
+                     lifetime.Last);
+    }
+}
+
+void AliasingPlanner::BuildSyntheticFrame(RenderGraph& graph, uint32_t width, uint32_t height)
+{
+    // Keep in sync with Renderer::BuildGraph for the deferred path with shadow maps
+    auto describe = [width, height](uint32_t bytesPerPixel, uint32_t mips = 1) {
+        return RenderGraphTextureDesc{ width, height, bytesPerPixel, mips };
+    };
+    uint32_t bloomMips = uint32_t(std::floor(std::log2(std::max(width, height)))) + 1;
+
+    graph.Reset();
+    graph.Import("Shadow Map", 0, RenderGraphUsage::Unknown, { 4096, 4096, 4, 1 });
+    graph.Import("Depth", 0, RenderGraphUsage::Unknown, describe(4));
+    graph.Import("Normals", 0, RenderGraphUsage::Unknown, describe(8));
+    graph.Import("Albedo", 0, RenderGraphUsage::Unknown, describe(4));
+    graph.Import("PBR", 0, RenderGraphUsage::Unknown, describe(4));
+    graph.Import("Velocity", 0, RenderGraphUsage::Unknown, describe(4));
+    graph.Import("Emissive", 0, RenderGraphUsage::Unknown, describe(8));
+    graph.Import("SSAO", 0, RenderGraphUsage::Unknown, describe(4));
+    graph.Import("HDR", 0, RenderGraphUsage::Unknown, describe(8));
+    graph.Import("Bloom Chain", 0, RenderGraphUsage::Unknown, describe(8, bloomMips));
+    graph.Import("LDR", 0);
+    graph.Import("Backbuffer", 0, RenderGraphUsage::Present);
+
+    graph.AddPass("Shadows", [](RenderGraph::PassBuilder& builder) {
+        builder.Write("Shadow Map", RenderGraphUsage::DepthWrite);
+    }, nullptr);
+    graph.AddPass("GBuffer", [](RenderGraph::PassBuilder& builder) {
+        builder.Write("Depth", RenderGraphUsage::DepthWrite);
+        for (const char *target : { "Normals", "Albedo", "PBR", "Velocity", "Emissive" }) {
+            builder.Write(target, RenderGraphUsage::RenderTarget);
+        }
+    }, nullptr);
+    graph.AddPass("SSAO", [](RenderGraph::PassBuilder& builder) {
+        builder.Read("Depth");
+        builder.Read("Normals");
+        builder.Write("SSAO", RenderGraphUsage::Storage);
+    }, nullptr);
+    graph.AddPass("Lighting", [](RenderGraph::PassBuilder& builder) {
+        for (const char *input : { "Depth", "Normals", "Albedo", "PBR", "Velocity", "Emissive", "SSAO", "Shadow Map" }) {
+            builder.Read(input);
+        }
+        builder.Write("HDR", RenderGraphUsage::Storage);
+    }, nullptr);
+    graph.AddPass("Environment Map", [](RenderGraph::PassBuilder& builder) {
+        builder.Read("Depth", RenderGraphUsage::DepthWrite);
+        builder.Write("HDR", RenderGraphUsage::RenderTarget);
+    }, nullptr);
+    for (const char *pass : { "Temporal Anti-Aliasing", "Motion Blur" }) {
+        graph.AddPass(pass, [](RenderGraph::PassBuilder& builder) {
+            builder.Read("Velocity");
+            builder.Write("HDR", RenderGraphUsage::Storage);
+        }, nullptr);
+    }
+    graph.AddPass("Chromatic Aberration", [](RenderGraph::PassBuilder& builder) {
+        builder.Write("HDR", RenderGraphUsage::Storage);
+    }, nullptr);
+    graph.AddPass("Bloom", [](RenderGraph::PassBuilder& builder) {
+        builder.Read("Emissive", RenderGraphUsage::CopySource);
+        builder.Write("Bloom Chain", RenderGraphUsage::Storage);
+        builder.Write("HDR", RenderGraphUsage::Storage);
+    }, nullptr);
+    for (const char *pass : { "Color Correction", "Film Grain" }) {
+        graph.AddPass(pass, [](RenderGraph::PassBuilder& builder) {
+            builder.Write("HDR", RenderGraphUsage::Storage);
+        }, nullptr);
+    }
+    graph.AddPass("Auto Exposure", [](RenderGraph::PassBuilder& builder) {
+        builder.Read("HDR");
+        builder.SideEffect();
+    }, nullptr);
+    graph.AddPass("Tonemapping", [](RenderGraph::PassBuilder& builder) {
+        builder.Read("HDR");
+        builder.Write("LDR", RenderGraphUsage::Storage);
+    }, nullptr);
+    graph.AddPass("Debug Renderer", [](RenderGraph::PassBuilder& builder) {
+        builder.Read("Velocity");
+        builder.Write("LDR", RenderGraphUsage::RenderTarget);
+    }, nullptr);
+    graph.AddPass("Copy to Backbuffer", [](RenderGraph::PassBuilder& builder) {
+        builder.Read("LDR", RenderGraphUsage::CopySource);
+        builder.Write("Backbuffer", RenderGraphUsage::CopyDest);
+    }, nullptr);
+    graph.MarkOutput("Backbuffer", RenderGraphUsage::Present);
+}
+
+void AliasingPlanner::ReportSyntheticFrame()
+{
+    RenderGraph graph;
+    std::vector<uint32_t> resources;
+    for (const AliasingResolution& resolution : GetReportResolutions()) {
+        BuildSyntheticFrame(graph, resolution.Width, resolution.Height);
+        graph.Compile();
+
+        std::vector<AliasingRequest> requests = GatherRequests(graph, [](uint32_t format) { return format; }, resources);
+        AliasingPlan plan = Plan(requests);
+        std::string error;
+        if (!Validate(requests, plan, &error)) {
+            Logger::Error("[ALIASING] Invalid plan: %s", error.c_str());
+        }
+        Report(std::string("Synthetic frame at ") + resolution.Name, graph, resources, plan);
+    }
+}
+
+void AliasingPlanner::Benchmark(uint32_t resourceCount, uint32_t iterations)
+{
+    std::mt19937 random(1234);
+    std::uniform_int_distribution<uint32_t> pass(0, 63);
+    std::uniform_int_distribution<uint32_t> length(0, 12);
+    std::uniform_int_distribution<uint32_t> size(1, 64);
+
+    float planTime = 0.0f;
+    uint64_t dedicated = 0;
+    uint64_t aliased = 0;
+    uint32_t failures = 0;
+    std::vector<AliasingRequest> requests(resourceCount);
+    for (uint32_t i = 0; i < iterations; i++) {
+        for (AliasingRequest& request : requests) {
+            request.First = pass(random);
+            request.Last = request.First + length(random);
+            request.Size = size(random) * ALIASING_DEFAULT_ALIGNMENT * 8;
+            request.Alignment = ALIASING_DEFAULT_ALIGNMENT;
+        }
+
+        AliasingPlan plan = Plan(requests);
+        std::string error;
+        if (!Validate(requests, plan, &error)) {
+            if (failures++ == 0) {
+                Logger::Error("[ALIASING] Invalid plan: %s", error.c_str());
+            }
+        }
+        planTime += plan.PlanTime;
+        dedicated += plan.DedicatedSize;
+        aliased += plan.AliasedSize;
+    }
+
+    Logger::Info("[ALIASING] %u plans of %u resources: %.4fms average, %.1f%% of the dedicated memory, %u invalid",
+                 iterations,
+                 resourceCount,
+                 planTime / iterations,
+                 dedicated ? aliased * 100.0 / dedicated : 0.0,
+                 failures);
+}
@@ -0,0 +1,92 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 16:21:09
+//
+
+#pragma once
+
+#include "render_graph.hpp"
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Doesn't include anything from D3D12, so that plans can be computed and checked on any platform
+
+// D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT
+#define ALIASING_DEFAULT_ALIGNMENT (64ull * 1024)
+#define ALIASING_MAX_HEAP_SIZE (256ull * 1024 * 1024)
+
+struct AliasingRequest
+{
+    uint64_t Size;
+    uint64_t Alignment = ALIASING_DEFAULT_ALIGNMENT;
+    uint32_t First; // First and last pass using the resource, both inclusive
+    uint32_t Last;
+};
+
+// A size the aliasing reports are made at
+struct AliasingResolution
+{
+    const char *Name;
+    uint32_t Width;
+    uint32_t Height;
+};
+
+struct AliasingPlacement
+{
+    uint32_t Heap;
+    uint64_t Offset;
+};
+
+struct AliasingHeap
+{
+    uint64_t Size = 0;
+    std::vector<uint32_t> Resources; // Indices in the requests
+};
+
+struct AliasingPlan
+{
+    std::vector<AliasingPlacement> Placements; // One per request
+    std::vector<AliasingHeap> Heaps;
+    uint64_t DedicatedSize = 0; // What every resource having its own allocation takes
+    uint64_t AliasedSize = 0; // What the heaps take
+    float PlanTime = 0.0f; // Milliseconds
+};
+
+// Places resources in shared heaps so that resources that are never alive at the same time share memory. Resources
+// are the vertices of an interval graph (an edge between two resources whose lifetimes overlap), and a placement is
+// their colour: neighbours can't have overlapping ranges of the same heap. Colouring goes from the biggest resource to
+// the smallest, each one going to the lowest offset that fits between its neighbours in the heap that grows the least.
+class AliasingPlanner
+{
+public:
+    // Size of a pixel for a RenderGraphTextureDesc format
+    using BytesPerPixel = std::function<uint32_t(uint32_t format)>;
+
+    static AliasingPlan Plan(const std::vector<AliasingRequest>& requests, uint64_t maxHeapSize = ALIASING_MAX_HEAP_SIZE);
+
+    // Checks that no two resources alive at the same time overlap, that every placement is aligned and fits its heap
+    static bool Validate(const std::vector<AliasingRequest>& requests, const AliasingPlan& plan, std::string *error = nullptr);
+
+    // Aligned size of a texture and its mips, close to what D3D12 reports for 64KB aligned placed resources
+    static uint64_t EstimateTextureSize(uint32_t width, uint32_t height, uint32_t bytesPerPixel, uint32_t mips);
+
+    // Requests for the textures of a compiled graph that only live during the frame: described, not an output, and used
+    // by a pass that runs. Resources gets the graph resource of each request.
+    static std::vector<AliasingRequest> GatherRequests(const RenderGraph& graph, const BytesPerPixel& bytesPerPixel, std::vector<uint32_t>& resources);
+    // 1080p, 1440p and 4K, shared by every report so that their numbers compare
+    static const std::vector<AliasingResolution>& GetReportResolutions();
+    // Logs what a plan of GatherRequests saves, then where every texture went
+    static void Report(const std::string& label, const RenderGraph& graph, const std::vector<uint32_t>& resources, const AliasingPlan& plan);
+
+    // Declares a frame with the passes and textures of the deferred renderer. Formats are bytes per pixel.
+    static void BuildSyntheticFrame(RenderGraph& graph, uint32_t width, uint32_t height);
+    // Reports the aliasing of the synthetic frame at 1080p, 1440p and 4K, without a renderer
+    static void ReportSyntheticFrame();
+
+    // Plans and validates random sets of resources, and logs how long planning takes
+    static void Benchmark(uint32_t resourceCount, uint32_t iterations);
+};
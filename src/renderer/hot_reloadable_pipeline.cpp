@@ -8,7 +8,11 @@
 
 #include "core/log.hpp"
 #include "core/shader_loader.hpp"
+#include "core/shader_compile_service.hpp"
 #include "core/file_system.hpp"
+#include "core/timer.hpp"
+
+#include <algorithm>
 
 HotReloadablePipeline::~HotReloadablePipeline()
 {
@@ -20,7 +24,13 @@ void HotReloadablePipeline::ReflectRootSignature(bool reflect)
     _reflectRootSignature = reflect;
 }
 
-void HotReloadablePipeline::AddShaderWatch(const std::string& path, const std::string& entryPoint, ShaderType type)
+void HotReloadablePipeline::AddPermutationKey(const std::string& name, uint32_t valueCount)
+{
+    _keys.push_back({ name, valueCount });
+    _values.push_back(0);
+}
+
+void HotReloadablePipeline::AddShaderWatch(const std::string& path, const std::string& entryPoint, ShaderType type, const std::vector<std::string>& keys)
 {
     if (!FileSystem::Exists(path)) {
         Logger::Error("Shader doesn't exist!");
@@ -29,10 +39,19 @@ void HotReloadablePipeline::AddShaderWatch(const std::string& path, const std::s
     ShaderWatch watch;
     watch.Path = path;
     watch.EntryPoint = entryPoint;
+    for (auto& key : keys) {
+        auto it = std::find_if(_keys.begin(), _keys.end(), [&](const ShaderPermutationKey& k) { return k.Name == key; });
+        if (it == _keys.end()) {
+            Logger::Error("[PERMUTATION] Shader %s uses undeclared key %s", path.c_str(), key.c_str());
+            continue;
+        }
+        watch.Keys.push_back(uint32_t(it - _keys.begin()));
+    }
     watch.Watch.Load(path);
-    watch.Bytecode = ShaderLoader::GetFromCache(path);
+    watch.Bytecode = ShaderLoader::GetFromCache(path, GetDefines(watch, GetPermutationIndex()));
     
     _shaders[type] = watch;
+    _loadedPermutation = GetPermutationIndex();
 }
 
 ShaderBytecode HotReloadablePipeline::GetBytecode(ShaderType type)
@@ -40,120 +59,461 @@ ShaderBytecode HotReloadablePipeline::GetBytecode(ShaderType type)
     return _shaders[type].Bytecode;
 }
 
+std::vector<std::string> HotReloadablePipeline::GetDefines(const ShaderWatch& watch, uint64_t permutation)
+{
+    // Undo the mixed radix of GetPermutationIndex
+    std::vector<uint32_t> values(_keys.size());
+    for (size_t i = _keys.size(); i-- > 0;) {
+        values[i] = uint32_t(permutation % _keys[i].ValueCount);
+        permutation /= _keys[i].ValueCount;
+    }
+
+    std::vector<std::string> defines;
+    for (uint32_t key : watch.Keys) {
+        defines.push_back(_keys[key].Name + "=" + std::to_string(values[key]));
+    }
+    return defines;
+}
+
+uint64_t HotReloadablePipeline::GetPermutationIndex()
+{
+    // Mixed radix, every combination of values gets its own index
+    uint64_t index = 0;
+    for (size_t i = 0; i < _keys.size(); i++) {
+        index = index * _keys[i].ValueCount + _values[i];
+    }
+    return index;
+}
+
+std::string HotReloadablePipeline::GetPermutationName(uint64_t permutation)
+{
+    std::string name;
+    for (size_t i = _keys.size(); i-- > 0;) {
+        name = _keys[i].Name + "=" + std::to_string(permutation % _keys[i].ValueCount) + (name.empty() ? "" : " ") + name;
+        permutation /= _keys[i].ValueCount;
+    }
+    return name;
+}
+
+void HotReloadablePipeline::LoadPermutationBytecode()
+{
+    // Stages without keys keep their bytecode, it may come from a hot reload that the cache doesn't have yet
+    for (auto& shader : _shaders) {
+        if (!shader.second.Keys.empty()) {
+            shader.second.Bytecode = ShaderLoader::GetFromCache(shader.second.Path, GetDefines(shader.second, GetPermutationIndex()));
+        }
+    }
+    _loadedPermutation = GetPermutationIndex();
+}
+
+void HotReloadablePipeline::SetPermutation(const std::string& key, uint32_t value)
+{
+    for (size_t i = 0; i < _keys.size(); i++) {
+        if (_keys[i].Name == key) {
+            _values[i] = std::min(value, _keys[i].ValueCount - 1);
+            return;
+        }
+    }
+    Logger::Error("[PERMUTATION] Unknown permutation key %s", key.c_str());
+}
+
+void HotReloadablePipeline::SelectPermutation(RenderContext::Ptr context)
+{
+    SwapPermutation(context);
+
+    uint64_t index = GetPermutationIndex();
+
+    _selections++;
+    if (index == _activePermutation) {
+        _hits++;
+        return;
+    }
+
+    auto it = _variants.find(index);
+    if (it != _variants.end()) {
+        _hits++;
+        ApplyVariant(index, it->second);
+        return;
+    }
+
+    // A variant for other values may still be compiling, this one goes next
+    if (!_permutationInFlight && !_failedPermutations.count(index)) {
+        SubmitPermutation(context, index);
+    }
+}
+
+void HotReloadablePipeline::SubmitPermutation(RenderContext::Ptr context, uint64_t permutation)
+{
+    struct Stage
+    {
+        ShaderType Type;
+        std::string Path;
+        std::vector<std::string> Defines;
+    };
+
+    // Stages without keys are the same in every variant
+    Bytecodes shaders;
+    std::vector<Stage> stages;
+    for (auto& shader : _shaders) {
+        if (shader.second.Keys.empty()) {
+            shaders[shader.first] = shader.second.Bytecode;
+        } else {
+            stages.push_back({ shader.first, shader.second.Path, GetDefines(shader.second, permutation) });
+        }
+    }
+
+    std::shared_ptr<Reload> build = _permutationBuild;
+    PipelineType type = _type;
+    bool reflect = _reflectRootSignature;
+    GraphicsPipelineSpecs specs = Specs;
+    RaytracingPipelineSpecs rtSpecs = RTSpecs;
+    RootSignatureBuildInfo signatureInfo = SignatureInfo;
+
+    _permutationInFlight = true;
+    _permutationGeneration = _generation;
+    ShaderCompileService::Submit([=]() mutable {
+        // Through the shader cache, so that a variant is only compiled once per machine
+        Timer timer;
+        for (auto& stage : stages) {
+            ShaderBytecode bytecode = ShaderLoader::GetFromCache(stage.Path, stage.Defines);
+            if (bytecode.bytecode.empty()) {
+                std::lock_guard<std::mutex> lock(build->Lock);
+                build->Failed = true;
+                build->Ready = true;
+                build->Permutation = permutation;
+                return;
+            }
+            shaders[stage.Type] = bytecode;
+        }
+        float compileTime = timer.GetElapsed();
+
+        timer.Restart();
+        Variant variant = {};
+        if (type != PipelineType::Raytracing) {
+            variant = CreateVariant(context, type, reflect, shaders, specs, rtSpecs, signatureInfo);
+        }
+        float buildTime = timer.GetElapsed();
+
+        std::lock_guard<std::mutex> lock(build->Lock);
+        build->Ready = true;
+        build->Failed = false;
+        build->Shaders = std::move(shaders);
+        build->Pipelines = variant;
+        build->Permutation = permutation;
+        build->CompileTime = compileTime;
+        build->BuildTime = buildTime;
+    });
+}
+
+void HotReloadablePipeline::SwapPermutation(RenderContext::Ptr context)
+{
+    Bytecodes shaders;
+    Variant variant;
+    uint64_t permutation;
+    float compileTime;
+    float buildTime;
+    {
+        std::lock_guard<std::mutex> lock(_permutationBuild->Lock);
+        if (!_permutationBuild->Ready) {
+            return;
+        }
+        _permutationBuild->Ready = false;
+        _permutationInFlight = false;
+        if (_permutationBuild->Failed) {
+            Logger::Error("[PERMUTATION] Failed to compile variant %s, keeping the current one", GetPermutationName(_permutationBuild->Permutation).c_str());
+            if (_permutationGeneration == _generation) {
+                _failedPermutations.insert(_permutationBuild->Permutation);
+            }
+            return;
+        }
+        shaders = std::move(_permutationBuild->Shaders);
+        variant = _permutationBuild->Pipelines;
+        permutation = _permutationBuild->Permutation;
+        compileTime = _permutationBuild->CompileTime;
+        buildTime = _permutationBuild->BuildTime;
+        _permutationBuild->Pipelines = {};
+    }
+
+    // Built from sources a hot reload replaced since, the next selection asks for it again
+    if (_permutationGeneration != _generation) {
+        return;
+    }
+
+    if (_type == PipelineType::Raytracing) {
+        Timer timer;
+        variant = CreateVariant(context, _type, _reflectRootSignature, shaders, Specs, RTSpecs, SignatureInfo);
+        buildTime = timer.GetElapsed();
+    }
+    variant.Shaders = std::move(shaders);
+    _variants[permutation] = variant;
+    if (permutation == GetPermutationIndex()) {
+        ApplyVariant(permutation, variant);
+    }
+
+    PermutationStats stats = GetPermutationStats();
+    Logger::Info("[PERMUTATION] Built variant %s (compiled in %.2fms, built in %.2fms, %u/%u variants, %u/%u selections hit)",
+                 GetPermutationName(permutation).c_str(),
+                 compileTime,
+                 buildTime,
+                 stats.VariantCount,
+                 stats.PossibleCount,
+                 stats.Hits,
+                 stats.Selections);
+}
+
+HotReloadablePipeline::PermutationStats HotReloadablePipeline::GetPermutationStats()
+{
+    PermutationStats stats;
+    stats.VariantCount = _variants.size();
+    stats.PossibleCount = 1;
+    for (auto& key : _keys) {
+        stats.PossibleCount *= key.ValueCount;
+    }
+    stats.Selections = _selections;
+    stats.Hits = _hits;
+    stats.Building = _permutationInFlight;
+    return stats;
+}
+
 void HotReloadablePipeline::Build(RenderContext::Ptr context)
 {
-    Signature.reset();
+    if (GetPermutationIndex() != _loadedPermutation) {
+        LoadPermutationBytecode();
+    }
+
+    // Every other variant was built from the old sources
+    RetireVariants(context->GetBackBufferIndex());
+    BuildPipeline(context);
+}
+
+HotReloadablePipeline::Variant HotReloadablePipeline::CreateVariant(RenderContext::Ptr context, PipelineType type, bool reflect, Bytecodes& shaders, GraphicsPipelineSpecs& specs, RaytracingPipelineSpecs& rtSpecs, RootSignatureBuildInfo& signatureInfo)
+{
+    Variant variant = {};
 
-    switch (_type) {
+    switch (type) {
         case PipelineType::Compute: {
-            if (_reflectRootSignature) {
-                Signature = context->CreateRootSignature();
-                Signature->ReflectFromComputeShader(GetBytecode(ShaderType::Compute));
+            if (reflect) {
+                variant.Signature = context->CreateRootSignature();
+                variant.Signature->ReflectFromComputeShader(shaders[ShaderType::Compute]);
             } else {
-                Signature = context->CreateRootSignature(SignatureInfo);
+                variant.Signature = context->CreateRootSignature(signatureInfo);
             }
-            ComputePipeline = context->CreateComputePipeline(GetBytecode(ShaderType::Compute), Signature);
+            variant.Compute = context->CreateComputePipeline(shaders[ShaderType::Compute], variant.Signature);
             break;
         }
         case PipelineType::Graphics: {
-            if (_reflectRootSignature) {
-                Signature = context->CreateRootSignature();
-                Signature->ReflectFromGraphicsShader(GetBytecode(ShaderType::Vertex), GetBytecode(ShaderType::Fragment));
+            if (reflect) {
+                variant.Signature = context->CreateRootSignature();
+                variant.Signature->ReflectFromGraphicsShader(shaders[ShaderType::Vertex], shaders[ShaderType::Fragment]);
             } else {
-                Signature = context->CreateRootSignature(SignatureInfo);
+                variant.Signature = context->CreateRootSignature(signatureInfo);
             }
-            Specs.Bytecodes[ShaderType::Vertex] = GetBytecode(ShaderType::Vertex);
-            Specs.Bytecodes[ShaderType::Fragment] = GetBytecode(ShaderType::Fragment);
-            Specs.Signature = Signature;
-            GraphicsPipeline = context->CreateGraphicsPipeline(Specs);
+            specs.Bytecodes[ShaderType::Vertex] = shaders[ShaderType::Vertex];
+            specs.Bytecodes[ShaderType::Fragment] = shaders[ShaderType::Fragment];
+            specs.Signature = variant.Signature;
+            variant.Graphics = context->CreateGraphicsPipeline(specs);
             break;
         }
         case PipelineType::Mesh: {
-            if (_reflectRootSignature) {
+            if (reflect) {
                 Logger::Error("Shader reflection for mesh shaders is currently unsupported!");
             } else {
-                Signature = context->CreateRootSignature(SignatureInfo);
+                variant.Signature = context->CreateRootSignature(signatureInfo);
             }
-            if (Specs.UseAmplification) {
-                Specs.Bytecodes[ShaderType::Amplification] = GetBytecode(ShaderType::Amplification);
+            if (specs.UseAmplification) {
+                specs.Bytecodes[ShaderType::Amplification] = shaders[ShaderType::Amplification];
             }
-            Specs.Bytecodes[ShaderType::Mesh] = GetBytecode(ShaderType::Mesh);
-            Specs.Bytecodes[ShaderType::Fragment] = GetBytecode(ShaderType::Fragment);
-            Specs.Signature = Signature;
-            MeshPipeline = context->CreateMeshPipeline(Specs);
+            specs.Bytecodes[ShaderType::Mesh] = shaders[ShaderType::Mesh];
+            specs.Bytecodes[ShaderType::Fragment] = shaders[ShaderType::Fragment];
+            specs.Signature = variant.Signature;
+            variant.Mesh = context->CreateMeshPipeline(specs);
             break;
         }
         case PipelineType::Raytracing: {
-            if (_reflectRootSignature) {
+            if (reflect) {
                 Logger::Error("Shader reflection for raytracing shaders is currently unsupported!");
             } else {
-                Signature = context->CreateRootSignature(SignatureInfo);
+                variant.Signature = context->CreateRootSignature(signatureInfo);
             }
-            RTSpecs.LibBytecode = GetBytecode(ShaderType::Raytracing);
-            RTSpecs.Signature = Signature;
-            RTPipeline = context->CreateRaytracingPipeline(RTSpecs);
+            rtSpecs.LibBytecode = shaders[ShaderType::Raytracing];
+            rtSpecs.Signature = variant.Signature;
+            variant.Raytracing = context->CreateRaytracingPipeline(rtSpecs);
             break;
         }
     }
+    return variant;
+}
+
+void HotReloadablePipeline::ApplyVariant(uint64_t permutation, const Variant& variant)
+{
+    GraphicsPipeline = variant.Graphics;
+    ComputePipeline = variant.Compute;
+    MeshPipeline = variant.Mesh;
+    RTPipeline = variant.Raytracing;
+    Signature = variant.Signature;
+
+    for (auto& shader : variant.Shaders) {
+        _shaders[shader.first].Bytecode = shader.second;
+    }
+    _activePermutation = permutation;
+    _loadedPermutation = permutation;
+}
+
+void HotReloadablePipeline::RetireVariants(uint32_t frameIndex)
+{
+    // The pipeline members point at one of the variants, so they are kept alive as well
+    for (auto& variant : _variants) {
+        _retired[frameIndex].push_back(variant.second);
+    }
+    _variants.clear();
+    _failedPermutations.clear();
+    _generation++;
+}
+
+void HotReloadablePipeline::BuildPipeline(RenderContext::Ptr context)
+{
+    Bytecodes shaders;
+    for (auto& shader : _shaders) {
+        shaders[shader.first] = shader.second.Bytecode;
+    }
+    Variant variant = CreateVariant(context, _type, _reflectRootSignature, shaders, Specs, RTSpecs, SignatureInfo);
+    variant.Shaders = std::move(shaders);
+    _variants[_loadedPermutation] = variant;
+    ApplyVariant(_loadedPermutation, variant);
 }
 
 void HotReloadablePipeline::CheckForRebuild(RenderContext::Ptr context, const std::string &name)
 {
+    // The frame that last used this index is done on the GPU, so is everything that was swapped out during it
+    _retired[context->GetBackBufferIndex()].clear();
+
+    SwapReload(context, name);
+
+    // Nothing changed anywhere since the last frame: the watches aren't even looked at
+    uint64_t changes = ShaderCompileService::GetChangeCount();
+    if (changes != _seenChanges) {
+        _seenChanges = changes;
+        for (auto& shader : _shaders) {
+            if (shader.second.Watch.Check()) {
+                shader.second.Dirty = true;
+                _reloadDirty = true;
+            }
+        }
+    }
+
+    // Saves made while a compile is in flight are submitted once it landed
+    if (_reloadDirty && !_reloadInFlight) {
+        Logger::Info("[HOT RELOAD PIPELINE] Hot reloading pipeline %s", name.c_str());
+        _reloadDirty = false;
+        SubmitReload(context);
+    }
+}
+
+void HotReloadablePipeline::SubmitReload(RenderContext::Ptr context)
+{
+    struct Stage
+    {
+        ShaderType Type;
+        std::string Path;
+        std::string EntryPoint;
+        std::vector<std::string> Defines;
+    };
+
+    // The variant in use is the one reloaded: the watches hold its bytecode, which stages that didn't change are rebuilt with
+    Bytecodes shaders;
+    std::vector<Stage> stages;
     for (auto& shader : _shaders) {
-        ShaderWatch& watch = shader.second;
-
-        if (watch.Watch.Check()) {
-            Logger::Info("[HOT RELOAD PIPELINE] Hot reloading pipeline %s", name.c_str());
-            switch (_type) {
-                case PipelineType::Graphics: {
-                    ShaderBytecode temp;
-                    if (!ShaderCompiler::CompileShader(watch.Path, watch.EntryPoint, shader.first, temp)) {
-                        return;
-                    } else {
-                        watch.Bytecode.bytecode = temp.bytecode;
-                    }
-
-                    GraphicsPipeline.reset();
-                    Build(context);
-                    break;
-                }
-                case PipelineType::Compute: {
-                    ShaderBytecode temp;
-                    if (!ShaderCompiler::CompileShader(watch.Path, watch.EntryPoint, shader.first, temp)) {
-                        return;
-                    } else {
-                        watch.Bytecode.bytecode = temp.bytecode;
-                    }
-
-                    ComputePipeline.reset();
-                    Build(context);
-                    break;
-                }
-                case PipelineType::Mesh: {
-                    ShaderBytecode temp;
-                    if (!ShaderCompiler::CompileShader(watch.Path, watch.EntryPoint, shader.first, temp)) {
-                        return;
-                    } else {
-                        watch.Bytecode.bytecode = temp.bytecode;
-                    }
-
-                    MeshPipeline.reset();
-                    Build(context);
-                    break;
-                }
-                case PipelineType::Raytracing: {
-                    ShaderBytecode temp;
-                    if (!ShaderCompiler::CompileShader(watch.Path, watch.EntryPoint, shader.first, temp)) {
-                        return;
-                    } else {
-                        watch.Bytecode.bytecode = temp.bytecode;
-                    }
-
-                    RTPipeline.reset();
-                    Build(context);
-                    break;
-                }
+        shaders[shader.first] = shader.second.Bytecode;
+        if (shader.second.Dirty) {
+            stages.push_back({ shader.first, shader.second.Path, shader.second.EntryPoint, GetDefines(shader.second, _loadedPermutation) });
+            shader.second.Dirty = false;
+        }
+    }
+
+    // Everything the job needs is copied, the pipeline keeps being used and edited on the frame thread meanwhile
+    std::shared_ptr<Reload> reload = _reload;
+    PipelineType type = _type;
+    bool reflect = _reflectRootSignature;
+    GraphicsPipelineSpecs specs = Specs;
+    RaytracingPipelineSpecs rtSpecs = RTSpecs;
+    RootSignatureBuildInfo signatureInfo = SignatureInfo;
+    uint64_t permutation = _loadedPermutation;
+
+    _reloadInFlight = true;
+    ShaderCompileService::Submit([=]() mutable {
+        Timer timer;
+        for (auto& stage : stages) {
+            ShaderBytecode temp;
+            if (!ShaderCompiler::CompileShader(stage.Path, stage.EntryPoint, stage.Type, temp, stage.Defines)) {
+                std::lock_guard<std::mutex> lock(reload->Lock);
+                reload->Failed = true;
+                reload->Ready = true;
+                return;
             }
+            shaders[stage.Type].bytecode = temp.bytecode;
+        }
+        float compileTime = timer.GetElapsed();
+
+        // Raytracing pipelines allocate their shader tables from the context's heaps, which only the frame thread may touch
+        timer.Restart();
+        Variant variant = {};
+        if (type != PipelineType::Raytracing) {
+            variant = CreateVariant(context, type, reflect, shaders, specs, rtSpecs, signatureInfo);
+        }
+        float buildTime = timer.GetElapsed();
+
+        std::lock_guard<std::mutex> lock(reload->Lock);
+        reload->Ready = true;
+        reload->Failed = false;
+        reload->Shaders = std::move(shaders);
+        reload->Pipelines = variant;
+        reload->Permutation = permutation;
+        reload->CompileTime = compileTime;
+        reload->BuildTime = buildTime;
+    });
+}
+
+void HotReloadablePipeline::SwapReload(RenderContext::Ptr context, const std::string& name)
+{
+    Bytecodes shaders;
+    Variant variant;
+    uint64_t permutation;
+    float compileTime;
+    float buildTime;
+    {
+        std::lock_guard<std::mutex> lock(_reload->Lock);
+        if (!_reload->Ready) {
+            return;
         }
+        _reload->Ready = false;
+        _reloadInFlight = false;
+        if (_reload->Failed) {
+            Logger::Error("[HOT RELOAD PIPELINE] Failed to compile pipeline %s, keeping the old one", name.c_str());
+            return;
+        }
+        shaders = std::move(_reload->Shaders);
+        variant = _reload->Pipelines;
+        permutation = _reload->Permutation;
+        compileTime = _reload->CompileTime;
+        buildTime = _reload->BuildTime;
+        _reload->Pipelines = {};
     }
+
+    if (_type == PipelineType::Raytracing) {
+        Timer timer;
+        variant = CreateVariant(context, _type, _reflectRootSignature, shaders, Specs, RTSpecs, SignatureInfo);
+        buildTime = timer.GetElapsed();
+    }
+    variant.Shaders = std::move(shaders);
+
+    // Every other variant was built from the old sources, the next selection rebuilds them in the background
+    RetireVariants(context->GetBackBufferIndex());
+    _variants[permutation] = variant;
+    ApplyVariant(permutation, variant);
+
+    Logger::Info("[HOT RELOAD PIPELINE] Swapped in pipeline %s (compiled in %.2fms, built in %.2fms %s)",
+                 name.c_str(),
+                 compileTime,
+                 buildTime,
+                 _type == PipelineType::Raytracing ? "on the frame thread" : "in the background");
 }
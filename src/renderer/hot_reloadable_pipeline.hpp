@@ -13,7 +13,11 @@
 #include "rhi/mesh_pipeline.hpp"
 #include "rhi/raytracing/raytracing_pipeline.hpp"
 
+#include <array>
+#include <memory>
+#include <mutex>
 #include <unordered_map>
+#include <unordered_set>
 
 enum class PipelineType
 {
@@ -24,6 +28,13 @@ enum class PipelineType
     // Graph Node
 };
 
+// A compile time switch of a shader, passed as a define: a boolean, or an enum with ValueCount values
+struct ShaderPermutationKey
+{
+    std::string Name;
+    uint32_t ValueCount = 2;
+};
+
 class HotReloadablePipeline
 {
 public:
@@ -33,13 +44,35 @@ public:
     }
     ~HotReloadablePipeline();
 
+    struct PermutationStats
+    {
+        uint32_t VariantCount; // Built so far
+        uint32_t PossibleCount;
+        uint32_t Selections;
+        uint32_t Hits;
+        bool Building; // A variant is being compiled in the background
+    };
+
     void ReflectRootSignature(bool reflect);
-    void AddShaderWatch(const std::string& path, const std::string& entryPoint, ShaderType type);
+
+    // Keys are declared before the shaders that use them, each shader only gets the defines of its own keys
+    void AddPermutationKey(const std::string& name, uint32_t valueCount = 2);
+    void AddShaderWatch(const std::string& path, const std::string& entryPoint, ShaderType type, const std::vector<std::string>& keys = {});
     ShaderBytecode GetBytecode(ShaderType type);
 
     void Build(RenderContext::Ptr context);
+
+    // Call between frames. Changed shaders are compiled and their pipeline built on the shader compile service, the result is
+    // swapped in at a later call. Swapped out pipelines are released once the frames in flight that may use them are done.
     void CheckForRebuild(RenderContext::Ptr context, const std::string &name = "");
 
+    // Call before binding: points the pipeline members at the variant for the current key values.
+    // A variant is compiled and built on the shader compile service the first time it's selected, the current one stays
+    // bound until it's there. Variants are kept until the pipeline is rebuilt.
+    void SetPermutation(const std::string& key, uint32_t value);
+    void SelectPermutation(RenderContext::Ptr context);
+    PermutationStats GetPermutationStats();
+
     GraphicsPipelineSpecs Specs;
     RaytracingPipelineSpecs RTSpecs;
     RootSignatureBuildInfo SignatureInfo;
@@ -60,7 +93,71 @@ private:
         ShaderBytecode Bytecode;
         std::string Path;
         std::string EntryPoint;
+        std::vector<uint32_t> Keys; // Indices into _keys
+        bool Dirty = false; // Changed on disk, not submitted yet
     };
 
+    struct Variant
+    {
+        GraphicsPipeline::Ptr Graphics;
+        ComputePipeline::Ptr Compute;
+        MeshPipeline::Ptr Mesh;
+        RaytracingPipeline::Ptr Raytracing;
+        RootSignature::Ptr Signature;
+        std::unordered_map<ShaderType, ShaderBytecode> Shaders; // What it was built from
+    };
+
+    using Bytecodes = std::unordered_map<ShaderType, ShaderBytecode>;
+
+    // Filled by the compile job, picked up by the frame thread
+    struct Reload
+    {
+        std::mutex Lock;
+        bool Ready = false;
+        bool Failed = false;
+        Bytecodes Shaders;
+        Variant Pipelines;
+        uint64_t Permutation = 0;
+        float CompileTime = 0.0f;
+        float BuildTime = 0.0f;
+    };
+
+    // Doesn't touch the members, so that compile jobs can call it
+    static Variant CreateVariant(RenderContext::Ptr context, PipelineType type, bool reflect, Bytecodes& shaders, GraphicsPipelineSpecs& specs, RaytracingPipelineSpecs& rtSpecs, RootSignatureBuildInfo& signatureInfo);
+    // Binds the variant, and gives the shader watches its bytecode so that hot reloads start from it
+    void ApplyVariant(uint64_t permutation, const Variant& variant);
+    void RetireVariants(uint32_t frameIndex);
+
+    void BuildPipeline(RenderContext::Ptr context);
+    void SubmitReload(RenderContext::Ptr context);
+    void SwapReload(RenderContext::Ptr context, const std::string& name);
+    void SubmitPermutation(RenderContext::Ptr context, uint64_t permutation);
+    void SwapPermutation(RenderContext::Ptr context);
+    void LoadPermutationBytecode();
+    std::vector<std::string> GetDefines(const ShaderWatch& watch, uint64_t permutation);
+    uint64_t GetPermutationIndex();
+    std::string GetPermutationName(uint64_t permutation);
+
     std::unordered_map<ShaderType, ShaderWatch> _shaders;
+
+    std::vector<ShaderPermutationKey> _keys;
+    std::vector<uint32_t> _values;
+    std::unordered_map<uint64_t, Variant> _variants;
+    uint64_t _activePermutation = 0;
+    uint64_t _loadedPermutation = 0; // The one the shader watches have the bytecode of
+    uint32_t _selections = 0;
+    uint32_t _hits = 0;
+
+    std::shared_ptr<Reload> _reload = std::make_shared<Reload>();
+    bool _reloadInFlight = false;
+    bool _reloadDirty = false;
+    uint64_t _seenChanges = 0;
+
+    // One variant is built in the background at a time. Sources changed if the generation moved on while it was.
+    std::shared_ptr<Reload> _permutationBuild = std::make_shared<Reload>();
+    bool _permutationInFlight = false;
+    uint64_t _generation = 0;
+    uint64_t _permutationGeneration = 0;
+    std::unordered_set<uint64_t> _failedPermutations; // Not asked for again until the sources change
+    std::array<std::vector<Variant>, FRAMES_IN_FLIGHT> _retired;
 };
@@ -0,0 +1,288 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 14:40:03
+//
+
+#include "render_graph.hpp"
+
+#include <core/log.hpp>
+#include <core/timer.hpp>
+
+#include <algorithm>
+
+uint32_t RenderGraph::PassBuilder::Read(const std::string& name, RenderGraphUsage usage)
+{
+    return _graph.Use(_pass, name, usage, false);
+}
+
+uint32_t RenderGraph::PassBuilder::Write(const std::string& name, RenderGraphUsage usage)
+{
+    return _graph.Use(_pass, name, usage, true);
+}
+
+uint32_t RenderGraph::PassBuilder::Create(const std::string& name, const RenderGraphTextureDesc& desc, RenderGraphUsage usage)
+{
+    if (_graph.FindResource(name) != RENDER_GRAPH_INVALID) {
+        Logger::Error("[GRAPH] Pass %s creates %s, which already exists", _graph._passes[_pass].Name.c_str(), name.c_str());
+        return RENDER_GRAPH_INVALID;
+    }
+    uint32_t resource = _graph.NewResource(name);
+    _graph._resources[resource].Desc = desc;
+    _graph._resources[resource].Transient = true;
+    return _graph.Use(_pass, name, usage, true);
+}
+
+void RenderGraph::PassBuilder::SideEffect()
+{
+    _graph._passes[_pass].SideEffect = true;
+}
+
+void RenderGraph::Reset()
+{
+    _passes.clear();
+    _resources.clear();
+    _lookup.clear();
+    _order.clear();
+    _finalBarriers.clear();
+    _stats = {};
+}
+
+uint32_t RenderGraph::Import(const std::string& name, uint64_t userData, RenderGraphUsage initial, const RenderGraphTextureDesc& desc)
+{
+    if (FindResource(name) != RENDER_GRAPH_INVALID) {
+        Logger::Error("[GRAPH] %s was imported twice", name.c_str());
+        return RENDER_GRAPH_INVALID;
+    }
+    uint32_t resource = NewResource(name);
+    _resources[resource].UserData = userData;
+    _resources[resource].Initial = initial;
+    _resources[resource].Desc = desc;
+    return resource;
+}
+
+void RenderGraph::MarkOutput(const std::string& name, RenderGraphUsage finalUsage)
+{
+    uint32_t resource = FindResource(name);
+    if (resource == RENDER_GRAPH_INVALID) {
+        Logger::Error("[GRAPH] Output %s was never imported or created", name.c_str());
+        return;
+    }
+    _resources[resource].Output = true;
+    _resources[resource].Final = finalUsage;
+}
+
+uint32_t RenderGraph::FindResource(const std::string& name) const
+{
+    auto it = _lookup.find(name);
+    return it != _lookup.end() ? it->second : RENDER_GRAPH_INVALID;
+}
+
+uint32_t RenderGraph::NewPass(const std::string& name, Execute execute)
+{
+    Pass pass;
+    pass.Name = name;
+    pass.Callback = std::move(execute);
+    _passes.push_back(std::move(pass));
+    return uint32_t(_passes.size() - 1);
+}
+
+uint32_t RenderGraph::NewResource(const std::string& name)
+{
+    Resource resource;
+    resource.Name = name;
+    _resources.push_back(std::move(resource));
+    _lookup[name] = uint32_t(_resources.size() - 1);
+    return uint32_t(_resources.size() - 1);
+}
+
+uint32_t RenderGraph::Use(uint32_t pass, const std::string& name, RenderGraphUsage usage, bool write)
+{
+    uint32_t id = FindResource(name);
+    if (id == RENDER_GRAPH_INVALID) {
+        Logger::Error("[GRAPH] Pass %s uses %s, which was never imported or created", _passes[pass].Name.c_str(), name.c_str());
+        return RENDER_GRAPH_INVALID;
+    }
+    Pass& p = _passes[pass];
+    Resource& resource = _resources[id];
+
+    // Reading a version, or writing the next one, needs the pass that made it
+    if (resource.Writer != RENDER_GRAPH_INVALID && resource.Writer != pass) {
+        if (std::find(p.Dependencies.begin(), p.Dependencies.end(), resource.Writer) == p.Dependencies.end()) {
+            p.Dependencies.push_back(resource.Writer);
+        }
+    }
+
+    // A pass uses a resource one way: writes win over reads, otherwise the first usage declared stays
+    auto access = std::find_if(p.Accesses.begin(), p.Accesses.end(), [id](const Access& a) { return a.Resource == id; });
+    if (access == p.Accesses.end()) {
+        p.Accesses.push_back({ id, usage, write });
+    } else if (write && !access->Write) {
+        access->Usage = usage;
+        access->Write = true;
+    }
+
+    if (write) {
+        resource.Writer = pass;
+    }
+    return id;
+}
+
+void RenderGraph::Compile()
+{
+    Timer timer;
+
+    _order.clear();
+    _finalBarriers.clear();
+    _stats = {};
+    for (Resource& resource : _resources) {
+        resource.Lifetime = {};
+    }
+
+    // Culling: walk back from what has to run. Passes only depend on earlier ones, so a single reverse walk is enough.
+    for (Pass& pass : _passes) {
+        pass.Culled = !pass.SideEffect;
+        pass.Barriers.clear();
+    }
+    for (Resource& resource : _resources) {
+        if (resource.Output && resource.Writer != RENDER_GRAPH_INVALID) {
+            _passes[resource.Writer].Culled = false;
+        }
+    }
+    for (uint32_t i = uint32_t(_passes.size()); i-- > 0;) {
+        if (_passes[i].Culled) {
+            _stats.Culled++;
+            continue;
+        }
+        for (uint32_t dependency : _passes[i].Dependencies) {
+            _passes[dependency].Culled = false;
+        }
+    }
+
+    // Barriers: a transition whenever a resource is used differently than it was last, and a UAV barrier between a
+    // storage write and the next storage access. Declaration order is already a valid execution order.
+    std::vector<RenderGraphUsage> states(_resources.size());
+    std::vector<bool> pendingWrites(_resources.size(), false);
+    for (uint32_t i = 0; i < _resources.size(); i++) {
+        states[i] = _resources[i].Initial;
+    }
+
+    for (uint32_t i = 0; i < _passes.size(); i++) {
+        Pass& pass = _passes[i];
+        if (pass.Culled) {
+            continue;
+        }
+        uint32_t index = uint32_t(_order.size());
+        _order.push_back(i);
+
+        for (const Access& access : pass.Accesses) {
+            RenderGraphLifetime& lifetime = _resources[access.Resource].Lifetime;
+            if (lifetime.First == RENDER_GRAPH_INVALID) {
+                lifetime.First = index;
+            }
+            lifetime.Last = index;
+
+            RenderGraphUsage& state = states[access.Resource];
+            if (state != access.Usage || state == RenderGraphUsage::Unknown) {
+                pass.Barriers.push_back({ access.Resource, state, access.Usage, false });
+                state = access.Usage;
+                _stats.Barriers++;
+            } else if (access.Usage == RenderGraphUsage::Storage && pendingWrites[access.Resource]) {
+                pass.Barriers.push_back({ access.Resource, state, state, true });
+                _stats.UAVBarriers++;
+            }
+            pendingWrites[access.Resource] = access.Write && access.Usage == RenderGraphUsage::Storage;
+        }
+    }
+
+    for (uint32_t i = 0; i < _resources.size(); i++) {
+        const Resource& resource = _resources[i];
+        if (resource.Output && resource.Final != RenderGraphUsage::Unknown && states[i] != resource.Final) {
+            _finalBarriers.push_back({ i, states[i], resource.Final, false });
+            _stats.Barriers++;
+        }
+        if (resource.Transient) {
+            _stats.Transient++;
+        }
+    }
+
+    _stats.Passes = uint32_t(_order.size());
+    _stats.Resources = uint32_t(_resources.size());
+    _stats.CompileTime = timer.GetElapsed();
+}
+
+void RenderGraph::Run(const std::function<void(const RenderGraphBarrier&)>& barrier)
+{
+    for (uint32_t pass : _order) {
+        for (const RenderGraphBarrier& b : _passes[pass].Barriers) {
+            barrier(b);
+        }
+        if (_passes[pass].Callback) {
+            _passes[pass].Callback();
+        }
+    }
+    for (const RenderGraphBarrier& b : _finalBarriers) {
+        barrier(b);
+    }
+}
+
+void RenderGraph::Benchmark(uint32_t passCount, uint32_t iterations)
+{
+    RenderGraph graph;
+
+    Timer declareTimer;
+    graph.Import("Backbuffer", 0, RenderGraphUsage::Present);
+    for (uint32_t i = 0; i < passCount; i++) {
+        std::string output = "Target " + std::to_string(i);
+        graph.AddPass("Pass " + std::to_string(i), [&](PassBuilder& builder) {
+            // Every eighth pass is a debug view nothing reads, the next pass reads the one before it
+            if (i > 0) {
+                uint32_t previous = (i - 1) % 8 == 7 ? i - 2 : i - 1;
+                builder.Read("Target " + std::to_string(previous));
+            }
+            if (i > 1 && i % 3 == 0 && (i / 2) % 8 != 7) {
+                builder.Read("Target " + std::to_string(i / 2));
+            }
+            builder.Create(output, { 1920, 1080, 0, 1 }, i % 2 ? RenderGraphUsage::Storage : RenderGraphUsage::RenderTarget);
+        }, nullptr);
+    }
+    graph.AddPass("Present", [&](PassBuilder& builder) {
+        builder.Read("Target " + std::to_string(passCount - 1), RenderGraphUsage::CopySource);
+        builder.Write("Backbuffer", RenderGraphUsage::CopyDest);
+    }, nullptr);
+    graph.MarkOutput("Backbuffer", RenderGraphUsage::Present);
+    float declareTime = declareTimer.GetElapsed();
+
+    Timer timer;
+    float best = 1e9f;
+    for (uint32_t i = 0; i < iterations; i++) {
+        graph.Compile();
+        best = std::min(best, graph.GetStats().CompileTime);
+    }
+    float total = timer.GetElapsed();
+
+    const RenderGraphStats& stats = graph.GetStats();
+    Logger::Info("[GRAPH] %u passes declared in %.3fms, compiled %u times: %.4fms average, %.4fms best", passCount + 1, declareTime, iterations, total / iterations, best);
+    Logger::Info("[GRAPH] %u passes run, %u culled, %u resources (%u transient), %u barriers, %u UAV barriers",
+                 stats.Passes,
+                 stats.Culled,
+                 stats.Resources,
+                 stats.Transient,
+                 stats.Barriers,
+                 stats.UAVBarriers);
+}
+
+const char *RenderGraph::GetUsageName(RenderGraphUsage usage)
+{
+    switch (usage) {
+        case RenderGraphUsage::Unknown: return "Unknown";
+        case RenderGraphUsage::RenderTarget: return "RenderTarget";
+        case RenderGraphUsage::DepthWrite: return "DepthWrite";
+        case RenderGraphUsage::ShaderResource: return "ShaderResource";
+        case RenderGraphUsage::Storage: return "Storage";
+        case RenderGraphUsage::CopySource: return "CopySource";
+        case RenderGraphUsage::CopyDest: return "CopyDest";
+        case RenderGraphUsage::Present: return "Present";
+        default: return "?";
+    }
+}
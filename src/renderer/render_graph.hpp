@@ -0,0 +1,186 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 14:12:46
+//
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Doesn't include anything from D3D12, so that graphs can be compiled and benchmarked on any platform
+
+#define RENDER_GRAPH_INVALID 0xFFFFFFFF
+
+// How a pass uses a resource. The renderer turns them into texture layouts.
+enum class RenderGraphUsage : uint8_t
+{
+    Unknown, // Imported resources whose state the graph doesn't know, their first use always gets a barrier
+    RenderTarget,
+    DepthWrite,
+    ShaderResource,
+    Storage,
+    CopySource,
+    CopyDest,
+    Present
+};
+
+// What a resource looks like, so that it can be created and aliased. Resources without a size are never aliased.
+struct RenderGraphTextureDesc
+{
+    uint32_t Width = 0;
+    uint32_t Height = 0;
+    uint32_t Format = 0; // TextureFormat
+    uint32_t Mips = 1;
+};
+
+struct RenderGraphBarrier
+{
+    uint32_t Resource;
+    RenderGraphUsage Before;
+    RenderGraphUsage After;
+    bool UAV; // Before and After are both Storage, the barrier only waits for the previous writes
+};
+
+// Indices in the execution order, both inclusive. First is RENDER_GRAPH_INVALID for resources no pass that runs touches.
+struct RenderGraphLifetime
+{
+    uint32_t First = RENDER_GRAPH_INVALID;
+    uint32_t Last = RENDER_GRAPH_INVALID;
+};
+
+struct RenderGraphStats
+{
+    uint32_t Passes = 0;
+    uint32_t Culled = 0;
+    uint32_t Resources = 0;
+    uint32_t Transient = 0;
+    uint32_t Barriers = 0; // Transitions, UAV barriers excluded
+    uint32_t UAVBarriers = 0;
+    float CompileTime = 0.0f; // Milliseconds
+};
+
+// Passes declare the resources they read and write by name, in the order they should run. Compiling culls the passes
+// nothing needs, works out the barriers each pass needs before it runs and how long every resource has to live.
+// Every write makes a new version of a resource, which is what culling follows: a pass only runs if a pass that runs
+// reads what it wrote, if it writes one of the graph's outputs, or if it has side effects the graph can't see.
+class RenderGraph
+{
+public:
+    using Execute = std::function<void()>;
+
+    class PassBuilder
+    {
+    public:
+        // Imported or created by an earlier pass
+        uint32_t Read(const std::string& name, RenderGraphUsage usage = RenderGraphUsage::ShaderResource);
+        // Read-modify-write of an existing resource: runs after every pass that used its previous version
+        uint32_t Write(const std::string& name, RenderGraphUsage usage);
+        // A resource that only lives inside the graph, from this pass to its last reader
+        uint32_t Create(const std::string& name, const RenderGraphTextureDesc& desc, RenderGraphUsage usage);
+        // Never culled, for passes that write state outside of the graph (history buffers, readbacks...)
+        void SideEffect();
+    private:
+        friend class RenderGraph;
+        PassBuilder(RenderGraph& graph, uint32_t pass) : _graph(graph), _pass(pass) {}
+
+        RenderGraph& _graph;
+        uint32_t _pass;
+    };
+
+    // Forgets every pass and resource, keeps the memory
+    void Reset();
+
+    // The user data is whatever lets the caller find the actual resource again. Imports that are only used during the
+    // frame can give their description, for the aliasing plan.
+    uint32_t Import(const std::string& name, uint64_t userData, RenderGraphUsage initial = RenderGraphUsage::Unknown, const RenderGraphTextureDesc& desc = {});
+    // Passes writing the last version of an output are never culled. A final usage other than Unknown adds a barrier
+    // after the last pass.
+    void MarkOutput(const std::string& name, RenderGraphUsage finalUsage = RenderGraphUsage::Unknown);
+
+    template<typename Setup>
+    uint32_t AddPass(const std::string& name, Setup setup, Execute execute)
+    {
+        uint32_t pass = NewPass(name, std::move(execute));
+        PassBuilder builder(*this, pass);
+        setup(builder);
+        return pass;
+    }
+
+    void Compile();
+    // Runs the passes in order. The callback gets the barriers of each pass before it runs, then the final ones.
+    void Run(const std::function<void(const RenderGraphBarrier&)>& barrier);
+
+    const std::vector<uint32_t>& GetOrder() const { return _order; }
+    const std::vector<RenderGraphBarrier>& GetBarriers(uint32_t pass) const { return _passes[pass].Barriers; }
+    const std::vector<RenderGraphBarrier>& GetFinalBarriers() const { return _finalBarriers; }
+    bool IsCulled(uint32_t pass) const { return _passes[pass].Culled; }
+    uint32_t GetPassCount() const { return uint32_t(_passes.size()); }
+    const std::string& GetPassName(uint32_t pass) const { return _passes[pass].Name; }
+
+    uint32_t GetResourceCount() const { return uint32_t(_resources.size()); }
+    uint32_t FindResource(const std::string& name) const;
+    const std::string& GetResourceName(uint32_t resource) const { return _resources[resource].Name; }
+    uint64_t GetUserData(uint32_t resource) const { return _resources[resource].UserData; }
+    bool IsTransient(uint32_t resource) const { return _resources[resource].Transient; }
+    bool IsOutput(uint32_t resource) const { return _resources[resource].Output; }
+    const RenderGraphTextureDesc& GetDesc(uint32_t resource) const { return _resources[resource].Desc; }
+    const RenderGraphLifetime& GetLifetime(uint32_t resource) const { return _resources[resource].Lifetime; }
+
+    const RenderGraphStats& GetStats() const { return _stats; }
+
+    // Compiles a synthetic graph shaped like a frame (a chain of passes, each reading a couple of earlier results, and a
+    // debug view nobody reads every eight passes) a number of times and logs how long it takes
+    static void Benchmark(uint32_t passCount, uint32_t iterations);
+
+    static const char *GetUsageName(RenderGraphUsage usage);
+private:
+    struct Access
+    {
+        uint32_t Resource;
+        RenderGraphUsage Usage;
+        bool Write;
+    };
+
+    struct Pass
+    {
+        std::string Name;
+        Execute Callback;
+        std::vector<Access> Accesses;
+        std::vector<uint32_t> Dependencies; // Passes that have to run for this one to
+        std::vector<RenderGraphBarrier> Barriers;
+        bool SideEffect = false;
+        bool Culled = false;
+    };
+
+    struct Resource
+    {
+        std::string Name;
+        uint64_t UserData = 0;
+        RenderGraphUsage Initial = RenderGraphUsage::Unknown;
+        RenderGraphUsage Final = RenderGraphUsage::Unknown;
+        RenderGraphTextureDesc Desc;
+        bool Transient = false;
+        bool Output = false;
+
+        uint32_t Writer = RENDER_GRAPH_INVALID; // Pass that made the current version, while declaring
+
+        RenderGraphLifetime Lifetime;
+    };
+
+    uint32_t NewPass(const std::string& name, Execute execute);
+    uint32_t NewResource(const std::string& name);
+    uint32_t Use(uint32_t pass, const std::string& name, RenderGraphUsage usage, bool write);
+
+    std::vector<Pass> _passes;
+    std::vector<Resource> _resources;
+    std::unordered_map<std::string, uint32_t> _lookup;
+
+    std::vector<uint32_t> _order;
+    std::vector<RenderGraphBarrier> _finalBarriers;
+    RenderGraphStats _stats;
+};
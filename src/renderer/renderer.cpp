@@ -7,9 +7,11 @@
 #include "core/log.hpp"
 #include "core/texture_file.hpp"
 #include "core/texture_compressor.hpp"
+#include "core/profiler.hpp"
 
 #include <sstream>
 #include <algorithm>
+#include <cmath>
 #include <ctime>
 
 #include <ImGui/imgui.h>
@@ -17,6 +19,8 @@
 #include <stb/stb_image_write.h>
 #include <optick.h>
 
+#undef max
+
 Renderer::Renderer(RenderContext::Ptr context)
     : _renderContext(context)
 {
@@ -54,146 +58,349 @@ Renderer::~Renderer()
     
 }
     
+static TextureLayout ToTextureLayout(RenderGraphUsage usage)
+{
+    switch (usage) {
+        case RenderGraphUsage::RenderTarget: return TextureLayout::RenderTarget;
+        case RenderGraphUsage::DepthWrite: return TextureLayout::Depth;
+        case RenderGraphUsage::ShaderResource: return TextureLayout::ShaderResource;
+        case RenderGraphUsage::Storage: return TextureLayout::Storage;
+        case RenderGraphUsage::CopySource: return TextureLayout::CopySource;
+        case RenderGraphUsage::CopyDest: return TextureLayout::CopyDest;
+        case RenderGraphUsage::Present: return TextureLayout::Present;
+        default: return TextureLayout::Common;
+    }
+}
+
+static uint32_t GetBytesPerPixel(TextureFormat format)
+{
+    switch (format) {
+        case TextureFormat::RGBA32Float: return 16;
+        case TextureFormat::RGB32Float: return 12;
+        case TextureFormat::RGBA16Float:
+        case TextureFormat::RGBA16Unorm: return 8;
+        case TextureFormat::RGBA8:
+        case TextureFormat::RGB11Float:
+        case TextureFormat::RG16Float:
+        case TextureFormat::R32Float:
+        case TextureFormat::R32Depth:
+        case TextureFormat::R32Typeless: return 4;
+        default: return 0;
+    }
+}
+
 void Renderer::Render(Scene& scene, uint32_t width, uint32_t height, float dt)
 {
     CommandBuffer::Ptr cmdBuf = _renderContext->GetCurrentCommandBuffer();
 
     scene.Update(_renderContext);
 
+    // Everything that changes which passes run or how they are wired
+    uint64_t key = (uint64_t(width) << 32) | (uint64_t(height) << 8) | (uint64_t(_gpType) << 2) | (uint64_t(_useRTShadows) << 1) | uint64_t(_taa->IsEnabled());
+    if (key != _graphKey) {
+        BuildGraph(width, height);
+        {
+            PROFILE_SCOPE("Render Graph Compile");
+            _graph.Compile();
+        }
+        _graphKey = key;
+
+        const RenderGraphStats& stats = _graph.GetStats();
+        Logger::Info("[GRAPH] Compiled in %.3fms: %u passes, %u culled, %u barriers, %u UAV barriers",
+                     stats.CompileTime,
+                     stats.Passes,
+                     stats.Culled,
+                     stats.Barriers,
+                     stats.UAVBarriers);
+    }
+    _graphTextures[_backBufferTexture] = _renderContext->GetBackBuffer();
+
+    _frameScene = &scene;
+    _frameWidth = width;
+    _frameHeight = height;
+    _frameDt = dt;
+
+    {
+        OPTICK_EVENT("Frame Render");
+        PROFILE_SCOPE("Frame Render");
+
+        // The textures track their own state, so the barriers only ever ask for the layout a pass wants
+        _graph.Run([&](const RenderGraphBarrier& barrier) {
+            Texture::Ptr texture = _graphTextures[_graph.GetUserData(barrier.Resource)];
+            if (texture) {
+                cmdBuf->ImageBarrier(texture, ToTextureLayout(barrier.After));
+            }
+        });
+    }
+    _frameScene = nullptr;
+}
+
+void Renderer::ImportTexture(const std::string& name, Texture::Ptr texture, RenderGraphUsage initial, const RenderGraphTextureDesc& desc)
+{
+    _graphTextures.push_back(texture);
+    _graph.Import(name, _graphTextures.size() - 1, initial, desc);
+}
+
+void Renderer::PlanAliasing()
+{
+    std::vector<AliasingRequest> requests = AliasingPlanner::GatherRequests(_graph, [](uint32_t format) {
+        return GetBytesPerPixel(TextureFormat(format));
+    }, _aliasedResources);
+
+    _aliasingPlan = AliasingPlanner::Plan(requests);
+    std::string error;
+    if (!AliasingPlanner::Validate(requests, _aliasingPlan, &error)) {
+        Logger::Error("[ALIASING] Invalid plan: %s", error.c_str());
+    }
+}
+
+void Renderer::ReportAliasing()
+{
+    for (const AliasingResolution& resolution : AliasingPlanner::GetReportResolutions()) {
+        BuildGraph(resolution.Width, resolution.Height);
+        _graph.Compile();
+        PlanAliasing();
+        AliasingPlanner::Report(resolution.Name, _graph, _aliasedResources, _aliasingPlan);
+    }
+
+    // Whatever renders next builds the graph again for its own size
+    _graphKey = UINT64_MAX;
+    _aliasingPlanKey = UINT64_MAX;
+}
+
+void Renderer::AddPass(const std::string& name, std::function<void(RenderGraph::PassBuilder&)> setup, std::function<void()> execute)
+{
+    uint32_t zone = Profiler::Intern(name);
+    _graph.AddPass(name, setup, [zone, execute]() {
+        ProfileScope scope(zone);
+        execute();
+    });
+}
+
+void Renderer::BuildGraph(uint32_t width, uint32_t height)
+{
+    PROFILE_SCOPE("Render Graph Build");
+
+    _graph.Reset();
+    _graphTextures.clear();
+
+    bool deferred = _gpType == GeometryPassType::Deferred;
+    Texture::Ptr depth = deferred ? _deferred->GetDepthBuffer() : _forwardPlus->GetDepthBuffer();
+    Texture::Ptr velocity = deferred ? _deferred->GetVelocityBuffer() : _forwardPlus->GetVelocityBuffer();
+    Texture::Ptr emissive = deferred ? _deferred->GetEmissiveBuffer() : _forwardPlus->GetEmissiveBuffer();
+
+    auto describe = [width, height](TextureFormat format, uint32_t mips = 1) {
+        return RenderGraphTextureDesc{ width, height, uint32_t(format), mips };
+    };
+    uint32_t shadowSize = _shadows->GetOutput()->GetWidth();
+    uint32_t bloomMips = uint32_t(std::floor(std::log2(std::max(width, height)))) + 1;
+
+    // Everything but the LDR output (read by screenshots after the frame) and the backbuffer only lives during the
+    // frame. Techniques keep the textures they don't hand out, the graph only knows what they look like.
+    // The post stack always works on the deferred output, in place.
+    ImportTexture("Shadow Map", _shadows->GetOutput(), RenderGraphUsage::Unknown, { shadowSize, shadowSize, uint32_t(TextureFormat::R32Typeless), 1 });
+    ImportTexture("Depth", depth, RenderGraphUsage::Unknown, describe(TextureFormat::R32Typeless));
+    ImportTexture("Normals", _deferred->GetNormalBuffer(), RenderGraphUsage::Unknown, describe(TextureFormat::RGBA16Float));
+    ImportTexture("Albedo", nullptr, RenderGraphUsage::Unknown, describe(TextureFormat::RGBA8));
+    ImportTexture("PBR", nullptr, RenderGraphUsage::Unknown, describe(TextureFormat::RGBA8));
+    ImportTexture("Velocity", velocity, RenderGraphUsage::Unknown, describe(TextureFormat::RG16Float));
+    ImportTexture("Emissive", emissive, RenderGraphUsage::Unknown, describe(TextureFormat::RGBA16Float));
+    ImportTexture("SSAO", _ssao->GetOutput(), RenderGraphUsage::Unknown, describe(TextureFormat::R32Float));
+    ImportTexture("HDR", _deferred->GetOutput(), RenderGraphUsage::Unknown, describe(TextureFormat::RGBA16Unorm));
+    ImportTexture("Bloom Chain", nullptr, RenderGraphUsage::Unknown, describe(TextureFormat::RGBA16Float, bloomMips));
+    ImportTexture("LDR", _tonemapping->GetOutput());
+    _backBufferTexture = uint32_t(_graphTextures.size());
+    ImportTexture("Backbuffer", _renderContext->GetBackBuffer(), RenderGraphUsage::Present);
+
     // Connect
-    if (_gpType == GeometryPassType::Deferred) {
-        _ssao->SetDepthBuffer(_deferred->GetDepthBuffer());
+    _ssao->SetDepthBuffer(depth);
+    if (deferred) {
         _ssao->SetNormalBuffer(_deferred->GetNormalBuffer());
 
         _deferred->ConnectEnvironmentMap(_envMapForward->GetEnvMap());
         _deferred->ConnectShadowMap(_shadows->GetOutput());
         _deferred->ConnectSSAO(_ssao->GetOutput());
-
         _deferred->ShouldJitter(_taa->IsEnabled());
-
-        _taa->SetVelocityBuffer(_deferred->GetVelocityBuffer());
-        _motionBlur->SetVelocityBuffer(_deferred->GetVelocityBuffer());
-        _bloom->ConnectEmissiveBuffer(_deferred->GetEmissiveBuffer());
-
-        _debugRenderer->SetVelocityBuffer(_deferred->GetVelocityBuffer());
     } else {
-        _ssao->SetDepthBuffer(_forwardPlus->GetDepthBuffer());
-
         _forwardPlus->ConnectEnvironmentMap(_envMapForward->GetEnvMap());
         _forwardPlus->ConnectShadowMap(_shadows->GetOutput());
         _forwardPlus->ConnectSSAO(_ssao->GetOutput());
-
         _forwardPlus->ShouldJitter(_taa->IsEnabled());
-    
-        _taa->SetVelocityBuffer(_forwardPlus->GetVelocityBuffer());
-        _motionBlur->SetVelocityBuffer(_forwardPlus->GetVelocityBuffer());
-        _bloom->ConnectEmissiveBuffer(_forwardPlus->GetEmissiveBuffer());
-
-        _debugRenderer->SetVelocityBuffer(_forwardPlus->GetVelocityBuffer());
     }
-
-    {
-        OPTICK_EVENT("Frame Render");
-
-        if (!_useRTShadows) {
-            _stats.PushFrameTime("Shadows", [this, &scene, width, height]() {
-                _shadows->Render(scene, width, height);
-            });
-        }
-
-        // Geometry + SSAO
-        if (_gpType == GeometryPassType::Deferred) {
-            _stats.PushFrameTime("GBuffer", [this, &scene, width, height]() {
-                _deferred->GBufferPass(scene, width, height);
-            });
-            _stats.PushFrameTime("SSAO", [this, &scene, width, height]() {
-                _ssao->Render(scene, width, height);
-            });
-            _stats.PushFrameTime("Lighting", [this, &scene, width, height]() {
-                _deferred->LightingPass(scene, width, height, _useRTShadows);
-            });
-        } else  {
-            _stats.PushFrameTime("Z Prepass", [this, &scene, width, height]() {
-                if (_forwardPlus->UseMeshShaders()) {
-                    _forwardPlus->ZPrepassMesh(scene, width, height);
-                } else {
-                    _forwardPlus->ZPrepassClassic(scene, width, height);
-                }
-            });
-            _stats.PushFrameTime("SSAO", [this, &scene, width, height]() {
-                _ssao->Render(scene, width, height);
-            });
-            _stats.PushFrameTime("Cull Lights", [this, &scene, width, height]() {
-                _forwardPlus->LightCullPass(scene, width, height);
-            });
-            _stats.PushFrameTime("Lighting", [this, &scene, width, height]() {
-                if (_forwardPlus->UseMeshShaders()) {
-                    _forwardPlus->LightingMesh(scene, width, height, _useRTShadows);
-                } else {
-                    _forwardPlus->LightingClassic(scene, width, height, _useRTShadows);
-                }
-            });
-        }
-
-        // Skybox
-        _stats.PushFrameTime("Environment Map", [this, &scene, width, height]() {
-            _envMapForward->Render(scene, width, height);
+    _taa->SetVelocityBuffer(velocity);
+    _motionBlur->SetVelocityBuffer(velocity);
+    _bloom->ConnectEmissiveBuffer(emissive);
+    _debugRenderer->SetVelocityBuffer(velocity);
+
+    // Culled when lighting traces its shadows instead of reading the map
+    AddPass("Shadows", [](RenderGraph::PassBuilder& builder) {
+        builder.Write("Shadow Map", RenderGraphUsage::DepthWrite);
+    }, [this]() {
+        _shadows->Render(*_frameScene, _frameWidth, _frameHeight);
+    });
+
+    // Geometry + SSAO
+    bool rtShadows = _useRTShadows;
+    if (deferred) {
+        AddPass("GBuffer", [](RenderGraph::PassBuilder& builder) {
+            builder.Write("Depth", RenderGraphUsage::DepthWrite);
+            builder.Write("Normals", RenderGraphUsage::RenderTarget);
+            builder.Write("Albedo", RenderGraphUsage::RenderTarget);
+            builder.Write("PBR", RenderGraphUsage::RenderTarget);
+            builder.Write("Velocity", RenderGraphUsage::RenderTarget);
+            builder.Write("Emissive", RenderGraphUsage::RenderTarget);
+        }, [this]() {
+            _deferred->GBufferPass(*_frameScene, _frameWidth, _frameHeight);
         });
-
-        // Post FX stack
-        _stats.PushFrameTime("Temporal Anti-Aliasing", [this, &scene, width, height]() {
-            _taa->Render(scene, width, height);
-        });
-        _stats.PushFrameTime("Motion Blur", [this, &scene, width, height]() {
-            _motionBlur->Render(scene, width, height);
-        });
-        _stats.PushFrameTime("Chromatic Aberration", [this, &scene, width, height]() {
-            _chromaticAberration->Render(scene, width, height);
+        AddPass("SSAO", [](RenderGraph::PassBuilder& builder) {
+            builder.Read("Depth");
+            builder.Read("Normals");
+            builder.Write("SSAO", RenderGraphUsage::Storage);
+        }, [this]() {
+            _ssao->Render(*_frameScene, _frameWidth, _frameHeight);
         });
-        _stats.PushFrameTime("Bloom", [this, &scene, width, height]() {
-            _bloom->Render(scene, width, height);
+        AddPass("Lighting", [rtShadows](RenderGraph::PassBuilder& builder) {
+            builder.Read("Depth");
+            builder.Read("Normals");
+            builder.Read("Albedo");
+            builder.Read("PBR");
+            builder.Read("Velocity");
+            builder.Read("Emissive");
+            builder.Read("SSAO");
+            if (!rtShadows) {
+                builder.Read("Shadow Map");
+            }
+            builder.Write("HDR", RenderGraphUsage::Storage);
+        }, [this, rtShadows]() {
+            _deferred->LightingPass(*_frameScene, _frameWidth, _frameHeight, rtShadows);
         });
-        _stats.PushFrameTime("Color Correction", [this, &scene, width, height]() {
-            _colorCorrection->Render(scene, width, height);
+    } else {
+        AddPass("Z Prepass", [](RenderGraph::PassBuilder& builder) {
+            builder.Write("Depth", RenderGraphUsage::DepthWrite);
+            builder.Write("Velocity", RenderGraphUsage::RenderTarget);
+        }, [this]() {
+            if (_forwardPlus->UseMeshShaders()) {
+                _forwardPlus->ZPrepassMesh(*_frameScene, _frameWidth, _frameHeight);
+            } else {
+                _forwardPlus->ZPrepassClassic(*_frameScene, _frameWidth, _frameHeight);
+            }
         });
-        _stats.PushFrameTime("Film Grain", [this, &scene, width, height, dt]() {
-            _filmGrain->Render(scene, width, height, dt);
+        AddPass("SSAO", [](RenderGraph::PassBuilder& builder) {
+            builder.Read("Depth");
+            builder.Write("SSAO", RenderGraphUsage::Storage);
+        }, [this]() {
+            _ssao->Render(*_frameScene, _frameWidth, _frameHeight);
         });
-        _stats.PushFrameTime("Auto Exposure", [this, &scene, width, height, dt]() {
-            _autoExposure->Render(scene, width, height, dt);
+        // The light lists live in buffers the graph doesn't track
+        AddPass("Cull Lights", [](RenderGraph::PassBuilder& builder) {
+            builder.Read("Depth");
+            builder.SideEffect();
+        }, [this]() {
+            _forwardPlus->LightCullPass(*_frameScene, _frameWidth, _frameHeight);
         });
-        _stats.PushFrameTime("Tonemapping", [this, &scene, width, height]() {
-            _tonemapping->Render(scene, width, height);
-        });
-
-        // Debug renderer
-        _stats.PushFrameTime("Debug Renderer", [this, &scene, width, height]() {
-            _debugRenderer->Flush(scene, width, height);
+        AddPass("Lighting", [rtShadows](RenderGraph::PassBuilder& builder) {
+            builder.Read("Depth", RenderGraphUsage::DepthWrite);
+            builder.Read("SSAO");
+            if (!rtShadows) {
+                builder.Read("Shadow Map");
+            }
+            builder.Write("Emissive", RenderGraphUsage::RenderTarget);
+            builder.Write("HDR", RenderGraphUsage::RenderTarget);
+        }, [this, rtShadows]() {
+            if (_forwardPlus->UseMeshShaders()) {
+                _forwardPlus->LightingMesh(*_frameScene, _frameWidth, _frameHeight, rtShadows);
+            } else {
+                _forwardPlus->LightingClassic(*_frameScene, _frameWidth, _frameHeight, rtShadows);
+            }
         });
     }
 
-    {
+    // Skybox
+    AddPass("Environment Map", [](RenderGraph::PassBuilder& builder) {
+        builder.Read("Depth", RenderGraphUsage::DepthWrite);
+        builder.Write("HDR", RenderGraphUsage::RenderTarget);
+    }, [this]() {
+        _envMapForward->Render(*_frameScene, _frameWidth, _frameHeight);
+    });
+
+    // Post FX stack
+    AddPass("Temporal Anti-Aliasing", [](RenderGraph::PassBuilder& builder) {
+        builder.Read("Velocity");
+        builder.Write("HDR", RenderGraphUsage::Storage);
+    }, [this]() {
+        _taa->Render(*_frameScene, _frameWidth, _frameHeight);
+    });
+    AddPass("Motion Blur", [](RenderGraph::PassBuilder& builder) {
+        builder.Read("Velocity");
+        builder.Write("HDR", RenderGraphUsage::Storage);
+    }, [this]() {
+        _motionBlur->Render(*_frameScene, _frameWidth, _frameHeight);
+    });
+    AddPass("Chromatic Aberration", [](RenderGraph::PassBuilder& builder) {
+        builder.Write("HDR", RenderGraphUsage::Storage);
+    }, [this]() {
+        _chromaticAberration->Render(*_frameScene, _frameWidth, _frameHeight);
+    });
+    AddPass("Bloom", [](RenderGraph::PassBuilder& builder) {
+        builder.Read("Emissive", RenderGraphUsage::CopySource);
+        builder.Write("Bloom Chain", RenderGraphUsage::Storage);
+        builder.Write("HDR", RenderGraphUsage::Storage);
+    }, [this]() {
+        _bloom->Render(*_frameScene, _frameWidth, _frameHeight);
+    });
+    AddPass("Color Correction", [](RenderGraph::PassBuilder& builder) {
+        builder.Write("HDR", RenderGraphUsage::Storage);
+    }, [this]() {
+        _colorCorrection->Render(*_frameScene, _frameWidth, _frameHeight);
+    });
+    AddPass("Film Grain", [](RenderGraph::PassBuilder& builder) {
+        builder.Write("HDR", RenderGraphUsage::Storage);
+    }, [this]() {
+        _filmGrain->Render(*_frameScene, _frameWidth, _frameHeight, _frameDt);
+    });
+    // Adapts the exposure it keeps from one frame to the next, nothing in the graph reads it
+    AddPass("Auto Exposure", [](RenderGraph::PassBuilder& builder) {
+        builder.Read("HDR");
+        builder.SideEffect();
+    }, [this]() {
+        _autoExposure->Render(*_frameScene, _frameWidth, _frameHeight, _frameDt);
+    });
+    AddPass("Tonemapping", [](RenderGraph::PassBuilder& builder) {
+        builder.Read("HDR");
+        builder.Write("LDR", RenderGraphUsage::Storage);
+    }, [this]() {
+        _tonemapping->Render(*_frameScene, _frameWidth, _frameHeight);
+    });
+
+    // Debug renderer
+    AddPass("Debug Renderer", [](RenderGraph::PassBuilder& builder) {
+        builder.Read("Velocity");
+        builder.Write("LDR", RenderGraphUsage::RenderTarget);
+    }, [this]() {
+        _debugRenderer->Flush(*_frameScene, _frameWidth, _frameHeight);
+    });
+
+    AddPass("Copy to Backbuffer", [](RenderGraph::PassBuilder& builder) {
+        builder.Read("LDR", RenderGraphUsage::CopySource);
+        builder.Write("Backbuffer", RenderGraphUsage::CopyDest);
+    }, [this]() {
         CommandBuffer::Ptr cmdBuf = _renderContext->GetCurrentCommandBuffer();
-        Texture::Ptr backbuffer = _renderContext->GetBackBuffer();
 
         OPTICK_GPU_CONTEXT(cmdBuf->GetCommandList());
         OPTICK_GPU_EVENT("Copy to Backbuffer");
 
-        _stats.PushFrameTime("Copy to Backbuffer", [this, cmdBuf, backbuffer]() {
-            cmdBuf->BeginEvent("Copy To Backbuffer");
-            cmdBuf->ImageBarrier(backbuffer, TextureLayout::CopyDest);
-            cmdBuf->ImageBarrier(_debugRenderer->GetOutput(), TextureLayout::CopySource);
-            cmdBuf->CopyTextureToTexture(backbuffer, _debugRenderer->GetOutput());
-            cmdBuf->ImageBarrier(backbuffer, TextureLayout::Present);
-            cmdBuf->ImageBarrier(_debugRenderer->GetOutput(), TextureLayout::ShaderResource);
-            cmdBuf->EndEvent();
-        });
-    }
+        cmdBuf->BeginEvent("Copy To Backbuffer");
+        cmdBuf->CopyTextureToTexture(_graphTextures[_backBufferTexture], _tonemapping->GetOutput());
+        cmdBuf->EndEvent();
+    });
+    _graph.MarkOutput("Backbuffer", RenderGraphUsage::Present);
 }
 
 // Not used
 void Renderer::Resize(uint32_t width, uint32_t height)
 {
+    _graphKey = UINT64_MAX;
+
     _shadows->Resize(width, height);
     _ssao->Resize(width, height);
     _deferred->Resize(width, height);
@@ -235,6 +442,38 @@ void Renderer::OnUI()
 
     ImGui::Separator();
 
+    if (ImGui::TreeNodeEx("Render Graph", ImGuiTreeNodeFlags_Framed)) {
+        const RenderGraphStats& stats = _graph.GetStats();
+        ImGui::Text("Compiled in %.3fms", stats.CompileTime);
+        ImGui::Text("%u passes, %u culled", stats.Passes, stats.Culled);
+        ImGui::Text("%u barriers, %u UAV barriers", stats.Barriers, stats.UAVBarriers);
+        if (_aliasingPlanKey != _graphKey) {
+            PlanAliasing();
+            _aliasingPlanKey = _graphKey;
+        }
+        ImGui::Text("Intermediates: %.2f MB, %.2f MB if aliased in %u heaps",
+                    _aliasingPlan.DedicatedSize / (1024.0f * 1024.0f),
+                    _aliasingPlan.AliasedSize / (1024.0f * 1024.0f),
+                    uint32_t(_aliasingPlan.Heaps.size()));
+
+        for (uint32_t i = 0; i < _graph.GetPassCount(); i++) {
+            if (_graph.IsCulled(i)) {
+                ImGui::TextDisabled("%s (culled)", _graph.GetPassName(i).c_str());
+                continue;
+            }
+            ImGui::Text("%s", _graph.GetPassName(i).c_str());
+            for (const RenderGraphBarrier& barrier : _graph.GetBarriers(i)) {
+                ImGui::TextDisabled("    %s: %s -> %s",
+                                    _graph.GetResourceName(barrier.Resource).c_str(),
+                                    RenderGraph::GetUsageName(barrier.Before),
+                                    barrier.UAV ? "UAV" : RenderGraph::GetUsageName(barrier.After));
+            }
+        }
+        ImGui::TreePop();
+    }
+
+    ImGui::Separator();
+
     if (ImGui::TreeNodeEx("Per-Pass Settings", ImGuiTreeNodeFlags_Framed)) {
         if (!_useRTShadows) {
             _shadows->OnUI();
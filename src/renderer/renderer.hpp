@@ -6,6 +6,8 @@
 #pragma once
 
 #include "scene.hpp"
+#include "render_graph.hpp"
+#include "aliasing_planner.hpp"
 #include "core/timer.hpp"
 
 #include "techniques/shadows.hpp"
@@ -25,6 +27,7 @@
 
 #include "techniques/debug_renderer.hpp"
 
+#include <functional>
 #include <vector>
 
 enum class GeometryPassType
@@ -36,24 +39,6 @@ enum class GeometryPassType
 class Renderer
 {
 public:
-    struct Statistics
-    {
-        Timer timer;
-        std::unordered_map<std::string, std::vector<float>> FrameTimesHistory;
-
-        void PushFrameTime(const std::string& key, const std::function<void()>& function) {
-            timer.Restart();
-            float start = timer.GetElapsed();
-            function();
-            float end = timer.GetElapsed();
-            
-            if (FrameTimesHistory[key].size() > 500) {
-                FrameTimesHistory[key].erase(FrameTimesHistory[key].begin());
-            }
-            FrameTimesHistory[key].push_back(end - start);
-        }
-    };
-
     Renderer(RenderContext::Ptr context);
     ~Renderer();
     
@@ -65,11 +50,36 @@ public:
     // Perform hot reloads
     void Reconstruct();
 
-    Statistics& GetStats() { return _stats; }
+    // Logs how much memory aliasing the frame's intermediate textures would save at 1080p, 1440p and 4K
+    void ReportAliasing();
 private:
-    Statistics _stats;
+    // Declares the passes of a frame and wires the techniques together. Only runs when something that changes the wiring
+    // changed, the compiled graph is reused otherwise.
+    void BuildGraph(uint32_t width, uint32_t height);
+    void ImportTexture(const std::string& name, Texture::Ptr texture, RenderGraphUsage initial = RenderGraphUsage::Unknown, const RenderGraphTextureDesc& desc = {});
+    // Plans the textures of the compiled graph that only live during the frame. Nothing is placed with it, so it only
+    // runs for the reports and when the render graph panel is open.
+    void PlanAliasing();
+    void AddPass(const std::string& name, std::function<void(RenderGraph::PassBuilder&)> setup, std::function<void()> execute);
+
     RenderContext::Ptr _renderContext;
 
+    RenderGraph _graph;
+    std::vector<Texture::Ptr> _graphTextures; // The graph's user data indexes in there
+    uint32_t _backBufferTexture = 0; // Changes every frame
+    uint64_t _graphKey = UINT64_MAX;
+
+    // Where the graph's intermediate textures would go if they were aliased
+    AliasingPlan _aliasingPlan;
+    std::vector<uint32_t> _aliasedResources; // Graph resource of each placement
+    uint64_t _aliasingPlanKey = UINT64_MAX; // Graph key the plan was made for
+
+    // What the passes render, set right before running the graph
+    Scene *_frameScene = nullptr;
+    uint32_t _frameWidth = 0;
+    uint32_t _frameHeight = 0;
+    float _frameDt = 0.0f;
+
     // Geometry and lighting
     std::shared_ptr<Shadows> _shadows;
     std::shared_ptr<SSAO> _ssao;
@@ -62,10 +62,7 @@ void Bloom::Downsample(Scene& scene, uint32_t width, uint32_t height)
         { _emissionBuffer, TextureLayout::CopySource }
     });
     cmdBuf->CopyTextureToTexture(_bloomFramebuffer, _emissionBuffer);
-    cmdBuf->ImageBarrierBatch({
-        { _bloomFramebuffer, TextureLayout::Storage },
-        { _emissionBuffer, TextureLayout::RenderTarget }
-    });
+    cmdBuf->ImageBarrier(_bloomFramebuffer, TextureLayout::Storage);
     cmdBuf->EndEvent();
 
     cmdBuf->BeginEvent("Bloom Downsample");
@@ -238,7 +238,6 @@ void DebugRenderer::Flush(Scene& scene, uint32_t width, uint32_t height)
         }
     }
 
-    cmdBuffer->ImageBarrier(Output, TextureLayout::ShaderResource);
     cmdBuffer->EndEvent();
 }
 
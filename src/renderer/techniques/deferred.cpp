@@ -7,13 +7,19 @@
 #include "deferred.hpp"
 
 #include "core/log.hpp"
+#include "core/shader_loader.hpp"
 
 #include <meshopt/meshoptimizer.h>
+#include <algorithm>
 #include <cstdio>
+#include <string>
 #include <ImGui/imgui_internal.h>
 
+#undef min
+#undef max
+
 Deferred::Deferred(RenderContext::Ptr context)
-    : _context(context), _gbufferPipelineMesh(PipelineType::Mesh), _lightingPipeline(PipelineType::Compute)
+    : _context(context), _gbufferPipelineMesh(PipelineType::Mesh), _lightingPipeline(PipelineType::Compute), _gbufferRecorder(context)
 {
     uint32_t width, height;
     context->GetWindow()->GetSize(width, height);
@@ -93,9 +99,11 @@ Deferred::Deferred(RenderContext::Ptr context)
             18 * sizeof(uint32_t)
         };
         _gbufferPipelineMesh.ReflectRootSignature(false);
+        _gbufferPipelineMesh.AddPermutationKey("ORCA");
+        _gbufferPipelineMesh.AddPermutationKey("DRAW_MESHLETS");
         _gbufferPipelineMesh.AddShaderWatch("shaders/Deferred/GBuffer/GBufferAmplification.hlsl", "Main", ShaderType::Amplification);
         _gbufferPipelineMesh.AddShaderWatch("shaders/Deferred/GBuffer/GBufferMesh.hlsl", "Main", ShaderType::Mesh);
-        _gbufferPipelineMesh.AddShaderWatch("shaders/Deferred/GBuffer/GBufferFrag.hlsl", "Main", ShaderType::Fragment);
+        _gbufferPipelineMesh.AddShaderWatch("shaders/Deferred/GBuffer/GBufferFrag.hlsl", "Main", ShaderType::Fragment, { "ORCA", "DRAW_MESHLETS" });
         _gbufferPipelineMesh.Build(context);
 
         _useMesh = true;
@@ -107,7 +115,9 @@ Deferred::Deferred(RenderContext::Ptr context)
             92
         };
         _lightingPipeline.ReflectRootSignature(false);
-        _lightingPipeline.AddShaderWatch("shaders/Deferred/Lighting/LightingCompute.hlsl", "Main", ShaderType::Compute);
+        _lightingPipeline.AddPermutationKey("RT_SHADOWS");
+        _lightingPipeline.AddPermutationKey("OUTPUT_MODE", 11);
+        _lightingPipeline.AddShaderWatch("shaders/Deferred/Lighting/LightingCompute.hlsl", "Main", ShaderType::Compute, { "RT_SHADOWS", "OUTPUT_MODE" });
         _lightingPipeline.Build(context);
     }
 
@@ -159,143 +169,85 @@ Deferred::~Deferred()
 
 void Deferred::GBufferPass(Scene& scene, uint32_t width, uint32_t height)
 {
-    CommandBuffer::Ptr commandBuffer = _context->GetCurrentCommandBuffer();
     uint32_t frameIndex = _context->GetBackBufferIndex();
-    
-    OPTICK_GPU_CONTEXT(commandBuffer->GetCommandList());
-    OPTICK_GPU_EVENT("Construct GBuffer");
 
     // Construct matrices
     glm::mat4 depthProjection = glm::ortho(-25.0f, 25.0f, -25.0f, 25.0f, 0.05f, 50.0f);
     glm::mat4 depthView = glm::lookAt(scene.Lights.SunTransform.Position, scene.Lights.SunTransform.Position - scene.Lights.SunTransform.GetFrontVector(), glm::vec3(0.0f, 1.0f, 0.0f));
+    glm::mat4 shadowMatrix = depthProjection * depthView;
 
     // Apply jitter
     _currJitter = _haltonSequence[_jitterCounter];
     _jitterCounter = (_jitterCounter + 1) % (_haltonSequence.size());
 
-    // Start
-    commandBuffer->BeginEvent("GBuffer");
-    commandBuffer->ImageBarrierBatch({
-        { _depthBuffer, TextureLayout::Depth },
-        { _normals, TextureLayout::RenderTarget },
-        { _albedoEmission, TextureLayout::RenderTarget },
-        { _pbrData, TextureLayout::RenderTarget },
-        { _emissive, TextureLayout::RenderTarget },
-        { _velocityBuffer, TextureLayout::RenderTarget }
-    });
-    commandBuffer->ClearDepthTarget(_depthBuffer);
-    commandBuffer->ClearRenderTarget(_normals, 0.0f, 0.0f, 0.0f, 1.0f);
-    commandBuffer->ClearRenderTarget(_albedoEmission, 0.0f, 0.0f, 0.0f, 1.0f);
-    commandBuffer->ClearRenderTarget(_pbrData, 0.0f, 0.0f, 0.0f, 1.0f);
-    commandBuffer->ClearRenderTarget(_emissive, 0.0f, 0.0f, 0.0f, 1.0f);
-    commandBuffer->ClearRenderTarget(_velocityBuffer, 0.0f, 0.0f, 0.0f, 1.0f);
-    if (_draw) { 
-        commandBuffer->SetViewport(0, 0, width, height);
-        commandBuffer->SetTopology(Topology::TriangleList);
-        commandBuffer->BindRenderTargets({ _normals, _albedoEmission, _pbrData, _emissive, _velocityBuffer }, _depthBuffer);
-        commandBuffer->BindMeshPipeline(_gbufferPipelineMesh.MeshPipeline);
-
-        for (auto model : scene.Models) {
-            _totalMeshes += model.Primitives.size();
-            for (auto primitive : model.Primitives) {
-                auto material = model.Materials[primitive.MaterialIndex];
-
-                Texture::Ptr albedo = material.HasAlbedo ? material.AlbedoTexture : _whiteTexture;
-                Texture::Ptr normal = material.HasNormal ? material.NormalTexture : _whiteTexture;
-                Texture::Ptr pbr = material.HasMetallicRoughness ? material.PBRTexture : _blackTexture;
-                Texture::Ptr emissive = material.HasEmissive ? material.EmissiveTexture : _blackTexture;
-                Texture::Ptr ao = material.HasAO ? material.AOTexture : _whiteTexture;
-
-                struct ModelUpload {
-                    glm::mat4 CameraMatrix;
-                    glm::mat4 PrevCameraMatrix;
-                    glm::mat4 Transform;
-                    glm::mat4 PrevTransform;
-
-                    glm::vec3 CameraPosition;
-                    float Scale;
-
-                    glm::vec4 Planes[6];
-                };
-                ModelUpload matrices = {
-                    scene.Camera.Projection() * scene.Camera.View(),
-                    scene.PrevViewProj,
-                    primitive.Transform.Matrix,
-                    primitive.PrevTransform.Matrix,
-                    scene.Camera.GetPosition(),
-                    (primitive.Transform.Scale.x + primitive.Transform.Scale.y + primitive.Transform.Scale.y) / 3.0f
-                };
-                if (_visualizeShadow) {
-                    matrices.CameraMatrix = depthProjection * depthView;
-                    matrices.PrevCameraMatrix = depthProjection * depthView;
-                }
-                for (int i = 0; i < 6; i++) {
-                    matrices.Planes[i] = scene.Camera.GetPlane(i);
-                }
-
-                void *pData;
-                primitive.ModelBuffer[frameIndex]->Map(0, 0, &pData);
-                memcpy(pData, &matrices, sizeof(matrices));
-                primitive.ModelBuffer[frameIndex]->Unmap(0, 0);
-
-                struct Data {
-                    uint32_t Matrices;
-                    uint32_t Vertices;
-                    uint32_t Indices;
-                    uint32_t Meshlets;
-                    uint32_t MeshletVertices;
-                    uint32_t Triangles;
-                    uint32_t MeshletBounds;
-
-                    uint32_t Albedo;
-                    uint32_t Normal;
-                    uint32_t PBR;
-                    uint32_t Emissive;
-                    uint32_t AO;
-                    uint32_t Sampler;
-                    
-                    uint32_t DrawMeshlets;
-                    float EmissiveStrenght;
-                    glm::vec2 Jitter;
-                    uint32_t Pad;
-                };
-                Data data = {
-                    primitive.ModelBuffer[frameIndex]->CBV(),
-                    primitive.VertexBuffer->SRV(),
-                    primitive.IndexBuffer->SRV(),
-                    primitive.MeshletBuffer->SRV(),
-                    primitive.MeshletVertices->SRV(),
-                    primitive.MeshletTriangles->SRV(),
-                    primitive.MeshletBounds->SRV(),
-                    
-                    albedo->SRV(),
-                    normal->SRV(),
-                    pbr->SRV(),
-                    emissive->SRV(),
-                    ao->SRV(),
-                    _sampler->BindlesssSampler(),
-
-                    _drawMeshlets,
-                    _emissiveStrength,
-                    _currJitter
-                };
-                if (!_jitter) {
-                    data.Jitter = glm::vec2(0.0f);
-                }
-
-                commandBuffer->PushConstantsGraphics(&data, sizeof(data), 0);
-                commandBuffer->DispatchMesh(primitive.MeshletCount, 1, 1);
+    uint32_t drawCount = 0;
+    if (_draw) {
+        _gbufferPipelineMesh.SetPermutation("ORCA", _orca);
+        _gbufferPipelineMesh.SetPermutation("DRAW_MESHLETS", _drawMeshlets);
+        _gbufferPipelineMesh.SelectPermutation(_context);
+
+        _gbufferDraws.clear();
+        for (uint32_t m = 0; m < scene.Models.size(); m++) {
+            for (uint32_t p = 0; p < scene.Models[m].Primitives.size(); p++) {
+                _gbufferDraws.push_back({ m, p });
             }
         }
+        drawCount = uint32_t(_gbufferDraws.size());
+        _totalMeshes += drawCount;
     }
-    commandBuffer->ImageBarrierBatch({
-        { _normals, TextureLayout::ShaderResource },
-        { _albedoEmission, TextureLayout::ShaderResource },
-        { _pbrData, TextureLayout::ShaderResource },
-        { _emissive, TextureLayout::ShaderResource },
-        { _velocityBuffer, TextureLayout::ShaderResource }
+
+    GBufferTargets targets = { _normals, _albedoEmission, _pbrData, _emissive, _velocityBuffer, _depthBuffer };
+    _gbufferRecorder.Record(targets, _gbufferPipelineMesh.MeshPipeline, drawCount, uint32_t(_maxRecordThreads), width, height, [&](uint32_t draw, GBufferDraw& out) {
+        const Model& model = scene.Models[_gbufferDraws[draw].Model];
+        const Primitive& primitive = model.Primitives[_gbufferDraws[draw].Primitive];
+        const Material& material = model.Materials[primitive.MaterialIndex];
+
+        Texture::Ptr albedo = material.HasAlbedo ? material.AlbedoTexture : _whiteTexture;
+        Texture::Ptr normal = material.HasNormal ? material.NormalTexture : _whiteTexture;
+        Texture::Ptr pbr = material.HasMetallicRoughness ? material.PBRTexture : _blackTexture;
+        Texture::Ptr emissive = material.HasEmissive ? material.EmissiveTexture : _blackTexture;
+        Texture::Ptr ao = material.HasAO ? material.AOTexture : _whiteTexture;
+
+        out.ModelBuffer = primitive.ModelBuffer[frameIndex];
+        out.MeshletCount = primitive.MeshletCount;
+
+        out.Matrices = {
+            scene.Camera.Projection() * scene.Camera.View(),
+            scene.PrevViewProj,
+            primitive.Transform.Matrix,
+            primitive.PrevTransform.Matrix,
+            scene.Camera.GetPosition(),
+            (primitive.Transform.Scale.x + primitive.Transform.Scale.y + primitive.Transform.Scale.y) / 3.0f
+        };
+        if (_visualizeShadow) {
+            out.Matrices.CameraMatrix = shadowMatrix;
+            out.Matrices.PrevCameraMatrix = shadowMatrix;
+        }
+        for (int i = 0; i < 6; i++) {
+            out.Matrices.Planes[i] = scene.Camera.GetPlane(i);
+        }
+
+        out.Constants = {
+            0,
+            primitive.VertexBuffer->SRV(),
+            primitive.IndexBuffer->SRV(),
+            primitive.MeshletBuffer->SRV(),
+            primitive.MeshletVertices->SRV(),
+            primitive.MeshletTriangles->SRV(),
+            primitive.MeshletBounds->SRV(),
+
+            albedo->SRV(),
+            normal->SRV(),
+            pbr->SRV(),
+            emissive->SRV(),
+            ao->SRV(),
+            _sampler->BindlesssSampler(),
+
+            _drawMeshlets,
+            _emissiveStrength,
+            _jitter ? _currJitter : glm::vec2(0.0f)
+        };
     });
-    commandBuffer->EndEvent();
 }
 
 void Deferred::LightingPass(Scene& scene, uint32_t width, uint32_t height, bool rtShadows)
@@ -391,6 +343,10 @@ void Deferred::LightingPass(Scene& scene, uint32_t width, uint32_t height, bool
             scene.TLAS->SRV()
         };
 
+        _lightingPipeline.SetPermutation("RT_SHADOWS", rtShadows);
+        _lightingPipeline.SetPermutation("OUTPUT_MODE", _mode);
+        _lightingPipeline.SelectPermutation(_context);
+
         commandBuffer->SetViewport(0, 0, width, height);
         commandBuffer->BindComputePipeline(_lightingPipeline.ComputePipeline);
         commandBuffer->PushConstantsCompute(&constants, sizeof(constants), 0);
@@ -442,6 +398,13 @@ void Deferred::OnUI()
             ImGui::Text("Total Meshes: %d", _totalMeshes);
             ImGui::Text("Culled Meshes: %d", _culledMeshes);
 
+            ImGui::SliderInt("Recording Threads", &_maxRecordThreads, 1, GBUFFER_MAX_RECORD_THREADS);
+            ImGui::Text("Recorded on %u threads in %.3fms", _gbufferRecorder.GetThreadCount(), _gbufferRecorder.GetRecordTime());
+            for (uint32_t i = 0; i < _gbufferRecorder.GetThreadCount(); i++) {
+                const GBufferRecorder::ThreadStats& stats = _gbufferRecorder.GetThreadStats(i);
+                ImGui::Text("    Thread %u: %u draws, %.3fms", i, stats.Draws, stats.Time);
+            }
+
             // TODO: Freeze frustum
             if (_context->GetDevice()->GetFeatures().MeshShaders) {
                 ImGui::Checkbox("Use Mesh Shaders", &_useMesh);
@@ -468,6 +431,21 @@ void Deferred::OnUI()
         
             static const char* Modes[] = { "Default", "Albedo", "Normal", "Metallic Roughness", "Baked AO", "SSAO", "Emissive", "Direct", "Indirect", "Position", "Velocity" };
             ImGui::Combo("Mode", (int*)&_mode, Modes, 11, 11);
+            ImGui::Checkbox("ORCA Textures", &_orca);
+
+            ImGui::TreePop();
+        }
+
+        if (ImGui::TreeNodeEx("Permutations", ImGuiTreeNodeFlags_Framed)) {
+            auto showStats = [](const char *name, HotReloadablePipeline& pipeline) {
+                HotReloadablePipeline::PermutationStats stats = pipeline.GetPermutationStats();
+                ImGui::Text("%s: %u/%u variants built, %.1f%% selection hit rate%s", name, stats.VariantCount, stats.PossibleCount, stats.Selections ? 100.0f * stats.Hits / stats.Selections : 0.0f, stats.Building ? ", building one" : "");
+            };
+            showStats("GBuffer", _gbufferPipelineMesh);
+            showStats("Lighting", _lightingPipeline);
+
+            ShaderPermutationStats& cacheStats = ShaderLoader::GetPermutationStats();
+            ImGui::Text("Shader cache: %u requests, %u hits, %u compiles", cacheStats.Requests.load(), cacheStats.CacheHits.load(), cacheStats.Compiles.load());
 
             ImGui::TreePop();
         }
@@ -12,6 +12,7 @@
 #include "renderer/hot_reloadable_pipeline.hpp"
 
 #include "envmap_forward.hpp"
+#include "gbuffer_recorder.hpp"
 
 class Deferred
 {
@@ -80,6 +81,7 @@ private:
     bool _draw = true;
     bool _useMesh = true;
     bool _drawMeshlets = false;
+    bool _orca = false; // Occlusion, roughness and metallic packed in one texture
 
     int _mode = 0;
     bool _visualizeShadow = false;
@@ -91,4 +93,14 @@ private:
 
     int _totalMeshes = 0;
     int _culledMeshes = 0;
+
+    struct GBufferPrimitive
+    {
+        uint32_t Model;
+        uint32_t Primitive;
+    };
+    std::vector<GBufferPrimitive> _gbufferDraws; // Every primitive of the scene, rebuilt each frame
+
+    GBufferRecorder _gbufferRecorder;
+    int _maxRecordThreads = GBUFFER_MAX_RECORD_THREADS;
 };
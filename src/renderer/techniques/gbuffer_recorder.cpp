@@ -0,0 +1,124 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-19 01:41:55
+//
+
+#include "gbuffer_recorder.hpp"
+
+#include "core/job_system.hpp"
+#include "core/profiler.hpp"
+#include "core/timer.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#if !defined(ONI_RHI_NULL)
+#include <optick.h>
+#else
+// No command lists to attach GPU events to
+#define OPTICK_GPU_CONTEXT(...)
+#define OPTICK_GPU_EVENT(...)
+#endif
+
+#undef min
+#undef max
+
+static_assert(sizeof(GBufferConstants) == 18 * sizeof(uint32_t), "GBuffer push constants don't match the root signature");
+
+GBufferRecorder::GBufferRecorder(RenderContext::Ptr context)
+    : _context(context)
+{
+}
+
+void GBufferRecorder::Record(const GBufferTargets& targets, MeshPipeline::Ptr pipeline, uint32_t drawCount, uint32_t maxThreads, uint32_t width, uint32_t height, const DescribeFunction& describe)
+{
+    CommandBuffer::Ptr commandBuffer = _context->GetCurrentCommandBuffer();
+
+    // GPU events are scoped to a single submission: the draws may go out in buffers of their own, each one with its own
+    // event.
+    commandBuffer->BeginEvent("GBuffer");
+    {
+        OPTICK_GPU_CONTEXT(commandBuffer->GetCommandList());
+        OPTICK_GPU_EVENT("Clear GBuffer");
+
+        commandBuffer->ImageBarrierBatch({
+            { targets.Depth, TextureLayout::Depth },
+            { targets.Normals, TextureLayout::RenderTarget },
+            { targets.AlbedoEmission, TextureLayout::RenderTarget },
+            { targets.PBR, TextureLayout::RenderTarget },
+            { targets.Emissive, TextureLayout::RenderTarget },
+            { targets.Velocity, TextureLayout::RenderTarget }
+        });
+        commandBuffer->ClearDepthTarget(targets.Depth);
+        commandBuffer->ClearRenderTarget(targets.Normals, 0.0f, 0.0f, 0.0f, 1.0f);
+        commandBuffer->ClearRenderTarget(targets.AlbedoEmission, 0.0f, 0.0f, 0.0f, 1.0f);
+        commandBuffer->ClearRenderTarget(targets.PBR, 0.0f, 0.0f, 0.0f, 1.0f);
+        commandBuffer->ClearRenderTarget(targets.Emissive, 0.0f, 0.0f, 0.0f, 1.0f);
+        commandBuffer->ClearRenderTarget(targets.Velocity, 0.0f, 0.0f, 0.0f, 1.0f);
+    }
+    if (drawCount) {
+        // Every thread records a contiguous range, so that submitting the buffers in order keeps the draw order
+        uint32_t threads = std::min({ maxThreads, uint32_t(GBUFFER_MAX_RECORD_THREADS), JobSystem::GetThreadCount(), std::max(drawCount / GBUFFER_MIN_DRAWS_PER_THREAD, 1u) });
+        threads = std::max(threads, 1u);
+        _threads = threads;
+
+        Timer timer;
+        if (threads == 1) {
+            RecordRange(commandBuffer, targets, pipeline, 0, 0, drawCount, width, height, describe);
+        } else {
+            // Events can't span command lists
+            commandBuffer->EndEvent();
+            std::vector<CommandBuffer::Ptr> buffers = _context->BeginParallel(threads);
+            JobSystem::ParallelFor(threads, [&](uint32_t thread) {
+                RecordRange(buffers[thread], targets, pipeline, thread, drawCount * thread / threads, drawCount * (thread + 1) / threads, width, height, describe);
+            });
+            _context->EndParallel();
+            commandBuffer->BeginEvent("GBuffer");
+        }
+        _recordTime = timer.GetElapsed();
+    }
+    {
+        OPTICK_GPU_CONTEXT(commandBuffer->GetCommandList());
+        OPTICK_GPU_EVENT("Finish GBuffer");
+
+        // Normals, emissive and velocity are left to the render graph, their readers don't all want them as shader resources
+        commandBuffer->ImageBarrierBatch({
+            { targets.AlbedoEmission, TextureLayout::ShaderResource },
+            { targets.PBR, TextureLayout::ShaderResource }
+        });
+    }
+    commandBuffer->EndEvent();
+}
+
+void GBufferRecorder::RecordRange(CommandBuffer::Ptr commandBuffer, const GBufferTargets& targets, MeshPipeline::Ptr pipeline, uint32_t thread, uint32_t first, uint32_t last, uint32_t width, uint32_t height, const DescribeFunction& describe)
+{
+    PROFILE_SCOPE("Record GBuffer");
+    OPTICK_GPU_CONTEXT(commandBuffer->GetCommandList());
+    OPTICK_GPU_EVENT("Construct GBuffer");
+    Timer timer;
+
+    commandBuffer->BeginEvent("GBuffer Draws " + std::to_string(thread));
+    commandBuffer->SetViewport(0, 0, width, height);
+    commandBuffer->SetTopology(Topology::TriangleList);
+    commandBuffer->BindRenderTargets({ targets.Normals, targets.AlbedoEmission, targets.PBR, targets.Emissive, targets.Velocity }, targets.Depth);
+    commandBuffer->BindMeshPipeline(pipeline);
+
+    GBufferDraw draw = {};
+    for (uint32_t i = first; i < last; i++) {
+        describe(i, draw);
+
+        void *pData;
+        draw.ModelBuffer->Map(0, 0, &pData);
+        memcpy(pData, &draw.Matrices, sizeof(draw.Matrices));
+        draw.ModelBuffer->Unmap(0, 0);
+        draw.Constants.Matrices = draw.ModelBuffer->CBV();
+
+        commandBuffer->PushConstantsGraphics(&draw.Constants, sizeof(draw.Constants), 0);
+        commandBuffer->DispatchMesh(draw.MeshletCount, 1, 1);
+    }
+    commandBuffer->EndEvent();
+
+    _threadStats[thread] = { last - first, timer.GetElapsed() };
+}
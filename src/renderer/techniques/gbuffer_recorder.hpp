@@ -0,0 +1,109 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-19 01:34:17
+//
+
+#pragma once
+
+#include "rhi/render_context.hpp"
+
+#include <glm/glm.hpp>
+
+#include <array>
+#include <functional>
+
+// Threads recording the GBuffer at most, and the draws it takes to give one more thread something to do
+#define GBUFFER_MAX_RECORD_THREADS 8
+#define GBUFFER_MIN_DRAWS_PER_THREAD 16
+
+struct GBufferTargets
+{
+    Texture::Ptr Normals;
+    Texture::Ptr AlbedoEmission;
+    Texture::Ptr PBR;
+    Texture::Ptr Emissive;
+    Texture::Ptr Velocity;
+    Texture::Ptr Depth;
+};
+
+// Written to the draw's model buffer
+struct GBufferMatrices
+{
+    glm::mat4 CameraMatrix;
+    glm::mat4 PrevCameraMatrix;
+    glm::mat4 Transform;
+    glm::mat4 PrevTransform;
+
+    glm::vec3 CameraPosition;
+    float Scale;
+
+    glm::vec4 Planes[6];
+};
+
+// Push constants of the GBuffer mesh pipeline
+struct GBufferConstants
+{
+    uint32_t Matrices;
+    uint32_t Vertices;
+    uint32_t Indices;
+    uint32_t Meshlets;
+    uint32_t MeshletVertices;
+    uint32_t Triangles;
+    uint32_t MeshletBounds;
+
+    uint32_t Albedo;
+    uint32_t Normal;
+    uint32_t PBR;
+    uint32_t Emissive;
+    uint32_t AO;
+    uint32_t Sampler;
+
+    uint32_t DrawMeshlets;
+    float EmissiveStrenght;
+    glm::vec2 Jitter;
+    uint32_t Pad;
+};
+
+struct GBufferDraw
+{
+    Buffer::Ptr ModelBuffer; // This frame's. Constants.Matrices is filled in from it.
+    GBufferMatrices Matrices;
+    GBufferConstants Constants;
+    uint32_t MeshletCount;
+};
+
+// Records the GBuffer pass of Deferred: clears the targets, records the draws over as many threads as there are enough
+// of them for, and leaves albedo and PBR as shader resources. Only uses what RenderContext and CommandBuffer have in
+// common with the null backend, so the same recording runs in oni_tests.
+class GBufferRecorder
+{
+public:
+    // Fills a draw in, called from the recording threads
+    using DescribeFunction = std::function<void(uint32_t draw, GBufferDraw& out)>;
+
+    struct ThreadStats
+    {
+        uint32_t Draws;
+        float Time; // Milliseconds
+    };
+
+    GBufferRecorder(RenderContext::Ptr context);
+
+    // Without draws, only clears and transitions the targets
+    void Record(const GBufferTargets& targets, MeshPipeline::Ptr pipeline, uint32_t drawCount, uint32_t maxThreads, uint32_t width, uint32_t height, const DescribeFunction& describe);
+
+    // Of the last Record with draws
+    uint32_t GetThreadCount() { return _threads; }
+    float GetRecordTime() { return _recordTime; }
+    const ThreadStats& GetThreadStats(uint32_t thread) { return _threadStats[thread]; }
+private:
+    // Records the draws in [first, last) on the given command buffer, from any thread
+    void RecordRange(CommandBuffer::Ptr commandBuffer, const GBufferTargets& targets, MeshPipeline::Ptr pipeline, uint32_t thread, uint32_t first, uint32_t last, uint32_t width, uint32_t height, const DescribeFunction& describe);
+
+    RenderContext::Ptr _context;
+
+    std::array<ThreadStats, GBUFFER_MAX_RECORD_THREADS> _threadStats = {};
+    uint32_t _threads = 0;
+    float _recordTime = 0.0f; // Whole recording, waiting on the threads included
+};
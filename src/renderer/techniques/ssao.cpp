@@ -172,10 +172,8 @@ void SSAO::SSAOPass(Scene& scene, uint32_t width, uint32_t height)
         commandBuffer->PushConstantsCompute(&data, sizeof(data), 0);
         commandBuffer->Dispatch(std::ceil(width / 8), std::ceil(height / 8), 1);
     }
-    commandBuffer->ImageBarrierBatch({
-        { _ssao, TextureLayout::Storage },
-        { _depth, TextureLayout::Depth }
-    });
+    // The render graph moves the depth buffer to whatever the next pass needs
+    commandBuffer->ImageBarrier(_ssao, TextureLayout::Storage);
     commandBuffer->EndEvent();
 }
 
@@ -15,6 +15,7 @@
 void GPUResource::ClearFromAllocationList()
 {
     if (ParentAllocator) {
+        std::lock_guard<std::mutex> lock(ParentAllocator->_allocationsLock);
         ParentAllocator->_allocations.erase(std::find(ParentAllocator->_allocations.begin(), ParentAllocator->_allocations.end(), this));
     }
 }
@@ -59,7 +60,10 @@ GPUResource *Allocator::Allocate(D3D12MA::ALLOCATION_DESC *allocDesc, D3D12_RESO
     if (FAILED(result)) {
         Logger::Error("[D3D12] Failed to allocate resource!");
     }
-    _allocations.push_back(resource);
+    {
+        std::lock_guard<std::mutex> lock(_allocationsLock);
+        _allocations.push_back(resource);
+    }
 
     std::wstring resourceName = std::wstring(name.begin(), name.end());
     resource->Resource->SetName(resourceName.c_str());
@@ -69,6 +73,8 @@ GPUResource *Allocator::Allocate(D3D12MA::ALLOCATION_DESC *allocDesc, D3D12_RESO
 
 void Allocator::OnGUI()
 {
+    std::lock_guard<std::mutex> lock(_allocationsLock);
+
     ImGui::Begin("Resource Inspector");
 
     // Left
@@ -9,6 +9,7 @@
 
 #include "D3D12MA/D3D12MemAlloc.h"
 
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -62,6 +63,9 @@ private:
     friend struct GPUResource;
 
     D3D12MA::Allocator* _allocator;
+
+    // Staging buffers are allocated from the texture streamer's worker threads
+    std::mutex _allocationsLock;
     std::vector<GPUResource*> _allocations;
     GPUResource* _uiSelected;
 };
@@ -11,16 +11,6 @@
 
 typedef TextureLayout BufferLayout;
 
-enum class BufferType
-{
-    Vertex,
-    Index,
-    Constant,
-    Storage,
-    Copy,
-    AccelerationStructure
-};
-
 class Buffer
 {
 public:
@@ -13,14 +13,31 @@
 #include <ImGui/imgui_impl_dx12.h>
 
 #include <sstream>
+#include <cstring>
 #include <ctime>
 #include <algorithm>
 #include <vector>
+#include <atomic>
 
 #include <pix3.h>
 
+#undef min
 #undef max
 
+static_assert(uint32_t(TextureLayout::RenderTarget) == uint32_t(StreamState::RenderTarget), "Stream states have to match D3D12's");
+static_assert(uint32_t(TextureLayout::Storage) == uint32_t(StreamState::UnorderedAccess), "Stream states have to match D3D12's");
+static_assert(uint32_t(TextureLayout::Depth) == uint32_t(StreamState::DepthWrite), "Stream states have to match D3D12's");
+static_assert(uint32_t(TextureLayout::ShaderResource) == uint32_t(StreamState::ShaderResource), "Stream states have to match D3D12's");
+static_assert(uint32_t(TextureLayout::CopyDest) == uint32_t(StreamState::CopyDest), "Stream states have to match D3D12's");
+static_assert(uint32_t(TextureLayout::CopySource) == uint32_t(StreamState::CopySource), "Stream states have to match D3D12's");
+static_assert(uint32_t(TextureLayout::DataRead) == uint32_t(StreamState::GenericRead), "Stream states have to match D3D12's");
+static_assert(D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES == STREAM_SUBRESOURCE_ALL, "Barrier queues use the stream's subresources");
+
+static uint32_t ToStreamSubresource(int subresource)
+{
+    return subresource == SUBRESOURCE_ALL ? STREAM_SUBRESOURCE_ALL : uint32_t(subresource);
+}
+
 bool IsHDR(TextureFormat format)
 {
     if (format == TextureFormat::RGBA32Float)
@@ -29,7 +46,8 @@ bool IsHDR(TextureFormat format)
 }
 
 CommandBuffer::CommandBuffer(Device::Ptr devicePtr, Allocator::Ptr allocator, DescriptorHeap::Heaps& heaps, CommandQueueType type, bool close)
-    : _type(D3D12_COMMAND_LIST_TYPE(type)), _heaps(heaps), _device(devicePtr), _allocator(allocator)
+    : _type(D3D12_COMMAND_LIST_TYPE(type)), _heaps(heaps), _device(devicePtr), _allocator(allocator),
+      _barrierQueue(_stats, [this](const PendingBarrier *barriers, uint32_t count) { EmitBarriers(barriers, count); })
 {
     HRESULT result = devicePtr->GetDevice()->CreateCommandAllocator(_type, IID_PPV_ARGS(&_commandAllocator));
     if (FAILED(result)) {
@@ -55,130 +73,275 @@ CommandBuffer::~CommandBuffer()
     _commandAllocator->Release();
 }
 
+void CommandBuffer::SetRecording(CommandRecording recording)
+{
+    _recording = recording;
+    if (recording == CommandRecording::Off) {
+        _stream.reset();
+    } else if (!_stream) {
+        _stream = std::make_unique<CommandStream>();
+    }
+}
+
+uint64_t CommandBuffer::Track(GPUResource *resource)
+{
+    _stream->NameResource(uint64_t(resource), resource->Name);
+    return uint64_t(resource);
+}
+
+void CommandBuffer::SetPipelineState(ID3D12PipelineState *pipeline)
+{
+    if (Filter(StateCommand::Pipeline, _bound.Pipeline == pipeline)) {
+        return;
+    }
+    _commandList->SetPipelineState(pipeline);
+    _bound.Pipeline = pipeline;
+}
+
+void CommandBuffer::SetGraphicsRootSignature(ID3D12RootSignature *signature)
+{
+    if (Filter(StateCommand::RootSignature, _bound.GraphicsSignature == signature)) {
+        return;
+    }
+    _commandList->SetGraphicsRootSignature(signature);
+    _bound.GraphicsSignature = signature;
+}
+
+void CommandBuffer::SetComputeRootSignature(ID3D12RootSignature *signature)
+{
+    if (Filter(StateCommand::RootSignature, _bound.ComputeSignature == signature)) {
+        return;
+    }
+    _commandList->SetComputeRootSignature(signature);
+    _bound.ComputeSignature = signature;
+}
+
+void CommandBuffer::InvalidateState()
+{
+    _bound = {};
+}
+
+void CommandBuffer::Validate()
+{
+    static std::atomic<uint32_t> logged = 0;
+
+    std::vector<StreamError> errors = _stream->Validate();
+    for (auto& error : errors) {
+        uint32_t index = logged++;
+        if (index < COMMAND_VALIDATION_MAX_LOGGED) {
+            Logger::Error("[RHI] Command %u: %s", error.Command, error.Message.c_str());
+        } else if (index == COMMAND_VALIDATION_MAX_LOGGED) {
+            Logger::Warn("[RHI] Too many command validation errors, not logging any more of them");
+        }
+    }
+}
+
 void CommandBuffer::Begin(bool reset)
 {
     if (reset) {
         _commandAllocator->Reset();
         _commandList->Reset(_commandAllocator, nullptr);
     }
+    if (_stream) {
+        _stream->Reset();
+    }
+    _barrierQueue.Clear();
+    // Command lists start without any state, whether they were reset or are still open from their creation
+    InvalidateState();
+    if (!Forward()) {
+        return;
+    }
 
     if (_type == D3D12_COMMAND_LIST_TYPE_DIRECT || _type == D3D12_COMMAND_LIST_TYPE_COMPUTE) {
         ID3D12DescriptorHeap* heaps[] = {
             _heaps.ShaderHeap->GetHeap(),
             _heaps.SamplerHeap->GetHeap()
         };
+        Filter(StateCommand::DescriptorHeaps, false);
         _commandList->SetDescriptorHeaps(2, heaps);
+        _bound.Heaps[0] = heaps[0];
+        _bound.Heaps[1] = heaps[1];
     }
 }
 
 void CommandBuffer::End()
 {
+    if (Forward()) {
+        FlushBarriers();
+    }
     _commandList->Close();
+    if (_stream && _recording != CommandRecording::Record) {
+        Validate();
+    }
+
+    CommandStats::Add(_stats);
+    _stats = {};
+}
+
+void CommandBuffer::Continue()
+{
+    _commandList->Reset(_commandAllocator, nullptr);
+    Begin(false);
 }
 
 void CommandBuffer::ClearState()
 {
+    if (!Forward()) {
+        return;
+    }
     _commandList->ClearState(nullptr);
+    InvalidateState();
 }
 
 void CommandBuffer::BeginEvent(const std::string& name, int r, int g, int b)
 {
+    if (_stream) {
+        _stream->Push(StreamCommand::BeginEvent, StreamEvent{ _stream->InternString(name) });
+    }
+    if (!Forward()) {
+        return;
+    }
     PIXBeginEvent(_commandList, PIX_COLOR(r, g, b), name.c_str());
 }
 
 void CommandBuffer::InsertMarker(const std::string& name, int r, int g, int b)
 {
+    if (_stream) {
+        _stream->Push(StreamCommand::Marker, StreamEvent{ _stream->InternString(name) });
+    }
+    if (!Forward()) {
+        return;
+    }
     PIXSetMarker(_commandList, PIX_COLOR(r, g, b), name.c_str());
 }
 
 void CommandBuffer::EndEvent()
 {
+    if (_stream) {
+        _stream->Push(StreamCommand::EndEvent);
+    }
+    if (!Forward()) {
+        return;
+    }
     PIXEndEvent(_commandList);
 }
 
 void CommandBuffer::ImageBarrier(Texture::Ptr texture, TextureLayout newLayout, int subresource)
 {
     TextureLayout oldLayout = TextureLayout(texture->GetState(subresource));
+    _stats.BarriersRequested++;
 
     if (oldLayout == TextureLayout::Storage && newLayout == TextureLayout::Storage) {
-        D3D12_RESOURCE_BARRIER barrier = {};
-        barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
-        barrier.UAV.pResource = texture->GetResource().Resource;
-
-        _commandList->ResourceBarrier(1, &barrier);
-        texture->SetState(D3D12_RESOURCE_STATES(newLayout), subresource);
-    } else {
-        D3D12_RESOURCE_BARRIER barrier = {};
-        barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-        barrier.Transition.StateBefore = D3D12_RESOURCE_STATES(oldLayout);
-        barrier.Transition.StateAfter = D3D12_RESOURCE_STATES(newLayout);
-        barrier.Transition.pResource = texture->_resource->Resource;
-        if (subresource == SUBRESOURCE_ALL) {
-            barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-        } else {
-            barrier.Transition.Subresource = subresource;
+        if (_stream) {
+            _stream->Push(StreamCommand::UAVBarrier, StreamBarrier{ Track(texture->_resource), ToStreamSubresource(subresource), uint32_t(newLayout), uint32_t(newLayout), 0 });
+        }
+        if (Forward()) {
+            _barrierQueue.UAV(texture->_resource);
         }
+        return;
+    }
+    if (oldLayout == newLayout) {
+        return;
+    }
 
-        if (barrier.Transition.StateBefore == barrier.Transition.StateAfter)
-            return;
-    
-        _commandList->ResourceBarrier(1, &barrier);
-        texture->SetState(D3D12_RESOURCE_STATES(newLayout), subresource);
+    if (_stream) {
+        _stream->Push(StreamCommand::Barrier, StreamBarrier{ Track(texture->_resource), ToStreamSubresource(subresource), uint32_t(oldLayout), uint32_t(newLayout), 0 });
     }
+    if (Forward()) {
+        _barrierQueue.Transition(texture->_resource, ToStreamSubresource(subresource), uint32_t(oldLayout), uint32_t(newLayout));
+    }
+    texture->SetState(D3D12_RESOURCE_STATES(newLayout), subresource);
 }
 
-void CommandBuffer::ImageBarrierBatch(const std::vector<Barrier>& barrier)
+void CommandBuffer::ImageBarrierBatch(std::initializer_list<Barrier> barriers)
 {
-    std::vector<D3D12_RESOURCE_BARRIER> barrierList;
-    for (int i = 0; i < barrier.size(); i++) {
-        D3D12_RESOURCE_BARRIER pushBarrier = {};
-        TextureLayout oldLayout = TextureLayout(barrier[i].Texture->GetState(barrier[i].Subresource));
-
-        if (barrier[i].NewLayout == TextureLayout::Storage && oldLayout == TextureLayout::Storage) {
-            pushBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
-            pushBarrier.UAV.pResource = barrier[i].Texture->GetResource().Resource;
-
-            barrier[i].Texture->SetState(D3D12_RESOURCE_STATES(barrier[i].NewLayout), barrier[i].Subresource);
-            barrierList.push_back(pushBarrier);
-        } else {
-            pushBarrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-            pushBarrier.Transition.pResource = barrier[i].Texture->GetResource().Resource;
-            pushBarrier.Transition.StateBefore = barrier[i].Texture->GetState(barrier[i].Subresource);
-            pushBarrier.Transition.StateAfter = D3D12_RESOURCE_STATES(barrier[i].NewLayout);
-            pushBarrier.Transition.Subresource = barrier[i].Subresource;
-
-            if (pushBarrier.Transition.StateBefore == pushBarrier.Transition.StateAfter)
-                continue;
+    // The barriers are queued like any other, the batch only tells captures they were asked for together
+    uint32_t batched = 0;
+    for (const Barrier& barrier : barriers) {
+        TextureLayout oldLayout = TextureLayout(barrier.Texture->GetState(barrier.Subresource));
+        _stats.BarriersRequested++;
+
+        if (barrier.NewLayout == TextureLayout::Storage && oldLayout == TextureLayout::Storage) {
+            if (_stream) {
+                _stream->Push(StreamCommand::UAVBarrier, StreamBarrier{
+                    Track(barrier.Texture->_resource),
+                    ToStreamSubresource(barrier.Subresource),
+                    uint32_t(barrier.NewLayout),
+                    uint32_t(barrier.NewLayout),
+                    batched++ > 0
+                });
+            }
+            if (Forward()) {
+                _barrierQueue.UAV(barrier.Texture->_resource);
+            }
+            continue;
+        }
+        if (oldLayout == barrier.NewLayout) {
+            continue;
+        }
 
-            barrier[i].Texture->SetState(D3D12_RESOURCE_STATES(barrier[i].NewLayout), barrier[i].Subresource);
-            barrierList.push_back(pushBarrier);
+        if (_stream) {
+            _stream->Push(StreamCommand::Barrier, StreamBarrier{
+                Track(barrier.Texture->_resource),
+                ToStreamSubresource(barrier.Subresource),
+                uint32_t(oldLayout),
+                uint32_t(barrier.NewLayout),
+                batched++ > 0
+            });
         }
+        if (Forward()) {
+            _barrierQueue.Transition(barrier.Texture->_resource, ToStreamSubresource(barrier.Subresource), uint32_t(oldLayout), uint32_t(barrier.NewLayout));
+        }
+        barrier.Texture->SetState(D3D12_RESOURCE_STATES(barrier.NewLayout), barrier.Subresource);
     }
-    if (barrierList.size() == 0) {
-        return;
-    }
-    _commandList->ResourceBarrier(barrierList.size(), barrierList.data());
 }
 
 void CommandBuffer::CubeMapBarrier(CubeMap::Ptr cubemap, TextureLayout newLayout)
 {
-    D3D12_RESOURCE_BARRIER barrier = {};
-    barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-    barrier.Transition.pResource = cubemap->GetResource().Resource;
-    barrier.Transition.StateBefore = cubemap->GetState();
-    barrier.Transition.StateAfter = D3D12_RESOURCE_STATES(newLayout);
-    barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-
-    if (barrier.Transition.StateBefore == barrier.Transition.StateAfter)
+    D3D12_RESOURCE_STATES oldState = cubemap->GetState();
+    _stats.BarriersRequested++;
+    if (oldState == D3D12_RESOURCE_STATES(newLayout)) {
         return;
+    }
 
-    _commandList->ResourceBarrier(1, &barrier);
-
+    if (_stream) {
+        _stream->Push(StreamCommand::Barrier, StreamBarrier{ Track(cubemap->_resource), STREAM_SUBRESOURCE_ALL, uint32_t(oldState), uint32_t(newLayout), 0 });
+    }
+    if (Forward()) {
+        _barrierQueue.Transition(cubemap->_resource, STREAM_SUBRESOURCE_ALL, uint32_t(oldState), uint32_t(newLayout));
+    }
     cubemap->SetState(D3D12_RESOURCE_STATES(newLayout));
 }
 
+void CommandBuffer::EmitBarriers(const PendingBarrier *barriers, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        GPUResource *resource = static_cast<GPUResource*>(barriers[i].Resource);
+        D3D12_RESOURCE_BARRIER& barrier = _barriers[i];
+        barrier = {};
+        if (barriers[i].UAV) {
+            barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+            barrier.UAV.pResource = resource->Resource;
+        } else {
+            barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+            barrier.Transition.pResource = resource->Resource;
+            barrier.Transition.Subresource = barriers[i].Subresource;
+            barrier.Transition.StateBefore = D3D12_RESOURCE_STATES(barriers[i].Before);
+            barrier.Transition.StateAfter = D3D12_RESOURCE_STATES(barriers[i].After);
+        }
+    }
+    _commandList->ResourceBarrier(count, _barriers.data());
+}
+
 void CommandBuffer::SetViewport(float x, float y, float width, float height)
 {
+    if (_stream) {
+        _stream->Push(StreamCommand::SetViewport, StreamViewport{ x, y, width, height });
+    }
+    if (!Forward()) {
+        return;
+    }
+
     D3D12_VIEWPORT Viewport = {};
     Viewport.Width = width;
     Viewport.Height = height;
@@ -187,6 +350,13 @@ void CommandBuffer::SetViewport(float x, float y, float width, float height)
     Viewport.TopLeftX = x;
     Viewport.TopLeftY = y;
 
+    // The scissor only depends on the viewport
+    if (Filter(StateCommand::Viewport, _bound.ViewportSet && !memcmp(&_bound.Viewport, &Viewport, sizeof(Viewport)))) {
+        return;
+    }
+    _bound.Viewport = Viewport;
+    _bound.ViewportSet = true;
+
     D3D12_RECT Rect;
     Rect.right = width;
     Rect.bottom = height;
@@ -199,169 +369,399 @@ void CommandBuffer::SetViewport(float x, float y, float width, float height)
 
 void CommandBuffer::SetTopology(Topology topology)
 {
+    if (_stream) {
+        _stream->Push(StreamCommand::SetTopology, StreamTopology{ uint32_t(topology) });
+    }
+    if (!Forward()) {
+        return;
+    }
+    if (Filter(StateCommand::Topology, _bound.Topology == D3D12_PRIMITIVE_TOPOLOGY(topology))) {
+        return;
+    }
     _commandList->IASetPrimitiveTopology(D3D12_PRIMITIVE_TOPOLOGY(topology));
+    _bound.Topology = D3D12_PRIMITIVE_TOPOLOGY(topology);
 }
 
 void CommandBuffer::BindRenderTargets(const std::vector<Texture::Ptr>& renderTargets, Texture::Ptr depthTarget)
 {
-    std::vector<D3D12_CPU_DESCRIPTOR_HANDLE> rtvDescriptors;
-    D3D12_CPU_DESCRIPTOR_HANDLE dsvDescriptor;
+    if (_stream) {
+        StreamRenderTargets targets = {};
+        targets.Count = std::min(uint32_t(renderTargets.size()), uint32_t(STREAM_MAX_RENDER_TARGETS));
+        for (uint32_t i = 0; i < targets.Count; i++) {
+            targets.Targets[i] = Track(renderTargets[i]->_resource);
+        }
+        targets.Depth = depthTarget ? Track(depthTarget->_resource) : 0;
+        _stream->Push(StreamCommand::BindRenderTargets, targets);
+    }
+    if (!Forward()) {
+        return;
+    }
+
+    std::array<D3D12_CPU_DESCRIPTOR_HANDLE, D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT> rtvDescriptors;
+    D3D12_CPU_DESCRIPTOR_HANDLE dsvDescriptor = {};
 
-    for (auto& renderTarget : renderTargets) {
-        rtvDescriptors.push_back(renderTarget->_rtv.CPU);
+    uint32_t count = std::min(uint32_t(renderTargets.size()), uint32_t(D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT));
+    bool redundant = _bound.RenderTargetCount == count;
+    for (uint32_t i = 0; i < count; i++) {
+        rtvDescriptors[i] = renderTargets[i]->_rtv.CPU;
+        redundant = redundant && _bound.RenderTargets[i] == rtvDescriptors[i].ptr;
     }
     if (depthTarget) {
         dsvDescriptor = depthTarget->_dsv.CPU;
     }
+    if (Filter(StateCommand::RenderTargets, redundant && _bound.DepthTarget == dsvDescriptor.ptr)) {
+        return;
+    }
 
-    _commandList->OMSetRenderTargets(rtvDescriptors.size(), rtvDescriptors.data(), false, depthTarget ? &dsvDescriptor : nullptr);
+    _commandList->OMSetRenderTargets(count, rtvDescriptors.data(), false, depthTarget ? &dsvDescriptor : nullptr);
+    for (uint32_t i = 0; i < count; i++) {
+        _bound.RenderTargets[i] = rtvDescriptors[i].ptr;
+    }
+    _bound.RenderTargetCount = count;
+    _bound.DepthTarget = dsvDescriptor.ptr;
 }
 
 void CommandBuffer::ClearRenderTarget(Texture::Ptr renderTarget, float r, float g, float b, float a)
 {
+    if (_stream) {
+        _stream->Push(StreamCommand::ClearRenderTarget, StreamClear{ Track(renderTarget->_resource), STREAM_SUBRESOURCE_ALL, { r, g, b, a } });
+    }
+    if (!Forward()) {
+        return;
+    }
+    FlushBarriers();
+
     float clearValues[4] = { r, g, b, a };
     _commandList->ClearRenderTargetView(renderTarget->_rtv.CPU, clearValues, 0, nullptr);
 }
 
 void CommandBuffer::ClearDepthTarget(Texture::Ptr depthTarget)
 {
+    if (_stream) {
+        _stream->Push(StreamCommand::ClearDepth, StreamClear{ Track(depthTarget->_resource), STREAM_SUBRESOURCE_ALL, { 1.0f, 0.0f, 0.0f, 0.0f } });
+    }
+    if (!Forward()) {
+        return;
+    }
+    FlushBarriers();
     _commandList->ClearDepthStencilView(depthTarget->_dsv.CPU, D3D12_CLEAR_FLAG_DEPTH, 1.0f, 0, 0, nullptr);
 }
 
 void CommandBuffer::ClearUAV(Texture::Ptr texture, float r, float g, float b, float a, int subresource)
 {
+    if (_stream) {
+        _stream->Push(StreamCommand::ClearUAV, StreamClear{ Track(texture->_resource), uint32_t(subresource), { r, g, b, a } });
+    }
+    if (!Forward()) {
+        return;
+    }
+    FlushBarriers();
+
     float clearValues[4] = { r, g, b, a };
     _commandList->ClearUnorderedAccessViewFloat(texture->_uavs[subresource].GPU, texture->_uavs[subresource].CPU, texture->_resource->Resource, clearValues, 0, nullptr);
 }
 
 void CommandBuffer::BindVertexBuffer(Buffer::Ptr buffer)
 {
+    if (_stream) {
+        _stream->Push(StreamCommand::BindVertexBuffer, StreamResource{ Track(buffer->_resource) });
+    }
+    if (!Forward()) {
+        return;
+    }
+    if (Filter(StateCommand::VertexBuffer, !memcmp(&_bound.VertexBuffer, &buffer->_VBV, sizeof(D3D12_VERTEX_BUFFER_VIEW)))) {
+        return;
+    }
     _commandList->IASetVertexBuffers(0, 1, &buffer->_VBV);
+    _bound.VertexBuffer = buffer->_VBV;
 }
 
 void CommandBuffer::BindIndexBuffer(Buffer::Ptr buffer)
 {
+    if (_stream) {
+        _stream->Push(StreamCommand::BindIndexBuffer, StreamResource{ Track(buffer->_resource) });
+    }
+    if (!Forward()) {
+        return;
+    }
+    if (Filter(StateCommand::IndexBuffer, !memcmp(&_bound.IndexBuffer, &buffer->_IBV, sizeof(D3D12_INDEX_BUFFER_VIEW)))) {
+        return;
+    }
     _commandList->IASetIndexBuffer(&buffer->_IBV);
+    _bound.IndexBuffer = buffer->_IBV;
 }
 
 void CommandBuffer::BindMeshPipeline(MeshPipeline::Ptr pipeline)
 {
-    _commandList->SetPipelineState(pipeline->GetPipeline());
-    _commandList->SetGraphicsRootSignature(pipeline->GetSignature()->GetSignature());
+    if (_stream) {
+        _stream->Push(StreamCommand::BindPipeline, StreamBindPipeline{ uint64_t(pipeline.get()), uint64_t(pipeline->GetSignature().get()), StreamPipeline::Mesh });
+    }
+    if (!Forward()) {
+        return;
+    }
+    SetPipelineState(pipeline->GetPipeline());
+    SetGraphicsRootSignature(pipeline->GetSignature()->GetSignature());
 }
 
 void CommandBuffer::BindRaytracingPipeline(RaytracingPipeline::Ptr pipeline)
 {
     _currentlyBoundRT = pipeline;
+    if (_stream) {
+        _stream->Push(StreamCommand::BindPipeline, StreamBindPipeline{ uint64_t(pipeline.get()), uint64_t(pipeline->GetSignature().get()), StreamPipeline::Raytracing });
+    }
+    if (!Forward()) {
+        return;
+    }
 
-    _commandList->SetPipelineState1(pipeline->GetPipeline());
-    _commandList->SetComputeRootSignature(pipeline->GetSignature()->GetSignature());
+    if (!Filter(StateCommand::Pipeline, _bound.Pipeline == pipeline->GetPipeline())) {
+        _commandList->SetPipelineState1(pipeline->GetPipeline());
+        _bound.Pipeline = pipeline->GetPipeline();
+    }
+    SetComputeRootSignature(pipeline->GetSignature()->GetSignature());
 }
 
 void CommandBuffer::BindGraphicsPipeline(GraphicsPipeline::Ptr pipeline)
 {
-    _commandList->SetPipelineState(pipeline->GetPipeline());
-    _commandList->SetGraphicsRootSignature(pipeline->GetSignature()->GetSignature());
+    if (_stream) {
+        _stream->Push(StreamCommand::BindPipeline, StreamBindPipeline{ uint64_t(pipeline.get()), uint64_t(pipeline->GetSignature().get()), StreamPipeline::Graphics });
+    }
+    if (!Forward()) {
+        return;
+    }
+    SetPipelineState(pipeline->GetPipeline());
+    SetGraphicsRootSignature(pipeline->GetSignature()->GetSignature());
 }
 
 void CommandBuffer::BindGraphicsConstantBuffer(Buffer::Ptr buffer, int index)
 {
+    if (_stream) {
+        _stream->Push(StreamCommand::BindTable, StreamBindTable{ Track(buffer->_resource), uint32_t(index), 0, StreamBindPoint::Graphics, StreamView::ConstantBuffer });
+    }
+    if (!Forward()) {
+        return;
+    }
     _commandList->SetGraphicsRootDescriptorTable(index, buffer->_cbv.GPU);
 }
 
 void CommandBuffer::BindGraphicsShaderResource(Texture::Ptr texture, int index)
 {
+    if (_stream) {
+        _stream->Push(StreamCommand::BindTable, StreamBindTable{ Track(texture->_resource), uint32_t(index), 0, StreamBindPoint::Graphics, StreamView::ShaderResource });
+    }
+    if (!Forward()) {
+        return;
+    }
     _commandList->SetGraphicsRootDescriptorTable(index, texture->_srvs[0].GPU);
 }
 
 void CommandBuffer::BindGraphicsSampler(Sampler::Ptr sampler, int index)
 {
+    if (_stream) {
+        _stream->Push(StreamCommand::BindTable, StreamBindTable{ uint64_t(sampler.get()), uint32_t(index), 0, StreamBindPoint::Graphics, StreamView::Sampler });
+    }
+    if (!Forward()) {
+        return;
+    }
     _commandList->SetGraphicsRootDescriptorTable(index, sampler->GetDescriptor().GPU);
 }
 
 void CommandBuffer::BindGraphicsCubeMap(CubeMap::Ptr cubemap, int index)
 {
+    if (_stream) {
+        _stream->Push(StreamCommand::BindTable, StreamBindTable{ Track(cubemap->_resource), uint32_t(index), 0, StreamBindPoint::Graphics, StreamView::ShaderResource });
+    }
+    if (!Forward()) {
+        return;
+    }
     _commandList->SetGraphicsRootDescriptorTable(index, cubemap->_srv.GPU);
 }
 
 void CommandBuffer::BindComputePipeline(ComputePipeline::Ptr pipeline)
 {
-    _commandList->SetPipelineState(pipeline->GetPipeline());
-    _commandList->SetComputeRootSignature(pipeline->GetSignature()->GetSignature());
+    if (_stream) {
+        _stream->Push(StreamCommand::BindPipeline, StreamBindPipeline{ uint64_t(pipeline.get()), uint64_t(pipeline->GetSignature().get()), StreamPipeline::Compute });
+    }
+    if (!Forward()) {
+        return;
+    }
+    SetPipelineState(pipeline->GetPipeline());
+    SetComputeRootSignature(pipeline->GetSignature()->GetSignature());
 }
 
 void CommandBuffer::BindComputeShaderResource(Texture::Ptr texture, int index, int mip)
 {
+    if (_stream) {
+        _stream->Push(StreamCommand::BindTable, StreamBindTable{ Track(texture->_resource), uint32_t(index), uint32_t(mip), StreamBindPoint::Compute, StreamView::ShaderResource });
+    }
+    if (!Forward()) {
+        return;
+    }
     _commandList->SetComputeRootDescriptorTable(index, texture->_srvs[mip].GPU);
 }
 
 void CommandBuffer::BindComputeStorageTexture(Texture::Ptr texture, int index, int mip)
 {
+    if (_stream) {
+        _stream->Push(StreamCommand::BindTable, StreamBindTable{ Track(texture->_resource), uint32_t(index), uint32_t(mip), StreamBindPoint::Compute, StreamView::Storage });
+    }
+    if (!Forward()) {
+        return;
+    }
     _commandList->SetComputeRootDescriptorTable(index, texture->_uavs[mip].GPU);
 }
 
 void CommandBuffer::BindComputeCubeMapShaderResource(CubeMap::Ptr texture, int index)
 {
+    if (_stream) {
+        _stream->Push(StreamCommand::BindTable, StreamBindTable{ Track(texture->_resource), uint32_t(index), 0, StreamBindPoint::Compute, StreamView::ShaderResource });
+    }
+    if (!Forward()) {
+        return;
+    }
     _commandList->SetComputeRootDescriptorTable(index, texture->_srv.GPU);
 }
 
 void CommandBuffer::BindComputeCubeMapStorage(CubeMap::Ptr texture, int index, int mip)
 {
+    if (_stream) {
+        _stream->Push(StreamCommand::BindTable, StreamBindTable{ Track(texture->_resource), uint32_t(index), uint32_t(mip), StreamBindPoint::Compute, StreamView::Storage });
+    }
+    if (!Forward()) {
+        return;
+    }
     _commandList->SetComputeRootDescriptorTable(index, texture->_uavs[mip].GPU);
 }
 
 void CommandBuffer::BindComputeAccelerationStructure(TLAS::Ptr tlas, int index)
 {
+    if (_stream) {
+        _stream->Push(StreamCommand::BindTable, StreamBindTable{ uint64_t(tlas.get()), uint32_t(index), 0, StreamBindPoint::Compute, StreamView::AccelerationStructure });
+    }
+    if (!Forward()) {
+        return;
+    }
     _commandList->SetComputeRootDescriptorTable(index, tlas->_srv.GPU);
 }
 
 void CommandBuffer::BindComputeConstantBuffer(Buffer::Ptr buffer, int index)
 {
+    if (_stream) {
+        _stream->Push(StreamCommand::BindTable, StreamBindTable{ Track(buffer->_resource), uint32_t(index), 0, StreamBindPoint::Compute, StreamView::ConstantBuffer });
+    }
+    if (!Forward()) {
+        return;
+    }
     _commandList->SetComputeRootDescriptorTable(index, buffer->_cbv.GPU);
 }
 
 void CommandBuffer::BindComputeStorageBuffer(Buffer::Ptr buffer, int index)
 {
+    if (_stream) {
+        _stream->Push(StreamCommand::BindTable, StreamBindTable{ Track(buffer->_resource), uint32_t(index), 0, StreamBindPoint::Compute, StreamView::Storage });
+    }
+    if (!Forward()) {
+        return;
+    }
     _commandList->SetComputeRootDescriptorTable(index, buffer->_uav.GPU);
 }
 
 void CommandBuffer::BindComputeSampler(Sampler::Ptr sampler, int index)
 {
+    if (_stream) {
+        _stream->Push(StreamCommand::BindTable, StreamBindTable{ uint64_t(sampler.get()), uint32_t(index), 0, StreamBindPoint::Compute, StreamView::Sampler });
+    }
+    if (!Forward()) {
+        return;
+    }
     _commandList->SetComputeRootDescriptorTable(index, sampler->GetDescriptor().GPU);
 }
 
 void CommandBuffer::PushConstantsGraphics(const void *data, uint32_t size, int index)
 {
+    if (_stream) {
+        _stream->Push(StreamCommand::PushConstants, StreamPushConstants{ uint32_t(index), size, StreamBindPoint::Graphics }, data, size);
+    }
+    if (!Forward()) {
+        return;
+    }
+
     _commandList->SetGraphicsRoot32BitConstants(index, size / 4, data, 0);
 }
 
 void CommandBuffer::PushConstantsCompute(const void *data, uint32_t size, int index)
 {
+    if (_stream) {
+        _stream->Push(StreamCommand::PushConstants, StreamPushConstants{ uint32_t(index), size, StreamBindPoint::Compute }, data, size);
+    }
+    if (!Forward()) {
+        return;
+    }
+
     _commandList->SetComputeRoot32BitConstants(index, size / 4, data, 0);
 }
 
 void CommandBuffer::Draw(int vertexCount)
 {
+    if (_stream) {
+        _stream->Push(StreamCommand::Draw, StreamDraw{ uint32_t(vertexCount) });
+    }
+    if (!Forward()) {
+        return;
+    }
+    FlushBarriers();
+
     _commandList->DrawInstanced(vertexCount, 1, 0, 0);
 }
 
 void CommandBuffer::DrawIndexed(int indexCount)
 {
+    if (_stream) {
+        _stream->Push(StreamCommand::DrawIndexed, StreamDraw{ uint32_t(indexCount) });
+    }
+    if (!Forward()) {
+        return;
+    }
+    FlushBarriers();
+
     _commandList->DrawIndexedInstanced(indexCount, 1, 0, 0, 0);
 }
 
 void CommandBuffer::Dispatch(int x, int y, int z)
 {
+    if (_stream) {
+        _stream->Push(StreamCommand::Dispatch, StreamDispatch{ uint32_t(x), uint32_t(y), uint32_t(z) });
+    }
+    if (!Forward()) {
+        return;
+    }
+    FlushBarriers();
+
     _commandList->Dispatch(x, y, z);
 }
 
 void CommandBuffer::DispatchMesh(int x, int y, int z)
 {
+    if (_stream) {
+        _stream->Push(StreamCommand::DispatchMesh, StreamDispatch{ uint32_t(x), uint32_t(y), uint32_t(z) });
+    }
+    if (!Forward()) {
+        return;
+    }
+    FlushBarriers();
+
     _commandList->DispatchMesh(x, y, z);
 }
 
 void CommandBuffer::TraceRays(int width, int height)
 {
+    if (_stream) {
+        _stream->Push(StreamCommand::TraceRays, StreamDispatch{ uint32_t(width), uint32_t(height), 1 });
+    }
+    if (!Forward()) {
+        return;
+    }
+    FlushBarriers();
+
     if (_currentlyBoundRT == nullptr) {
         Logger::Error("Please bind a raytracing pipeline before calling TraceRays");
     }
@@ -383,6 +783,14 @@ void CommandBuffer::TraceRays(int width, int height)
 
 void CommandBuffer::CopyTextureToTexture(Texture::Ptr dst, Texture::Ptr src)
 {
+    if (_stream) {
+        _stream->Push(StreamCommand::Copy, StreamCopy{ Track(dst->_resource), Track(src->_resource), 0, 0, 1 });
+    }
+    if (!Forward()) {
+        return;
+    }
+    FlushBarriers();
+
     D3D12_TEXTURE_COPY_LOCATION BlitSource = {};
     BlitSource.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
     BlitSource.pResource = src->GetResource().Resource;
@@ -398,11 +806,27 @@ void CommandBuffer::CopyTextureToTexture(Texture::Ptr dst, Texture::Ptr src)
 
 void CommandBuffer::CopyBufferToBuffer(Buffer::Ptr dst, Buffer::Ptr src)
 {
+    if (_stream) {
+        _stream->Push(StreamCommand::Copy, StreamCopy{ Track(dst->_resource), Track(src->_resource), 0, 0, 1 });
+    }
+    if (!Forward()) {
+        return;
+    }
+    FlushBarriers();
+
     _commandList->CopyResource(dst->_resource->Resource, src->_resource->Resource);
 }
 
 void CommandBuffer::CopyBufferToTexture(Texture::Ptr dst, Buffer::Ptr src)
 {
+    if (_stream) {
+        _stream->Push(StreamCommand::Copy, StreamCopy{ Track(dst->_resource), Track(src->_resource), 0, 0, 1 });
+    }
+    if (!Forward()) {
+        return;
+    }
+    FlushBarriers();
+
     D3D12_TEXTURE_COPY_LOCATION CopySource = {};
     CopySource.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
     CopySource.pResource = src->_resource->Resource;
@@ -430,6 +854,14 @@ void CommandBuffer::CopyBufferToTexture(Texture::Ptr dst, Buffer::Ptr src)
 
 void CommandBuffer::CopyBufferToTextureLOD(Texture::Ptr dst, Buffer::Ptr src, int mip)
 {
+    if (_stream) {
+        _stream->Push(StreamCommand::Copy, StreamCopy{ Track(dst->_resource), Track(src->_resource), uint32_t(mip), 0, 1 });
+    }
+    if (!Forward()) {
+        return;
+    }
+    FlushBarriers();
+
     int width = mip > 0 ? dst->GetSizeOfMip(mip) : dst->_width;
     int height = mip > 0 ? dst->GetSizeOfMip(mip) : dst->_height;
 
@@ -458,20 +890,26 @@ void CommandBuffer::CopyBufferToTextureLOD(Texture::Ptr dst, Buffer::Ptr src, in
     _commandList->CopyTextureRegion(&CopyDest, 0, 0, 0, &CopySource, nullptr);
 }
 
-void CommandBuffer::CopyTextureFileToTexture(Texture::Ptr dst, Buffer::Ptr srcTexels, TextureFile *file)
+void CommandBuffer::CopyTextureFileToTexture(Texture::Ptr dst, Buffer::Ptr srcTexels, uint32_t firstMip, uint32_t mipCount)
 {
-    uint32_t numMips = file->MipCount();
-    
+    if (_stream) {
+        _stream->Push(StreamCommand::Copy, StreamCopy{ Track(dst->_resource), Track(srcTexels->_resource), firstMip, 0, mipCount });
+    }
+    if (!Forward()) {
+        return;
+    }
+    FlushBarriers();
+
     D3D12_RESOURCE_DESC desc = dst->GetResource().Resource->GetDesc();
 
-    std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> footprints(numMips);
-    std::vector<uint32_t> numRows(numMips);
-    std::vector<uint64_t> rowSizes(numMips);
+    std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> footprints(mipCount);
+    std::vector<uint32_t> numRows(mipCount);
+    std::vector<uint64_t> rowSizes(mipCount);
     uint64_t totalSize = 0;
 
-    _device->GetDevice()->GetCopyableFootprints(&desc, 0, numMips, 0, footprints.data(), numRows.data(), rowSizes.data(), &totalSize);
+    _device->GetDevice()->GetCopyableFootprints(&desc, firstMip, mipCount, 0, footprints.data(), numRows.data(), rowSizes.data(), &totalSize);
 
-    for (uint32_t i = 0; i < numMips; i++) {
+    for (uint32_t i = 0; i < mipCount; i++) {
         D3D12_TEXTURE_COPY_LOCATION srcCopy = {};
         srcCopy.pResource = srcTexels->_resource->Resource;
         srcCopy.Type = D3D12_TEXTURE_COPY_TYPE_PLACED_FOOTPRINT;
@@ -480,7 +918,32 @@ void CommandBuffer::CopyTextureFileToTexture(Texture::Ptr dst, Buffer::Ptr srcTe
         D3D12_TEXTURE_COPY_LOCATION dstCopy = {};
         dstCopy.pResource = dst->_resource->Resource;
         dstCopy.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
-        dstCopy.SubresourceIndex = i;
+        dstCopy.SubresourceIndex = firstMip + i;
+
+        _commandList->CopyTextureRegion(&dstCopy, 0, 0, 0, &srcCopy, nullptr);
+    }
+}
+
+void CommandBuffer::CopyTextureMips(GPUResource *dst, uint32_t dstFirstMip, GPUResource *src, uint32_t srcFirstMip, uint32_t mipCount)
+{
+    if (_stream) {
+        _stream->Push(StreamCommand::Copy, StreamCopy{ Track(dst), Track(src), dstFirstMip, srcFirstMip, mipCount });
+    }
+    if (!Forward()) {
+        return;
+    }
+    FlushBarriers();
+
+    for (uint32_t i = 0; i < mipCount; i++) {
+        D3D12_TEXTURE_COPY_LOCATION srcCopy = {};
+        srcCopy.pResource = src->Resource;
+        srcCopy.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+        srcCopy.SubresourceIndex = srcFirstMip + i;
+
+        D3D12_TEXTURE_COPY_LOCATION dstCopy = {};
+        dstCopy.pResource = dst->Resource;
+        dstCopy.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
+        dstCopy.SubresourceIndex = dstFirstMip + i;
 
         _commandList->CopyTextureRegion(&dstCopy, 0, 0, 0, &srcCopy, nullptr);
     }
@@ -488,6 +951,14 @@ void CommandBuffer::CopyTextureFileToTexture(Texture::Ptr dst, Buffer::Ptr srcTe
 
 void CommandBuffer::CopyTextureToBuffer(Buffer::Ptr dst, Texture::Ptr src)
 {
+    if (_stream) {
+        _stream->Push(StreamCommand::Copy, StreamCopy{ Track(dst->_resource), Track(src->_resource), 0, 0, 1 });
+    }
+    if (!Forward()) {
+        return;
+    }
+    FlushBarriers();
+
     D3D12_TEXTURE_COPY_LOCATION CopySource = {};
     CopySource.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
     CopySource.pResource = src->_resource->Resource;
@@ -509,6 +980,14 @@ void CommandBuffer::CopyTextureToBuffer(Buffer::Ptr dst, Texture::Ptr src)
 
 void CommandBuffer::BuildAccelerationStructure(AccelerationStructure structure, const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS& inputs)
 {
+    if (_stream) {
+        _stream->Push(StreamCommand::BuildAccelerationStructure, StreamResource{ Track(structure.AS) });
+    }
+    if (!Forward()) {
+        return;
+    }
+    FlushBarriers();
+
     D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_DESC buildDesc = {};
     buildDesc.Inputs = inputs;
     buildDesc.DestAccelerationStructureData = structure.AS->Resource->GetGPUVirtualAddress();
@@ -532,11 +1011,31 @@ void CommandBuffer::EndImGui()
 {
     ImGuiIO& io = ImGui::GetIO();
 
+    if (_stream) {
+        _stream->Push(StreamCommand::RenderImGui);
+    }
+    if (!Forward()) {
+        // Still ends the ImGui frame
+        ImGui::Render();
+        return;
+    }
+
     ID3D12DescriptorHeap* pHeaps[] = { _heaps.ShaderHeap->GetHeap(), _heaps.SamplerHeap->GetHeap() };
-    _commandList->SetDescriptorHeaps(2, pHeaps);
+    if (!Filter(StateCommand::DescriptorHeaps, _bound.Heaps[0] == pHeaps[0] && _bound.Heaps[1] == pHeaps[1])) {
+        _commandList->SetDescriptorHeaps(2, pHeaps);
+        _bound.Heaps[0] = pHeaps[0];
+        _bound.Heaps[1] = pHeaps[1];
+    }
 
+    FlushBarriers();
     ImGui::Render();
     ImGui_ImplDX12_RenderDrawData(ImGui::GetDrawData(), _commandList);
+
+    // The backend sets its own pipeline, root signature, viewport, topology and buffers, but leaves the heaps
+    ID3D12DescriptorHeap *heaps[2] = { _bound.Heaps[0], _bound.Heaps[1] };
+    InvalidateState();
+    _bound.Heaps[0] = heaps[0];
+    _bound.Heaps[1] = heaps[1];
 }
 
 void CommandBuffer::CleanupImGui()
@@ -545,7 +1044,46 @@ void CommandBuffer::CleanupImGui()
 
     if (io.ConfigFlags & ImGuiConfigFlags_ViewportsEnable)
     {
+        if (Forward()) {
+            FlushBarriers();
+        }
         ImGui::UpdatePlatformWindows();
         ImGui::RenderPlatformWindowsDefault(nullptr, (void*)_commandList);
     }
 }
+
+void CommandBuffer::OnGUI()
+{
+    CommandBufferStats stats = GetStats();
+
+    ImGui::Begin("Command Buffers");
+    ImGui::Text("Barriers: %u requested, %u emitted in %u calls", stats.BarriersRequested, stats.BarriersEmitted, stats.BarrierCalls);
+    if (ImGui::BeginTable("State Commands", 3, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg)) {
+        ImGui::TableSetupColumn("State");
+        ImGui::TableSetupColumn("Issued");
+        ImGui::TableSetupColumn("Filtered");
+        ImGui::TableHeadersRow();
+
+        uint32_t issued = 0, filtered = 0;
+        for (size_t i = 0; i < size_t(StateCommand::Count); i++) {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::Text("%s", CommandStats::GetStateCommandName(StateCommand(i)));
+            ImGui::TableNextColumn();
+            ImGui::Text("%u", stats.Issued[i]);
+            ImGui::TableNextColumn();
+            ImGui::Text("%u", stats.Filtered[i]);
+            issued += stats.Issued[i];
+            filtered += stats.Filtered[i];
+        }
+        ImGui::TableNextRow();
+        ImGui::TableNextColumn();
+        ImGui::Text("Total");
+        ImGui::TableNextColumn();
+        ImGui::Text("%u", issued);
+        ImGui::TableNextColumn();
+        ImGui::Text("%u (%.1f%%)", filtered, issued + filtered ? filtered * 100.0f / (issued + filtered) : 0.0f);
+        ImGui::EndTable();
+    }
+    ImGui::End();
+}
@@ -5,10 +5,11 @@
 
 #pragma once
 
+#include <array>
+#include <atomic>
+#include <initializer_list>
 #include <vector>
 
-#include "core/texture_file.hpp"
-
 #include "device.hpp"
 #include "buffer.hpp"
 #include "texture.hpp"
@@ -18,22 +19,30 @@
 #include "graphics_pipeline.hpp"
 #include "compute_pipeline.hpp"
 #include "mesh_pipeline.hpp"
+#include "command_stream.hpp"
+#include "command_state.hpp"
 
 #include "raytracing/acceleration_structure.hpp"
 #include "raytracing/raytracing_pipeline.hpp"
 #include "raytracing/tlas.hpp"
 
-#define SUBRESOURCE_ALL 999
-
 enum class CommandQueueType;
 
-enum class Topology
+static_assert(int(Topology::LineList) == D3D_PRIMITIVE_TOPOLOGY_LINELIST, "Topology doesn't match D3D12");
+static_assert(int(Topology::LineStrip) == D3D_PRIMITIVE_TOPOLOGY_LINESTRIP, "Topology doesn't match D3D12");
+static_assert(int(Topology::PointList) == D3D_PRIMITIVE_TOPOLOGY_POINTLIST, "Topology doesn't match D3D12");
+static_assert(int(Topology::TriangleList) == D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST, "Topology doesn't match D3D12");
+static_assert(int(Topology::TriangleStrip) == D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP, "Topology doesn't match D3D12");
+
+enum class CommandRecording
 {
-    LineList = D3D_PRIMITIVE_TOPOLOGY_LINELIST,
-    LineStrip = D3D_PRIMITIVE_TOPOLOGY_LINESTRIP,
-    PointList = D3D_PRIMITIVE_TOPOLOGY_POINTLIST,
-    TriangleList = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST,
-    TriangleStrip = D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP
+    Off,
+    // Records a CommandStream next to the command list, for captures
+    Record,
+    // Same, and validates the stream when the buffer ends
+    Validate,
+    // Same, but nothing reaches the command list. Runs the CPU side of a frame without any GPU work.
+    RecordOnly
 };
 
 struct Barrier
@@ -53,6 +62,9 @@ public:
 
     void Begin(bool reset = true);
     void End();
+    // Records after commands that were already submitted this frame: resets the list but keeps the allocator, which the
+    // GPU may still be reading from
+    void Continue();
 
     void ClearState();
 
@@ -60,8 +72,9 @@ public:
     void InsertMarker(const std::string& name, int r = 255, int g = 255, int b = 255);
     void EndEvent();
 
+    // Barriers are queued in a BarrierQueue and go out together right before the next draw, dispatch, copy or clear
     void ImageBarrier(Texture::Ptr texture, TextureLayout newLayout, int subresource = SUBRESOURCE_ALL);
-    void ImageBarrierBatch(const std::vector<Barrier>& barrier);
+    void ImageBarrierBatch(std::initializer_list<Barrier> barriers);
     
     void CubeMapBarrier(CubeMap::Ptr cubemap, TextureLayout newLayout);
 
@@ -111,7 +124,8 @@ public:
     void CopyTextureToBuffer(Buffer::Ptr dst, Texture::Ptr src);
 
     void CopyBufferToTextureLOD(Texture::Ptr dst, Buffer::Ptr src, int mip);
-    void CopyTextureFileToTexture(Texture::Ptr dst, Buffer::Ptr srcTexels, TextureFile *file);
+    void CopyTextureFileToTexture(Texture::Ptr dst, Buffer::Ptr srcTexels, uint32_t firstMip, uint32_t mipCount);
+    void CopyTextureMips(GPUResource *dst, uint32_t dstFirstMip, GPUResource *src, uint32_t srcFirstMip, uint32_t mipCount);
 
     // RT
     void BuildAccelerationStructure(AccelerationStructure structure, const D3D12_BUILD_RAYTRACING_ACCELERATION_STRUCTURE_INPUTS& inputs);
@@ -122,7 +136,33 @@ public:
     void CleanupImGui();
 
     ID3D12GraphicsCommandList* GetCommandList() { return _commandList; }
+
+    void SetRecording(CommandRecording recording);
+    CommandRecording GetRecording() { return _recording; }
+    // nullptr when not recording. Holds the commands since the last Begin.
+    CommandStream *GetStream() { return _stream.get(); }
+
+    // Forget the shadowed state, for anything that changes it on the command list directly
+    void InvalidateState();
+
+    // State calls and barriers of every command buffer ended during the last frame
+    static CommandBufferStats GetStats() { return CommandStats::GetLastFrame(); }
+    static void EndFrame() { CommandStats::EndFrame(); }
+    static void OnGUI();
 private:
+    bool Forward() { return _recording != CommandRecording::RecordOnly; }
+    uint64_t Track(GPUResource *resource);
+    void Validate();
+
+    // Counts the call, returns true if it has to be dropped
+    bool Filter(StateCommand command, bool redundant) { return _stats.Filter(command, redundant); }
+    void SetPipelineState(ID3D12PipelineState *pipeline);
+    void SetGraphicsRootSignature(ID3D12RootSignature *signature);
+    void SetComputeRootSignature(ID3D12RootSignature *signature);
+
+    void EmitBarriers(const PendingBarrier *barriers, uint32_t count);
+    void FlushBarriers() { _barrierQueue.Flush(); }
+
     Allocator::Ptr _allocator;
     Device::Ptr _device;
     DescriptorHeap::Heaps _heaps;
@@ -131,4 +171,31 @@ private:
     ID3D12CommandAllocator* _commandAllocator;
 
     RaytracingPipeline::Ptr _currentlyBoundRT = nullptr;
+
+    // What the command list has bound, as of the last call that reached it
+    struct BoundState
+    {
+        void *Pipeline = nullptr; // ID3D12PipelineState or ID3D12StateObject, setting one unsets the other
+        ID3D12RootSignature *GraphicsSignature = nullptr;
+        ID3D12RootSignature *ComputeSignature = nullptr;
+        D3D12_PRIMITIVE_TOPOLOGY Topology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+        D3D12_VIEWPORT Viewport = {};
+        bool ViewportSet = false;
+        std::array<SIZE_T, D3D12_SIMULTANEOUS_RENDER_TARGET_COUNT> RenderTargets = {};
+        uint32_t RenderTargetCount = UINT32_MAX; // Nothing bound yet
+        SIZE_T DepthTarget = 0;
+        D3D12_VERTEX_BUFFER_VIEW VertexBuffer = {};
+        D3D12_INDEX_BUFFER_VIEW IndexBuffer = {};
+        ID3D12DescriptorHeap *Heaps[2] = { nullptr, nullptr };
+    };
+    BoundState _bound;
+
+    CommandBufferStats _stats; // Since the last End
+
+    // Resources are GPUResources
+    BarrierQueue _barrierQueue;
+    std::array<D3D12_RESOURCE_BARRIER, COMMAND_MAX_PENDING_BARRIERS> _barriers;
+
+    CommandRecording _recording = CommandRecording::Off;
+    std::unique_ptr<CommandStream> _stream;
 };
@@ -0,0 +1,269 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 11:32:17
+//
+
+#include "command_capture.hpp"
+
+#include <core/log.hpp>
+#include <core/timer.hpp>
+
+#include <cstring>
+
+std::string CaptureData::GetName(uint64_t resource) const
+{
+    auto it = Names.find(resource);
+    if (it != Names.end() && !it->second.empty()) {
+        return it->second;
+    }
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "0x%llx", (unsigned long long)resource);
+    return buffer;
+}
+
+CommandCapture::CommandCapture(const std::string& path, uint32_t maxFrames, uint64_t maxBytes)
+    : _path(path), _maxFrames(maxFrames), _maxBytes(maxBytes)
+{
+    _file.open(path, std::ios::binary | std::ios::trunc);
+    if (!_file.is_open()) {
+        Logger::Error("[CAPTURE] Failed to open %s for writing", path.c_str());
+        return;
+    }
+
+    CaptureHeader header = {};
+    header.Magic = CAPTURE_MAGIC;
+    header.Version = CAPTURE_VERSION;
+    _file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    _size = sizeof(header);
+
+    Logger::Info("[CAPTURE] Capturing %u frames of commands to %s", maxFrames, path.c_str());
+}
+
+CommandCapture::~CommandCapture()
+{
+    Close();
+}
+
+void CommandCapture::WriteChunk(CaptureChunk type, const void *data, uint64_t size)
+{
+    CaptureChunkHeader header = {};
+    header.Type = type;
+    header.Size = size;
+    _file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    _file.write(reinterpret_cast<const char*>(data), size);
+    _size += sizeof(header) + size;
+}
+
+void CommandCapture::AddStream(const CommandStream& stream)
+{
+    if (!_file.is_open()) {
+        return;
+    }
+    Timer timer;
+    uint64_t id = stream.GetId();
+
+    // Strings the stream interned since it was last captured
+    const std::vector<std::string>& strings = stream.GetStrings();
+    uint32_t& written = _stringsWritten[id];
+    if (written < strings.size()) {
+        uint32_t count = uint32_t(strings.size()) - written;
+        _scratch.resize(sizeof(uint64_t) + 2 * sizeof(uint32_t));
+        memcpy(_scratch.data(), &id, sizeof(uint64_t));
+        memcpy(_scratch.data() + sizeof(uint64_t), &written, sizeof(uint32_t));
+        memcpy(_scratch.data() + sizeof(uint64_t) + sizeof(uint32_t), &count, sizeof(uint32_t));
+        for (uint32_t i = written; i < strings.size(); i++) {
+            uint32_t length = uint32_t(strings[i].size());
+            size_t offset = _scratch.size();
+            _scratch.resize(offset + sizeof(uint32_t) + length);
+            memcpy(_scratch.data() + offset, &length, sizeof(uint32_t));
+            memcpy(_scratch.data() + offset + sizeof(uint32_t), strings[i].data(), length);
+        }
+        WriteChunk(CaptureChunk::Strings, _scratch.data(), _scratch.size());
+        written = uint32_t(strings.size());
+    }
+
+    // Names only ever get added to a stream, so one that didn't grow has nothing new
+    uint32_t& names = _namesSeen[id];
+    if (names != stream.GetResourceNames().size()) {
+        names = uint32_t(stream.GetResourceNames().size());
+        for (auto& [resource, name] : stream.GetResourceNames()) {
+            if (!_named.insert(resource).second) {
+                continue;
+            }
+            uint32_t length = uint32_t(name.size());
+            _scratch.resize(sizeof(uint64_t) + sizeof(uint32_t) + length);
+            memcpy(_scratch.data(), &resource, sizeof(uint64_t));
+            memcpy(_scratch.data() + sizeof(uint64_t), &length, sizeof(uint32_t));
+            memcpy(_scratch.data() + sizeof(uint64_t) + sizeof(uint32_t), name.data(), length);
+            WriteChunk(CaptureChunk::Name, _scratch.data(), _scratch.size());
+        }
+    }
+
+    // The id goes in front of the commands, written in place rather than copied into the scratch buffer
+    const std::vector<uint8_t>& data = stream.GetData();
+    CaptureChunkHeader header = {};
+    header.Type = CaptureChunk::Commands;
+    header.Size = sizeof(uint64_t) + data.size();
+    _file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    _file.write(reinterpret_cast<const char*>(&id), sizeof(uint64_t));
+    _file.write(reinterpret_cast<const char*>(data.data()), data.size());
+    _size += sizeof(header) + header.Size;
+
+    _writeTime += timer.GetElapsed();
+}
+
+bool CommandCapture::EndFrame()
+{
+    if (!_file.is_open()) {
+        return false;
+    }
+    Timer timer;
+
+    uint64_t index = _frameCount++;
+    WriteChunk(CaptureChunk::EndFrame, &index, sizeof(index));
+
+    _writeTime += timer.GetElapsed();
+    if (_size >= _maxBytes) {
+        Logger::Warn("[CAPTURE] Stopping after %u frames, the capture is over %.2f MB", _frameCount, _maxBytes / (1024.0f * 1024.0f));
+        return false;
+    }
+    return _frameCount < _maxFrames;
+}
+
+void CommandCapture::Close()
+{
+    if (!_file.is_open()) {
+        return;
+    }
+    _file.close();
+    Logger::Info("[CAPTURE] Wrote %u frames (%.2f MB) to %s, %.3fms per frame spent capturing",
+                 _frameCount,
+                 _size / (1024.0f * 1024.0f),
+                 _path.c_str(),
+                 _frameCount ? _writeTime / _frameCount : 0.0f);
+}
+
+bool CommandCapture::Load(const std::string& path, CaptureData& capture)
+{
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open()) {
+        Logger::Error("[CAPTURE] Failed to open %s", path.c_str());
+        return false;
+    }
+
+    CaptureHeader header = {};
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.Magic != CAPTURE_MAGIC || header.Version != CAPTURE_VERSION) {
+        Logger::Error("[CAPTURE] %s is not a capture (or was made by another version)", path.c_str());
+        return false;
+    }
+
+    file.seekg(0, std::ios::end);
+    uint64_t fileSize = uint64_t(file.tellg());
+    file.seekg(sizeof(header), std::ios::beg);
+
+    std::unordered_map<uint64_t, std::vector<std::string>> strings;
+    CapturedFrame frame = {};
+    std::vector<uint8_t> payload;
+
+    // Every size comes from the file, none of them is trusted
+    uint64_t position = sizeof(header);
+    auto fail = [&](const std::string& message) {
+        Logger::Error("[CAPTURE] %s is corrupt, chunk at byte %llu: %s", path.c_str(), (unsigned long long)position, message.c_str());
+        capture = {};
+        return false;
+    };
+
+    CaptureChunkHeader chunk = {};
+    while (position < fileSize) {
+        if (fileSize - position < sizeof(chunk) || !file.read(reinterpret_cast<char*>(&chunk), sizeof(chunk))) {
+            return fail("chunk header cut off");
+        }
+        if (chunk.Size > fileSize - position - sizeof(chunk)) {
+            return fail("payload of " + std::to_string(chunk.Size) + " bytes runs past the end of the file");
+        }
+        payload.resize(chunk.Size);
+        if (!file.read(reinterpret_cast<char*>(payload.data()), chunk.Size)) {
+            return fail("failed to read the payload");
+        }
+
+        const uint8_t *data = payload.data();
+        switch (chunk.Type) {
+            case CaptureChunk::Strings: {
+                if (chunk.Size < 16) {
+                    return fail("strings chunk is too small");
+                }
+                uint64_t id;
+                uint32_t first, count;
+                memcpy(&id, data, sizeof(id));
+                memcpy(&first, data + 8, sizeof(first));
+                memcpy(&count, data + 12, sizeof(count));
+
+                std::vector<std::string>& table = strings[id];
+                if (first > table.size()) {
+                    return fail("strings start at " + std::to_string(first) + " but the stream only has " + std::to_string(table.size()));
+                }
+                table.resize(first);
+                uint64_t offset = 16;
+                for (uint32_t i = 0; i < count; i++) {
+                    uint32_t length;
+                    if (chunk.Size - offset < 4) {
+                        return fail("string " + std::to_string(i) + " is cut off");
+                    }
+                    memcpy(&length, data + offset, sizeof(length));
+                    if (length > chunk.Size - offset - 4) {
+                        return fail("string " + std::to_string(i) + " runs past the chunk");
+                    }
+                    table.emplace_back(reinterpret_cast<const char*>(data + offset + 4), length);
+                    offset += 4 + length;
+                }
+                break;
+            }
+            case CaptureChunk::Name: {
+                if (chunk.Size < 12) {
+                    return fail("name chunk is too small");
+                }
+                uint64_t resource;
+                uint32_t length;
+                memcpy(&resource, data, sizeof(resource));
+                memcpy(&length, data + 8, sizeof(length));
+                if (length > chunk.Size - 12) {
+                    return fail("name runs past the chunk");
+                }
+                capture.Names[resource] = std::string(reinterpret_cast<const char*>(data + 12), length);
+                break;
+            }
+            case CaptureChunk::Commands: {
+                if (chunk.Size < sizeof(uint64_t)) {
+                    return fail("commands chunk is too small");
+                }
+                CapturedStream stream;
+                memcpy(&stream.Id, data, sizeof(uint64_t));
+                for (auto& string : strings[stream.Id]) {
+                    stream.Commands.InternString(string);
+                }
+                std::string error;
+                if (!stream.Commands.Assign(data + sizeof(uint64_t), chunk.Size - sizeof(uint64_t), &error)) {
+                    return fail(error);
+                }
+                frame.Streams.push_back(std::move(stream));
+                break;
+            }
+            case CaptureChunk::EndFrame: {
+                if (chunk.Size < sizeof(frame.Index)) {
+                    return fail("end of frame chunk is too small");
+                }
+                memcpy(&frame.Index, data, sizeof(frame.Index));
+                capture.Frames.push_back(std::move(frame));
+                frame = {};
+                break;
+            }
+            default:
+                break;
+        }
+        position += sizeof(chunk) + chunk.Size;
+    }
+
+    Logger::Info("[CAPTURE] Loaded %u frames from %s", uint32_t(capture.Frames.size()), path.c_str());
+    return true;
+}
@@ -0,0 +1,104 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 11:05:52
+//
+
+#pragma once
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "command_stream.hpp"
+
+#define CAPTURE_MAGIC 0x5041434F // 'OCAP'
+#define CAPTURE_VERSION 1
+// A capture stops on its own past this size
+#define CAPTURE_MAX_BYTES (512ull * 1024 * 1024)
+
+enum class CaptureChunk : uint32_t
+{
+    Strings, // Stream id, first index, count, then each string as a length and its characters
+    Name, // Resource id, length, characters
+    Commands, // Stream id, then the stream's commands as recorded
+    EndFrame // Frame index
+};
+
+struct CaptureHeader
+{
+    uint32_t Magic;
+    uint32_t Version;
+};
+
+struct CaptureChunkHeader
+{
+    CaptureChunk Type;
+    uint32_t Pad;
+    uint64_t Size; // Payload bytes
+};
+
+struct CapturedStream
+{
+    uint64_t Id; // CommandStream::GetId when it was recorded
+    CommandStream Commands;
+};
+
+struct CapturedFrame
+{
+    uint64_t Index;
+    std::vector<CapturedStream> Streams; // In submission order
+};
+
+struct CaptureData
+{
+    std::vector<CapturedFrame> Frames;
+    std::unordered_map<uint64_t, std::string> Names;
+
+    std::string GetName(uint64_t resource) const;
+};
+
+// Writes the command streams submitted over a number of frames to a compact binary file. Event strings and resource
+// names are only written the first time they show up, the rest is the streams copied as they were recorded.
+class CommandCapture
+{
+public:
+    using Ptr = std::shared_ptr<CommandCapture>;
+
+    CommandCapture(const std::string& path, uint32_t maxFrames, uint64_t maxBytes = CAPTURE_MAX_BYTES);
+    ~CommandCapture();
+
+    bool IsOpen() { return _file.is_open(); }
+
+    // Call on submission, for every command buffer that has a stream
+    void AddStream(const CommandStream& stream);
+    // Returns false once the capture has all its frames, or is too big to go on
+    bool EndFrame();
+    void Close();
+
+    uint32_t GetFrameCount() { return _frameCount; }
+    uint64_t GetSize() { return _size; }
+
+    // Fails on anything malformed, truncated captures included: every size in the file is checked before it is used
+    static bool Load(const std::string& path, CaptureData& capture);
+private:
+    void WriteChunk(CaptureChunk type, const void *data, uint64_t size);
+
+    std::string _path;
+    std::ofstream _file;
+    std::vector<uint8_t> _scratch;
+
+    uint32_t _maxFrames;
+    uint64_t _maxBytes;
+    uint32_t _frameCount = 0;
+    uint64_t _size = 0;
+    float _writeTime = 0.0f; // Milliseconds spent in AddStream and EndFrame
+
+    std::unordered_map<uint64_t, uint32_t> _stringsWritten; // Per stream
+    std::unordered_map<uint64_t, uint32_t> _namesSeen; // Per stream
+    std::unordered_set<uint64_t> _named;
+};
@@ -0,0 +1,120 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-19 01:18:02
+//
+
+#include "command_state.hpp"
+#include "command_stream.hpp"
+
+CommandStats::Data CommandStats::_Data;
+
+void CommandStats::Add(const CommandBufferStats& stats)
+{
+    for (size_t i = 0; i < size_t(StateCommand::Count); i++) {
+        _Data.Issued[i] += stats.Issued[i];
+        _Data.Filtered[i] += stats.Filtered[i];
+    }
+    _Data.BarriersRequested += stats.BarriersRequested;
+    _Data.BarriersEmitted += stats.BarriersEmitted;
+    _Data.BarrierCalls += stats.BarrierCalls;
+}
+
+void CommandStats::EndFrame()
+{
+    for (size_t i = 0; i < size_t(StateCommand::Count); i++) {
+        _Data.LastFrame.Issued[i] = _Data.Issued[i].exchange(0);
+        _Data.LastFrame.Filtered[i] = _Data.Filtered[i].exchange(0);
+    }
+    _Data.LastFrame.BarriersRequested = _Data.BarriersRequested.exchange(0);
+    _Data.LastFrame.BarriersEmitted = _Data.BarriersEmitted.exchange(0);
+    _Data.LastFrame.BarrierCalls = _Data.BarrierCalls.exchange(0);
+}
+
+CommandBufferStats CommandStats::GetLastFrame()
+{
+    return _Data.LastFrame;
+}
+
+const char *CommandStats::GetStateCommandName(StateCommand command)
+{
+    switch (command) {
+        case StateCommand::Pipeline: return "Pipeline";
+        case StateCommand::RootSignature: return "Root Signature";
+        case StateCommand::Topology: return "Topology";
+        case StateCommand::Viewport: return "Viewport";
+        case StateCommand::RenderTargets: return "Render Targets";
+        case StateCommand::VertexBuffer: return "Vertex Buffer";
+        case StateCommand::IndexBuffer: return "Index Buffer";
+        case StateCommand::DescriptorHeaps: return "Descriptor Heaps";
+        default: return "Unknown";
+    }
+}
+
+BarrierQueue::BarrierQueue(CommandBufferStats& stats, Emit emit)
+    : _stats(stats), _emit(std::move(emit))
+{
+}
+
+void BarrierQueue::Transition(void *resource, uint32_t subresource, uint32_t before, uint32_t after)
+{
+    for (uint32_t i = 0; i < _count; i++) {
+        PendingBarrier& pending = _pending[i];
+        if (pending.Resource != resource || pending.UAV) {
+            continue;
+        }
+        if (pending.Subresource == subresource) {
+            if (pending.Before == after) {
+                // A to B and back to A before anything used it
+                Remove(i);
+            } else {
+                // A to B then B to C goes out as A to C
+                pending.After = after;
+            }
+            return;
+        }
+        // One of them covers every subresource, they can't be merged and have to go out in order
+        if (pending.Subresource == STREAM_SUBRESOURCE_ALL || subresource == STREAM_SUBRESOURCE_ALL) {
+            Flush();
+            break;
+        }
+    }
+    if (_count == COMMAND_MAX_PENDING_BARRIERS) {
+        Flush();
+    }
+    _pending[_count++] = { resource, subresource, before, after, false };
+}
+
+void BarrierQueue::UAV(void *resource)
+{
+    // Nothing ran since the pending barrier, which already waits for the previous writes
+    for (uint32_t i = 0; i < _count; i++) {
+        if (_pending[i].Resource == resource && (_pending[i].UAV || _pending[i].After == uint32_t(StreamState::UnorderedAccess))) {
+            return;
+        }
+    }
+    if (_count == COMMAND_MAX_PENDING_BARRIERS) {
+        Flush();
+    }
+    _pending[_count++] = { resource, STREAM_SUBRESOURCE_ALL, 0, 0, true };
+}
+
+void BarrierQueue::Remove(uint32_t index)
+{
+    // Keeps the order, barriers on the same resource have to go out in the order they were asked for
+    for (uint32_t i = index + 1; i < _count; i++) {
+        _pending[i - 1] = _pending[i];
+    }
+    _count--;
+}
+
+void BarrierQueue::Flush()
+{
+    if (_count == 0) {
+        return;
+    }
+    _emit(_pending.data(), _count);
+    _stats.BarriersEmitted += _count;
+    _stats.BarrierCalls++;
+    _count = 0;
+}
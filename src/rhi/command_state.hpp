@@ -0,0 +1,112 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-19 01:12:40
+//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+// Doesn't include anything from D3D12, so that every backend queues barriers and filters state the same way
+
+// Validation errors logged over the whole run, they would repeat every frame otherwise
+#define COMMAND_VALIDATION_MAX_LOGGED 64
+// Barriers waiting for the next draw, dispatch or copy. Queuing one more flushes them early.
+#define COMMAND_MAX_PENDING_BARRIERS 32
+
+// State that command buffers shadow, calls that would set what is already bound don't reach the command list
+enum class StateCommand
+{
+    Pipeline,
+    RootSignature,
+    Topology,
+    Viewport,
+    RenderTargets,
+    VertexBuffer,
+    IndexBuffer,
+    DescriptorHeaps,
+    Count
+};
+
+struct CommandBufferStats
+{
+    std::array<uint32_t, size_t(StateCommand::Count)> Issued = {};
+    std::array<uint32_t, size_t(StateCommand::Count)> Filtered = {};
+    uint32_t BarriersRequested = 0;
+    uint32_t BarriersEmitted = 0; // After merging, cancelling and dropping no-ops
+    uint32_t BarrierCalls = 0;
+
+    // Counts the call, returns true if it has to be dropped
+    bool Filter(StateCommand command, bool redundant)
+    {
+        if (redundant) {
+            Filtered[size_t(command)]++;
+        } else {
+            Issued[size_t(command)]++;
+        }
+        return redundant;
+    }
+};
+
+// Stats of every command buffer ended during the last frame, whatever the backend
+class CommandStats
+{
+public:
+    // From any thread, when a command buffer ends
+    static void Add(const CommandBufferStats& stats);
+    static void EndFrame();
+    static CommandBufferStats GetLastFrame();
+
+    static const char *GetStateCommandName(StateCommand command);
+private:
+    struct Data
+    {
+        std::array<std::atomic<uint32_t>, size_t(StateCommand::Count)> Issued;
+        std::array<std::atomic<uint32_t>, size_t(StateCommand::Count)> Filtered;
+        std::atomic<uint32_t> BarriersRequested;
+        std::atomic<uint32_t> BarriersEmitted;
+        std::atomic<uint32_t> BarrierCalls;
+        CommandBufferStats LastFrame;
+    };
+    static Data _Data;
+};
+
+struct PendingBarrier
+{
+    void *Resource;
+    uint32_t Subresource; // STREAM_SUBRESOURCE_ALL for all of them
+    uint32_t Before;
+    uint32_t After;
+    bool UAV;
+};
+
+// Barriers waiting for the next draw, dispatch, copy or clear. A transition that follows a queued one on the same
+// subresource is merged with it, and both disappear if it undoes it. States are the stream's, which are D3D12's.
+class BarrierQueue
+{
+public:
+    // Hands a flush over to the backend, with the barriers in the order they have to go out
+    using Emit = std::function<void(const PendingBarrier *barriers, uint32_t count)>;
+
+    BarrierQueue(CommandBufferStats& stats, Emit emit);
+
+    void Transition(void *resource, uint32_t subresource, uint32_t before, uint32_t after);
+    void UAV(void *resource);
+    void Flush();
+    // Drops what is queued, for command lists that start over
+    void Clear() { _count = 0; }
+
+    uint32_t GetCount() { return _count; }
+private:
+    void Remove(uint32_t index);
+
+    CommandBufferStats& _stats;
+    Emit _emit;
+
+    std::array<PendingBarrier, COMMAND_MAX_PENDING_BARRIERS> _pending;
+    uint32_t _count = 0;
+};
@@ -0,0 +1,453 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-17 16:58:03
+//
+
+#include "command_stream.hpp"
+
+#include <cstdio>
+
+CommandStream::CommandStream()
+{
+    static std::atomic<uint64_t> nextId = 1;
+    _id = nextId++;
+}
+
+void CommandStream::Push(StreamCommand type)
+{
+    size_t offset = _data.size();
+    _data.resize(offset + sizeof(StreamHeader));
+
+    StreamHeader header = {};
+    header.Type = type;
+    memcpy(_data.data() + offset, &header, sizeof(header));
+    _counts[size_t(type)]++;
+    _commandCount++;
+}
+
+uint32_t CommandStream::InternString(const std::string& string)
+{
+    auto it = _stringLookup.find(string);
+    if (it != _stringLookup.end()) {
+        return it->second;
+    }
+    uint32_t index = uint32_t(_strings.size());
+    _strings.push_back(string);
+    _stringLookup[string] = index;
+    return index;
+}
+
+void CommandStream::NameResource(uint64_t resource, const std::string& name)
+{
+    _resourceNames.try_emplace(resource, name);
+}
+
+std::string CommandStream::GetResourceName(uint64_t resource) const
+{
+    auto it = _resourceNames.find(resource);
+    if (it != _resourceNames.end()) {
+        return it->second;
+    }
+    char buffer[32];
+    snprintf(buffer, sizeof(buffer), "0x%llx", (unsigned long long)resource);
+    return buffer;
+}
+
+void CommandStream::Reset()
+{
+    _data.clear();
+    _commandCount = 0;
+    _counts = {};
+}
+
+bool CommandStream::Assign(const uint8_t *data, size_t size, std::string *error)
+{
+    auto fail = [&](size_t offset, const std::string& message) {
+        if (error) {
+            *error = "command at byte " + std::to_string(offset) + ": " + message;
+        }
+        return false;
+    };
+
+    size_t offset = 0;
+    while (offset < size) {
+        if (size - offset < sizeof(StreamHeader)) {
+            return fail(offset, "header cut off");
+        }
+        StreamHeader header;
+        memcpy(&header, data + offset, sizeof(header));
+        if (header.Type >= StreamCommand::Count) {
+            return fail(offset, "unknown type " + std::to_string(uint32_t(header.Type)));
+        }
+        if (Align(header.Size) > size - offset - sizeof(StreamHeader)) {
+            return fail(offset, "payload runs past the end of the stream");
+        }
+        if (header.Size < GetPayloadSize(header.Type)) {
+            return fail(offset, std::string(GetCommandName(header.Type)) + " payload is too small");
+        }
+
+        const uint8_t *payload = data + offset + sizeof(StreamHeader);
+        if (header.Type == StreamCommand::PushConstants) {
+            StreamPushConstants constants;
+            memcpy(&constants, payload, sizeof(constants));
+            if (constants.Size > header.Size - sizeof(constants)) {
+                return fail(offset, "push constants run past their payload");
+            }
+            if (constants.Point > StreamBindPoint::Compute) {
+                return fail(offset, "unknown bind point");
+            }
+        }
+        if (header.Type == StreamCommand::BindTable) {
+            StreamBindTable bind;
+            memcpy(&bind, payload, sizeof(bind));
+            if (bind.Point > StreamBindPoint::Compute || bind.View > StreamView::AccelerationStructure) {
+                return fail(offset, "unknown bind point or view");
+            }
+        }
+        if (header.Type == StreamCommand::BindPipeline) {
+            StreamBindPipeline bind;
+            memcpy(&bind, payload, sizeof(bind));
+            if (bind.Kind > StreamPipeline::Raytracing) {
+                return fail(offset, "unknown pipeline kind");
+            }
+        }
+        if (header.Type == StreamCommand::BeginEvent || header.Type == StreamCommand::Marker) {
+            StreamEvent event;
+            memcpy(&event, payload, sizeof(event));
+            if (event.Name >= _strings.size()) {
+                return fail(offset, "string " + std::to_string(event.Name) + " isn't in the stream");
+            }
+        }
+        if (header.Type == StreamCommand::BindRenderTargets) {
+            StreamRenderTargets targets;
+            memcpy(&targets, payload, sizeof(targets));
+            if (targets.Count > STREAM_MAX_RENDER_TARGETS) {
+                return fail(offset, std::to_string(targets.Count) + " render targets");
+            }
+        }
+        offset += sizeof(StreamHeader) + Align(header.Size);
+    }
+
+    Reset();
+    _data.assign(data, data + size);
+    ForEach([&](const StreamHeader& header, const uint8_t*) {
+        _counts[size_t(header.Type)]++;
+        _commandCount++;
+    });
+    return true;
+}
+
+size_t CommandStream::GetPayloadSize(StreamCommand type)
+{
+    switch (type) {
+        case StreamCommand::BeginEvent:
+        case StreamCommand::Marker: return sizeof(StreamEvent);
+        case StreamCommand::Barrier:
+        case StreamCommand::UAVBarrier: return sizeof(StreamBarrier);
+        case StreamCommand::SetViewport: return sizeof(StreamViewport);
+        case StreamCommand::SetTopology: return sizeof(StreamTopology);
+        case StreamCommand::BindRenderTargets: return sizeof(StreamRenderTargets);
+        case StreamCommand::BindVertexBuffer:
+        case StreamCommand::BindIndexBuffer:
+        case StreamCommand::BuildAccelerationStructure: return sizeof(StreamResource);
+        case StreamCommand::BindPipeline: return sizeof(StreamBindPipeline);
+        case StreamCommand::BindTable: return sizeof(StreamBindTable);
+        case StreamCommand::PushConstants: return sizeof(StreamPushConstants);
+        case StreamCommand::ClearRenderTarget:
+        case StreamCommand::ClearDepth:
+        case StreamCommand::ClearUAV: return sizeof(StreamClear);
+        case StreamCommand::Draw:
+        case StreamCommand::DrawIndexed: return sizeof(StreamDraw);
+        case StreamCommand::Dispatch:
+        case StreamCommand::DispatchMesh:
+        case StreamCommand::TraceRays: return sizeof(StreamDispatch);
+        case StreamCommand::Copy: return sizeof(StreamCopy);
+        default: return 0;
+    }
+}
+
+const char *CommandStream::GetCommandName(StreamCommand type)
+{
+    switch (type) {
+        case StreamCommand::BeginEvent: return "BeginEvent";
+        case StreamCommand::EndEvent: return "EndEvent";
+        case StreamCommand::Marker: return "Marker";
+        case StreamCommand::Barrier: return "Barrier";
+        case StreamCommand::UAVBarrier: return "UAVBarrier";
+        case StreamCommand::SetViewport: return "SetViewport";
+        case StreamCommand::SetTopology: return "SetTopology";
+        case StreamCommand::BindRenderTargets: return "BindRenderTargets";
+        case StreamCommand::BindVertexBuffer: return "BindVertexBuffer";
+        case StreamCommand::BindIndexBuffer: return "BindIndexBuffer";
+        case StreamCommand::BindPipeline: return "BindPipeline";
+        case StreamCommand::BindTable: return "BindTable";
+        case StreamCommand::PushConstants: return "PushConstants";
+        case StreamCommand::ClearRenderTarget: return "ClearRenderTarget";
+        case StreamCommand::ClearDepth: return "ClearDepth";
+        case StreamCommand::ClearUAV: return "ClearUAV";
+        case StreamCommand::Draw: return "Draw";
+        case StreamCommand::DrawIndexed: return "DrawIndexed";
+        case StreamCommand::Dispatch: return "Dispatch";
+        case StreamCommand::DispatchMesh: return "DispatchMesh";
+        case StreamCommand::TraceRays: return "TraceRays";
+        case StreamCommand::Copy: return "Copy";
+        case StreamCommand::BuildAccelerationStructure: return "BuildAccelerationStructure";
+        case StreamCommand::RenderImGui: return "RenderImGui";
+        default: return "Unknown";
+    }
+}
+
+std::string CommandStream::GetStateName(uint32_t state)
+{
+    switch (StreamState(state)) {
+        case StreamState::Common: return "Common";
+        case StreamState::RenderTarget: return "RenderTarget";
+        case StreamState::UnorderedAccess: return "Storage";
+        case StreamState::DepthWrite: return "Depth";
+        case StreamState::ShaderResource: return "ShaderResource";
+        case StreamState::CopyDest: return "CopyDest";
+        case StreamState::CopySource: return "CopySource";
+        case StreamState::GenericRead: return "DataRead";
+        default: {
+            char buffer[16];
+            snprintf(buffer, sizeof(buffer), "0x%x", state);
+            return buffer;
+        }
+    }
+}
+
+std::vector<StreamError> CommandStream::Validate(uint32_t *errorCount) const
+{
+    std::vector<StreamError> errors;
+    uint32_t count = 0;
+    uint32_t index = 0;
+
+    auto error = [&](const char *format, auto... args) {
+        if (count++ >= STREAM_MAX_ERRORS) {
+            return;
+        }
+        char buffer[512];
+        snprintf(buffer, sizeof(buffer), format, args...);
+        errors.push_back({ index, buffer });
+    };
+
+    // Whole resource layouts, then the subresources that were moved on their own
+    struct Layout
+    {
+        uint32_t All = 0;
+        bool Known = false;
+        std::unordered_map<uint32_t, uint32_t> Subresources;
+    };
+    std::unordered_map<uint64_t, Layout> layouts;
+
+    auto findLayout = [&](uint64_t resource, uint32_t subresource, uint32_t& state) {
+        auto it = layouts.find(resource);
+        if (it == layouts.end()) {
+            return false;
+        }
+        if (subresource != STREAM_SUBRESOURCE_ALL) {
+            auto sub = it->second.Subresources.find(subresource);
+            if (sub != it->second.Subresources.end()) {
+                state = sub->second;
+                return true;
+            }
+        }
+        state = it->second.All;
+        return it->second.Known;
+    };
+
+    // Copies can promote from Common without a barrier
+    auto expectLayout = [&](uint64_t resource, uint32_t subresource, StreamState expected, bool allowCommon, const char *usage) {
+        uint32_t state = 0;
+        if (!findLayout(resource, subresource, state)) {
+            return;
+        }
+        if ((state & uint32_t(expected)) == uint32_t(expected) && (state != 0 || expected == StreamState::Common)) {
+            return;
+        }
+        if (allowCommon && state == uint32_t(StreamState::Common)) {
+            return;
+        }
+        error("%s %s is in %s, expected %s", usage, GetResourceName(resource).c_str(), GetStateName(state).c_str(), GetStateName(uint32_t(expected)).c_str());
+    };
+
+    bool pipelineBound[2] = { false, false };
+    StreamPipeline pipelineKind[2] = { StreamPipeline::Graphics, StreamPipeline::Compute };
+    bool viewportSet = false;
+    bool indexBufferBound = false;
+    StreamRenderTargets targets = {};
+    bool targetsBound = false;
+    int eventDepth = 0;
+
+    auto expectPipeline = [&](StreamBindPoint point, StreamPipeline kind, const char *command) {
+        int slot = int(point);
+        if (!pipelineBound[slot]) {
+            error("%s without a pipeline bound", command);
+        } else if (pipelineKind[slot] != kind) {
+            error("%s with a pipeline of the wrong kind bound", command);
+        }
+    };
+
+    auto expectTargets = [&](const char *command) {
+        if (!viewportSet) {
+            error("%s without a viewport", command);
+        }
+        if (!targetsBound) {
+            error("%s without render targets bound", command);
+            return;
+        }
+        for (uint32_t i = 0; i < targets.Count; i++) {
+            expectLayout(targets.Targets[i], STREAM_SUBRESOURCE_ALL, StreamState::RenderTarget, false, "Render target");
+        }
+        if (targets.Depth) {
+            expectLayout(targets.Depth, STREAM_SUBRESOURCE_ALL, StreamState::DepthWrite, false, "Depth target");
+        }
+    };
+
+    ForEach([&](const StreamHeader& header, const uint8_t *payload) {
+        switch (header.Type) {
+            case StreamCommand::BeginEvent: {
+                eventDepth++;
+                break;
+            }
+            case StreamCommand::EndEvent: {
+                if (--eventDepth < 0) {
+                    error("EndEvent without a BeginEvent");
+                    eventDepth = 0;
+                }
+                break;
+            }
+            case StreamCommand::Barrier: {
+                const StreamBarrier& barrier = *reinterpret_cast<const StreamBarrier*>(payload);
+                uint32_t state = 0;
+                if (barrier.Before == barrier.After) {
+                    error("Barrier of %s from %s to itself", GetResourceName(barrier.Resource).c_str(), GetStateName(barrier.Before).c_str());
+                }
+                if (findLayout(barrier.Resource, barrier.Subresource, state) && state != barrier.Before) {
+                    error("Barrier of %s from %s, but it was left in %s",
+                          GetResourceName(barrier.Resource).c_str(),
+                          GetStateName(barrier.Before).c_str(),
+                          GetStateName(state).c_str());
+                }
+
+                Layout& layout = layouts[barrier.Resource];
+                if (barrier.Subresource == STREAM_SUBRESOURCE_ALL) {
+                    layout.All = barrier.After;
+                    layout.Known = true;
+                    layout.Subresources.clear();
+                } else {
+                    layout.Subresources[barrier.Subresource] = barrier.After;
+                }
+                break;
+            }
+            case StreamCommand::SetViewport: {
+                const StreamViewport& viewport = *reinterpret_cast<const StreamViewport*>(payload);
+                if (viewport.Width <= 0.0f || viewport.Height <= 0.0f) {
+                    error("Empty viewport (%.0fx%.0f)", viewport.Width, viewport.Height);
+                }
+                viewportSet = true;
+                break;
+            }
+            case StreamCommand::BindRenderTargets: {
+                targets = *reinterpret_cast<const StreamRenderTargets*>(payload);
+                targetsBound = targets.Count || targets.Depth;
+                break;
+            }
+            case StreamCommand::BindIndexBuffer: {
+                indexBufferBound = true;
+                break;
+            }
+            case StreamCommand::BindPipeline: {
+                const StreamBindPipeline& bind = *reinterpret_cast<const StreamBindPipeline*>(payload);
+                int slot = (bind.Kind == StreamPipeline::Graphics || bind.Kind == StreamPipeline::Mesh) ? 0 : 1;
+                pipelineBound[slot] = true;
+                pipelineKind[slot] = bind.Kind;
+                break;
+            }
+            case StreamCommand::BindTable: {
+                const StreamBindTable& bind = *reinterpret_cast<const StreamBindTable*>(payload);
+                if (!pipelineBound[int(bind.Point)]) {
+                    error("Table %u bound without a pipeline", bind.Index);
+                }
+                break;
+            }
+            case StreamCommand::PushConstants: {
+                const StreamPushConstants& constants = *reinterpret_cast<const StreamPushConstants*>(payload);
+                if (constants.Size % 4) {
+                    error("Push constants of %u bytes aren't a whole number of DWORDs", constants.Size);
+                }
+                if (constants.Size > STREAM_MAX_PUSH_CONSTANTS) {
+                    error("Push constants of %u bytes, at most %u fit in a root signature", constants.Size, STREAM_MAX_PUSH_CONSTANTS);
+                }
+                if (!pipelineBound[int(constants.Point)]) {
+                    error("Push constants without a pipeline");
+                }
+                break;
+            }
+            case StreamCommand::ClearRenderTarget: {
+                const StreamClear& clear = *reinterpret_cast<const StreamClear*>(payload);
+                expectLayout(clear.Resource, STREAM_SUBRESOURCE_ALL, StreamState::RenderTarget, false, "Cleared render target");
+                break;
+            }
+            case StreamCommand::ClearDepth: {
+                const StreamClear& clear = *reinterpret_cast<const StreamClear*>(payload);
+                expectLayout(clear.Resource, STREAM_SUBRESOURCE_ALL, StreamState::DepthWrite, false, "Cleared depth target");
+                break;
+            }
+            case StreamCommand::ClearUAV: {
+                const StreamClear& clear = *reinterpret_cast<const StreamClear*>(payload);
+                expectLayout(clear.Resource, clear.Subresource, StreamState::UnorderedAccess, false, "Cleared storage texture");
+                break;
+            }
+            case StreamCommand::Draw: {
+                expectPipeline(StreamBindPoint::Graphics, StreamPipeline::Graphics, "Draw");
+                expectTargets("Draw");
+                break;
+            }
+            case StreamCommand::DrawIndexed: {
+                expectPipeline(StreamBindPoint::Graphics, StreamPipeline::Graphics, "DrawIndexed");
+                expectTargets("DrawIndexed");
+                if (!indexBufferBound) {
+                    error("DrawIndexed without an index buffer");
+                }
+                break;
+            }
+            case StreamCommand::DispatchMesh: {
+                expectPipeline(StreamBindPoint::Graphics, StreamPipeline::Mesh, "DispatchMesh");
+                expectTargets("DispatchMesh");
+                break;
+            }
+            case StreamCommand::Dispatch: {
+                const StreamDispatch& dispatch = *reinterpret_cast<const StreamDispatch*>(payload);
+                expectPipeline(StreamBindPoint::Compute, StreamPipeline::Compute, "Dispatch");
+                if (!dispatch.X || !dispatch.Y || !dispatch.Z) {
+                    error("Empty dispatch (%u, %u, %u)", dispatch.X, dispatch.Y, dispatch.Z);
+                }
+                break;
+            }
+            case StreamCommand::TraceRays: {
+                expectPipeline(StreamBindPoint::Compute, StreamPipeline::Raytracing, "TraceRays");
+                break;
+            }
+            case StreamCommand::Copy: {
+                const StreamCopy& copy = *reinterpret_cast<const StreamCopy*>(payload);
+                expectLayout(copy.Dst, copy.DstSubresource, StreamState::CopyDest, true, "Copy destination");
+                expectLayout(copy.Src, copy.SrcSubresource, StreamState::CopySource, true, "Copy source");
+                break;
+            }
+            default:
+                break;
+        }
+        index++;
+    });
+
+    if (eventDepth > 0) {
+        error("%d events still open at the end of the stream", eventDepth);
+    }
+
+    if (errorCount) {
+        *errorCount = count;
+    }
+    return errors;
+}
@@ -0,0 +1,292 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-17 16:20:37
+//
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+// Doesn't include anything from D3D12, so that streams can be recorded, validated and analyzed on any platform
+
+#define STREAM_MAX_RENDER_TARGETS 8
+#define STREAM_MAX_PUSH_CONSTANTS 256 // 64 root DWORDs
+#define STREAM_SUBRESOURCE_ALL 0xFFFFFFFF
+// Errors kept per validation, the rest are only counted
+#define STREAM_MAX_ERRORS 16
+
+enum class StreamCommand : uint8_t
+{
+    BeginEvent,
+    EndEvent,
+    Marker,
+    Barrier,
+    UAVBarrier,
+    SetViewport,
+    SetTopology,
+    BindRenderTargets,
+    BindVertexBuffer,
+    BindIndexBuffer,
+    BindPipeline,
+    BindTable,
+    PushConstants,
+    ClearRenderTarget,
+    ClearDepth,
+    ClearUAV,
+    Draw,
+    DrawIndexed,
+    Dispatch,
+    DispatchMesh,
+    TraceRays,
+    Copy,
+    BuildAccelerationStructure,
+    RenderImGui,
+    Count
+};
+
+// Same values as D3D12_RESOURCE_STATES, which is what TextureLayout casts to
+enum class StreamState : uint32_t
+{
+    Common = 0x0,
+    RenderTarget = 0x4,
+    UnorderedAccess = 0x8,
+    DepthWrite = 0x10,
+    ShaderResource = 0x40 | 0x80,
+    CopyDest = 0x400,
+    CopySource = 0x800,
+    GenericRead = 0x1 | 0x2 | 0x40 | 0x80 | 0x200 | 0x800
+};
+
+enum class StreamPipeline : uint8_t
+{
+    Graphics,
+    Mesh,
+    Compute,
+    Raytracing
+};
+
+enum class StreamBindPoint : uint8_t
+{
+    Graphics,
+    Compute
+};
+
+enum class StreamView : uint8_t
+{
+    ConstantBuffer,
+    ShaderResource,
+    Storage,
+    Sampler,
+    AccelerationStructure
+};
+
+// Every command starts on an 8 byte boundary, so that payloads can be read in place
+struct StreamHeader
+{
+    StreamCommand Type;
+    uint8_t Pad;
+    uint16_t Size; // Payload bytes, header excluded
+    uint32_t Pad2;
+};
+
+// Resources and pipelines are identified by their address, which stays the same for as long as they live
+
+struct StreamEvent
+{
+    uint32_t Name; // Index in the stream's strings
+};
+
+// UAV barriers use it as well, from and to UnorderedAccess
+struct StreamBarrier
+{
+    uint64_t Resource;
+    uint32_t Subresource;
+    uint32_t Before;
+    uint32_t After;
+    uint32_t Batched; // Asked for in the same batch as the previous barrier. CommandBuffer merges them either way.
+};
+
+struct StreamResource
+{
+    uint64_t Resource;
+};
+
+struct StreamViewport
+{
+    float X;
+    float Y;
+    float Width;
+    float Height;
+};
+
+struct StreamTopology
+{
+    uint32_t Topology;
+};
+
+struct StreamRenderTargets
+{
+    uint32_t Count;
+    std::array<uint64_t, STREAM_MAX_RENDER_TARGETS> Targets;
+    uint64_t Depth; // 0 if none
+};
+
+struct StreamBindPipeline
+{
+    uint64_t Pipeline;
+    uint64_t Signature;
+    StreamPipeline Kind;
+};
+
+struct StreamBindTable
+{
+    uint64_t Resource;
+    uint32_t Index;
+    uint32_t Subresource;
+    StreamBindPoint Point;
+    StreamView View;
+};
+
+// Followed by the constants themselves
+struct StreamPushConstants
+{
+    uint32_t Index;
+    uint32_t Size;
+    StreamBindPoint Point;
+};
+
+struct StreamClear
+{
+    uint64_t Resource;
+    uint32_t Subresource;
+    float Color[4];
+};
+
+struct StreamDraw
+{
+    uint32_t Count;
+};
+
+struct StreamDispatch
+{
+    uint32_t X;
+    uint32_t Y;
+    uint32_t Z;
+};
+
+struct StreamCopy
+{
+    uint64_t Dst;
+    uint64_t Src;
+    uint32_t DstSubresource;
+    uint32_t SrcSubresource;
+    uint32_t Count; // Subresources copied
+};
+
+struct StreamError
+{
+    uint32_t Command; // Index in the stream
+    std::string Message;
+};
+
+// Linear recording of what a command buffer was asked to do, in a single growing block of memory that is reused from
+// one frame to the next. Only plain data goes in, recording is a copy.
+class CommandStream
+{
+public:
+    using Ptr = std::shared_ptr<CommandStream>;
+
+    CommandStream();
+
+    // Unique for the whole run, unlike the address of the stream or its command buffer which can get reused
+    uint64_t GetId() const { return _id; }
+
+    template<typename T>
+    void Push(StreamCommand type, const T& payload, const void *extra = nullptr, uint32_t extraSize = 0)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "Stream payloads have to be plain data");
+
+        uint32_t size = uint32_t(sizeof(T)) + extraSize;
+        size_t offset = _data.size();
+        _data.resize(offset + sizeof(StreamHeader) + Align(size));
+
+        StreamHeader header = {};
+        header.Type = type;
+        header.Size = uint16_t(size);
+        memcpy(_data.data() + offset, &header, sizeof(header));
+        memcpy(_data.data() + offset + sizeof(header), &payload, sizeof(T));
+        if (extraSize) {
+            memcpy(_data.data() + offset + sizeof(header) + sizeof(T), extra, extraSize);
+        }
+        _counts[size_t(type)]++;
+        _commandCount++;
+    }
+    // For commands without a payload
+    void Push(StreamCommand type);
+
+    // Returns the index to put in StreamEvent::Name
+    uint32_t InternString(const std::string& string);
+    const std::string& GetString(uint32_t index) const { return _strings[index]; }
+    const std::vector<std::string>& GetStrings() const { return _strings; }
+
+    // Only the first name given to a resource is kept
+    void NameResource(uint64_t resource, const std::string& name);
+    std::string GetResourceName(uint64_t resource) const;
+    const std::unordered_map<uint64_t, std::string>& GetResourceNames() const { return _resourceNames; }
+
+    // Forgets the commands, keeps the memory, the strings and the names
+    void Reset();
+
+    // Walks the commands in order. The callback gets the header and the payload.
+    template<typename F>
+    void ForEach(F callback) const
+    {
+        size_t offset = 0;
+        while (offset + sizeof(StreamHeader) <= _data.size()) {
+            const StreamHeader *header = reinterpret_cast<const StreamHeader*>(_data.data() + offset);
+            callback(*header, _data.data() + offset + sizeof(StreamHeader));
+            offset += sizeof(StreamHeader) + Align(header->Size);
+        }
+    }
+
+    uint32_t GetCommandCount() const { return _commandCount; }
+    uint32_t GetCount(StreamCommand type) const { return _counts[size_t(type)]; }
+    size_t GetSize() const { return _data.size(); }
+    const std::vector<uint8_t>& GetData() const { return _data; }
+
+    // Replaces the commands with already recorded ones, counting them again. Data read from outside is checked first:
+    // every command has to fit, be of a known type, carry the payload its type needs and name strings the stream has.
+    // Nothing is replaced if it doesn't.
+    bool Assign(const uint8_t *data, size_t size, std::string *error = nullptr);
+
+    // Checks what D3D12 would only complain about with the debug layer, or not at all: draws and dispatches without the
+    // right pipeline, render targets, viewport or index buffer, barriers whose before state isn't the state the resource
+    // was left in, unbalanced events, and push constants that don't fit. Layouts are only known after the first barrier
+    // of a resource in the stream, as streams don't see what happened before them.
+    std::vector<StreamError> Validate(uint32_t *errorCount = nullptr) const;
+
+    static const char *GetCommandName(StreamCommand type);
+    // Fixed part of a command's payload, 0 for commands without one
+    static size_t GetPayloadSize(StreamCommand type);
+    static std::string GetStateName(uint32_t state);
+private:
+    static size_t Align(size_t size) { return (size + 7) & ~size_t(7); }
+
+    uint64_t _id;
+    std::vector<uint8_t> _data;
+    uint32_t _commandCount = 0;
+    std::array<uint32_t, size_t(StreamCommand::Count)> _counts = {};
+
+    std::vector<std::string> _strings;
+    std::unordered_map<std::string, uint32_t> _stringLookup;
+    std::unordered_map<uint64_t, std::string> _resourceNames;
+};
@@ -0,0 +1,220 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 18:39:02
+//
+
+#include "descriptor_allocator.hpp"
+
+#include <core/log.hpp>
+#include <core/timer.hpp>
+
+#include <algorithm>
+#include <random>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#undef min
+#undef max
+
+static uint32_t CountTrailingZeros(uint64_t value)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, value);
+    return uint32_t(index);
+#else
+    return uint32_t(__builtin_ctzll(value));
+#endif
+}
+
+DescriptorAllocator::DescriptorAllocator(uint32_t size, uint32_t transientPerFrame, uint32_t frames)
+{
+    uint64_t transient = uint64_t(transientPerFrame) * frames;
+    if (transient > size) {
+        Logger::Error("[DESCRIPTORS] %u transient descriptors per frame don't fit in a heap of %u", transientPerFrame, size);
+        transientPerFrame = 0;
+        transient = 0;
+    }
+
+    _capacity = size - uint32_t(transient);
+    _transientBase = _capacity;
+    _transientPerFrame = transientPerFrame;
+    _transientOffsets.resize(frames, 0);
+
+    uint32_t wordCount = (_capacity + 63) / 64;
+    _words.resize(wordCount, ~0ull);
+    if (_capacity % 64) {
+        _words.back() = (1ull << (_capacity % 64)) - 1;
+    }
+    _summary.resize((wordCount + 63) / 64, ~0ull);
+    if (wordCount % 64) {
+        _summary.back() = (1ull << (wordCount % 64)) - 1;
+    }
+}
+
+uint32_t DescriptorAllocator::Allocate()
+{
+    for (; _firstSummary < _summary.size(); _firstSummary++) {
+        uint64_t& summary = _summary[_firstSummary];
+        if (!summary) {
+            continue;
+        }
+
+        uint32_t word = _firstSummary * 64 + CountTrailingZeros(summary);
+        uint32_t index = word * 64 + CountTrailingZeros(_words[word]);
+        _words[word] &= _words[word] - 1;
+        if (!_words[word]) {
+            summary &= ~(1ull << (word % 64));
+        }
+
+        _allocated++;
+        _peak = std::max(_peak, _allocated);
+        return index;
+    }
+    return DESCRIPTOR_INVALID;
+}
+
+void DescriptorAllocator::Free(uint32_t index, uint64_t fenceValue)
+{
+    _pending.push_back({ index, fenceValue });
+}
+
+void DescriptorAllocator::FreeNow(uint32_t index)
+{
+    if (index >= _capacity) {
+        Logger::Error("[DESCRIPTORS] Freed slot %u, which isn't in the heap", index);
+        return;
+    }
+    if (!IsAllocated(index)) {
+        Logger::Error("[DESCRIPTORS] Slot %u was freed twice", index);
+        return;
+    }
+
+    uint32_t word = index / 64;
+    _words[word] |= 1ull << (index % 64);
+    _summary[word / 64] |= 1ull << (word % 64);
+    _firstSummary = std::min(_firstSummary, word / 64);
+    _allocated--;
+}
+
+void DescriptorAllocator::Retire(uint64_t completedValue)
+{
+    while (!_pending.empty() && _pending.front().FenceValue <= completedValue) {
+        FreeNow(_pending.front().Index);
+        _pending.pop_front();
+    }
+}
+
+uint32_t DescriptorAllocator::AllocateTransient(uint32_t frame, uint32_t count)
+{
+    if (frame >= _transientOffsets.size()) {
+        return DESCRIPTOR_INVALID;
+    }
+    uint32_t& offset = _transientOffsets[frame];
+    if (count > _transientPerFrame - offset) {
+        return DESCRIPTOR_INVALID;
+    }
+    uint32_t index = _transientBase + frame * _transientPerFrame + offset;
+    offset += count;
+    return index;
+}
+
+bool DescriptorAllocator::IsAllocated(uint32_t index) const
+{
+    return index < _capacity && !(_words[index / 64] & (1ull << (index % 64)));
+}
+
+DescriptorAllocatorStats DescriptorAllocator::GetStats() const
+{
+    DescriptorAllocatorStats stats;
+    stats.Capacity = _capacity;
+    stats.Allocated = _allocated;
+    stats.Peak = _peak;
+    stats.PendingFrees = uint32_t(_pending.size());
+    stats.TransientPerFrame = _transientPerFrame;
+    stats.TransientUsed = 0;
+    for (uint32_t offset : _transientOffsets) {
+        stats.TransientUsed = std::max(stats.TransientUsed, offset);
+    }
+    return stats;
+}
+
+void DescriptorAllocator::Benchmark(uint32_t size, float occupancy, uint32_t iterations)
+{
+    // What a heap looks like at runtime: everything loaded at startup packed at the start, then views of streamed and
+    // resized resources coming and going on top of it
+    const uint32_t workingSet = 1024;
+    uint32_t filled = std::min(uint32_t(size * occupancy), size - 1);
+    uint32_t churn = std::min(workingSet, filled);
+
+    std::mt19937 random(1234);
+    std::vector<uint32_t> victims(iterations);
+    for (uint32_t& victim : victims) {
+        victim = random() % churn;
+    }
+
+    // Bitset, frees waiting two frames for their fence
+    float bitsetTime;
+    uint32_t failures = 0;
+    {
+        DescriptorAllocator allocator(size);
+        std::vector<uint32_t> live;
+        for (uint32_t i = 0; i < filled; i++) {
+            uint32_t index = allocator.Allocate();
+            if (i >= filled - churn) {
+                live.push_back(index);
+            }
+        }
+
+        Timer timer;
+        for (uint32_t i = 0; i < iterations; i++) {
+            allocator.Free(live[victims[i]], i);
+            allocator.Retire(i >= 2 ? i - 2 : 0);
+            live[victims[i]] = allocator.Allocate();
+            if (live[victims[i]] == DESCRIPTOR_INVALID) {
+                failures++;
+            }
+        }
+        bitsetTime = timer.GetElapsed();
+    }
+
+    // Linear scan, frees right away. Scans are long, so it gets fewer iterations.
+    uint32_t scanIterations = std::max(std::min(iterations / 16, 1000u), 1u);
+    float scanTime;
+    {
+        std::vector<bool> table(size, false);
+        std::vector<uint32_t> live;
+        for (uint32_t i = 0; i < filled; i++) {
+            table[i] = true;
+            if (i >= filled - churn) {
+                live.push_back(i);
+            }
+        }
+
+        Timer timer;
+        for (uint32_t i = 0; i < scanIterations; i++) {
+            table[live[victims[i]]] = false;
+            for (uint32_t j = 0; j < size; j++) {
+                if (!table[j]) {
+                    table[j] = true;
+                    live[victims[i]] = j;
+                    break;
+                }
+            }
+        }
+        scanTime = timer.GetElapsed();
+    }
+
+    float bitsetNs = bitsetTime * 1e6f / iterations;
+    float scanNs = scanTime * 1e6f / scanIterations;
+    Logger::Info("[DESCRIPTORS] %u slots %.1f%% full: %.1fns per free and allocation, %.1fns with a linear scan (%.0fx), %u failed",
+                 size,
+                 filled * 100.0f / size,
+                 bitsetNs,
+                 scanNs,
+                 bitsetNs > 0.0f ? scanNs / bitsetNs : 0.0f,
+                 failures);
+}
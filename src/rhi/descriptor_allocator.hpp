@@ -0,0 +1,76 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 18:24:37
+//
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+// Doesn't include anything from D3D12, so that allocation can be checked and benchmarked on any platform
+
+#define DESCRIPTOR_INVALID 0xFFFFFFFF
+// Shader visible descriptors every frame in flight can allocate with AllocateTransient
+#define DESCRIPTOR_TRANSIENT_PER_FRAME 4096
+
+struct DescriptorAllocatorStats
+{
+    uint32_t Capacity; // Slots handed out one by one, the transient ranges excluded
+    uint32_t Allocated;
+    uint32_t Peak;
+    uint32_t PendingFrees;
+    uint32_t TransientPerFrame;
+    uint32_t TransientUsed; // In the fullest frame's range
+};
+
+// Slots of a descriptor heap. Free slots are bits in 64-bit words, with a summary bit per word that still has a free
+// slot: allocating is two count-trailing-zeros, and the lowest free slot is always taken so the heap stays packed.
+// Frees wait for a fence value, as the GPU may still read the descriptor. The end of the heap can be kept for
+// transient descriptors, one linear range per frame in flight that starts over every time the frame comes back.
+class DescriptorAllocator
+{
+public:
+    DescriptorAllocator(uint32_t size = 0, uint32_t transientPerFrame = 0, uint32_t frames = 0);
+
+    uint32_t Allocate();
+    // The slot goes back to the heap once Retire is given a completed value at least this high
+    void Free(uint32_t index, uint64_t fenceValue);
+    // For slots the GPU never saw
+    void FreeNow(uint32_t index);
+    // Frees are retired in the order they came, so fence values should never go down
+    void Retire(uint64_t completedValue);
+
+    // First of count consecutive slots, valid until the frame's range is reset. DESCRIPTOR_INVALID once the range is full.
+    uint32_t AllocateTransient(uint32_t frame, uint32_t count = 1);
+    // Everything the frame allocated is dropped at once, there is nothing to walk
+    void ResetTransient(uint32_t frame) { _transientOffsets[frame] = 0; }
+
+    bool IsAllocated(uint32_t index) const;
+    DescriptorAllocatorStats GetStats() const;
+
+    // Fills a heap to the given occupancy, then allocates and frees in it, against the linear scan of a vector<bool> the
+    // heaps used before. Logs the average time of both.
+    static void Benchmark(uint32_t size, float occupancy, uint32_t iterations);
+private:
+    struct PendingFree
+    {
+        uint32_t Index;
+        uint64_t FenceValue;
+    };
+
+    std::vector<uint64_t> _words; // A set bit is a free slot
+    std::vector<uint64_t> _summary; // A set bit is a word with a free slot
+    uint32_t _firstSummary = 0; // Every summary word before it is empty
+    uint32_t _capacity = 0;
+    uint32_t _allocated = 0;
+    uint32_t _peak = 0;
+
+    std::deque<PendingFree> _pending;
+
+    uint32_t _transientBase = 0;
+    uint32_t _transientPerFrame = 0;
+    std::vector<uint32_t> _transientOffsets;
+};
@@ -47,10 +47,9 @@ DescriptorHeap::Descriptor::Descriptor(DescriptorHeap *parentHeap, int index)
     Valid = true;
 }
 
-DescriptorHeap::DescriptorHeap(Device::Ptr devicePtr, DescriptorHeapType type, uint32_t size)
-    : _devicePtr(devicePtr), _type(D3D12_DESCRIPTOR_HEAP_TYPE(type)), _heapSize(size)
+DescriptorHeap::DescriptorHeap(Device::Ptr devicePtr, DescriptorHeapType type, uint32_t size, uint32_t transientPerFrame, uint32_t frames)
+    : _devicePtr(devicePtr), _type(D3D12_DESCRIPTOR_HEAP_TYPE(type)), _heapSize(size), _allocator(size, transientPerFrame, frames)
 {
-    _table = std::vector<bool>(size, false);
 
     D3D12_DESCRIPTOR_HEAP_DESC desc = {};
     desc.Type = _type;
@@ -71,27 +70,17 @@ DescriptorHeap::DescriptorHeap(Device::Ptr devicePtr, DescriptorHeapType type, u
 
 DescriptorHeap::~DescriptorHeap()
 {
-    _table.clear();
     _heap->Release();
 }
 
 DescriptorHeap::Descriptor DescriptorHeap::Allocate()
 {
-    int index = -1;
-
-    for (int i = 0; i < _heapSize; i++) {
-        if (_table[i] == false) {
-            _table[i] = true;
-            index = i;
-            break;
-        }
-    }
-    if (index == -1) {
-        Logger::Error("Failed to find suitable descriptor!");
+    uint32_t index = _allocator.Allocate();
+    if (index == DESCRIPTOR_INVALID) {
+        Logger::Error("[D3D12] Descriptor heap of type %s is full!", D3D12HeapTypeToStr(_type));
         return Descriptor(this, -1);
-    } else {
-        return Descriptor(this, index);
     }
+    return Descriptor(this, int(index));
 }
 
 void DescriptorHeap::Free(DescriptorHeap::Descriptor descriptor)
@@ -99,7 +88,35 @@ void DescriptorHeap::Free(DescriptorHeap::Descriptor descriptor)
     if (!descriptor.Valid) {
         return;
     }
-    _table[descriptor.HeapIndex] = false;
+    _allocator.Free(uint32_t(descriptor.HeapIndex), _fenceValue);
     descriptor.Valid = false;
     descriptor.ParentHeap = nullptr;
 }
+
+DescriptorHeap::Descriptor DescriptorHeap::AllocateTransient(uint32_t count)
+{
+    uint32_t index = _allocator.AllocateTransient(_frameIndex, count);
+    if (index == DESCRIPTOR_INVALID) {
+        Logger::Error("[D3D12] Out of transient descriptors in heap of type %s", D3D12HeapTypeToStr(_type));
+        return Descriptor(this, -1);
+    }
+    return Descriptor(this, int(index));
+}
+
+void DescriptorHeap::BeginFrame(uint32_t frameIndex, uint64_t completedValue, uint64_t nextValue)
+{
+    Retire(completedValue, nextValue);
+    _frameIndex = frameIndex;
+    _allocator.ResetTransient(frameIndex);
+}
+
+void DescriptorHeap::Retire(uint64_t completedValue, uint64_t nextValue)
+{
+    _allocator.Retire(completedValue);
+    _fenceValue = nextValue;
+}
+
+const char *DescriptorHeap::GetTypeName()
+{
+    return D3D12HeapTypeToStr(_type);
+}
@@ -6,6 +6,7 @@
 #pragma once
 
 #include "device.hpp"
+#include "descriptor_allocator.hpp"
 
 #include <vector>
 
@@ -43,13 +44,26 @@ public:
     };
 
 public:
-    DescriptorHeap(Device::Ptr devicePtr, DescriptorHeapType type, uint32_t size);
+    // The last transientPerFrame * frames descriptors are kept for AllocateTransient
+    DescriptorHeap(Device::Ptr devicePtr, DescriptorHeapType type, uint32_t size, uint32_t transientPerFrame = 0, uint32_t frames = 0);
     ~DescriptorHeap();
 
     Descriptor Allocate();
+    // The descriptor stays untouched until the GPU is done with the frames that could use it
     void Free(Descriptor descriptor);
 
+    // Consecutive descriptors that only live until the frame comes back around. Returns the first one.
+    Descriptor AllocateTransient(uint32_t count = 1);
+
+    // Called once the fence of the next frame was waited on: frees up to completedValue go back to the heap, the next
+    // ones wait for nextValue, and the frame's transient range starts over
+    void BeginFrame(uint32_t frameIndex, uint64_t completedValue, uint64_t nextValue);
+    // Same, without touching the transient ranges, for waits in the middle of a frame
+    void Retire(uint64_t completedValue, uint64_t nextValue);
+
     ID3D12DescriptorHeap* GetHeap() { return _heap; }
+    DescriptorAllocatorStats GetStats() { return _allocator.GetStats(); }
+    const char *GetTypeName();
 private:
     Device::Ptr _devicePtr;
     ID3D12DescriptorHeap* _heap;
@@ -58,5 +72,7 @@ private:
     int _incrementSize;
     uint32_t _heapSize;
 
-    std::vector<bool> _table;
+    DescriptorAllocator _allocator;
+    uint64_t _fenceValue = 0; // What frees wait for
+    uint32_t _frameIndex = 0;
 };
@@ -0,0 +1,47 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 21:48:11
+//
+
+#include "null_buffer.hpp"
+
+NullBuffer::NullBuffer(NullDescriptorHeap::Ptr heap, uint64_t size, uint64_t stride, BufferType type, bool readback, const std::string& name)
+    : _heap(heap), _type(type), _size(size), _stride(stride), _readback(readback), _name(name)
+{
+    // Zeroed, like the committed resources D3D12 hands out
+    _memory.reset(new uint8_t[size ? size : 1]());
+}
+
+NullBuffer::~NullBuffer()
+{
+    _heap->Free(_cbv);
+    _heap->Free(_uav);
+    _heap->Free(_srv);
+}
+
+void NullBuffer::BuildConstantBuffer()
+{
+    if (_cbv == DESCRIPTOR_INVALID) {
+        _cbv = _heap->Allocate();
+    }
+}
+
+void NullBuffer::BuildStorage()
+{
+    if (_uav == DESCRIPTOR_INVALID) {
+        _uav = _heap->Allocate();
+    }
+}
+
+void NullBuffer::BuildShaderResource()
+{
+    if (_srv == DESCRIPTOR_INVALID) {
+        _srv = _heap->Allocate();
+    }
+}
+
+void NullBuffer::Map(int start, int end, void **data)
+{
+    *data = _memory.get();
+}
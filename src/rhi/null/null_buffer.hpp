@@ -0,0 +1,58 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 21:45:39
+//
+
+#pragma once
+
+#include "rhi/resource_types.hpp"
+
+#include "null_descriptor_heap.hpp"
+
+#include <memory>
+#include <string>
+
+// Buffer of the null backend, in host memory. Mapping returns the memory itself.
+class NullBuffer
+{
+public:
+    using Ptr = std::shared_ptr<NullBuffer>;
+
+    NullBuffer(NullDescriptorHeap::Ptr heap, uint64_t size, uint64_t stride, BufferType type, bool readback, const std::string& name = "Buffer");
+    ~NullBuffer();
+
+    void BuildConstantBuffer();
+    void BuildStorage();
+    void BuildShaderResource();
+
+    void Map(int start, int end, void **data);
+    void Unmap(int start, int end) {}
+
+    uint32_t CBV() { return _cbv; }
+    uint32_t UAV() { return _uav; }
+    uint32_t SRV() { return _srv; }
+
+    uint64_t Address() { return uint64_t(_memory.get()); }
+
+    uint8_t *GetData() { return _memory.get(); }
+    uint64_t GetSize() { return _size; }
+    uint64_t GetStride() { return _stride; }
+    BufferType GetType() { return _type; }
+    bool IsReadback() { return _readback; }
+    const std::string& GetName() { return _name; }
+private:
+    NullDescriptorHeap::Ptr _heap;
+
+    BufferType _type;
+    uint64_t _size;
+    uint64_t _stride;
+    bool _readback;
+    std::string _name;
+
+    uint32_t _cbv = DESCRIPTOR_INVALID;
+    uint32_t _uav = DESCRIPTOR_INVALID;
+    uint32_t _srv = DESCRIPTOR_INVALID;
+
+    std::unique_ptr<uint8_t[]> _memory;
+};
@@ -0,0 +1,304 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 22:04:33
+//
+
+#include "null_command_buffer.hpp"
+
+#include <core/log.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+
+#undef min
+#undef max
+
+static uint32_t ToStreamSubresource(int subresource)
+{
+    return subresource == SUBRESOURCE_ALL ? STREAM_SUBRESOURCE_ALL : uint32_t(subresource);
+}
+
+NullCommandBuffer::NullCommandBuffer(bool validate)
+    : _validate(validate), _barrierQueue(_stats, [](const PendingBarrier *barriers, uint32_t count) {})
+{
+}
+
+uint64_t NullCommandBuffer::Track(NullTexture *texture)
+{
+    _stream.NameResource(uint64_t(texture), texture->GetName());
+    return uint64_t(texture);
+}
+
+uint64_t NullCommandBuffer::Track(NullBuffer *buffer)
+{
+    _stream.NameResource(uint64_t(buffer), buffer->GetName());
+    return uint64_t(buffer);
+}
+
+void NullCommandBuffer::Begin(bool reset)
+{
+    _stream.Reset();
+    _barrierQueue.Clear();
+    _bound = {};
+    _recording = true;
+}
+
+void NullCommandBuffer::End()
+{
+    if (!_recording) {
+        Logger::Error("[RHI] Ended a null command buffer that wasn't recording");
+        return;
+    }
+    _recording = false;
+    _barrierQueue.Flush();
+    CommandStats::Add(_stats);
+    _stats = {};
+    _errors.clear();
+    _errorCount = 0;
+    if (!_validate) {
+        return;
+    }
+
+    static std::atomic<uint32_t> logged = 0;
+    _errors = _stream.Validate(&_errorCount);
+    for (auto& error : _errors) {
+        uint32_t index = logged++;
+        if (index < COMMAND_VALIDATION_MAX_LOGGED) {
+            Logger::Error("[RHI] Command %u: %s", error.Command, error.Message.c_str());
+        } else if (index == COMMAND_VALIDATION_MAX_LOGGED) {
+            Logger::Warn("[RHI] Too many command validation errors, not logging any more of them");
+        }
+    }
+}
+
+void NullCommandBuffer::BeginEvent(const std::string& name, int r, int g, int b)
+{
+    _stream.Push(StreamCommand::BeginEvent, StreamEvent{ _stream.InternString(name) });
+}
+
+void NullCommandBuffer::InsertMarker(const std::string& name, int r, int g, int b)
+{
+    _stream.Push(StreamCommand::Marker, StreamEvent{ _stream.InternString(name) });
+}
+
+void NullCommandBuffer::EndEvent()
+{
+    _stream.Push(StreamCommand::EndEvent);
+}
+
+bool NullCommandBuffer::QueueBarrier(NullTexture *texture, TextureLayout newLayout, int subresource, bool batched)
+{
+    TextureLayout oldLayout = texture->GetState(subresource);
+    _stats.BarriersRequested++;
+
+    if (oldLayout == TextureLayout::Storage && newLayout == TextureLayout::Storage) {
+        _stream.Push(StreamCommand::UAVBarrier, StreamBarrier{ Track(texture), ToStreamSubresource(subresource), uint32_t(newLayout), uint32_t(newLayout), batched });
+        _barrierQueue.UAV(texture);
+        return true;
+    }
+    if (oldLayout == newLayout) {
+        return false;
+    }
+    _stream.Push(StreamCommand::Barrier, StreamBarrier{ Track(texture), ToStreamSubresource(subresource), uint32_t(oldLayout), uint32_t(newLayout), batched });
+    _barrierQueue.Transition(texture, ToStreamSubresource(subresource), uint32_t(oldLayout), uint32_t(newLayout));
+    texture->SetState(newLayout, subresource);
+    return true;
+}
+
+void NullCommandBuffer::ImageBarrier(NullTexture::Ptr texture, TextureLayout newLayout, int subresource)
+{
+    QueueBarrier(texture.get(), newLayout, subresource, false);
+}
+
+void NullCommandBuffer::ImageBarrierBatch(std::initializer_list<NullBarrier> barriers)
+{
+    // Same as CommandBuffer, only barriers that made it into the stream count as batched
+    uint32_t batched = 0;
+    for (const NullBarrier& barrier : barriers) {
+        if (QueueBarrier(barrier.Texture.get(), barrier.NewLayout, barrier.Subresource, batched > 0)) {
+            batched++;
+        }
+    }
+}
+
+void NullCommandBuffer::SetViewport(float x, float y, float width, float height)
+{
+    StreamViewport viewport = { x, y, width, height };
+    _stream.Push(StreamCommand::SetViewport, viewport);
+    if (_stats.Filter(StateCommand::Viewport, _bound.ViewportSet && !memcmp(&_bound.Viewport, &viewport, sizeof(viewport)))) {
+        return;
+    }
+    _bound.Viewport = viewport;
+    _bound.ViewportSet = true;
+}
+
+void NullCommandBuffer::SetTopology(Topology topology)
+{
+    _stream.Push(StreamCommand::SetTopology, StreamTopology{ uint32_t(topology) });
+    if (_stats.Filter(StateCommand::Topology, _bound.Topology == uint32_t(topology))) {
+        return;
+    }
+    _bound.Topology = uint32_t(topology);
+}
+
+void NullCommandBuffer::ClearRenderTarget(NullTexture::Ptr renderTarget, float r, float g, float b, float a)
+{
+    if (!renderTarget->IsRenderTarget()) {
+        Logger::Error("[RHI] Cleared %s, which has no render target view", renderTarget->GetName().c_str());
+    }
+    _barrierQueue.Flush();
+    _stream.Push(StreamCommand::ClearRenderTarget, StreamClear{ Track(renderTarget.get()), STREAM_SUBRESOURCE_ALL, { r, g, b, a } });
+}
+
+void NullCommandBuffer::ClearDepthTarget(NullTexture::Ptr depthTarget)
+{
+    if (!depthTarget->IsDepthTarget()) {
+        Logger::Error("[RHI] Cleared %s, which has no depth view", depthTarget->GetName().c_str());
+    }
+    _barrierQueue.Flush();
+    _stream.Push(StreamCommand::ClearDepth, StreamClear{ Track(depthTarget.get()), STREAM_SUBRESOURCE_ALL, { 1.0f, 0.0f, 0.0f, 0.0f } });
+}
+
+void NullCommandBuffer::ClearUAV(NullTexture::Ptr texture, float r, float g, float b, float a, int subresource)
+{
+    if (texture->UAV(subresource) == DESCRIPTOR_INVALID) {
+        Logger::Error("[RHI] Cleared %s, which has no storage view", texture->GetName().c_str());
+    }
+    _barrierQueue.Flush();
+    _stream.Push(StreamCommand::ClearUAV, StreamClear{ Track(texture.get()), uint32_t(subresource), { r, g, b, a } });
+}
+
+void NullCommandBuffer::BindRenderTargets(const std::vector<NullTexture::Ptr>& renderTargets, NullTexture::Ptr depthTarget)
+{
+    StreamRenderTargets targets = {};
+    targets.Count = std::min(uint32_t(renderTargets.size()), uint32_t(STREAM_MAX_RENDER_TARGETS));
+    for (uint32_t i = 0; i < targets.Count; i++) {
+        targets.Targets[i] = Track(renderTargets[i].get());
+    }
+    targets.Depth = depthTarget ? Track(depthTarget.get()) : 0;
+    _stream.Push(StreamCommand::BindRenderTargets, targets);
+
+    bool redundant = _bound.RenderTargetsSet && _bound.RenderTargets.Count == targets.Count && _bound.RenderTargets.Depth == targets.Depth;
+    for (uint32_t i = 0; i < targets.Count && redundant; i++) {
+        redundant = _bound.RenderTargets.Targets[i] == targets.Targets[i];
+    }
+    if (_stats.Filter(StateCommand::RenderTargets, redundant)) {
+        return;
+    }
+    _bound.RenderTargets = targets;
+    _bound.RenderTargetsSet = true;
+}
+
+void NullCommandBuffer::BindVertexBuffer(NullBuffer::Ptr buffer)
+{
+    _stream.Push(StreamCommand::BindVertexBuffer, StreamResource{ Track(buffer.get()) });
+    if (_stats.Filter(StateCommand::VertexBuffer, _bound.VertexBuffer == buffer.get())) {
+        return;
+    }
+    _bound.VertexBuffer = buffer.get();
+}
+
+void NullCommandBuffer::BindIndexBuffer(NullBuffer::Ptr buffer)
+{
+    _stream.Push(StreamCommand::BindIndexBuffer, StreamResource{ Track(buffer.get()) });
+    if (_stats.Filter(StateCommand::IndexBuffer, _bound.IndexBuffer == buffer.get())) {
+        return;
+    }
+    _bound.IndexBuffer = buffer.get();
+}
+
+void NullCommandBuffer::BindPipeline(NullPipeline::Ptr pipeline)
+{
+    _stream.Push(StreamCommand::BindPipeline, StreamBindPipeline{ uint64_t(pipeline.get()), uint64_t(pipeline.get()), pipeline->Kind });
+    if (_stats.Filter(StateCommand::Pipeline, _bound.Pipeline == pipeline.get())) {
+        return;
+    }
+    _bound.Pipeline = pipeline.get();
+}
+
+void NullCommandBuffer::BindGraphicsConstantBuffer(NullBuffer::Ptr buffer, int index)
+{
+    _stream.Push(StreamCommand::BindTable, StreamBindTable{ Track(buffer.get()), uint32_t(index), 0, StreamBindPoint::Graphics, StreamView::ConstantBuffer });
+}
+
+void NullCommandBuffer::BindGraphicsShaderResource(NullTexture::Ptr texture, int index)
+{
+    _stream.Push(StreamCommand::BindTable, StreamBindTable{ Track(texture.get()), uint32_t(index), 0, StreamBindPoint::Graphics, StreamView::ShaderResource });
+}
+
+void NullCommandBuffer::BindComputeShaderResource(NullTexture::Ptr texture, int index, int mip)
+{
+    _stream.Push(StreamCommand::BindTable, StreamBindTable{ Track(texture.get()), uint32_t(index), uint32_t(mip), StreamBindPoint::Compute, StreamView::ShaderResource });
+}
+
+void NullCommandBuffer::BindComputeStorageTexture(NullTexture::Ptr texture, int index, int mip)
+{
+    _stream.Push(StreamCommand::BindTable, StreamBindTable{ Track(texture.get()), uint32_t(index), uint32_t(mip), StreamBindPoint::Compute, StreamView::Storage });
+}
+
+void NullCommandBuffer::BindComputeConstantBuffer(NullBuffer::Ptr buffer, int index)
+{
+    _stream.Push(StreamCommand::BindTable, StreamBindTable{ Track(buffer.get()), uint32_t(index), 0, StreamBindPoint::Compute, StreamView::ConstantBuffer });
+}
+
+void NullCommandBuffer::BindComputeStorageBuffer(NullBuffer::Ptr buffer, int index)
+{
+    _stream.Push(StreamCommand::BindTable, StreamBindTable{ Track(buffer.get()), uint32_t(index), 0, StreamBindPoint::Compute, StreamView::Storage });
+}
+
+void NullCommandBuffer::PushConstantsGraphics(const void *data, uint32_t size, int index)
+{
+    _stream.Push(StreamCommand::PushConstants, StreamPushConstants{ uint32_t(index), size, StreamBindPoint::Graphics }, data, size);
+}
+
+void NullCommandBuffer::PushConstantsCompute(const void *data, uint32_t size, int index)
+{
+    _stream.Push(StreamCommand::PushConstants, StreamPushConstants{ uint32_t(index), size, StreamBindPoint::Compute }, data, size);
+}
+
+void NullCommandBuffer::Draw(int vertexCount)
+{
+    _barrierQueue.Flush();
+    _stream.Push(StreamCommand::Draw, StreamDraw{ uint32_t(vertexCount) });
+}
+
+void NullCommandBuffer::DrawIndexed(int indexCount)
+{
+    _barrierQueue.Flush();
+    _stream.Push(StreamCommand::DrawIndexed, StreamDraw{ uint32_t(indexCount) });
+}
+
+void NullCommandBuffer::Dispatch(int x, int y, int z)
+{
+    _barrierQueue.Flush();
+    _stream.Push(StreamCommand::Dispatch, StreamDispatch{ uint32_t(x), uint32_t(y), uint32_t(z) });
+}
+
+void NullCommandBuffer::DispatchMesh(int x, int y, int z)
+{
+    _barrierQueue.Flush();
+    _stream.Push(StreamCommand::DispatchMesh, StreamDispatch{ uint32_t(x), uint32_t(y), uint32_t(z) });
+}
+
+void NullCommandBuffer::CopyTextureToTexture(NullTexture::Ptr dst, NullTexture::Ptr src)
+{
+    _barrierQueue.Flush();
+    _stream.Push(StreamCommand::Copy, StreamCopy{ Track(dst.get()), Track(src.get()), 0, 0, 1 });
+    memcpy(dst->GetData(), src->GetData(), size_t(std::min(dst->GetMipSize(0), src->GetMipSize(0))));
+}
+
+void NullCommandBuffer::CopyBufferToBuffer(NullBuffer::Ptr dst, NullBuffer::Ptr src)
+{
+    _barrierQueue.Flush();
+    _stream.Push(StreamCommand::Copy, StreamCopy{ Track(dst.get()), Track(src.get()), 0, 0, 1 });
+    memcpy(dst->GetData(), src->GetData(), size_t(std::min(dst->GetSize(), src->GetSize())));
+}
+
+void NullCommandBuffer::CopyBufferToTexture(NullTexture::Ptr dst, NullBuffer::Ptr src)
+{
+    _barrierQueue.Flush();
+    _stream.Push(StreamCommand::Copy, StreamCopy{ Track(dst.get()), Track(src.get()), 0, 0, 1 });
+    memcpy(dst->GetData(), src->GetData(), size_t(std::min(dst->GetMipSize(0), src->GetSize())));
+}
@@ -0,0 +1,120 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 21:58:06
+//
+
+#pragma once
+
+#include "rhi/command_stream.hpp"
+#include "rhi/command_state.hpp"
+
+#include "null_buffer.hpp"
+#include "null_texture.hpp"
+#include "null_pipeline.hpp"
+
+#include <initializer_list>
+#include <vector>
+
+struct NullBarrier
+{
+    NullTexture::Ptr Texture;
+    TextureLayout NewLayout;
+    int Subresource = 0;
+};
+
+// Command buffer of the null backend, with the calls of CommandBuffer. Everything goes into a CommandStream, layouts are
+// tracked on the textures the same way, and End validates the stream. Barriers go through the same BarrierQueue and
+// state calls through the same filter as CommandBuffer, so their stats are what the D3D12 backend would get. Copies go
+// through right away on the host memory, there is no GPU timeline for them to wait on.
+class NullCommandBuffer
+{
+public:
+    using Ptr = std::shared_ptr<NullCommandBuffer>;
+
+    NullCommandBuffer(bool validate = true);
+
+    void Begin(bool reset = true);
+    void End();
+    void Continue() { Begin(false); }
+    bool IsRecording() { return _recording; }
+
+    void BeginEvent(const std::string& name, int r = 255, int g = 255, int b = 255);
+    void InsertMarker(const std::string& name, int r = 255, int g = 255, int b = 255);
+    void EndEvent();
+
+    void ImageBarrier(NullTexture::Ptr texture, TextureLayout newLayout, int subresource = SUBRESOURCE_ALL);
+    void ImageBarrierBatch(std::initializer_list<NullBarrier> barriers);
+
+    void SetViewport(float x, float y, float width, float height);
+    void SetTopology(Topology topology);
+
+    void ClearRenderTarget(NullTexture::Ptr renderTarget, float r, float g, float b, float a);
+    void ClearDepthTarget(NullTexture::Ptr depthTarget);
+    void ClearUAV(NullTexture::Ptr texture, float r, float g, float b, float a, int subresource = 0);
+
+    void BindRenderTargets(const std::vector<NullTexture::Ptr>& renderTargets, NullTexture::Ptr depthTarget);
+    void BindVertexBuffer(NullBuffer::Ptr buffer);
+    void BindIndexBuffer(NullBuffer::Ptr buffer);
+
+    void BindGraphicsPipeline(NullPipeline::Ptr pipeline) { BindPipeline(pipeline); }
+    void BindMeshPipeline(NullPipeline::Ptr pipeline) { BindPipeline(pipeline); }
+    void BindComputePipeline(NullPipeline::Ptr pipeline) { BindPipeline(pipeline); }
+
+    void BindGraphicsConstantBuffer(NullBuffer::Ptr buffer, int index);
+    void BindGraphicsShaderResource(NullTexture::Ptr texture, int index);
+    void BindComputeShaderResource(NullTexture::Ptr texture, int index, int mip = 0);
+    void BindComputeStorageTexture(NullTexture::Ptr texture, int index, int mip = 0);
+    void BindComputeConstantBuffer(NullBuffer::Ptr buffer, int index);
+    void BindComputeStorageBuffer(NullBuffer::Ptr buffer, int index);
+
+    void PushConstantsGraphics(const void *data, uint32_t size, int index);
+    void PushConstantsCompute(const void *data, uint32_t size, int index);
+
+    void Draw(int vertexCount);
+    void DrawIndexed(int indexCount);
+    void Dispatch(int x, int y, int z);
+    void DispatchMesh(int x, int y, int z);
+
+    void CopyTextureToTexture(NullTexture::Ptr dst, NullTexture::Ptr src);
+    void CopyBufferToBuffer(NullBuffer::Ptr dst, NullBuffer::Ptr src);
+    void CopyBufferToTexture(NullTexture::Ptr dst, NullBuffer::Ptr src);
+
+    CommandStream *GetStream() { return &_stream; }
+    // Of the last End, the ones past STREAM_MAX_ERRORS are only counted
+    const std::vector<StreamError>& GetErrors() { return _errors; }
+    uint32_t GetErrorCount() { return _errorCount; }
+    // Since the last Begin, added to CommandStats on End
+    const CommandBufferStats& GetStats() { return _stats; }
+private:
+    void BindPipeline(NullPipeline::Ptr pipeline);
+    uint64_t Track(NullTexture *texture);
+    uint64_t Track(NullBuffer *buffer);
+    // Returns false if the texture was in the layout already
+    bool QueueBarrier(NullTexture *texture, TextureLayout newLayout, int subresource, bool batched);
+
+    CommandStream _stream;
+    bool _validate;
+    bool _recording = false;
+
+    // What CommandBuffer would have bound, as of the last call that reached its command list
+    struct BoundState
+    {
+        NullPipeline *Pipeline = nullptr;
+        uint32_t Topology = 0;
+        StreamViewport Viewport = {};
+        bool ViewportSet = false;
+        StreamRenderTargets RenderTargets = {};
+        bool RenderTargetsSet = false;
+        NullBuffer *VertexBuffer = nullptr;
+        NullBuffer *IndexBuffer = nullptr;
+    };
+    BoundState _bound;
+
+    CommandBufferStats _stats;
+    // Nothing to emit the barriers to, the stream already has them
+    BarrierQueue _barrierQueue;
+
+    std::vector<StreamError> _errors;
+    uint32_t _errorCount = 0;
+};
@@ -0,0 +1,48 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 21:43:02
+//
+
+#include "null_descriptor_heap.hpp"
+
+#include <core/log.hpp>
+
+NullDescriptorHeap::NullDescriptorHeap(uint32_t size, uint32_t transientPerFrame, uint32_t frames)
+    : _allocator(size, transientPerFrame, frames)
+{
+}
+
+uint32_t NullDescriptorHeap::Allocate()
+{
+    uint32_t index = _allocator.Allocate();
+    if (index == DESCRIPTOR_INVALID) {
+        Logger::Error("[RHI] Null descriptor heap is full!");
+    }
+    return index;
+}
+
+void NullDescriptorHeap::Free(uint32_t index)
+{
+    if (index == DESCRIPTOR_INVALID) {
+        return;
+    }
+    _allocator.Free(index, _fenceValue);
+}
+
+uint32_t NullDescriptorHeap::AllocateTransient(uint32_t count)
+{
+    uint32_t index = _allocator.AllocateTransient(_frameIndex, count);
+    if (index == DESCRIPTOR_INVALID) {
+        Logger::Error("[RHI] Out of transient descriptors in the null descriptor heap!");
+    }
+    return index;
+}
+
+void NullDescriptorHeap::BeginFrame(uint32_t frameIndex, uint64_t completedValue, uint64_t nextValue)
+{
+    _allocator.Retire(completedValue);
+    _fenceValue = nextValue;
+    _frameIndex = frameIndex;
+    _allocator.ResetTransient(frameIndex);
+}
@@ -0,0 +1,40 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 21:41:17
+//
+
+#pragma once
+
+#include "rhi/descriptor_allocator.hpp"
+
+#include <memory>
+
+// Shader visible heap of the null backend. There is nothing to write descriptors to, only the slots are handed out,
+// with the same allocator and fence rules as DescriptorHeap.
+class NullDescriptorHeap
+{
+public:
+    using Ptr = std::shared_ptr<NullDescriptorHeap>;
+
+    // The last transientPerFrame * frames slots are kept for AllocateTransient
+    NullDescriptorHeap(uint32_t size, uint32_t transientPerFrame = 0, uint32_t frames = 0);
+
+    // DESCRIPTOR_INVALID when the heap is full
+    uint32_t Allocate();
+    // The slot stays taken until the frames that could use it are done
+    void Free(uint32_t index);
+
+    // First of count consecutive slots that only live until the frame comes back around
+    uint32_t AllocateTransient(uint32_t count = 1);
+
+    // Frees up to completedValue go back to the heap, the next ones wait for nextValue, and the frame's transient range
+    // starts over
+    void BeginFrame(uint32_t frameIndex, uint64_t completedValue, uint64_t nextValue);
+
+    DescriptorAllocatorStats GetStats() { return _allocator.GetStats(); }
+private:
+    DescriptorAllocator _allocator;
+    uint64_t _fenceValue = 0; // What frees wait for
+    uint32_t _frameIndex = 0;
+};
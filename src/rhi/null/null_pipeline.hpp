@@ -0,0 +1,21 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 21:55:18
+//
+
+#pragma once
+
+#include "rhi/command_stream.hpp"
+
+#include <memory>
+#include <string>
+
+// Pipelines of the null backend have no shaders, only what binding them needs to be validated
+struct NullPipeline
+{
+    using Ptr = std::shared_ptr<NullPipeline>;
+
+    StreamPipeline Kind;
+    std::string Name;
+};
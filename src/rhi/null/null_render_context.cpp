@@ -0,0 +1,285 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 22:19:27
+//
+
+#include "null_render_context.hpp"
+
+#include <core/job_system.hpp>
+#include <core/log.hpp>
+#include <core/timer.hpp>
+
+#include <algorithm>
+
+#undef min
+#undef max
+
+NullRenderContext::NullRenderContext(uint32_t width, uint32_t height, bool validate)
+    : _width(width), _height(height), _validate(validate)
+{
+    _shaderHeap = std::make_shared<NullDescriptorHeap>(NULL_SHADER_HEAP_SIZE, DESCRIPTOR_TRANSIENT_PER_FRAME, NULL_FRAMES_IN_FLIGHT);
+    // Frees made during the first frame wait for its end, like every other frame's
+    _frameValues[_frameIndex] = 1;
+    _shaderHeap->BeginFrame(_frameIndex, 0, _frameValues[_frameIndex]);
+
+    for (int i = 0; i < NULL_FRAMES_IN_FLIGHT; i++) {
+        _commandBuffers[i] = CreateCommandBuffer();
+    }
+    CreateBackBuffers();
+
+    Logger::Info("[RHI] Created null render context (%ux%u)", width, height);
+}
+
+NullRenderContext::~NullRenderContext()
+{
+    if (_parallelCount) {
+        Logger::Warn("[RHI] Null render context destroyed between BeginParallel and EndParallel");
+    }
+}
+
+void NullRenderContext::CreateBackBuffers()
+{
+    for (int i = 0; i < NULL_FRAMES_IN_FLIGHT; i++) {
+        _backBuffers[i] = CreateTexture(_width, _height, 4, TextureUsage::RenderTarget, false, "Back Buffer " + std::to_string(i));
+        _backBuffers[i]->BuildRenderTarget();
+        _backBuffers[i]->SetState(TextureLayout::Present, SUBRESOURCE_ALL);
+    }
+}
+
+void NullRenderContext::Resize(uint32_t width, uint32_t height)
+{
+    _width = width;
+    _height = height;
+    CreateBackBuffers();
+}
+
+void NullRenderContext::Present(bool vsync)
+{
+    if (_backBuffers[_frameIndex]->GetState(0) != TextureLayout::Present) {
+        Logger::Error("[RHI] Presented back buffer %u, which isn't in the present layout", _frameIndex);
+    }
+}
+
+void NullRenderContext::Finish()
+{
+    // Submissions complete as they are made, the frame's fence value is reached already
+    uint64_t completedValue = _frameValues[_frameIndex];
+
+    _frameIndex = (_frameIndex + 1) % NULL_FRAMES_IN_FLIGHT;
+    _frameValues[_frameIndex] = completedValue + 1;
+    _shaderHeap->BeginFrame(_frameIndex, completedValue, _frameValues[_frameIndex]);
+    CommandStats::EndFrame();
+    _stats.Frames++;
+}
+
+void NullRenderContext::ExecuteCommandBuffers(const std::vector<NullCommandBuffer::Ptr>& buffers)
+{
+    for (auto& buffer : buffers) {
+        if (buffer->IsRecording()) {
+            Logger::Error("[RHI] Submitted a null command buffer that is still recording");
+            continue;
+        }
+        _stats.SubmittedBuffers++;
+        _stats.Commands += buffer->GetStream()->GetCommandCount();
+        for (StreamCommand command : { StreamCommand::Draw, StreamCommand::DrawIndexed, StreamCommand::Dispatch, StreamCommand::DispatchMesh }) {
+            _stats.Draws += buffer->GetStream()->GetCount(command);
+        }
+        _stats.StreamBytes += buffer->GetStream()->GetSize();
+        _stats.ValidationErrors += buffer->GetErrorCount();
+    }
+}
+
+std::vector<NullCommandBuffer::Ptr> NullRenderContext::BeginParallel(uint32_t count)
+{
+    if (_parallelCount) {
+        Logger::Error("[RHI] BeginParallel called twice without EndParallel");
+        return {};
+    }
+
+    NullCommandBuffer::Ptr frame = _commandBuffers[_frameIndex];
+    frame->End();
+    ExecuteCommandBuffers({ frame });
+
+    std::vector<NullCommandBuffer::Ptr>& buffers = _parallelBuffers[_frameIndex];
+    while (buffers.size() < count) {
+        buffers.push_back(CreateCommandBuffer());
+    }
+
+    std::vector<NullCommandBuffer::Ptr> active(buffers.begin(), buffers.begin() + count);
+    for (auto& buffer : active) {
+        buffer->Begin();
+    }
+    _parallelCount = count;
+    return active;
+}
+
+void NullRenderContext::EndParallel()
+{
+    std::vector<NullCommandBuffer::Ptr>& buffers = _parallelBuffers[_frameIndex];
+    std::vector<NullCommandBuffer::Ptr> active(buffers.begin(), buffers.begin() + _parallelCount);
+    for (auto& buffer : active) {
+        buffer->End();
+    }
+    if (!active.empty()) {
+        ExecuteCommandBuffers(active);
+    }
+    _parallelCount = 0;
+
+    _commandBuffers[_frameIndex]->Continue();
+}
+
+NullBuffer::Ptr NullRenderContext::CreateBuffer(uint64_t size, uint64_t stride, BufferType type, bool readback, const std::string& name)
+{
+    return std::make_shared<NullBuffer>(_shaderHeap, size, stride, type, readback, name);
+}
+
+NullTexture::Ptr NullRenderContext::CreateTexture(uint32_t width, uint32_t height, uint32_t bytesPerPixel, TextureUsage usage, bool mips, const std::string& name)
+{
+    return std::make_shared<NullTexture>(_shaderHeap, width, height, bytesPerPixel, usage, mips, name);
+}
+
+NullPipeline::Ptr NullRenderContext::CreateGraphicsPipeline(const std::string& name)
+{
+    return std::make_shared<NullPipeline>(NullPipeline{ StreamPipeline::Graphics, name });
+}
+
+NullPipeline::Ptr NullRenderContext::CreateComputePipeline(const std::string& name)
+{
+    return std::make_shared<NullPipeline>(NullPipeline{ StreamPipeline::Compute, name });
+}
+
+NullPipeline::Ptr NullRenderContext::CreateMeshPipeline(const std::string& name)
+{
+    return std::make_shared<NullPipeline>(NullPipeline{ StreamPipeline::Mesh, name });
+}
+
+NullCommandBuffer::Ptr NullRenderContext::CreateCommandBuffer()
+{
+    return std::make_shared<NullCommandBuffer>(_validate);
+}
+
+void NullRenderContext::Benchmark(uint32_t drawCount, uint32_t threads, uint32_t frames)
+{
+    const uint32_t width = 1920;
+    const uint32_t height = 1080;
+    NullRenderContext context(width, height);
+
+    std::vector<NullTexture::Ptr> gbuffer;
+    for (const char *name : { "Normals", "Albedo Emission", "PBR Data", "Emissive", "Velocity" }) {
+        gbuffer.push_back(context.CreateTexture(width, height, 8, TextureUsage::RenderTarget, false, name));
+        gbuffer.back()->BuildRenderTarget();
+        gbuffer.back()->BuildShaderResource();
+    }
+    NullTexture::Ptr depth = context.CreateTexture(width, height, 4, TextureUsage::DepthTarget, false, "Depth");
+    depth->BuildDepthTarget();
+    depth->BuildShaderResource();
+    NullTexture::Ptr output = context.CreateTexture(width, height, 8, TextureUsage::Storage, false, "Lit Output");
+    output->BuildStorage();
+
+    NullPipeline::Ptr gbufferPipeline = context.CreateMeshPipeline("GBuffer");
+    NullPipeline::Ptr lightingPipeline = context.CreateComputePipeline("Lighting");
+
+    // One constant buffer per draw and frame in flight, written every frame like the model buffers
+    struct Draw
+    {
+        NullBuffer::Ptr Constants[NULL_FRAMES_IN_FLIGHT];
+    };
+    std::vector<Draw> draws(drawCount);
+    for (uint32_t i = 0; i < drawCount; i++) {
+        for (auto& buffer : draws[i].Constants) {
+            buffer = context.CreateBuffer(512, 0, BufferType::Constant, false, "Model Buffer " + std::to_string(i));
+            buffer->BuildConstantBuffer();
+        }
+    }
+
+    threads = std::max(std::min(threads, drawCount), 1u);
+    auto record = [&](NullCommandBuffer::Ptr commandBuffer, uint32_t first, uint32_t last) {
+        uint32_t frameIndex = context.GetBackBufferIndex();
+        commandBuffer->BeginEvent("GBuffer Draws");
+        commandBuffer->SetViewport(0, 0, float(width), float(height));
+        commandBuffer->SetTopology(Topology::TriangleList);
+        commandBuffer->BindRenderTargets(gbuffer, depth);
+        commandBuffer->BindMeshPipeline(gbufferPipeline);
+        for (uint32_t draw = first; draw < last; draw++) {
+            NullBuffer::Ptr constants = draws[draw].Constants[frameIndex];
+            void *data;
+            constants->Map(0, 0, &data);
+            memset(data, int(draw), 256);
+            constants->Unmap(0, 0);
+
+            struct {
+                uint32_t Constants;
+                uint32_t Textures[5];
+                uint32_t Pad[2];
+            } push = { constants->CBV(), { draw, draw + 1, draw + 2, draw + 3, draw + 4 }, {} };
+            commandBuffer->PushConstantsGraphics(&push, sizeof(push), 0);
+            commandBuffer->DispatchMesh(64, 1, 1);
+        }
+        commandBuffer->EndEvent();
+    };
+
+    std::vector<float> times;
+    for (uint32_t frame = 0; frame < frames; frame++) {
+        Timer timer;
+        NullCommandBuffer::Ptr commandBuffer = context.GetCurrentCommandBuffer();
+        commandBuffer->Begin();
+
+        commandBuffer->BeginEvent("GBuffer");
+        commandBuffer->ImageBarrier(depth, TextureLayout::Depth);
+        for (auto& target : gbuffer) {
+            commandBuffer->ImageBarrier(target, TextureLayout::RenderTarget);
+        }
+        commandBuffer->ClearDepthTarget(depth);
+        for (auto& target : gbuffer) {
+            commandBuffer->ClearRenderTarget(target, 0.0f, 0.0f, 0.0f, 1.0f);
+        }
+        commandBuffer->EndEvent();
+        if (threads == 1) {
+            record(commandBuffer, 0, drawCount);
+        } else {
+            std::vector<NullCommandBuffer::Ptr> buffers = context.BeginParallel(threads);
+            JobSystem::ParallelFor(threads, [&](uint32_t thread) {
+                record(buffers[thread], drawCount * thread / threads, drawCount * (thread + 1) / threads);
+            });
+            context.EndParallel();
+        }
+
+        commandBuffer->BeginEvent("Lighting");
+        for (auto& target : gbuffer) {
+            commandBuffer->ImageBarrier(target, TextureLayout::ShaderResource);
+        }
+        commandBuffer->ImageBarrier(depth, TextureLayout::ShaderResource);
+        commandBuffer->ImageBarrier(output, TextureLayout::Storage);
+        commandBuffer->BindComputePipeline(lightingPipeline);
+        uint32_t views[8] = { gbuffer[0]->SRV(), gbuffer[1]->SRV(), gbuffer[2]->SRV(), gbuffer[3]->SRV(), gbuffer[4]->SRV(), depth->SRV(), output->UAV(), 0 };
+        commandBuffer->PushConstantsCompute(views, sizeof(views), 0);
+        commandBuffer->Dispatch((width + 7) / 8, (height + 7) / 8, 1);
+        commandBuffer->EndEvent();
+
+        NullTexture::Ptr backBuffer = context.GetBackBuffer();
+        commandBuffer->ImageBarrier(output, TextureLayout::CopySource);
+        commandBuffer->ImageBarrier(backBuffer, TextureLayout::CopyDest);
+        commandBuffer->CopyTextureToTexture(backBuffer, output);
+        commandBuffer->ImageBarrier(backBuffer, TextureLayout::Present);
+
+        commandBuffer->End();
+        context.ExecuteCommandBuffers({ commandBuffer });
+        context.Present(false);
+        context.Finish();
+        times.push_back(timer.GetElapsed());
+    }
+
+    std::sort(times.begin(), times.end());
+    float median = times.empty() ? 0.0f : times[times.size() / 2];
+    const NullContextStats& stats = context.GetStats();
+    Logger::Info("[RHI] Null frame loop: %u draws on %u threads, %.3fms per frame (median of %u), %.1fns per draw, %llu commands, %.2f MB of streams, %llu validation errors",
+                 drawCount,
+                 threads,
+                 median,
+                 frames,
+                 drawCount ? median * 1e6f / drawCount : 0.0f,
+                 (unsigned long long)stats.Commands,
+                 stats.StreamBytes / (1024.0 * 1024.0),
+                 (unsigned long long)stats.ValidationErrors);
+}
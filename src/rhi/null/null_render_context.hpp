@@ -0,0 +1,108 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 22:11:45
+//
+
+#pragma once
+
+#include "null_command_buffer.hpp"
+#include "null_descriptor_heap.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// Same as FRAMES_IN_FLIGHT, which lives with the swap chain
+#define NULL_FRAMES_IN_FLIGHT 3
+#define NULL_SHADER_HEAP_SIZE 1'000'000
+
+struct NullContextStats
+{
+    uint64_t Frames;
+    uint64_t SubmittedBuffers;
+    uint64_t Commands;
+    uint64_t Draws; // Dispatches of every kind included
+    uint64_t StreamBytes;
+    uint64_t ValidationErrors;
+};
+
+// RHI backend without a GPU, for running the CPU side of frames headless on any platform: resources live in host
+// memory, command buffers only record and validate streams, and the GPU finishes every submission as it is made. It
+// has the calls of RenderContext, minus what only makes sense with a device (swap chain, samplers, raytracing, ImGui).
+// Building with ONI_RHI_NULL makes it the RenderContext, see the end of this file.
+class NullRenderContext
+{
+public:
+    using Ptr = std::shared_ptr<NullRenderContext>;
+
+    NullRenderContext(uint32_t width, uint32_t height, bool validate = true);
+    ~NullRenderContext();
+
+    void Resize(uint32_t width, uint32_t height);
+
+    void Present(bool vsync);
+    void Finish();
+
+    void WaitForGPU() {}
+    // There is a single queue, nothing runs on it anyway
+    void ExecuteCommandBuffers(const std::vector<NullCommandBuffer::Ptr>& buffers);
+
+    NullCommandBuffer::Ptr GetCurrentCommandBuffer() { return _commandBuffers[_frameIndex]; }
+
+    // Same rules as RenderContext: what the frame command buffer holds is submitted, every thread gets a buffer of its
+    // own, and EndParallel submits them in order before the frame command buffer records again
+    std::vector<NullCommandBuffer::Ptr> BeginParallel(uint32_t count);
+    void EndParallel();
+    NullTexture::Ptr GetBackBuffer() { return _backBuffers[_frameIndex]; }
+    uint32_t GetBackBufferIndex() { return _frameIndex; }
+
+    NullBuffer::Ptr CreateBuffer(uint64_t size, uint64_t stride, BufferType type, bool readback, const std::string& name = "Buffer");
+    NullTexture::Ptr CreateTexture(uint32_t width, uint32_t height, uint32_t bytesPerPixel, TextureUsage usage, bool mips, const std::string& name = "Texture");
+
+    NullPipeline::Ptr CreateGraphicsPipeline(const std::string& name = "Graphics Pipeline");
+    NullPipeline::Ptr CreateComputePipeline(const std::string& name = "Compute Pipeline");
+    NullPipeline::Ptr CreateMeshPipeline(const std::string& name = "Mesh Pipeline");
+
+    NullCommandBuffer::Ptr CreateCommandBuffer();
+
+    NullDescriptorHeap::Ptr GetShaderHeap() { return _shaderHeap; }
+    // Since the context was created
+    const NullContextStats& GetStats() { return _stats; }
+
+    // Runs frames shaped like the deferred renderer's (a GBuffer pass recorded over threads, a lighting dispatch and a
+    // copy to the back buffer) and logs the CPU time of each frame
+    static void Benchmark(uint32_t drawCount, uint32_t threads, uint32_t frames);
+private:
+    void CreateBackBuffers();
+
+    uint32_t _width;
+    uint32_t _height;
+    bool _validate;
+
+    NullDescriptorHeap::Ptr _shaderHeap;
+
+    uint32_t _frameIndex = 0;
+    uint64_t _frameValues[NULL_FRAMES_IN_FLIGHT] = {};
+    NullTexture::Ptr _backBuffers[NULL_FRAMES_IN_FLIGHT];
+    NullCommandBuffer::Ptr _commandBuffers[NULL_FRAMES_IN_FLIGHT];
+    std::vector<NullCommandBuffer::Ptr> _parallelBuffers[NULL_FRAMES_IN_FLIGHT]; // Grown on demand
+    uint32_t _parallelCount = 0;
+
+    NullContextStats _stats = {};
+};
+
+// The backend is picked at build time: with ONI_RHI_NULL, rhi/render_context.hpp brings this file in instead of the
+// D3D12 one and code written against RenderContext records through the null backend
+#if defined(ONI_RHI_NULL)
+using RenderContext = NullRenderContext;
+using CommandBuffer = NullCommandBuffer;
+using Texture = NullTexture;
+using Buffer = NullBuffer;
+using Barrier = NullBarrier;
+using GraphicsPipeline = NullPipeline;
+using ComputePipeline = NullPipeline;
+using MeshPipeline = NullPipeline;
+
+#define FRAMES_IN_FLIGHT NULL_FRAMES_IN_FLIGHT
+#endif
@@ -0,0 +1,87 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 21:53:40
+//
+
+#include "null_texture.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+#undef min
+#undef max
+
+NullTexture::NullTexture(NullDescriptorHeap::Ptr heap, uint32_t width, uint32_t height, uint32_t bytesPerPixel, TextureUsage usage, bool mips, const std::string& name)
+    : _heap(heap), _name(name), _bytesPerPixel(bytesPerPixel), _width(width), _height(height)
+{
+    _mipLevels = mips ? int(floor(log2(std::max(std::max(width, height), 1u)))) + 1 : 1;
+
+    // Same starting layouts as Texture
+    TextureLayout state = TextureLayout::Common;
+    switch (usage) {
+        case TextureUsage::RenderTarget: state = TextureLayout::RenderTarget; break;
+        case TextureUsage::DepthTarget: state = TextureLayout::Depth; break;
+        case TextureUsage::Storage: state = TextureLayout::Storage; break;
+        case TextureUsage::ShaderResource: state = TextureLayout::ShaderResource; break;
+        case TextureUsage::Copy: state = TextureLayout::CopyDest; break;
+        default: break;
+    }
+    _states.resize(_mipLevels, state);
+
+    for (int mip = 0; mip < _mipLevels; mip++) {
+        _mipOffsets.push_back(_size);
+        _size += GetMipSize(mip);
+    }
+    _memory.reset(new uint8_t[_size ? _size : 1]());
+}
+
+NullTexture::~NullTexture()
+{
+    for (uint32_t srv : _srvs) {
+        _heap->Free(srv);
+    }
+    for (uint32_t uav : _uavs) {
+        _heap->Free(uav);
+    }
+}
+
+void NullTexture::BuildShaderResource()
+{
+    // One view per mip, like Texture, so that passes can read a single mip
+    if (_srvs.empty()) {
+        for (int mip = 0; mip < _mipLevels; mip++) {
+            _srvs.push_back(_heap->Allocate());
+        }
+    }
+}
+
+void NullTexture::BuildStorage()
+{
+    if (_uavs.empty()) {
+        for (int mip = 0; mip < _mipLevels; mip++) {
+            _uavs.push_back(_heap->Allocate());
+        }
+    }
+}
+
+void NullTexture::SetState(TextureLayout state, int mip)
+{
+    if (mip == SUBRESOURCE_ALL) {
+        std::fill(_states.begin(), _states.end(), state);
+    } else {
+        _states[mip] = state;
+    }
+}
+
+TextureLayout NullTexture::GetState(int mip)
+{
+    return _states[mip == SUBRESOURCE_ALL ? 0 : mip];
+}
+
+uint64_t NullTexture::GetMipSize(uint32_t mip)
+{
+    uint64_t width = std::max(uint32_t(_width) >> mip, 1u);
+    uint64_t height = std::max(uint32_t(_height) >> mip, 1u);
+    return width * height * _bytesPerPixel;
+}
@@ -0,0 +1,69 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 21:50:24
+//
+
+#pragma once
+
+#include "rhi/resource_types.hpp"
+
+#include "null_descriptor_heap.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+// Texture of the null backend: its mip chain in host memory, one layout per mip like Texture. Formats are only a pixel
+// size here, as TextureFormat is made of DXGI values.
+class NullTexture
+{
+public:
+    using Ptr = std::shared_ptr<NullTexture>;
+
+    NullTexture(NullDescriptorHeap::Ptr heap, uint32_t width, uint32_t height, uint32_t bytesPerPixel, TextureUsage usage, bool mips, const std::string& name = "Texture");
+    ~NullTexture();
+
+    // Render and depth targets have no heap of their own, building them only marks the texture as bindable
+    void BuildRenderTarget() { _renderTarget = true; }
+    void BuildDepthTarget() { _depthTarget = true; }
+    void BuildShaderResource();
+    void BuildStorage();
+
+    void SetState(TextureLayout state, int mip);
+    TextureLayout GetState(int mip);
+
+    int GetWidth() { return _width; }
+    int GetHeight() { return _height; }
+    int GetMips() { return _mipLevels; }
+    uint32_t GetBytesPerPixel() { return _bytesPerPixel; }
+    bool IsRenderTarget() { return _renderTarget; }
+    bool IsDepthTarget() { return _depthTarget; }
+    const std::string& GetName() { return _name; }
+
+    uint32_t SRV(uint32_t mip = 0) { return _srvs.empty() ? DESCRIPTOR_INVALID : _srvs[mip]; }
+    uint32_t UAV(uint32_t mip = 0) { return _uavs.empty() ? DESCRIPTOR_INVALID : _uavs[mip]; }
+
+    // Mips are tightly packed one after the other
+    uint8_t *GetData(uint32_t mip = 0) { return _memory.get() + _mipOffsets[mip]; }
+    uint64_t GetMipSize(uint32_t mip);
+    uint64_t GetSize() { return _size; }
+private:
+    NullDescriptorHeap::Ptr _heap;
+    std::string _name;
+
+    std::vector<uint32_t> _srvs;
+    std::vector<uint32_t> _uavs;
+    std::vector<TextureLayout> _states;
+    bool _renderTarget = false;
+    bool _depthTarget = false;
+
+    std::vector<uint64_t> _mipOffsets;
+    uint64_t _size = 0;
+    std::unique_ptr<uint8_t[]> _memory;
+
+    uint32_t _bytesPerPixel;
+    int _width;
+    int _height;
+    int _mipLevels;
+};
@@ -25,8 +25,8 @@ static float normalize(float value, float old_min, float old_max, float new_min,
     return (new_max - new_min) * (value - old_min) / (old_max - old_min) + new_min;
 }
 
-RenderContext::RenderContext(std::shared_ptr<Window> hwnd)
-    : _window(hwnd)
+RenderContext::RenderContext(std::shared_ptr<Window> hwnd, CommandRecording recording)
+    : _window(hwnd), _recording(recording)
 {
     _device = std::make_shared<Device>();
 
@@ -36,7 +36,7 @@ RenderContext::RenderContext(std::shared_ptr<Window> hwnd)
 
     _heaps.RTVHeap = std::make_shared<DescriptorHeap>(_device, DescriptorHeapType::RenderTarget, 1024);
     _heaps.DSVHeap = std::make_shared<DescriptorHeap>(_device, DescriptorHeapType::DepthTarget, 1024);
-    _heaps.ShaderHeap = std::make_shared<DescriptorHeap>(_device, DescriptorHeapType::ShaderResource, 1'000'000);
+    _heaps.ShaderHeap = std::make_shared<DescriptorHeap>(_device, DescriptorHeapType::ShaderResource, 1'000'000, DESCRIPTOR_TRANSIENT_PER_FRAME, FRAMES_IN_FLIGHT);
     _heaps.SamplerHeap = std::make_shared<DescriptorHeap>(_device, DescriptorHeapType::Sampler, 512);
 
     _allocator = std::make_shared<Allocator>(_device);
@@ -53,6 +53,7 @@ RenderContext::RenderContext(std::shared_ptr<Window> hwnd)
 
     for (int i = 0; i < FRAMES_IN_FLIGHT; i++) {
         _commandBuffers[i] = std::make_shared<CommandBuffer>(_device, _allocator, _heaps, CommandQueueType::Graphics);
+        _commandBuffers[i]->SetRecording(_recording);
         _frameValues[i] = 0;
     }
 
@@ -98,6 +99,7 @@ RenderContext::RenderContext(std::shared_ptr<Window> hwnd)
 RenderContext::~RenderContext()
 {
     WaitForGPU();
+    EndCapture();
 
     ImGui_ImplDX12_Shutdown();
     ImGui_ImplWin32_Shutdown();
@@ -127,11 +129,58 @@ void RenderContext::Finish()
     }
 
     _frameValues[_frameIndex] = currentFenceValue + 1;
+
+    uint64_t completed = _graphicsFence.Fence->CompletedValue();
+    for (auto& heap : { _heaps.RTVHeap, _heaps.DSVHeap, _heaps.ShaderHeap, _heaps.SamplerHeap }) {
+        heap->BeginFrame(_frameIndex, completed, _frameValues[_frameIndex]);
+    }
+
+    CommandBuffer::EndFrame();
 }
 
 void RenderContext::Present(bool vsync)
 {
     _swapChain->Present(vsync);
+
+    if (_capture && !_capture->EndFrame()) {
+        EndCapture();
+    }
+}
+
+void RenderContext::BeginCapture(const std::string& path, uint32_t frames)
+{
+    if (_capture) {
+        Logger::Warn("[CAPTURE] Already capturing, ignoring %s", path.c_str());
+        return;
+    }
+    _capture = std::make_shared<CommandCapture>(path, frames);
+    if (!_capture->IsOpen()) {
+        _capture.reset();
+        return;
+    }
+    for (int i = 0; i < FRAMES_IN_FLIGHT; i++) {
+        _commandBuffers[i]->SetRecording(GetActiveRecording());
+    }
+}
+
+void RenderContext::EndCapture()
+{
+    if (!_capture) {
+        return;
+    }
+    _capture->Close();
+    _capture.reset();
+    for (int i = 0; i < FRAMES_IN_FLIGHT; i++) {
+        _commandBuffers[i]->SetRecording(_recording);
+    }
+}
+
+CommandRecording RenderContext::GetActiveRecording()
+{
+    if (_capture && _recording == CommandRecording::Off) {
+        return CommandRecording::Record;
+    }
+    return _recording;
 }
 
 void RenderContext::WaitForGPU()
@@ -139,10 +188,24 @@ void RenderContext::WaitForGPU()
     _graphicsQueue->Signal(_graphicsFence.Fence, _frameValues[_frameIndex]);
     _graphicsFence.Fence->Wait(_frameValues[_frameIndex], 10'000'000);
     _frameValues[_frameIndex]++;
+
+    // Anything freed so far can go, what gets recorded next is only done at the new value
+    uint64_t completed = _graphicsFence.Fence->CompletedValue();
+    for (auto& heap : { _heaps.RTVHeap, _heaps.DSVHeap, _heaps.ShaderHeap, _heaps.SamplerHeap }) {
+        heap->Retire(completed, _frameValues[_frameIndex]);
+    }
 }
 
 void RenderContext::ExecuteCommandBuffers(const std::vector<CommandBuffer::Ptr>& buffers, CommandQueueType type)
 {
+    if (_capture) {
+        for (auto& buffer : buffers) {
+            if (buffer->GetStream()) {
+                _capture->AddStream(*buffer->GetStream());
+            }
+        }
+    }
+
     switch (type) {
         case CommandQueueType::Graphics: {
             _graphicsQueue->Submit(buffers);
@@ -164,6 +227,47 @@ CommandBuffer::Ptr RenderContext::GetCurrentCommandBuffer()
     return _commandBuffers[_frameIndex];
 }
 
+std::vector<CommandBuffer::Ptr> RenderContext::BeginParallel(uint32_t count)
+{
+    if (_parallelCount) {
+        Logger::Error("[RHI] BeginParallel called twice without EndParallel");
+        return {};
+    }
+
+    CommandBuffer::Ptr frame = _commandBuffers[_frameIndex];
+    frame->End();
+    ExecuteCommandBuffers({ frame }, CommandQueueType::Graphics);
+
+    // Finish waited on this frame's fence, nothing the GPU reads comes from these allocators anymore
+    std::vector<CommandBuffer::Ptr>& buffers = _parallelBuffers[_frameIndex];
+    while (buffers.size() < count) {
+        buffers.push_back(std::make_shared<CommandBuffer>(_device, _allocator, _heaps, CommandQueueType::Graphics));
+    }
+
+    std::vector<CommandBuffer::Ptr> active(buffers.begin(), buffers.begin() + count);
+    for (auto& buffer : active) {
+        buffer->SetRecording(GetActiveRecording());
+        buffer->Begin();
+    }
+    _parallelCount = count;
+    return active;
+}
+
+void RenderContext::EndParallel()
+{
+    std::vector<CommandBuffer::Ptr>& buffers = _parallelBuffers[_frameIndex];
+    std::vector<CommandBuffer::Ptr> active(buffers.begin(), buffers.begin() + _parallelCount);
+    for (auto& buffer : active) {
+        buffer->End();
+    }
+    if (!active.empty()) {
+        ExecuteCommandBuffers(active, CommandQueueType::Graphics);
+    }
+    _parallelCount = 0;
+
+    _commandBuffers[_frameIndex]->Continue();
+}
+
 Texture::Ptr RenderContext::GetBackBuffer()
 {
     return _swapChain->GetTexture(_frameIndex);
@@ -222,7 +326,9 @@ CubeMap::Ptr RenderContext::CreateCubeMap(uint32_t width, uint32_t height, Textu
 
 CommandBuffer::Ptr RenderContext::CreateCommandBuffer(CommandQueueType type, bool close)
 {
-    return std::make_shared<CommandBuffer>(_device, _allocator, _heaps, type, close);
+    CommandBuffer::Ptr commandBuffer = std::make_shared<CommandBuffer>(_device, _allocator, _heaps, type, close);
+    commandBuffer->SetRecording(GetActiveRecording());
+    return commandBuffer;
 }
 
 BLAS::Ptr RenderContext::CreateBLAS(Buffer::Ptr vertexBuffer, Buffer::Ptr indexBuffer, int vertexCount, int indexCount, const std::string& name)
@@ -283,7 +389,7 @@ void RenderContext::FlushUploader(Uploader& uploader, CommandBuffer::Ptr cmdBuf)
             }
             case Uploader::UploadCommandType::HostToDeviceCompressedTexture: {
                 cmdBuf->ImageBarrier(command.destTexture, TextureLayout::CopyDest);
-                cmdBuf->CopyTextureFileToTexture(command.destTexture, command.sourceBuffer, command.textureFile);
+                cmdBuf->CopyTextureFileToTexture(command.destTexture, command.sourceBuffer, command.firstMip, command.mipCount);
                 cmdBuf->ImageBarrier(command.destTexture, TextureLayout::ShaderResource);
                 break;
             }
@@ -339,7 +445,7 @@ void RenderContext::FlushUploader(Uploader& uploader)
             }
             case Uploader::UploadCommandType::HostToDeviceCompressedTexture: {
                 cmdBuf->ImageBarrier(command.destTexture, TextureLayout::CopyDest);
-                cmdBuf->CopyTextureFileToTexture(command.destTexture, command.sourceBuffer, command.textureFile);
+                cmdBuf->CopyTextureFileToTexture(command.destTexture, command.sourceBuffer, command.firstMip, command.mipCount);
                 cmdBuf->ImageBarrier(command.destTexture, TextureLayout::ShaderResource);
                 break;
             }
@@ -450,6 +556,18 @@ RootSignature::Ptr RenderContext::CreateDefaultRootSignature(uint32_t pushConsta
 void RenderContext::OnGUI()
 {
     _allocator->OnGUI();
+    CommandBuffer::OnGUI();
+
+    ImGui::Begin("Descriptor Heaps");
+    for (auto& heap : { _heaps.RTVHeap, _heaps.DSVHeap, _heaps.ShaderHeap, _heaps.SamplerHeap }) {
+        DescriptorAllocatorStats stats = heap->GetStats();
+        ImGui::Text("%s", heap->GetTypeName());
+        ImGui::Text("    %u/%u allocated (peak %u), %u waiting on the GPU", stats.Allocated, stats.Capacity, stats.Peak, stats.PendingFrees);
+        if (stats.TransientPerFrame) {
+            ImGui::Text("    Transient: %u/%u per frame", stats.TransientUsed, stats.TransientPerFrame);
+        }
+    }
+    ImGui::End();
 }
 
 void RenderContext::OnOverlay()
@@ -5,6 +5,10 @@
 
 #pragma once
 
+#if defined(ONI_RHI_NULL)
+#include "rhi/null/null_render_context.hpp"
+#else
+
 #include <unordered_map>
 
 #include "core/window.hpp"
@@ -18,6 +22,7 @@
 #include "rhi/texture.hpp"
 #include "rhi/buffer.hpp"
 #include "rhi/command_buffer.hpp"
+#include "rhi/command_capture.hpp"
 #include "rhi/graphics_pipeline.hpp"
 #include "rhi/compute_pipeline.hpp"
 #include "rhi/mesh_pipeline.hpp"
@@ -40,7 +45,8 @@ class RenderContext
 public:
     using Ptr = std::shared_ptr<RenderContext>;
 
-    RenderContext(std::shared_ptr<Window> hwnd);
+    // Recording applies to the frame command buffers and every one made with CreateCommandBuffer
+    RenderContext(std::shared_ptr<Window> hwnd, CommandRecording recording = CommandRecording::Off);
     ~RenderContext();
 
     std::shared_ptr<Window> GetWindow() { return _window; }
@@ -54,6 +60,12 @@ public:
     void ExecuteCommandBuffers(const std::vector<CommandBuffer::Ptr>& buffers, CommandQueueType type);
 
     CommandBuffer::Ptr GetCurrentCommandBuffer();
+
+    // Lets several threads record the next part of the frame. What the frame command buffer holds so far is submitted,
+    // and each thread gets a command buffer of its own for the frame, with its own allocator. EndParallel submits them in
+    // order, after which the frame command buffer records again.
+    std::vector<CommandBuffer::Ptr> BeginParallel(uint32_t count);
+    void EndParallel();
     Texture::Ptr GetBackBuffer();
     uint32_t GetBackBufferIndex() { return _frameIndex; }
 
@@ -88,11 +100,22 @@ public:
     void OnOverlay();
 
     Device::Ptr GetDevice() { return _device; }
+    Allocator::Ptr GetAllocator() { return _allocator; }
+    CommandRecording GetRecording() { return _recording; }
+
+    // Writes the command streams of everything submitted over the next frames, recording them if they weren't already.
+    // Ends on its own after the given number of frames.
+    void BeginCapture(const std::string& path, uint32_t frames);
+    void EndCapture();
+    bool IsCapturing() { return _capture != nullptr; }
 private:
     void SetStyle();
+    CommandRecording GetActiveRecording();
 
     Device::Ptr _device;
     std::shared_ptr<Window> _window;
+    CommandRecording _recording;
+    CommandCapture::Ptr _capture;
     
     CommandQueue::Ptr _graphicsQueue;
     FencePair _graphicsFence;
@@ -111,6 +134,8 @@ private:
     uint32_t _frameIndex = 0;
     uint64_t _frameValues[FRAMES_IN_FLIGHT];
     CommandBuffer::Ptr _commandBuffers[FRAMES_IN_FLIGHT];
+    std::vector<CommandBuffer::Ptr> _parallelBuffers[FRAMES_IN_FLIGHT]; // Grown on demand
+    uint32_t _parallelCount = 0;
 
     DescriptorHeap::Descriptor _fontDescriptor;
 
@@ -120,3 +145,5 @@ private:
 
     std::vector<Sampler::Ptr> _samplerCache;
 };
+
+#endif
@@ -0,0 +1,59 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 21:36:52
+//
+
+#pragma once
+
+#include <cstdint>
+
+// Doesn't include anything from D3D12, so that the null backend takes the same enums as the D3D12 one. Values that
+// D3D12 casts to are spelled out, texture.hpp and command_buffer.hpp check that they still match.
+
+#define SUBRESOURCE_ALL 999
+
+enum class BufferType
+{
+    Vertex,
+    Index,
+    Constant,
+    Storage,
+    Copy,
+    AccelerationStructure
+};
+
+// D3D12_RESOURCE_STATES
+enum class TextureLayout
+{
+    Common = 0x0,
+    ShaderResource = 0x40 | 0x80,
+    Storage = 0x8,
+    Depth = 0x10,
+    RenderTarget = 0x4,
+    CopySource = 0x800,
+    CopyDest = 0x400,
+    Present = 0x0,
+    DataRead = 0x1 | 0x2 | 0x40 | 0x80 | 0x200 | 0x800,
+    DataWrite = 0x0
+};
+
+enum class TextureUsage
+{
+    Copy,
+    RenderTarget,
+    DepthTarget,
+    Storage,
+    ShaderResource,
+    RenderStorage
+};
+
+// D3D_PRIMITIVE_TOPOLOGY
+enum class Topology
+{
+    LineList = 2,
+    LineStrip = 3,
+    PointList = 1,
+    TriangleList = 4,
+    TriangleStrip = 5
+};
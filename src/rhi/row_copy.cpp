@@ -0,0 +1,123 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 23:51:40
+//
+
+#include "row_copy.hpp"
+
+#include <core/log.hpp>
+#include <core/timer.hpp>
+#include <core/job_system.hpp>
+
+#include <algorithm>
+#include <cstring>
+
+#undef min
+#undef max
+
+void RowCopier::Copy(uint8_t *staging, const RowCopy& copy, uint32_t firstRow, uint32_t lastRow)
+{
+    uint8_t *dst = staging + copy.Dest + copy.RowPitch * firstRow;
+    const uint8_t *src = copy.Source + copy.RowSize * firstRow;
+
+    // Tightly packed rows can go out in a single memcpy
+    if (copy.RowSize == copy.RowPitch) {
+        memcpy(dst, src, copy.RowSize * (lastRow - firstRow));
+        return;
+    }
+    for (uint32_t row = firstRow; row < lastRow; row++) {
+        memcpy(dst, src, copy.RowSize);
+        dst += copy.RowPitch;
+        src += copy.RowSize;
+    }
+}
+
+void RowCopier::CopyParallel(uint8_t *staging, const std::vector<RowCopy>& copies)
+{
+    uint32_t workerCount = JobSystem::GetThreadCount();
+
+    // Cut every mip into row ranges of roughly equal size so that the workers don't wait on the biggest mip.
+    struct Job
+    {
+        const RowCopy *Copy;
+        uint32_t FirstRow;
+        uint32_t LastRow;
+    };
+    std::vector<Job> jobs;
+    for (auto& copy : copies) {
+        uint64_t rowsPerJob = std::max<uint64_t>(PARALLEL_COPY_THRESHOLD / (workerCount * copy.RowSize), 1);
+        for (uint32_t row = 0; row < copy.RowCount; row += rowsPerJob) {
+            jobs.push_back({ &copy, row, uint32_t(std::min<uint64_t>(row + rowsPerJob, copy.RowCount)) });
+        }
+    }
+
+    JobSystem::ParallelFor(uint32_t(jobs.size()), [&](uint32_t job) {
+        Copy(staging, *jobs[job].Copy, jobs[job].FirstRow, jobs[job].LastRow);
+    });
+}
+
+void RowCopier::Benchmark(uint32_t size, uint32_t iterations)
+{
+    // BC7: 16 bytes per 4x4 block, rows of blocks. Sizes that aren't a multiple of 64 get padded rows in the staging buffer.
+    std::vector<uint32_t> mips;
+    for (uint32_t mip = size; mip > 1; mip /= 2) {
+        mips.push_back(mip);
+    }
+    mips.push_back(1);
+
+    uint64_t sourceSize = 0;
+    uint64_t stagingSize = 0;
+    for (uint32_t mip : mips) {
+        uint64_t rowSize = uint64_t((mip + 3) / 4) * 16;
+        uint64_t rowPitch = (rowSize + ROW_PITCH_ALIGNMENT - 1) / ROW_PITCH_ALIGNMENT * ROW_PITCH_ALIGNMENT;
+        sourceSize += rowSize * ((mip + 3) / 4);
+        stagingSize += (rowPitch * ((mip + 3) / 4) + 511) / 512 * 512; // D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT
+    }
+
+    std::vector<uint8_t> source(sourceSize);
+    std::vector<uint8_t> staging(stagingSize);
+    for (uint64_t i = 0; i < sourceSize; i++) {
+        source[i] = uint8_t(i * 31 + 7);
+    }
+
+    std::vector<RowCopy> copies;
+    const uint8_t *pixels = source.data();
+    uint64_t dest = 0;
+    for (uint32_t mip : mips) {
+        RowCopy copy;
+        copy.Dest = dest;
+        copy.Source = pixels;
+        copy.RowSize = uint64_t((mip + 3) / 4) * 16;
+        copy.RowPitch = (copy.RowSize + ROW_PITCH_ALIGNMENT - 1) / ROW_PITCH_ALIGNMENT * ROW_PITCH_ALIGNMENT;
+        copy.RowCount = (mip + 3) / 4;
+        copies.push_back(copy);
+
+        pixels += copy.RowSize * copy.RowCount;
+        dest += (copy.RowPitch * copy.RowCount + 511) / 512 * 512;
+    }
+
+    Timer timer;
+    for (uint32_t i = 0; i < iterations; i++) {
+        for (auto& copy : copies) {
+            Copy(staging.data(), copy, 0, copy.RowCount);
+        }
+    }
+    float serialTime = timer.GetElapsed();
+
+    timer.Restart();
+    for (uint32_t i = 0; i < iterations; i++) {
+        CopyParallel(staging.data(), copies);
+    }
+    float parallelTime = timer.GetElapsed();
+
+    float gigabytes = float(sourceSize) * iterations / (1024.0f * 1024.0f * 1024.0f);
+    Logger::Info("[UPLOADER] %ux%u BC7 mip chain (%.2f MB): %.2fms per GB on one thread, %.2fms per GB on %u threads (%.1fx)",
+                 size,
+                 size,
+                 sourceSize / (1024.0f * 1024.0f),
+                 serialTime / gigabytes,
+                 parallelTime / gigabytes,
+                 JobSystem::GetThreadCount(),
+                 parallelTime > 0.0f ? serialTime / parallelTime : 0.0f);
+}
@@ -0,0 +1,39 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 23:48:26
+//
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Doesn't include anything from D3D12, so that texture copies can be checked and benchmarked on any platform
+
+// Textures above this size get their rows copied to the staging buffer by several threads
+#define PARALLEL_COPY_THRESHOLD (4 * 1024 * 1024)
+// D3D12_TEXTURE_DATA_PITCH_ALIGNMENT
+#define ROW_PITCH_ALIGNMENT 256
+
+// Rows of a tightly packed mip going to a staging buffer whose rows are RowPitch apart
+struct RowCopy
+{
+    uint64_t Dest;
+    const uint8_t *Source;
+    uint64_t RowSize;
+    uint64_t RowPitch;
+    uint32_t RowCount;
+};
+
+class RowCopier
+{
+public:
+    static void Copy(uint8_t *staging, const RowCopy& copy, uint32_t firstRow, uint32_t lastRow);
+    // Cuts the copies into row ranges and spreads them over the job system
+    static void CopyParallel(uint8_t *staging, const std::vector<RowCopy>& copies);
+
+    // Copies the mip chain of a BC7 texture of the given size to a staging buffer laid out like D3D12 would, on one
+    // thread and on the job system. Logs the time per GB of both.
+    static void Benchmark(uint32_t size, uint32_t iterations);
+};
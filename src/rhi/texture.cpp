@@ -189,6 +189,7 @@ void Texture::BuildShaderResource(TextureFormat specificFormat)
         ShaderResourceView.Texture2D.MostDetailedMip = 0;
 
         _devicePtr->GetDevice()->CreateShaderResourceView(_resource->Resource, &ShaderResourceView, firstMip.CPU);
+        _srvFormat = ShaderResourceView.Format;
 
         _srvs.push_back(firstMip);
     }
@@ -211,6 +212,50 @@ void Texture::BuildShaderResource(TextureFormat specificFormat)
     }
 }
 
+Texture::Retired Texture::ReplaceResource(GPUResource *resource, uint32_t residentMip)
+{
+    Retired retired;
+    retired.Resource = _resource;
+    retired.SRVs = std::move(_srvs);
+    retired.Heaps = _heaps;
+    _srvs.clear();
+
+    D3D12_RESOURCE_DESC desc = resource->Resource->GetDesc();
+
+    _resource = resource;
+    _resource->AttachTexture(this);
+    _residentMip = residentMip;
+    _width = desc.Width;
+    _height = desc.Height;
+    _mipLevels = desc.MipLevels;
+
+    _mipSizes.clear();
+    for (int level = 0, size = _width; level < _mipLevels; ++level, size /= 2) {
+        _mipSizes.push_back(size);
+    }
+    _states.resize(_mipLevels);
+    std::fill(_states.begin(), _states.end(), D3D12_RESOURCE_STATE_COPY_DEST);
+
+    if (!retired.SRVs.empty()) {
+        BuildShaderResource(TextureFormat(_srvFormat));
+    }
+    return retired;
+}
+
+void Texture::Retired::Release()
+{
+    for (auto& srv : SRVs) {
+        if (srv.Valid) {
+            Heaps.ShaderHeap->Free(srv);
+        }
+    }
+    if (Resource) {
+        Resource->Allocation->Release();
+        Resource->ClearFromAllocationList();
+        delete Resource;
+    }
+}
+
 void Texture::BuildStorage(TextureFormat specificFormat)
 {
     for (int i = 0; i < _mipLevels; i++) {
@@ -8,6 +8,7 @@
 #include "device.hpp"
 #include "descriptor_heap.hpp"
 #include "allocator.hpp"
+#include "resource_types.hpp"
 
 enum class TextureFormat
 {
@@ -26,35 +27,31 @@ enum class TextureFormat
     R32Typeless = DXGI_FORMAT_R32_TYPELESS // For shadows!
 };
 
-enum class TextureLayout
-{
-    Common = D3D12_RESOURCE_STATE_COMMON,
-    ShaderResource = D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE,
-    Storage = D3D12_RESOURCE_STATE_UNORDERED_ACCESS,
-    Depth = D3D12_RESOURCE_STATE_DEPTH_WRITE,
-    RenderTarget = D3D12_RESOURCE_STATE_RENDER_TARGET,
-    CopySource = D3D12_RESOURCE_STATE_COPY_SOURCE,
-    CopyDest = D3D12_RESOURCE_STATE_COPY_DEST,
-    Present = D3D12_RESOURCE_STATE_PRESENT,
-    DataRead = D3D12_RESOURCE_STATE_GENERIC_READ,
-    DataWrite = D3D12_RESOURCE_STATE_COMMON
-};
-
-enum class TextureUsage
-{
-    Copy,
-    RenderTarget,
-    DepthTarget,
-    Storage,
-    ShaderResource,
-    RenderStorage
-};
+static_assert(int(TextureLayout::Common) == D3D12_RESOURCE_STATE_COMMON, "TextureLayout doesn't match D3D12");
+static_assert(int(TextureLayout::ShaderResource) == D3D12_RESOURCE_STATE_ALL_SHADER_RESOURCE, "TextureLayout doesn't match D3D12");
+static_assert(int(TextureLayout::Storage) == D3D12_RESOURCE_STATE_UNORDERED_ACCESS, "TextureLayout doesn't match D3D12");
+static_assert(int(TextureLayout::Depth) == D3D12_RESOURCE_STATE_DEPTH_WRITE, "TextureLayout doesn't match D3D12");
+static_assert(int(TextureLayout::RenderTarget) == D3D12_RESOURCE_STATE_RENDER_TARGET, "TextureLayout doesn't match D3D12");
+static_assert(int(TextureLayout::CopySource) == D3D12_RESOURCE_STATE_COPY_SOURCE, "TextureLayout doesn't match D3D12");
+static_assert(int(TextureLayout::CopyDest) == D3D12_RESOURCE_STATE_COPY_DEST, "TextureLayout doesn't match D3D12");
+static_assert(int(TextureLayout::Present) == D3D12_RESOURCE_STATE_PRESENT, "TextureLayout doesn't match D3D12");
+static_assert(int(TextureLayout::DataRead) == D3D12_RESOURCE_STATE_GENERIC_READ, "TextureLayout doesn't match D3D12");
 
 class Texture
 {
 public:
     using Ptr = std::shared_ptr<Texture>;
 
+    // What is left of a resource after ReplaceResource, to be released once the GPU is done with it
+    struct Retired
+    {
+        GPUResource *Resource = nullptr;
+        std::vector<DescriptorHeap::Descriptor> SRVs;
+        DescriptorHeap::Heaps Heaps;
+
+        void Release();
+    };
+
     Texture(Device::Ptr devicePtr, const std::string& name = "Texture");
     Texture(Device::Ptr devicePtr, Allocator::Ptr allocator, DescriptorHeap::Heaps& heaps, uint32_t width, uint32_t height, TextureFormat format, TextureUsage usage, bool mips, const std::string& name = "Texture");
     ~Texture();
@@ -82,6 +79,12 @@ public:
     uint32_t UAV(uint32_t mip = 0) { return _uavs[mip].HeapIndex; }
     
     int GetSizeOfMip(uint32_t mip) { return _mipSizes[mip]; }
+
+    // Streamed textures only hold the mips from the resident mip of their full chain down.
+    // Swapping the resource allocates new shader resource views, since in flight frames still read the old ones.
+    Retired ReplaceResource(GPUResource *resource, uint32_t residentMip);
+    void SetResidentMip(uint32_t mip) { _residentMip = mip; }
+    uint32_t GetResidentMip() { return _residentMip; }
 private:
     friend class SwapChain;
     friend class CommandBuffer;
@@ -103,6 +106,8 @@ private:
     std::vector<D3D12_RESOURCE_STATES> _states;
 
     TextureFormat _format;
+    DXGI_FORMAT _srvFormat = DXGI_FORMAT_UNKNOWN;
+    uint32_t _residentMip = 0;
     int _width;
     int _height;
     int _mipLevels;
@@ -6,6 +6,15 @@
 #include "uploader.hpp"
 
 #include "core/log.hpp"
+#include "core/timer.hpp"
+
+#include <algorithm>
+
+#undef min
+#undef max
+
+Uploader::Stats Uploader::_stats;
+std::mutex Uploader::_statsLock;
 
 Uploader::Uploader(Device::Ptr device, Allocator::Ptr allocator, DescriptorHeap::Heaps& heaps)
     : _devicePtr(device), _allocator(allocator), _heaps(heaps)
@@ -80,43 +89,74 @@ void Uploader::CopyHostToDeviceTexture(Bitmap& image, Texture::Ptr pDestTexture)
     }
 }
 
-void Uploader::CopyHostToDeviceCompressedTexture(TextureFile *file, Texture::Ptr pDestTexture)
+void Uploader::CopyHostToDeviceCompressedTexture(TextureFile *file, Texture::Ptr pDestTexture, uint32_t firstMip, uint32_t mipCount)
 {
-    uint32_t numMips = file->MipCount();
-    
+    mipCount = std::min(mipCount, file->MipCount() - firstMip);
+
     D3D12_RESOURCE_DESC desc = pDestTexture->GetResource().Resource->GetDesc();
 
-    std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> footprints(numMips);
-    std::vector<uint32_t> numRows(numMips);
-    std::vector<uint64_t> rowSizes(numMips);
+    UploadCommand command;
+    command.type = UploadCommandType::HostToDeviceCompressedTexture;
+    command.firstMip = firstMip - (file->MipCount() - desc.MipLevels);
+    command.mipCount = mipCount;
+    command.destTexture = pDestTexture;
+    command.sourceBuffer = StageCompressedTexture(file, desc, firstMip, mipCount);
+
+    _commands.push_back(command);
+}
+
+Buffer::Ptr Uploader::StageCompressedTexture(TextureFile *file, const D3D12_RESOURCE_DESC& desc, uint32_t firstMip, uint32_t mipCount)
+{
+    Timer timer;
+
+    uint32_t firstSubresource = firstMip - (file->MipCount() - desc.MipLevels);
+
+    std::vector<D3D12_PLACED_SUBRESOURCE_FOOTPRINT> footprints(mipCount);
+    std::vector<uint32_t> numRows(mipCount);
+    std::vector<uint64_t> rowSizes(mipCount);
     uint64_t totalSize = 0;
 
-    _devicePtr->GetDevice()->GetCopyableFootprints(&desc, 0, numMips, 0, footprints.data(), numRows.data(), rowSizes.data(), &totalSize);
+    _devicePtr->GetDevice()->GetCopyableFootprints(&desc, firstSubresource, mipCount, 0, footprints.data(), numRows.data(), rowSizes.data(), &totalSize);
 
     Buffer::Ptr buf = std::make_shared<Buffer>(_devicePtr, _allocator, _heaps, totalSize, 0, BufferType::Copy, false, "Staging Buffer");
     
-    uint8_t *pixels = reinterpret_cast<uint8_t*>(file->GetMipChainStart());
+    const uint8_t *pixels = reinterpret_cast<uint8_t*>(file->GetMipChainStart()) + file->GetMipOffset(firstMip);
     uint8_t *pData;
 
-    buf->Map(0, 0, reinterpret_cast<void**>(&pData));
-    memset(pData, 0, totalSize);
-    for (int i = 0; i < numMips; i++) {
-        for (int j = 0; j < numRows[i]; j++) {
-            memcpy(pData, pixels, rowSizes[i]);
+    // Build the list of row spans to copy. The padding between rows is never read by the GPU, so there is no need to clear it.
+    std::vector<RowCopy> copies;
+    uint64_t bytesCopied = 0;
+    for (uint32_t i = 0; i < mipCount; i++) {
+        RowCopy copy;
+        copy.Dest = footprints[i].Offset;
+        copy.Source = pixels;
+        copy.RowSize = rowSizes[i];
+        copy.RowPitch = footprints[i].Footprint.RowPitch;
+        copy.RowCount = numRows[i];
+        copies.push_back(copy);
+
+        pixels += rowSizes[i] * numRows[i];
+        bytesCopied += rowSizes[i] * numRows[i];
+    }
 
-            pData += footprints[i].Footprint.RowPitch;
-            pixels += rowSizes[i];
+    buf->Map(0, 0, reinterpret_cast<void**>(&pData));
+    if (bytesCopied >= PARALLEL_COPY_THRESHOLD) {
+        RowCopier::CopyParallel(pData, copies);
+    } else {
+        for (auto& copy : copies) {
+            RowCopier::Copy(pData, copy, 0, copy.RowCount);
         }
     }
     buf->Unmap(0, 0);
 
-    UploadCommand command;
-    command.type = UploadCommandType::HostToDeviceCompressedTexture;
-    command.textureFile = file;
-    command.destTexture = pDestTexture;
-    command.sourceBuffer = buf;
+    {
+        std::lock_guard<std::mutex> lock(_statsLock);
+        _stats.TextureBytesCopied += bytesCopied;
+        _stats.TextureCopyTime += timer.GetElapsed();
+        _stats.TexturesCopied++;
+    }
 
-    _commands.push_back(command);
+    return buf;
 }
 
 void Uploader::CopyBufferToBuffer(Buffer::Ptr pSourceBuffer, Buffer::Ptr pDestBuffer)
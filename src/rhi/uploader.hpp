@@ -5,11 +5,13 @@
 
 #pragma once
 
+#include <mutex>
 #include <vector>
 
 #include "command_queue.hpp"
 #include "command_buffer.hpp"
 #include "device.hpp"
+#include "row_copy.hpp"
 
 #include "raytracing/blas.hpp"
 #include "raytracing/tlas.hpp"
@@ -20,13 +22,20 @@
 class Uploader
 {
 public:
+    struct Stats
+    {
+        uint64_t TextureBytesCopied = 0;
+        float TextureCopyTime = 0.0f; // In milliseconds
+        uint32_t TexturesCopied = 0;
+    };
+
     Uploader(Device::Ptr device, Allocator::Ptr allocator, DescriptorHeap::Heaps& heaps);
     ~Uploader();
 
     void CopyHostToDeviceShared(void* pData, uint64_t uiSize, Buffer::Ptr pDestBuffer);
     void CopyHostToDeviceLocal(void* pData, uint64_t uiSize, Buffer::Ptr pDestBuffer);
     void CopyHostToDeviceTexture(Bitmap& image, Texture::Ptr pDestTexture);
-    void CopyHostToDeviceCompressedTexture(TextureFile *file, Texture::Ptr pDestTexture);
+    void CopyHostToDeviceCompressedTexture(TextureFile *file, Texture::Ptr pDestTexture, uint32_t firstMip = 0, uint32_t mipCount = UINT32_MAX);
     void CopyBufferToBuffer(Buffer::Ptr pSourceBuffer, Buffer::Ptr pDestBuffer);
     void CopyTextureToTexture(Texture::Ptr pSourceTexture, Texture::Ptr pDestTexture);
     void CopyBufferToTexture(Buffer::Ptr pSourceBuffer, Texture::Ptr pDestTexture);
@@ -34,6 +43,13 @@ public:
     
     void BuildBLAS(BLAS::Ptr blas);
     void BuildTLAS(TLAS::Ptr tlas);
+
+    // Copies the given mips of a cooked texture into a new staging buffer laid out for CommandBuffer::CopyTextureFileToTexture.
+    // The destination may only hold the bottom of the mip chain: its first mip is the file's (MipCount - desc.MipLevels).
+    // Does not record any command, so it is safe to call from worker threads.
+    Buffer::Ptr StageCompressedTexture(TextureFile *file, const D3D12_RESOURCE_DESC& desc, uint32_t firstMip, uint32_t mipCount);
+
+    static Stats& GetStats() { return _stats; }
 private:
     friend class RenderContext;
 
@@ -63,7 +79,8 @@ private:
         void* data;
         uint64_t size;
 
-        TextureFile *textureFile;
+        uint32_t firstMip;
+        uint32_t mipCount;
 
         Texture::Ptr sourceTexture;
         Texture::Ptr destTexture;
@@ -75,4 +92,7 @@ private:
         TLAS::Ptr tlas;
     };
     std::vector<UploadCommand> _commands;
+
+    static Stats _stats;
+    static std::mutex _statsLock;
 };
@@ -0,0 +1,196 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 23:12:40
+//
+
+#include "test.hpp"
+
+#include "renderer/aliasing_planner.hpp"
+
+#include <string>
+
+#define MB (1024ull * 1024)
+
+static AliasingRequest MakeRequest(uint64_t size, uint32_t first, uint32_t last, uint64_t alignment = ALIASING_DEFAULT_ALIGNMENT)
+{
+    AliasingRequest request;
+    request.Size = size;
+    request.Alignment = alignment;
+    request.First = first;
+    request.Last = last;
+    return request;
+}
+
+static bool RangesOverlap(const AliasingRequest& a, const AliasingPlacement& pa, const AliasingRequest& b, const AliasingPlacement& pb)
+{
+    return pa.Heap == pb.Heap && pa.Offset < pb.Offset + b.Size && pb.Offset < pa.Offset + a.Size;
+}
+
+TEST(AliasingEmpty)
+{
+    std::vector<AliasingRequest> requests;
+    AliasingPlan plan = AliasingPlanner::Plan(requests);
+
+    CHECK(plan.Placements.empty());
+    CHECK(plan.Heaps.empty());
+    CHECK(plan.DedicatedSize == 0);
+    CHECK(plan.AliasedSize == 0);
+    CHECK(AliasingPlanner::Validate(requests, plan));
+}
+
+TEST(AliasingDisjointLifetimes)
+{
+    // One after the other, they can all take the same memory
+    std::vector<AliasingRequest> requests = {
+        MakeRequest(8 * MB, 0, 1),
+        MakeRequest(8 * MB, 2, 3),
+        MakeRequest(4 * MB, 4, 6)
+    };
+    AliasingPlan plan = AliasingPlanner::Plan(requests);
+
+    CHECK(AliasingPlanner::Validate(requests, plan));
+    CHECK(plan.Heaps.size() == 1);
+    for (const AliasingPlacement& placement : plan.Placements) {
+        CHECK(placement.Heap == 0);
+        CHECK(placement.Offset == 0);
+    }
+    CHECK(plan.DedicatedSize == 20 * MB);
+    CHECK(plan.AliasedSize == 8 * MB);
+}
+
+TEST(AliasingOverlappingLifetimes)
+{
+    std::vector<AliasingRequest> requests = {
+        MakeRequest(8 * MB, 0, 4),
+        MakeRequest(4 * MB, 2, 6),
+        MakeRequest(2 * MB, 3, 3),
+        MakeRequest(8 * MB, 5, 8) // Only overlaps the second one
+    };
+    AliasingPlan plan = AliasingPlanner::Plan(requests);
+
+    std::string error;
+    CHECK(AliasingPlanner::Validate(requests, plan, &error));
+    CHECK(error.empty());
+    for (uint32_t i = 0; i < requests.size(); i++) {
+        for (uint32_t j = i + 1; j < requests.size(); j++) {
+            bool alive = requests[i].First <= requests[j].Last && requests[j].First <= requests[i].Last;
+            if (alive) {
+                CHECK(!RangesOverlap(requests[i], plan.Placements[i], requests[j], plan.Placements[j]));
+            }
+        }
+    }
+    CHECK(plan.AliasedSize == 14 * MB);
+    CHECK(plan.AliasedSize < plan.DedicatedSize);
+
+    // Moving the last one onto the second one is caught
+    AliasingPlan broken = plan;
+    broken.Placements[3] = broken.Placements[1];
+    CHECK(!AliasingPlanner::Validate(requests, broken, &error));
+    CHECK(!error.empty());
+}
+
+TEST(AliasingAlignment)
+{
+    const uint64_t alignment = 4 * MB;
+    std::vector<AliasingRequest> requests = {
+        MakeRequest(MB + 7, 0, 3),
+        MakeRequest(3 * MB, 1, 2, alignment),
+        MakeRequest(65 * 1024, 2, 4),
+        MakeRequest(5 * MB, 2, 2, alignment)
+    };
+    AliasingPlan plan = AliasingPlanner::Plan(requests);
+
+    CHECK(AliasingPlanner::Validate(requests, plan));
+    for (uint32_t i = 0; i < requests.size(); i++) {
+        CHECK(plan.Placements[i].Offset % requests[i].Alignment == 0);
+    }
+    for (const AliasingHeap& heap : plan.Heaps) {
+        CHECK(heap.Size % ALIASING_DEFAULT_ALIGNMENT == 0);
+    }
+
+    // Misaligned placements are caught
+    AliasingPlan broken = plan;
+    broken.Placements[1].Offset += ALIASING_DEFAULT_ALIGNMENT;
+    CHECK(!AliasingPlanner::Validate(requests, broken));
+
+    CHECK(AliasingPlanner::EstimateTextureSize(1920, 1080, 4, 1) % ALIASING_DEFAULT_ALIGNMENT == 0);
+    CHECK(AliasingPlanner::EstimateTextureSize(1920, 1080, 4, 1) >= 1920ull * 1080 * 4);
+    CHECK(AliasingPlanner::EstimateTextureSize(1024, 1024, 4, 11) > AliasingPlanner::EstimateTextureSize(1024, 1024, 4, 1));
+}
+
+TEST(AliasingHeapCap)
+{
+    // Over the cap, each of them needs a heap of its own
+    std::vector<AliasingRequest> requests = {
+        MakeRequest(ALIASING_MAX_HEAP_SIZE + MB, 0, 2),
+        MakeRequest(300 * MB, 1, 3),
+        MakeRequest(16 * MB, 1, 1),
+        MakeRequest(16 * MB, 2, 2)
+    };
+    AliasingPlan plan = AliasingPlanner::Plan(requests);
+
+    CHECK(AliasingPlanner::Validate(requests, plan));
+    CHECK(plan.Placements[0].Offset == 0);
+    CHECK(plan.Placements[1].Offset == 0);
+    CHECK(plan.Placements[0].Heap != plan.Placements[1].Heap);
+    CHECK(plan.Heaps[plan.Placements[0].Heap].Size >= requests[0].Size);
+    CHECK(plan.Heaps[plan.Placements[1].Heap].Size >= requests[1].Size);
+
+    // Under it, heaps never grow past the cap
+    const uint64_t cap = 16 * MB;
+    std::vector<AliasingRequest> small;
+    for (uint32_t i = 0; i < 6; i++) {
+        small.push_back(MakeRequest(6 * MB, 0, 1));
+    }
+    AliasingPlan capped = AliasingPlanner::Plan(small, cap);
+
+    CHECK(AliasingPlanner::Validate(small, capped));
+    CHECK(capped.Heaps.size() == 3);
+    for (const AliasingHeap& heap : capped.Heaps) {
+        CHECK(heap.Size <= cap);
+    }
+}
+
+TEST(AliasingSyntheticFrame)
+{
+    RenderGraph graph;
+    AliasingPlanner::BuildSyntheticFrame(graph, 1920, 1080);
+    graph.Compile();
+
+    std::vector<uint32_t> resources;
+    std::vector<AliasingRequest> requests = AliasingPlanner::GatherRequests(graph, [](uint32_t format) { return format; }, resources);
+    AliasingPlan plan = AliasingPlanner::Plan(requests);
+
+    // Every described texture, the backbuffer and LDR have no description
+    CHECK(requests.size() == 10);
+    CHECK(resources.size() == requests.size());
+    CHECK(AliasingPlanner::Validate(requests, plan));
+    CHECK(plan.AliasedSize < plan.DedicatedSize);
+
+    std::vector<uint32_t> again;
+    AliasingPlan replanned = AliasingPlanner::Plan(AliasingPlanner::GatherRequests(graph, [](uint32_t format) { return format; }, again));
+    CHECK(again == resources);
+    CHECK(replanned.AliasedSize == plan.AliasedSize);
+    for (uint32_t i = 0; i < plan.Placements.size(); i++) {
+        CHECK(replanned.Placements[i].Heap == plan.Placements[i].Heap);
+        CHECK(replanned.Placements[i].Offset == plan.Placements[i].Offset);
+    }
+
+    // Bigger frames only ever need more memory
+    uint64_t previous = 0;
+    for (const AliasingResolution& resolution : AliasingPlanner::GetReportResolutions()) {
+        AliasingPlanner::BuildSyntheticFrame(graph, resolution.Width, resolution.Height);
+        graph.Compile();
+        AliasingPlan sized = AliasingPlanner::Plan(AliasingPlanner::GatherRequests(graph, [](uint32_t format) { return format; }, again));
+        CHECK(sized.DedicatedSize > previous);
+        previous = sized.DedicatedSize;
+    }
+}
+
+BENCHMARK(AliasingPlanner)
+{
+    AliasingPlanner::Benchmark(32, 10000);
+    AliasingPlanner::Benchmark(256, 100);
+    AliasingPlanner::ReportSyntheticFrame();
+}
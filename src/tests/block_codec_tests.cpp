@@ -0,0 +1,62 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 20:31:15
+//
+
+#include "test.hpp"
+
+#include "core/block_codec.hpp"
+
+#include <random>
+
+static bool RoundTrip(const std::vector<uint8_t>& data, uint32_t chunkSize, bool parallel)
+{
+    std::vector<uint8_t> compressed;
+    BlockCodec::CompressChunked(data.data(), data.size(), compressed, chunkSize);
+    if (BlockCodec::GetChunkedRawSize(compressed.data(), compressed.size()) != data.size()) {
+        return false;
+    }
+
+    std::vector<uint8_t> decompressed(data.size());
+    if (!BlockCodec::DecompressChunked(compressed.data(), compressed.size(), decompressed.data(), parallel)) {
+        return false;
+    }
+    return decompressed == data;
+}
+
+TEST(BlockCodecRoundTrip)
+{
+    std::mt19937 random(42);
+
+    // Repetitive data compresses, noise gets stored as is, and the last chunk is a partial one
+    std::vector<uint8_t> mixed(100000);
+    for (size_t i = 0; i < mixed.size(); i++) {
+        mixed[i] = i < 60000 ? uint8_t((i / 16) % 7) : uint8_t(random());
+    }
+    CHECK(RoundTrip(mixed, 4096, true));
+    CHECK(RoundTrip(mixed, 4096, false));
+    CHECK(RoundTrip(mixed, BLOCK_CODEC_CHUNK_SIZE, true));
+
+    CHECK(RoundTrip(std::vector<uint8_t>(1, 0x55), 4096, true));
+}
+
+TEST(BlockCodecEmpty)
+{
+    std::vector<uint8_t> compressed;
+    BlockCodec::CompressChunked(nullptr, 0, compressed);
+    CHECK(BlockCodec::GetChunkedRawSize(compressed.data(), compressed.size()) == 0);
+    CHECK(BlockCodec::DecompressChunked(compressed.data(), compressed.size(), nullptr));
+    CHECK(BlockCodec::DecompressChunked(compressed.data(), compressed.size(), nullptr, false));
+}
+
+TEST(BlockCodecMalformed)
+{
+    std::vector<uint8_t> data(20000, 3);
+    std::vector<uint8_t> compressed;
+    BlockCodec::CompressChunked(data.data(), data.size(), compressed, 4096);
+
+    std::vector<uint8_t> out(data.size());
+    CHECK(!BlockCodec::DecompressChunked(compressed.data(), sizeof(BlockCodec::ChunkedHeader) - 1, out.data()));
+    CHECK(!BlockCodec::DecompressChunked(compressed.data(), compressed.size() - 1, out.data()));
+}
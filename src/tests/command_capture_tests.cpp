@@ -0,0 +1,120 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-19 00:14:37
+//
+
+#include "test.hpp"
+
+#include "core/file_system.hpp"
+#include "rhi/command_capture.hpp"
+
+#include <cstdio>
+#include <fstream>
+#include <iterator>
+#include <random>
+
+#define TEST_CAPTURE_PATH ".cache/tests/commands.capture"
+#define TEST_CAPTURE_DAMAGED_PATH ".cache/tests/damaged.capture"
+
+static std::vector<uint8_t> WriteTestCapture()
+{
+    for (const char *directory : { ".cache/", ".cache/tests/" }) {
+        if (!FileSystem::Exists(directory)) {
+            FileSystem::CreateDirectoryFromPath(directory);
+        }
+    }
+
+    CommandStream stream;
+    stream.NameResource(0x1000, "Target");
+    {
+        CommandCapture capture(TEST_CAPTURE_PATH, 2);
+        for (uint32_t frame = 0; frame < 2; frame++) {
+            stream.Reset();
+            stream.Push(StreamCommand::BeginEvent, StreamEvent{ stream.InternString("Frame " + std::to_string(frame)) });
+            stream.Push(StreamCommand::Barrier, StreamBarrier{ 0x1000, STREAM_SUBRESOURCE_ALL, 0x0, 0x4, 0 });
+            uint32_t constants[4] = { 1, 2, 3, 4 };
+            stream.Push(StreamCommand::PushConstants, StreamPushConstants{ 0, sizeof(constants), StreamBindPoint::Graphics }, constants, sizeof(constants));
+            stream.Push(StreamCommand::Draw, StreamDraw{ 3 });
+            stream.Push(StreamCommand::EndEvent);
+            capture.AddStream(stream);
+            capture.EndFrame();
+        }
+    }
+
+    std::ifstream file(TEST_CAPTURE_PATH, std::ios::binary);
+    return std::vector<uint8_t>(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+}
+
+static bool LoadDamaged(const std::vector<uint8_t>& bytes, CaptureData& capture)
+{
+    {
+        std::ofstream file(TEST_CAPTURE_DAMAGED_PATH, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    }
+    return CommandCapture::Load(TEST_CAPTURE_DAMAGED_PATH, capture);
+}
+
+TEST(CaptureRoundTrip)
+{
+    WriteTestCapture();
+
+    CaptureData capture;
+    CHECK(CommandCapture::Load(TEST_CAPTURE_PATH, capture));
+    CHECK(capture.Frames.size() == 2);
+    CHECK(capture.GetName(0x1000) == "Target");
+    for (auto& frame : capture.Frames) {
+        CHECK(frame.Streams.size() == 1);
+        CHECK(frame.Streams[0].Commands.GetCommandCount() == 5);
+        CHECK(frame.Streams[0].Commands.GetCount(StreamCommand::PushConstants) == 1);
+    }
+    CHECK(capture.Frames[1].Streams[0].Commands.GetString(1) == "Frame 1");
+
+    CHECK(std::remove(TEST_CAPTURE_PATH) == 0);
+}
+
+TEST(CaptureTruncated)
+{
+    std::vector<uint8_t> bytes = WriteTestCapture();
+
+    // Every cut but the ones between chunks fails, and none of them reads past what is there
+    uint32_t loaded = 0;
+    for (size_t size = 0; size < bytes.size(); size++) {
+        CaptureData capture;
+        if (LoadDamaged(std::vector<uint8_t>(bytes.begin(), bytes.begin() + size), capture)) {
+            loaded++;
+        } else {
+            CHECK(capture.Frames.empty());
+        }
+    }
+    CHECK(loaded > 0 && loaded < 16);
+
+    CHECK(std::remove(TEST_CAPTURE_PATH) == 0);
+    CHECK(std::remove(TEST_CAPTURE_DAMAGED_PATH) == 0);
+}
+
+TEST(CaptureCorrupt)
+{
+    std::vector<uint8_t> bytes = WriteTestCapture();
+
+    // Random bytes overwritten past the file header. Whatever loads has to be walkable.
+    std::mt19937 random(99);
+    for (uint32_t i = 0; i < 2000; i++) {
+        std::vector<uint8_t> damaged = bytes;
+        for (uint32_t j = 0; j < 1 + i % 4; j++) {
+            damaged[sizeof(CaptureHeader) + random() % (damaged.size() - sizeof(CaptureHeader))] = uint8_t(random());
+        }
+
+        CaptureData capture;
+        if (LoadDamaged(damaged, capture)) {
+            for (auto& frame : capture.Frames) {
+                for (auto& stream : frame.Streams) {
+                    stream.Commands.Validate();
+                }
+            }
+        }
+    }
+
+    CHECK(std::remove(TEST_CAPTURE_PATH) == 0);
+    CHECK(std::remove(TEST_CAPTURE_DAMAGED_PATH) == 0);
+}
@@ -0,0 +1,152 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 23:31:18
+//
+
+#include "test.hpp"
+
+#include "rhi/descriptor_allocator.hpp"
+
+#include <algorithm>
+#include <random>
+
+TEST(DescriptorAllocatorPacking)
+{
+    // Not a multiple of 64, the last word is partly outside the heap
+    const uint32_t size = 200;
+    DescriptorAllocator allocator(size);
+    for (uint32_t i = 0; i < size; i++) {
+        CHECK(allocator.Allocate() == i);
+    }
+    CHECK(allocator.Allocate() == DESCRIPTOR_INVALID);
+
+    DescriptorAllocatorStats stats = allocator.GetStats();
+    CHECK(stats.Capacity == size);
+    CHECK(stats.Allocated == size);
+    CHECK(stats.Peak == size);
+
+    // The lowest free slot always goes first
+    allocator.FreeNow(130);
+    allocator.FreeNow(5);
+    allocator.FreeNow(64);
+    CHECK(!allocator.IsAllocated(5));
+    CHECK(allocator.Allocate() == 5);
+    CHECK(allocator.Allocate() == 64);
+    CHECK(allocator.Allocate() == 130);
+    CHECK(allocator.Allocate() == DESCRIPTOR_INVALID);
+
+    // Double frees and slots past the end are refused
+    allocator.FreeNow(10);
+    allocator.FreeNow(10);
+    allocator.FreeNow(size);
+    CHECK(allocator.GetStats().Allocated == size - 1);
+    CHECK(allocator.GetStats().Peak == size);
+}
+
+TEST(DescriptorAllocatorDeferredFrees)
+{
+    DescriptorAllocator allocator(128);
+    uint32_t a = allocator.Allocate();
+    uint32_t b = allocator.Allocate();
+    uint32_t c = allocator.Allocate();
+
+    allocator.Free(a, 1);
+    allocator.Free(b, 2);
+    allocator.Free(c, 2);
+    CHECK(allocator.GetStats().PendingFrees == 3);
+
+    // Still in use by the GPU, nothing is handed out twice
+    uint32_t d = allocator.Allocate();
+    CHECK(d != a && d != b && d != c);
+
+    allocator.Retire(0);
+    CHECK(allocator.IsAllocated(a));
+    allocator.Retire(1);
+    CHECK(!allocator.IsAllocated(a));
+    CHECK(allocator.IsAllocated(b));
+    CHECK(allocator.GetStats().PendingFrees == 2);
+    allocator.Retire(5);
+    CHECK(!allocator.IsAllocated(b));
+    CHECK(!allocator.IsAllocated(c));
+    CHECK(allocator.GetStats().PendingFrees == 0);
+    CHECK(allocator.GetStats().Allocated == 1);
+    CHECK(allocator.Allocate() == a);
+}
+
+TEST(DescriptorAllocatorRandom)
+{
+    // Against a plain set of taken slots
+    const uint32_t size = 4096 + 17;
+    DescriptorAllocator allocator(size);
+    std::vector<bool> taken(size, false);
+    std::vector<uint32_t> live;
+    std::mt19937 random(42);
+
+    for (uint32_t i = 0; i < 50000; i++) {
+        if (live.empty() || (random() % 3 != 0 && live.size() < size)) {
+            uint32_t expected = uint32_t(std::find(taken.begin(), taken.end(), false) - taken.begin());
+            uint32_t index = allocator.Allocate();
+            CHECK(index == expected);
+            taken[index] = true;
+            live.push_back(index);
+        } else {
+            uint32_t pick = random() % live.size();
+            allocator.FreeNow(live[pick]);
+            taken[live[pick]] = false;
+            live[pick] = live.back();
+            live.pop_back();
+        }
+    }
+    CHECK(allocator.GetStats().Allocated == live.size());
+    for (uint32_t index : live) {
+        CHECK(allocator.IsAllocated(index));
+    }
+}
+
+TEST(DescriptorAllocatorTransient)
+{
+    // 100 slots one by one, then three frames of 8
+    const uint32_t size = 124;
+    DescriptorAllocator allocator(size, 8, 3);
+    CHECK(allocator.GetStats().Capacity == 100);
+    CHECK(allocator.GetStats().TransientPerFrame == 8);
+
+    // Every frame has its own range past the slots, handed out front to back
+    for (uint32_t frame = 0; frame < 3; frame++) {
+        CHECK(allocator.AllocateTransient(frame, 3) == 100 + frame * 8);
+        CHECK(allocator.AllocateTransient(frame) == 100 + frame * 8 + 3);
+        CHECK(allocator.AllocateTransient(frame, 4) == 100 + frame * 8 + 4);
+        CHECK(allocator.AllocateTransient(frame) == DESCRIPTOR_INVALID);
+    }
+    CHECK(allocator.GetStats().TransientUsed == 8);
+    CHECK(allocator.AllocateTransient(3) == DESCRIPTOR_INVALID);
+    CHECK(allocator.AllocateTransient(0, 0xFFFFFFFF) == DESCRIPTOR_INVALID);
+
+    // The bitset never hands out a transient slot
+    for (uint32_t i = 0; i < 100; i++) {
+        CHECK(allocator.Allocate() == i);
+    }
+    CHECK(allocator.Allocate() == DESCRIPTOR_INVALID);
+    CHECK(!allocator.IsAllocated(100));
+
+    // Resetting a frame only gives its own range back, and leaves the slots alone
+    allocator.ResetTransient(1);
+    CHECK(allocator.AllocateTransient(1, 8) == 108);
+    CHECK(allocator.AllocateTransient(0) == DESCRIPTOR_INVALID);
+    CHECK(allocator.AllocateTransient(2) == DESCRIPTOR_INVALID);
+    CHECK(allocator.GetStats().Allocated == 100);
+
+    // Ranges that don't fit are dropped rather than eating the slots
+    DescriptorAllocator tooSmall(16, 8, 3);
+    CHECK(tooSmall.GetStats().Capacity == 16);
+    CHECK(tooSmall.AllocateTransient(0) == DESCRIPTOR_INVALID);
+}
+
+BENCHMARK(DescriptorAllocator)
+{
+    DescriptorAllocator::Benchmark(1'000'000, 0.9f, 1'000'000);
+    DescriptorAllocator::Benchmark(1'000'000, 0.99f, 1'000'000);
+    DescriptorAllocator::Benchmark(1'000'000, 0.999f, 1'000'000);
+    DescriptorAllocator::Benchmark(1024, 0.99f, 1'000'000);
+}
@@ -0,0 +1,152 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 20:52:36
+//
+
+#include "test.hpp"
+
+#include "core/file_system.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#define TEST_PAK_DIRECTORY ".cache/tests/pak/"
+#define TEST_PAK_CORRUPT_DIRECTORY ".cache/tests/pak_corrupt/"
+
+static void WriteText(const std::string& path, const std::string& text)
+{
+    std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+    stream << text;
+}
+
+static std::string MapText(const std::string& path)
+{
+    FileView view = FileSystem::Map(path);
+    if (!view.IsValid()) {
+        return "";
+    }
+    return std::string(reinterpret_cast<const char*>(view.GetData()), view.GetSize());
+}
+
+TEST(PakShadowing)
+{
+    for (const char *directory : { ".cache/", ".cache/tests/", TEST_PAK_DIRECTORY }) {
+        if (!FileSystem::Exists(directory)) {
+            FileSystem::CreateDirectoryFromPath(directory);
+        }
+    }
+    std::string written = TEST_PAK_DIRECTORY "written.bin";
+    std::string packed = TEST_PAK_DIRECTORY "packed.bin";
+    WriteText(written, "old");
+    WriteText(packed, "packed");
+
+    std::string pakPath = ".cache/tests/shadow.pak";
+    CHECK(PakFile::Build(pakPath, { { TEST_PAK_DIRECTORY, {} } }));
+    PakFile::Ptr pak = std::make_shared<PakFile>(pakPath);
+    CHECK(pak->IsOpen());
+    FileSystem::MountPak(pak);
+
+    // A cooker rewrites one file, the other only lives in the pak from now on
+    WriteText(written, "new!");
+    FileSystem::Delete(packed);
+    CHECK(MapText(written) == "old");
+
+    FileSystem::ShadowPak("./" + written);
+    CHECK(FileSystem::GetShadowedCount() == 1);
+    CHECK(MapText(written) == "new!");
+    CHECK(FileSystem::GetFileSize(written) == 4);
+    CHECK(FileSystem::ReadFile(written) == "new!");
+
+    CHECK(FileSystem::Exists(packed));
+    CHECK(MapText(packed) == "packed");
+
+    FileSystem::MountPak(nullptr);
+    CHECK(FileSystem::GetShadowedCount() == 0);
+    CHECK(!FileSystem::Exists(packed));
+}
+
+static bool OpensAsPak(const std::string& path, const std::vector<uint8_t>& bytes)
+{
+    {
+        std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+        stream.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    }
+    PakFile pak(path);
+    if (!pak.IsOpen()) {
+        return false;
+    }
+    // Whatever opens has every entry inside the file
+    for (const char *name : { "a.bin", "b.bin", "c.bin" }) {
+        if (const PakEntry *entry = pak.Find(TEST_PAK_CORRUPT_DIRECTORY + std::string(name))) {
+            CHECK(entry->Offset + entry->Size <= pak.GetSize());
+        }
+    }
+    return true;
+}
+
+TEST(PakCorruptEntries)
+{
+    for (const char *directory : { ".cache/", ".cache/tests/", TEST_PAK_CORRUPT_DIRECTORY }) {
+        if (!FileSystem::Exists(directory)) {
+            FileSystem::CreateDirectoryFromPath(directory);
+        }
+    }
+    WriteText(TEST_PAK_CORRUPT_DIRECTORY "a.bin", "first");
+    WriteText(TEST_PAK_CORRUPT_DIRECTORY "b.bin", "second");
+    WriteText(TEST_PAK_CORRUPT_DIRECTORY "c.bin", std::string(10000, 'c'));
+
+    std::string pakPath = ".cache/tests/corrupt.pak";
+    std::string damagedPath = ".cache/tests/damaged.pak";
+    CHECK(PakFile::Build(pakPath, { { TEST_PAK_CORRUPT_DIRECTORY, {} } }));
+    CHECK(!FileSystem::Exists(pakPath + ".tmp"));
+
+    std::vector<uint8_t> bytes;
+    {
+        std::ifstream stream(pakPath, std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(stream), std::istreambuf_iterator<char>());
+    }
+    CHECK(OpensAsPak(damagedPath, bytes));
+
+    auto damage = [&](uint32_t index, size_t field, uint64_t value, size_t size) {
+        std::vector<uint8_t> damaged = bytes;
+        memcpy(damaged.data() + sizeof(PakHeader) + index * sizeof(PakEntry) + field, &value, size);
+        return OpensAsPak(damagedPath, damaged);
+    };
+    CHECK(!damage(0, offsetof(PakEntry, Offset), bytes.size(), sizeof(uint64_t)));
+    CHECK(!damage(1, offsetof(PakEntry, Size), bytes.size(), sizeof(uint64_t)));
+    // Offset + Size wraps around to a small value
+    CHECK(!damage(2, offsetof(PakEntry, Size), ~uint64_t(0) - 64, sizeof(uint64_t)));
+    CHECK(!damage(0, offsetof(PakEntry, NameOffset), 1000, sizeof(uint32_t)));
+    CHECK(!damage(1, offsetof(PakEntry, NameLength), 0xFFFFFFFF, sizeof(uint32_t)));
+    CHECK(!damage(2, offsetof(PakEntry, Hash), 0, sizeof(uint64_t)));
+    {
+        std::vector<uint8_t> damaged = bytes;
+        uint64_t namesSize = ~uint64_t(0);
+        memcpy(damaged.data() + offsetof(PakHeader, NamesSize), &namesSize, sizeof(namesSize));
+        CHECK(!OpensAsPak(damagedPath, damaged));
+    }
+
+    // Truncated: only cuts that keep every entry whole may open
+    uint32_t opened = 0;
+    for (size_t size = 0; size < bytes.size(); size += 7) {
+        opened += OpensAsPak(damagedPath, std::vector<uint8_t>(bytes.begin(), bytes.begin() + size));
+    }
+    CHECK(opened < bytes.size() / 7);
+
+    // A build that can't finish leaves the previous archive as it was
+    FileSystem::CreateDirectoryFromPath(pakPath + ".tmp");
+    CHECK(!PakFile::Build(pakPath, { { TEST_PAK_CORRUPT_DIRECTORY, {} } }));
+    CHECK(FileSystem::GetFileSize(pakPath) == bytes.size());
+    CHECK(PakFile(pakPath).IsOpen());
+    FileSystem::Delete(pakPath + ".tmp");
+
+    for (const char *name : { "a.bin", "b.bin", "c.bin" }) {
+        FileSystem::Delete(TEST_PAK_CORRUPT_DIRECTORY + std::string(name));
+    }
+    FileSystem::Delete(pakPath);
+    FileSystem::Delete(damagedPath);
+}
@@ -0,0 +1,104 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-19 02:03:26
+//
+
+#include "test.hpp"
+
+#include "core/job_system.hpp"
+#include "renderer/techniques/gbuffer_recorder.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+
+#undef min
+#undef max
+
+// oni_tests builds with ONI_RHI_NULL, RenderContext is the null backend's
+TEST(GBufferRecording)
+{
+    const uint32_t width = 64;
+    const uint32_t height = 64;
+    const uint32_t drawCount = GBUFFER_MIN_DRAWS_PER_THREAD * 4;
+
+    RenderContext::Ptr context = std::make_shared<RenderContext>(width, height);
+    GBufferTargets targets;
+    Texture::Ptr *colorTargets[] = { &targets.Normals, &targets.AlbedoEmission, &targets.PBR, &targets.Emissive, &targets.Velocity };
+    for (Texture::Ptr *target : colorTargets) {
+        *target = context->CreateTexture(width, height, 8, TextureUsage::RenderTarget, false, "GBuffer Target");
+        (*target)->BuildRenderTarget();
+        (*target)->BuildShaderResource();
+    }
+    targets.Depth = context->CreateTexture(width, height, 4, TextureUsage::DepthTarget, false, "GBuffer Depth");
+    targets.Depth->BuildDepthTarget();
+    targets.Depth->BuildShaderResource();
+    MeshPipeline::Ptr pipeline = context->CreateMeshPipeline("GBuffer");
+
+    std::vector<Buffer::Ptr> modelBuffers(drawCount);
+    for (auto& buffer : modelBuffers) {
+        buffer = context->CreateBuffer(512, 0, BufferType::Constant, false, "Model Buffer");
+        buffer->BuildConstantBuffer();
+    }
+
+    GBufferRecorder recorder(context);
+    for (uint32_t maxThreads : { 1u, uint32_t(GBUFFER_MAX_RECORD_THREADS) }) {
+        // Drops what the tests before this one ended
+        CommandStats::EndFrame();
+        NullContextStats before = context->GetStats();
+
+        CommandBuffer::Ptr commandBuffer = context->GetCurrentCommandBuffer();
+        commandBuffer->Begin();
+        recorder.Record(targets, pipeline, drawCount, maxThreads, width, height, [&](uint32_t draw, GBufferDraw& out) {
+            out.ModelBuffer = modelBuffers[draw];
+            out.Matrices = {};
+            out.Matrices.Scale = float(draw + maxThreads);
+            out.Constants = {};
+            out.Constants.Albedo = draw;
+            out.MeshletCount = 1;
+        });
+        commandBuffer->End();
+        context->ExecuteCommandBuffers({ commandBuffer });
+        context->Finish();
+
+        uint32_t threads = recorder.GetThreadCount();
+        CHECK(threads == std::min({ maxThreads, JobSystem::GetThreadCount(), drawCount / GBUFFER_MIN_DRAWS_PER_THREAD }));
+        uint32_t recorded = 0;
+        for (uint32_t i = 0; i < threads; i++) {
+            recorded += recorder.GetThreadStats(i).Draws;
+        }
+        CHECK(recorded == drawCount);
+
+        // Recorded over threads, what came before BeginParallel goes out on its own
+        const NullContextStats& stats = context->GetStats();
+        CHECK(stats.ValidationErrors == before.ValidationErrors);
+        CHECK(stats.Draws - before.Draws == drawCount);
+        CHECK(stats.SubmittedBuffers - before.SubmittedBuffers == (threads == 1 ? 1 : threads + 2));
+
+        bool written = true;
+        for (uint32_t draw = 0; draw < drawCount; draw++) {
+            float scale;
+            memcpy(&scale, modelBuffers[draw]->GetData() + offsetof(GBufferMatrices, Scale), sizeof(scale));
+            written = written && scale == float(draw + maxThreads);
+        }
+        CHECK(written);
+
+        CHECK(targets.AlbedoEmission->GetState(0) == TextureLayout::ShaderResource);
+        CHECK(targets.PBR->GetState(0) == TextureLayout::ShaderResource);
+        CHECK(targets.Normals->GetState(0) == TextureLayout::RenderTarget);
+        CHECK(targets.Depth->GetState(0) == TextureLayout::Depth);
+
+        // The targets start where they are made, after that albedo and PBR come back from the last frame. Both batches
+        // go out in a single call each.
+        bool first = maxThreads == 1;
+        CommandBufferStats frame = CommandStats::GetLastFrame();
+        CHECK(frame.BarriersRequested == 8);
+        CHECK(frame.BarriersEmitted == (first ? 2u : 4u));
+        CHECK(frame.BarrierCalls == (first ? 1u : 2u));
+        // Every buffer the draws are recorded on binds its state once
+        CHECK(frame.Issued[size_t(StateCommand::Pipeline)] == threads);
+        CHECK(frame.Issued[size_t(StateCommand::RenderTargets)] == threads);
+        CHECK(frame.Filtered[size_t(StateCommand::Pipeline)] == 0);
+    }
+}
@@ -0,0 +1,97 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 21:14:08
+//
+
+#include "test.hpp"
+
+#include "core/file_system.hpp"
+#include "core/io_queue.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#define TEST_IO_DIRECTORY ".cache/tests/io/"
+#define TEST_IO_FILE_COUNT (IO_QUEUE_MAX_OPEN_FILES * 3)
+
+TEST(IOQueueBoundedHandles)
+{
+    for (const char *directory : { ".cache/", ".cache/tests/", TEST_IO_DIRECTORY }) {
+        if (!FileSystem::Exists(directory)) {
+            FileSystem::CreateDirectoryFromPath(directory);
+        }
+    }
+    std::vector<std::string> paths;
+    for (uint32_t i = 0; i < TEST_IO_FILE_COUNT; i++) {
+        paths.push_back(TEST_IO_DIRECTORY + std::to_string(i) + ".bin");
+        std::ofstream stream(paths.back(), std::ios::binary | std::ios::trunc);
+        stream.write(reinterpret_cast<const char*>(&i), sizeof(i));
+    }
+
+    for (IOBackend backend : { IOBackend::Default, IOBackend::ThreadPool }) {
+        IOQueue queue(backend);
+        std::vector<uint32_t> values(paths.size(), UINT32_MAX);
+        std::vector<IORequest> requests;
+        for (size_t i = 0; i < paths.size(); i++) {
+            requests.push_back({ paths[i], 0, sizeof(uint32_t), &values[i], nullptr });
+        }
+        queue.Submit(requests);
+        queue.Flush();
+
+        IOQueue::Stats stats = queue.GetStats();
+        CHECK(stats.Failed == 0);
+        CHECK(stats.OpenFiles <= IO_QUEUE_MAX_OPEN_FILES);
+        for (size_t i = 0; i < values.size(); i++) {
+            CHECK(values[i] == i);
+        }
+
+        queue.CloseIdleFiles();
+        CHECK(queue.GetStats().OpenFiles == 0);
+    }
+
+    for (auto& path : paths) {
+        CHECK(std::remove(path.c_str()) == 0);
+    }
+}
+
+TEST(IOQueueFailedReads)
+{
+    const std::string path = ".cache/tests/short.bin";
+    for (const char *directory : { ".cache/", ".cache/tests/" }) {
+        if (!FileSystem::Exists(directory)) {
+            FileSystem::CreateDirectoryFromPath(directory);
+        }
+    }
+    {
+        std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+        stream.write("0123456789", 10);
+    }
+
+    // Past the end, missing, and one that only half exists: Flush has to come back with all of them done
+    for (IOBackend backend : { IOBackend::Default, IOBackend::ThreadPool }) {
+        IOQueue queue(backend);
+        char buffers[4][16] = {};
+        std::vector<bool> results(4, true);
+        std::vector<IORequest> requests = {
+            { path, 100, 4, buffers[0], [&](bool success) { results[0] = success; } },
+            { ".cache/tests/missing.bin", 0, 4, buffers[1], [&](bool success) { results[1] = success; } },
+            { path, 6, 8, buffers[2], [&](bool success) { results[2] = success; } },
+            { path, 0, 10, buffers[3], [&](bool success) { results[3] = success; } }
+        };
+        queue.Submit(requests);
+        queue.Flush();
+
+        CHECK(!results[0]);
+        CHECK(!results[1]);
+        CHECK(!results[2]);
+        CHECK(results[3]);
+        CHECK(!memcmp(buffers[3], "0123456789", 10));
+        CHECK(queue.GetStats().Failed == 3);
+    }
+
+    CHECK(std::remove(path.c_str()) == 0);
+}
@@ -0,0 +1,85 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 19:45:31
+//
+
+// oni_tests: unit tests for the parts of the engine that don't need a GPU. Runs every test by default, or every
+// benchmark with --benchmark. A filter only runs the entries with that string in their name.
+
+#include "test.hpp"
+
+#include "core/log.hpp"
+#include "core/timer.hpp"
+#include "core/job_system.hpp"
+
+#include <cstring>
+#include <string>
+
+static uint32_t _Failures = 0;
+
+int TestRegistry::Register(const char *name, void (*function)(), bool benchmark)
+{
+    GetEntries().push_back({ name, function, benchmark });
+    return 0;
+}
+
+std::vector<TestRegistry::Entry>& TestRegistry::GetEntries()
+{
+    static std::vector<Entry> entries;
+    return entries;
+}
+
+void TestRegistry::Fail(const char *file, int line, const char *expression)
+{
+    Logger::Error("[TEST] %s:%d: CHECK(%s) failed", file, line, expression);
+    _Failures++;
+}
+
+uint32_t TestRegistry::GetFailures()
+{
+    return _Failures;
+}
+
+int main(int argc, char **argv)
+{
+    Logger::Init();
+
+    bool benchmark = false;
+    std::string filter;
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--benchmark")) {
+            benchmark = true;
+        } else {
+            filter = argv[i];
+        }
+    }
+
+    // Some of the code under test splits its work on it
+    JobSystem::Init();
+
+    uint32_t run = 0;
+    uint32_t failed = 0;
+    for (auto& entry : TestRegistry::GetEntries()) {
+        if (entry.Benchmark != benchmark || (!filter.empty() && !strstr(entry.Name, filter.c_str()))) {
+            continue;
+        }
+
+        uint32_t failuresBefore = TestRegistry::GetFailures();
+        Timer timer;
+        entry.Function();
+        bool passed = TestRegistry::GetFailures() == failuresBefore;
+        if (passed) {
+            Logger::Info("[TEST] %s passed (%.2fms)", entry.Name, timer.GetElapsed());
+        } else {
+            Logger::Error("[TEST] %s FAILED", entry.Name);
+        }
+        run++;
+        failed += !passed;
+    }
+    Logger::Info("[TEST] %u/%u passed", run - failed, run);
+
+    JobSystem::Exit();
+    Logger::Exit();
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,186 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 22:31:50
+//
+
+#include "test.hpp"
+
+#include "core/job_system.hpp"
+#include "rhi/null/null_render_context.hpp"
+
+#include <cstring>
+
+TEST(NullFrameLoop)
+{
+    NullRenderContext context(64, 64);
+    NullTexture::Ptr target = context.CreateTexture(64, 64, 4, TextureUsage::RenderTarget, false, "Target");
+    target->BuildRenderTarget();
+    target->BuildShaderResource();
+    NullPipeline::Ptr pipeline = context.CreateGraphicsPipeline();
+
+    for (uint32_t frame = 0; frame < NULL_FRAMES_IN_FLIGHT * 2; frame++) {
+        NullCommandBuffer::Ptr commandBuffer = context.GetCurrentCommandBuffer();
+        commandBuffer->Begin();
+        commandBuffer->ImageBarrier(target, TextureLayout::RenderTarget);
+        commandBuffer->ClearRenderTarget(target, 0.0f, 0.0f, 0.0f, 1.0f);
+
+        // Recorded over the job system, like the GBuffer
+        std::vector<NullCommandBuffer::Ptr> buffers = context.BeginParallel(4);
+        CHECK(buffers.size() == 4);
+        JobSystem::ParallelFor(4, [&](uint32_t thread) {
+            buffers[thread]->SetViewport(0, 0, 64, 64);
+            buffers[thread]->BindRenderTargets({ target }, nullptr);
+            buffers[thread]->BindGraphicsPipeline(pipeline);
+            buffers[thread]->Draw(3);
+        });
+        context.EndParallel();
+
+        NullTexture::Ptr backBuffer = context.GetBackBuffer();
+        commandBuffer->ImageBarrier(target, TextureLayout::CopySource);
+        commandBuffer->ImageBarrier(backBuffer, TextureLayout::CopyDest);
+        commandBuffer->CopyTextureToTexture(backBuffer, target);
+        commandBuffer->ImageBarrier(backBuffer, TextureLayout::Present);
+        commandBuffer->End();
+        CHECK(commandBuffer->GetErrorCount() == 0);
+
+        context.ExecuteCommandBuffers({ commandBuffer });
+        context.Present(false);
+        context.Finish();
+        CHECK(context.GetBackBufferIndex() == (frame + 1) % NULL_FRAMES_IN_FLIGHT);
+    }
+
+    const NullContextStats& stats = context.GetStats();
+    CHECK(stats.Frames == NULL_FRAMES_IN_FLIGHT * 2);
+    // Every frame: the part before BeginParallel, the four threads, then the rest
+    CHECK(stats.SubmittedBuffers == NULL_FRAMES_IN_FLIGHT * 2 * 6);
+    CHECK(stats.ValidationErrors == 0);
+}
+
+TEST(NullValidation)
+{
+    NullRenderContext context(64, 64);
+    NullTexture::Ptr target = context.CreateTexture(64, 64, 4, TextureUsage::ShaderResource, false, "Target");
+    target->BuildRenderTarget();
+    NullPipeline::Ptr compute = context.CreateComputePipeline();
+
+    // Drawing into a texture left as a shader resource, with a compute pipeline and no viewport
+    NullCommandBuffer::Ptr commandBuffer = context.CreateCommandBuffer();
+    commandBuffer->Begin();
+    commandBuffer->ImageBarrier(target, TextureLayout::CopyDest);
+    commandBuffer->ImageBarrier(target, TextureLayout::ShaderResource);
+    commandBuffer->BindRenderTargets({ target }, nullptr);
+    commandBuffer->BindGraphicsPipeline(compute);
+    commandBuffer->Draw(3);
+    commandBuffer->BeginEvent("Never closed");
+    commandBuffer->End();
+
+    CHECK(commandBuffer->GetErrorCount() == 4);
+    context.ExecuteCommandBuffers({ commandBuffer });
+    CHECK(context.GetStats().ValidationErrors == 4);
+
+    // Still recording, not counted
+    commandBuffer->Begin();
+    context.ExecuteCommandBuffers({ commandBuffer });
+    CHECK(context.GetStats().SubmittedBuffers == 1);
+    commandBuffer->End();
+}
+
+TEST(NullBarrierQueue)
+{
+    NullRenderContext context(64, 64);
+    NullTexture::Ptr texture = context.CreateTexture(64, 64, 4, TextureUsage::ShaderResource, true, "Texture");
+    texture->BuildShaderResource();
+    texture->BuildStorage();
+    NullPipeline::Ptr compute = context.CreateComputePipeline();
+    // Drops what the tests before this one ended
+    CommandStats::EndFrame();
+
+    NullCommandBuffer::Ptr commandBuffer = context.CreateCommandBuffer();
+    commandBuffer->Begin();
+    // There and back before anything used it cancels out, two in a row go out as one
+    commandBuffer->ImageBarrier(texture, TextureLayout::RenderTarget);
+    commandBuffer->ImageBarrier(texture, TextureLayout::ShaderResource);
+    commandBuffer->ImageBarrier(texture, TextureLayout::CopyDest);
+    commandBuffer->ImageBarrier(texture, TextureLayout::CopySource);
+    commandBuffer->BindComputePipeline(compute);
+    commandBuffer->BindComputePipeline(compute);
+    commandBuffer->Dispatch(1, 1, 1);
+    CHECK(commandBuffer->GetStats().BarriersRequested == 4);
+    CHECK(commandBuffer->GetStats().BarriersEmitted == 1);
+    CHECK(commandBuffer->GetStats().BarrierCalls == 1);
+    CHECK(commandBuffer->GetStats().Issued[size_t(StateCommand::Pipeline)] == 1);
+    CHECK(commandBuffer->GetStats().Filtered[size_t(StateCommand::Pipeline)] == 1);
+
+    // The transition to storage already waits for the writes before it, the UAV barrier after it isn't needed
+    commandBuffer->ImageBarrier(texture, TextureLayout::Storage, 1);
+    commandBuffer->ImageBarrier(texture, TextureLayout::Storage, 1);
+    commandBuffer->Dispatch(1, 1, 1);
+    CHECK(commandBuffer->GetStats().BarriersEmitted == 2);
+    CHECK(commandBuffer->GetStats().BarrierCalls == 2);
+
+    // Whatever is left goes out at the end
+    commandBuffer->ImageBarrier(texture, TextureLayout::ShaderResource, 1);
+    commandBuffer->ImageBarrier(texture, TextureLayout::ShaderResource, 0);
+    commandBuffer->End();
+    CHECK(commandBuffer->GetErrorCount() == 0);
+    CHECK(commandBuffer->GetStats().BarriersRequested == 0);
+
+    context.Finish();
+    CommandBufferStats frame = CommandStats::GetLastFrame();
+    CHECK(frame.BarriersRequested == 8);
+    CHECK(frame.BarriersEmitted == 4);
+    CHECK(frame.BarrierCalls == 3);
+}
+
+TEST(NullResources)
+{
+    NullRenderContext context(64, 64);
+    NullBuffer::Ptr source = context.CreateBuffer(256, 0, BufferType::Copy, false, "Source");
+    NullBuffer::Ptr destination = context.CreateBuffer(256, 0, BufferType::Storage, false, "Destination");
+
+    void *data;
+    source->Map(0, 0, &data);
+    memset(data, 0x5A, 256);
+    source->Unmap(0, 0);
+
+    NullCommandBuffer::Ptr commandBuffer = context.CreateCommandBuffer();
+    commandBuffer->Begin();
+    commandBuffer->CopyBufferToBuffer(destination, source);
+    commandBuffer->End();
+    context.ExecuteCommandBuffers({ commandBuffer });
+    CHECK(destination->GetData()[0] == 0x5A && destination->GetData()[255] == 0x5A);
+
+    NullTexture::Ptr texture = context.CreateTexture(64, 32, 4, TextureUsage::Storage, true, "Mips");
+    CHECK(texture->GetMips() == 7);
+    CHECK(texture->GetMipSize(6) == 4);
+    CHECK(texture->GetState(3) == TextureLayout::Storage);
+
+    // Views go back to the heap once the frame that could read them is done, which is right away without a GPU
+    uint32_t allocated = context.GetShaderHeap()->GetStats().Allocated;
+    texture->BuildShaderResource();
+    texture->BuildStorage();
+    CHECK(context.GetShaderHeap()->GetStats().Allocated == allocated + 14);
+    texture.reset();
+    CHECK(context.GetShaderHeap()->GetStats().Allocated == allocated + 14);
+    CHECK(context.GetShaderHeap()->GetStats().PendingFrees == 14);
+    context.Finish();
+    CHECK(context.GetShaderHeap()->GetStats().Allocated == allocated);
+
+    // Transient ranges start over when their frame comes back around
+    uint32_t transient = context.GetShaderHeap()->AllocateTransient(16);
+    CHECK(transient != DESCRIPTOR_INVALID);
+    CHECK(context.GetShaderHeap()->AllocateTransient() == transient + 16);
+    for (int i = 0; i < NULL_FRAMES_IN_FLIGHT; i++) {
+        CHECK(context.GetShaderHeap()->AllocateTransient() != transient);
+        context.Finish();
+    }
+    CHECK(context.GetShaderHeap()->AllocateTransient(16) == transient);
+}
+
+BENCHMARK(NullFrameLoopBenchmark)
+{
+    for (uint32_t threads : { 1u, 4u }) {
+        NullRenderContext::Benchmark(4096, threads, 100);
+    }
+}
@@ -0,0 +1,231 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 22:47:13
+//
+
+#include "test.hpp"
+
+#include "renderer/render_graph.hpp"
+
+#include <string>
+
+static const RenderGraphTextureDesc TEST_GRAPH_DESC = { 256, 256, 0, 1 };
+
+static bool HasBarrier(const std::vector<RenderGraphBarrier>& barriers, uint32_t resource, RenderGraphUsage before, RenderGraphUsage after, bool uav)
+{
+    for (const RenderGraphBarrier& barrier : barriers) {
+        if (barrier.Resource == resource && barrier.Before == before && barrier.After == after && barrier.UAV == uav) {
+            return true;
+        }
+    }
+    return false;
+}
+
+TEST(RenderGraphCulling)
+{
+    RenderGraph graph;
+    graph.Import("Backbuffer", 0, RenderGraphUsage::Present);
+
+    uint32_t scene = graph.AddPass("Scene", [](RenderGraph::PassBuilder& builder) {
+        builder.Create("Color", TEST_GRAPH_DESC, RenderGraphUsage::RenderTarget);
+    }, nullptr);
+    // Only feeds the debug view, so it goes with it
+    uint32_t debugInput = graph.AddPass("Debug Input", [](RenderGraph::PassBuilder& builder) {
+        builder.Create("Debug Data", TEST_GRAPH_DESC, RenderGraphUsage::Storage);
+    }, nullptr);
+    uint32_t debug = graph.AddPass("Debug View", [](RenderGraph::PassBuilder& builder) {
+        builder.Read("Color");
+        builder.Read("Debug Data");
+        builder.Create("Debug", TEST_GRAPH_DESC, RenderGraphUsage::RenderTarget);
+    }, nullptr);
+    // Nothing reads what it makes, it writes outside of the graph
+    uint32_t readback = graph.AddPass("Readback", [](RenderGraph::PassBuilder& builder) {
+        builder.Read("Color", RenderGraphUsage::CopySource);
+        builder.Create("Readback Buffer", {}, RenderGraphUsage::CopyDest);
+        builder.SideEffect();
+    }, nullptr);
+    uint32_t present = graph.AddPass("Present", [](RenderGraph::PassBuilder& builder) {
+        builder.Read("Color", RenderGraphUsage::CopySource);
+        builder.Write("Backbuffer", RenderGraphUsage::CopyDest);
+    }, nullptr);
+    graph.MarkOutput("Backbuffer", RenderGraphUsage::Present);
+    graph.Compile();
+
+    CHECK(!graph.IsCulled(scene));
+    CHECK(graph.IsCulled(debugInput));
+    CHECK(graph.IsCulled(debug));
+    CHECK(!graph.IsCulled(readback));
+    CHECK(!graph.IsCulled(present));
+    CHECK(graph.GetStats().Culled == 2);
+    CHECK(graph.GetStats().Passes == 3);
+    CHECK((graph.GetOrder() == std::vector<uint32_t>{ scene, readback, present }));
+
+    // Without an output, only the side effect and what it needs are left
+    RenderGraph orphan;
+    uint32_t first = orphan.AddPass("First", [](RenderGraph::PassBuilder& builder) {
+        builder.Create("A", TEST_GRAPH_DESC, RenderGraphUsage::RenderTarget);
+    }, nullptr);
+    uint32_t second = orphan.AddPass("Second", [](RenderGraph::PassBuilder& builder) {
+        builder.Read("A");
+        builder.SideEffect();
+    }, nullptr);
+    uint32_t third = orphan.AddPass("Third", [](RenderGraph::PassBuilder& builder) {
+        builder.Read("A");
+        builder.Create("B", TEST_GRAPH_DESC, RenderGraphUsage::RenderTarget);
+    }, nullptr);
+    orphan.Compile();
+    CHECK(!orphan.IsCulled(first));
+    CHECK(!orphan.IsCulled(second));
+    CHECK(orphan.IsCulled(third));
+}
+
+TEST(RenderGraphVersioning)
+{
+    // Readers depend on the version they read: a write that comes after them and that nobody reads is culled, the
+    // write they read from isn't
+    RenderGraph graph;
+    graph.Import("History", 1, RenderGraphUsage::ShaderResource);
+    uint32_t firstWrite = graph.AddPass("First Write", [](RenderGraph::PassBuilder& builder) {
+        builder.Write("History", RenderGraphUsage::Storage);
+    }, nullptr);
+    uint32_t reader = graph.AddPass("Reader", [](RenderGraph::PassBuilder& builder) {
+        builder.Read("History");
+        builder.Create("Result", TEST_GRAPH_DESC, RenderGraphUsage::RenderTarget);
+    }, nullptr);
+    uint32_t secondWrite = graph.AddPass("Second Write", [](RenderGraph::PassBuilder& builder) {
+        builder.Write("History", RenderGraphUsage::Storage);
+    }, nullptr);
+    graph.MarkOutput("Result");
+    graph.Compile();
+
+    CHECK(!graph.IsCulled(firstWrite));
+    CHECK(!graph.IsCulled(reader));
+    CHECK(graph.IsCulled(secondWrite));
+
+    // Once something reads the second version, both writes run
+    uint32_t lateReader = graph.AddPass("Late Reader", [](RenderGraph::PassBuilder& builder) {
+        builder.Read("History");
+        builder.Create("Late Result", TEST_GRAPH_DESC, RenderGraphUsage::RenderTarget);
+    }, nullptr);
+    graph.MarkOutput("Late Result");
+    graph.Compile();
+
+    CHECK(!graph.IsCulled(firstWrite));
+    CHECK(!graph.IsCulled(secondWrite));
+    CHECK(!graph.IsCulled(lateReader));
+    CHECK(graph.GetStats().Culled == 0);
+}
+
+TEST(RenderGraphBarriers)
+{
+    RenderGraph graph;
+    uint32_t target = graph.Import("Target", 0, RenderGraphUsage::RenderTarget);
+    uint32_t unknown = graph.Import("Unknown", 0);
+
+    uint32_t draw = graph.AddPass("Draw", [](RenderGraph::PassBuilder& builder) {
+        builder.Write("Target", RenderGraphUsage::RenderTarget);
+        builder.Read("Unknown");
+    }, nullptr);
+    uint32_t create = graph.AddPass("Create", [](RenderGraph::PassBuilder& builder) {
+        builder.Read("Target");
+        builder.Create("Storage", TEST_GRAPH_DESC, RenderGraphUsage::Storage);
+    }, nullptr);
+    uint32_t accumulate = graph.AddPass("Accumulate", [](RenderGraph::PassBuilder& builder) {
+        builder.Write("Storage", RenderGraphUsage::Storage);
+    }, nullptr);
+    uint32_t firstRead = graph.AddPass("First Read", [](RenderGraph::PassBuilder& builder) {
+        builder.Read("Storage", RenderGraphUsage::Storage);
+        builder.SideEffect();
+    }, nullptr);
+    uint32_t secondRead = graph.AddPass("Second Read", [](RenderGraph::PassBuilder& builder) {
+        builder.Read("Storage", RenderGraphUsage::Storage);
+        builder.SideEffect();
+    }, nullptr);
+    graph.MarkOutput("Target", RenderGraphUsage::Present);
+    graph.Compile();
+    uint32_t storage = graph.FindResource("Storage");
+
+    // Already a render target, the import is only transitioned for its read. Unknown state always gets a barrier.
+    CHECK(graph.GetBarriers(draw).size() == 1);
+    CHECK(HasBarrier(graph.GetBarriers(draw), unknown, RenderGraphUsage::Unknown, RenderGraphUsage::ShaderResource, false));
+    CHECK(HasBarrier(graph.GetBarriers(create), target, RenderGraphUsage::RenderTarget, RenderGraphUsage::ShaderResource, false));
+    CHECK(HasBarrier(graph.GetBarriers(create), storage, RenderGraphUsage::Unknown, RenderGraphUsage::Storage, false));
+    // Storage after a storage write waits for it, storage after a storage read doesn't
+    CHECK(graph.GetBarriers(accumulate).size() == 1);
+    CHECK(HasBarrier(graph.GetBarriers(accumulate), storage, RenderGraphUsage::Storage, RenderGraphUsage::Storage, true));
+    CHECK(HasBarrier(graph.GetBarriers(firstRead), storage, RenderGraphUsage::Storage, RenderGraphUsage::Storage, true));
+    CHECK(graph.GetBarriers(secondRead).empty());
+
+    CHECK(graph.GetFinalBarriers().size() == 1);
+    CHECK(HasBarrier(graph.GetFinalBarriers(), target, RenderGraphUsage::ShaderResource, RenderGraphUsage::Present, false));
+    CHECK(graph.GetStats().Barriers == 4);
+    CHECK(graph.GetStats().UAVBarriers == 2);
+
+    // Barriers go out before their pass runs, the final ones after the last pass
+    std::string log;
+    RenderGraph run;
+    run.Import("Target", 0, RenderGraphUsage::RenderTarget);
+    run.AddPass("A", [](RenderGraph::PassBuilder& builder) {
+        builder.Read("Target");
+        builder.SideEffect();
+    }, [&]() { log += "A "; });
+    run.AddPass("B", [](RenderGraph::PassBuilder& builder) {
+        builder.Write("Target", RenderGraphUsage::RenderTarget);
+    }, [&]() { log += "B "; });
+    run.MarkOutput("Target", RenderGraphUsage::Present);
+    run.Compile();
+    run.Run([&](const RenderGraphBarrier& barrier) {
+        log += std::string(RenderGraph::GetUsageName(barrier.After)) + " ";
+    });
+    CHECK(log == "ShaderResource A RenderTarget B Present ");
+}
+
+TEST(RenderGraphLifetimes)
+{
+    RenderGraph graph;
+    graph.Import("Backbuffer", 0, RenderGraphUsage::Present);
+    graph.AddPass("Depth", [](RenderGraph::PassBuilder& builder) {
+        builder.Create("Depth", TEST_GRAPH_DESC, RenderGraphUsage::DepthWrite);
+    }, nullptr);
+    graph.AddPass("Unused", [](RenderGraph::PassBuilder& builder) {
+        builder.Create("Unused", TEST_GRAPH_DESC, RenderGraphUsage::RenderTarget);
+    }, nullptr);
+    graph.AddPass("GBuffer", [](RenderGraph::PassBuilder& builder) {
+        builder.Write("Depth", RenderGraphUsage::DepthWrite);
+        builder.Create("Albedo", TEST_GRAPH_DESC, RenderGraphUsage::RenderTarget);
+    }, nullptr);
+    graph.AddPass("Lighting", [](RenderGraph::PassBuilder& builder) {
+        builder.Read("Depth");
+        builder.Read("Albedo");
+        builder.Create("Lit", TEST_GRAPH_DESC, RenderGraphUsage::Storage);
+    }, nullptr);
+    graph.AddPass("Present", [](RenderGraph::PassBuilder& builder) {
+        builder.Read("Lit", RenderGraphUsage::CopySource);
+        builder.Write("Backbuffer", RenderGraphUsage::CopyDest);
+    }, nullptr);
+    graph.MarkOutput("Backbuffer", RenderGraphUsage::Present);
+    graph.Compile();
+
+    // Indices in the execution order, the culled pass takes none
+    auto lifetime = [&](const char *name) { return graph.GetLifetime(graph.FindResource(name)); };
+    CHECK(lifetime("Depth").First == 0 && lifetime("Depth").Last == 2);
+    CHECK(lifetime("Albedo").First == 1 && lifetime("Albedo").Last == 2);
+    CHECK(lifetime("Lit").First == 2 && lifetime("Lit").Last == 3);
+    CHECK(lifetime("Backbuffer").First == 3 && lifetime("Backbuffer").Last == 3);
+    CHECK(lifetime("Unused").First == RENDER_GRAPH_INVALID);
+    CHECK(graph.GetStats().Transient == 4);
+    CHECK(graph.IsTransient(graph.FindResource("Lit")));
+    CHECK(!graph.IsTransient(graph.FindResource("Backbuffer")));
+
+    // Reset keeps nothing of the previous frame
+    graph.Reset();
+    CHECK(graph.GetPassCount() == 0);
+    CHECK(graph.FindResource("Depth") == RENDER_GRAPH_INVALID);
+}
+
+BENCHMARK(RenderGraphCompile)
+{
+    RenderGraph::Benchmark(64, 1000);
+    RenderGraph::Benchmark(512, 100);
+}
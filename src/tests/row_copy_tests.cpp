@@ -0,0 +1,57 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 23:58:12
+//
+
+#include "test.hpp"
+
+#include "rhi/row_copy.hpp"
+
+#include <cstring>
+
+// Copies one mip of the given row size on one thread and on the job system, and checks every row landed at its pitch
+static void CheckRowCopy(uint64_t rowSize, uint32_t rowCount)
+{
+    uint64_t rowPitch = (rowSize + ROW_PITCH_ALIGNMENT - 1) / ROW_PITCH_ALIGNMENT * ROW_PITCH_ALIGNMENT;
+    std::vector<uint8_t> source(rowSize * rowCount);
+    for (uint64_t i = 0; i < source.size(); i++) {
+        source[i] = uint8_t(i * 13 + 5);
+    }
+
+    const uint64_t offset = 512;
+    RowCopy copy = { offset, source.data(), rowSize, rowPitch, rowCount };
+    std::vector<uint8_t> serial(offset + rowPitch * rowCount, 0xCD);
+    std::vector<uint8_t> parallel(serial.size(), 0xCD);
+    RowCopier::Copy(serial.data(), copy, 0, rowCount);
+    RowCopier::CopyParallel(parallel.data(), { copy });
+
+    bool rowsMatch = true;
+    for (uint32_t row = 0; row < rowCount; row++) {
+        rowsMatch &= !memcmp(serial.data() + offset + row * rowPitch, source.data() + row * rowSize, rowSize);
+    }
+    CHECK(rowsMatch);
+    CHECK(serial == parallel);
+    // Nothing written before the destination offset
+    CHECK(serial[offset - 1] == 0xCD);
+}
+
+TEST(RowCopyPacked)
+{
+    CheckRowCopy(1024, 4);
+    // Over PARALLEL_COPY_THRESHOLD, so it gets cut in row ranges
+    CheckRowCopy(16384, 1024);
+}
+
+TEST(RowCopyPadded)
+{
+    CheckRowCopy(16000, 1000);
+    CheckRowCopy(16, 1);
+}
+
+BENCHMARK(RowCopy)
+{
+    RowCopier::Benchmark(4096, 20);
+    RowCopier::Benchmark(4000, 20);
+    RowCopier::Benchmark(16384, 2);
+}
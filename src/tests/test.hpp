@@ -0,0 +1,44 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 19:42:08
+//
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// Just enough of a test framework for oni_tests: TEST bodies register themselves before main, CHECK records the failed
+// expression and keeps going so that one run reports every broken case.
+class TestRegistry
+{
+public:
+    struct Entry
+    {
+        const char *Name;
+        void (*Function)();
+        bool Benchmark; // Only run with --benchmark, they take seconds
+    };
+
+    static int Register(const char *name, void (*function)(), bool benchmark);
+    static std::vector<Entry>& GetEntries();
+
+    static void Fail(const char *file, int line, const char *expression);
+    static uint32_t GetFailures();
+};
+
+#define TEST_REGISTER(name, benchmark) \
+    static void name(); \
+    static int name##Registered = TestRegistry::Register(#name, &name, benchmark); \
+    static void name()
+
+#define TEST(name) TEST_REGISTER(name, false)
+#define BENCHMARK(name) TEST_REGISTER(name, true)
+
+#define CHECK(expression) \
+    do { \
+        if (!(expression)) { \
+            TestRegistry::Fail(__FILE__, __LINE__, #expression); \
+        } \
+    } while (0)
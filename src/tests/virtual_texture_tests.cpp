@@ -0,0 +1,294 @@
+//
+// $Notice: Xander Studios @ 2024
+// $Author: Amélie Heinrich
+// $Create Time: 2024-10-18 20:03:47
+//
+
+#include "test.hpp"
+
+#include "core/file_system.hpp"
+#include "core/block_codec.hpp"
+#include "core/timer.hpp"
+#include "core/virtual_texture/virtual_texture_system.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+#define TEST_DIRECTORY ".cache/tests/"
+
+// Every block holds its own mip and coordinates, so that a tile can be checked against where it was cut from
+static std::vector<uint8_t> MakeMipChain(uint32_t width, uint32_t height, uint32_t mipCount, uint32_t mode)
+{
+    uint32_t blockSize = TileCooker::GetBlockSize(mode);
+    std::vector<uint8_t> chain(TileCooker::GetMipChainSize(width, height, mipCount, mode));
+    uint8_t *block = chain.data();
+    for (uint32_t mip = 0; mip < mipCount; mip++) {
+        uint32_t blocksX = (std::max(width >> mip, 1u) + 3) / 4;
+        uint32_t blocksY = (std::max(height >> mip, 1u) + 3) / 4;
+        for (uint32_t y = 0; y < blocksY; y++) {
+            for (uint32_t x = 0; x < blocksX; x++) {
+                uint16_t values[4] = { uint16_t(mip + 1), uint16_t(x), uint16_t(y), 0xABCD };
+                memcpy(block, values, std::min<size_t>(blockSize, sizeof(values)));
+                block += blockSize;
+            }
+        }
+    }
+    return chain;
+}
+
+static bool CheckTile(const std::vector<uint8_t>& tile, uint32_t width, uint32_t height, uint32_t mode, uint32_t mip, uint32_t tileX, uint32_t tileY)
+{
+    uint32_t blockSize = TileCooker::GetBlockSize(mode);
+    uint32_t tileBlocks = VT_TILE_SIZE / 4;
+    uint32_t blocksX = (std::max(width >> mip, 1u) + 3) / 4;
+    uint32_t blocksY = (std::max(height >> mip, 1u) + 3) / 4;
+    if (tile.size() != tileBlocks * tileBlocks * blockSize) {
+        return false;
+    }
+
+    std::vector<uint8_t> expected(blockSize);
+    for (uint32_t row = 0; row < tileBlocks; row++) {
+        for (uint32_t column = 0; column < tileBlocks; column++) {
+            uint32_t x = tileX * tileBlocks + column;
+            uint32_t y = tileY * tileBlocks + row;
+            std::fill(expected.begin(), expected.end(), 0);
+            if (x < blocksX && y < blocksY) {
+                uint16_t values[4] = { uint16_t(mip + 1), uint16_t(x), uint16_t(y), 0xABCD };
+                memcpy(expected.data(), values, std::min<size_t>(blockSize, sizeof(values)));
+            }
+            if (memcmp(tile.data() + (row * tileBlocks + column) * blockSize, expected.data(), blockSize)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static void CreateTestDirectory()
+{
+    for (const char *directory : { ".cache/", TEST_DIRECTORY }) {
+        if (!FileSystem::Exists(directory)) {
+            FileSystem::CreateDirectoryFromPath(directory);
+        }
+    }
+}
+
+TEST(PageIdPacking)
+{
+    PageId page = vt::make_page(513, 7, 1000, 70000);
+    CHECK(vt::page_texture(page) == 513);
+    CHECK(vt::page_mip(page) == 7);
+    CHECK(vt::page_x(page) == 1000);
+    CHECK(vt::page_y(page) == 70000);
+
+    PageId parent = vt::page_parent(page);
+    CHECK(vt::page_texture(parent) == 513);
+    CHECK(vt::page_mip(parent) == 8);
+    CHECK(vt::page_x(parent) == 500);
+    CHECK(vt::page_y(parent) == 35000);
+
+    CHECK(FeedbackParser::Unpack(FeedbackParser::Pack(12, 3, 45, 67)) == vt::make_page(12, 3, 45, 67));
+}
+
+TEST(PageTableMapping)
+{
+    PageTable table;
+    uint32_t texture = table.AddTexture(300, 200, 3, 128);
+    CHECK(table.GetMipCount(texture) == 3);
+    CHECK(table.GetTilesX(texture, 0) == 3 && table.GetTilesY(texture, 0) == 2);
+    CHECK(table.GetTilesX(texture, 2) == 1 && table.GetTilesY(texture, 2) == 1);
+
+    CHECK(table.IsValid(vt::make_page(texture, 0, 2, 1)));
+    CHECK(!table.IsValid(vt::make_page(texture, 0, 3, 0)));
+    CHECK(!table.IsValid(vt::make_page(texture, 3, 0, 0)));
+    CHECK(!table.IsValid(vt::make_page(texture + 1, 0, 0, 0)));
+
+    PageId page = vt::make_page(texture, 0, 2, 1);
+    CHECK(table.Lookup(page) == VT_INVALID_SLOT);
+    CHECK(table.FindResidentAncestor(page) == VT_INVALID_PAGE);
+
+    PageId root = vt::make_page(texture, 2, 0, 0);
+    table.Map(root, 5);
+    CHECK(table.FindResidentAncestor(page) == root);
+    table.Map(page, 9);
+    CHECK(table.Lookup(page) == 9);
+    CHECK(table.FindResidentAncestor(page) == page);
+
+    std::vector<PageId> dirty;
+    table.Map(page, 9);
+    table.TakeDirty(dirty);
+    CHECK(dirty.size() == 2);
+    table.TakeDirty(dirty);
+    CHECK(dirty.empty());
+
+    table.Unmap(page);
+    CHECK(table.Lookup(page) == VT_INVALID_SLOT);
+    CHECK(table.FindResidentAncestor(page) == root);
+}
+
+TEST(PageCacheEviction)
+{
+    PageCache cache(2);
+    PageId a = vt::make_page(0, 0, 0, 0);
+    PageId b = vt::make_page(0, 0, 1, 0);
+    PageId c = vt::make_page(0, 0, 2, 0);
+    PageId d = vt::make_page(0, 0, 3, 0);
+
+    PageId evicted;
+    uint32_t slotA = cache.Allocate(a, evicted);
+    CHECK(evicted == VT_INVALID_PAGE);
+    uint32_t slotB = cache.Allocate(b, evicted);
+    CHECK(evicted == VT_INVALID_PAGE);
+    CHECK(slotA != slotB);
+    CHECK(cache.GetUsedSlots() == 2);
+
+    // a was used last, so b goes
+    CHECK(cache.Touch(a) == slotA);
+    uint32_t slotC = cache.Allocate(c, evicted);
+    CHECK(evicted == b);
+    CHECK(slotC == slotB);
+    CHECK(cache.Touch(b) == VT_INVALID_SLOT);
+
+    // a is the oldest now, but pinned
+    cache.Pin(slotA, true);
+    cache.Allocate(d, evicted);
+    CHECK(evicted == c);
+    CHECK(cache.Touch(a) == slotA);
+
+    cache.Pin(slotC, true);
+    CHECK(cache.Allocate(b, evicted) == VT_INVALID_SLOT);
+}
+
+TEST(FeedbackRequests)
+{
+    PageTable table;
+    table.AddTexture(512, 512, 3, 128);
+    PageCache cache(16);
+    FeedbackParser parser;
+
+    std::vector<uint32_t> feedback = {
+        FeedbackParser::Pack(0, 0, 3, 3), FeedbackParser::Pack(0, 0, 3, 3), VT_FEEDBACK_EMPTY,
+        FeedbackParser::Pack(0, 0, 2, 2), FeedbackParser::Pack(0, 0, 3, 3), VT_FEEDBACK_EMPTY
+    };
+
+    // Both pages and their shared ancestors, coarsest first
+    std::vector<PageId> requests;
+    parser.Parse(feedback.data(), feedback.size(), table, cache, requests, UINT32_MAX);
+    std::vector<PageId> expected = { vt::make_page(0, 2, 0, 0), vt::make_page(0, 1, 1, 1), vt::make_page(0, 0, 2, 2), vt::make_page(0, 0, 3, 3) };
+    CHECK(requests == expected);
+    CHECK(parser.GetStats().EntriesParsed == feedback.size());
+    CHECK(parser.GetStats().UniquePages == 2);
+
+    // Still loading, so not asked for again
+    requests.clear();
+    parser.Parse(feedback.data(), feedback.size(), table, cache, requests, UINT32_MAX);
+    CHECK(requests.empty());
+
+    // Resident
+    for (PageId page : expected) {
+        PageId evicted;
+        table.Map(page, cache.Allocate(page, evicted));
+        parser.Complete(page);
+    }
+    parser.Parse(feedback.data(), feedback.size(), table, cache, requests, UINT32_MAX);
+    CHECK(requests.empty());
+
+    // Capped, the coarsest pages go first
+    FeedbackParser capped;
+    PageCache empty(16);
+    capped.Parse(feedback.data(), feedback.size(), table, empty, requests, 2);
+    CHECK(requests.size() == 2);
+    CHECK(requests.size() == 2 && requests[0] == expected[0] && requests[1] == expected[1]);
+}
+
+TEST(TileCookerRoundTrip)
+{
+    CreateTestDirectory();
+
+    // Uncompressed BC7 chain with edge tiles on both axes
+    const uint32_t width = 300, height = 200, mipCount = 3;
+    std::vector<uint8_t> chain = MakeMipChain(width, height, mipCount, 7);
+
+    // Compressed BC1 file, as the texture cooker writes them
+    const uint32_t fileWidth = 260, fileHeight = 130, fileMipCount = 2;
+    std::string filePath = TEST_DIRECTORY "vt_source.oni";
+    {
+        std::vector<uint8_t> fileChain = MakeMipChain(fileWidth, fileHeight, fileMipCount, 1);
+        TextureFileHeader header = { fileWidth, fileHeight, fileMipCount, 1 | TEXTURE_FILE_COMPRESSED_FLAG };
+        std::vector<uint8_t> compressed;
+        BlockCodec::CompressChunked(fileChain.data(), fileChain.size(), compressed, 4096);
+
+        std::ofstream stream(filePath, std::ios::binary);
+        stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        stream.write(reinterpret_cast<const char*>(compressed.data()), compressed.size());
+    }
+
+    std::string archivePath = TEST_DIRECTORY "vt_round_trip.vta";
+    {
+        TileCooker cooker;
+        CHECK(cooker.AddTexture({ width, height, mipCount, 7, chain.data() }) == 0);
+        CHECK(cooker.AddTextureFile(filePath) == 1);
+        CHECK(cooker.AddTextureFile(TEST_DIRECTORY "missing.oni") == UINT32_MAX);
+        CHECK(cooker.Write(archivePath));
+    }
+
+    TileLoader loader(archivePath);
+    CHECK(loader.IsOpen());
+    if (!loader.IsOpen()) {
+        return;
+    }
+    CHECK(loader.GetTextureCount() == 2);
+    CHECK(loader.GetTexture(0).Mode == 7);
+    CHECK(loader.GetTexture(0).TileCount == 6 + 2 + 1);
+    CHECK(loader.GetTexture(1).Mode == 1);
+    CHECK(loader.GetTexture(1).TileBytes == (VT_TILE_SIZE / 4) * (VT_TILE_SIZE / 4) * 8);
+
+    struct Texture { uint32_t Width, Height, MipCount, Mode; };
+    Texture textures[] = { { width, height, mipCount, 7 }, { fileWidth, fileHeight, fileMipCount, 1 } };
+    for (uint32_t t = 0; t < 2; t++) {
+        const Texture& texture = textures[t];
+        for (uint32_t mip = 0; mip < texture.MipCount; mip++) {
+            uint32_t tilesX = (std::max(texture.Width >> mip, 1u) + VT_TILE_SIZE - 1) / VT_TILE_SIZE;
+            uint32_t tilesY = (std::max(texture.Height >> mip, 1u) + VT_TILE_SIZE - 1) / VT_TILE_SIZE;
+            for (uint32_t y = 0; y < tilesY; y++) {
+                for (uint32_t x = 0; x < tilesX; x++) {
+                    std::vector<uint8_t> tile;
+                    CHECK(loader.Read(vt::make_page(t, mip, x, y), tile));
+                    CHECK(CheckTile(tile, texture.Width, texture.Height, texture.Mode, mip, x, y));
+                }
+            }
+        }
+    }
+
+    // Pages out of the archive come back empty instead of reading someone else's tiles
+    std::vector<uint8_t> tile;
+    CHECK(!loader.Read(vt::make_page(0, mipCount, 0, 0), tile));
+    CHECK(!loader.Read(vt::make_page(0, 0, 3, 0), tile));
+    CHECK(!loader.Read(vt::make_page(0, 2, 0, 1), tile));
+    CHECK(!loader.Read(vt::make_page(1, 0, 0, 2), tile));
+    CHECK(!loader.Read(vt::make_page(2, 0, 0, 0), tile));
+
+    // Same through the workers
+    loader.Submit({ vt::make_page(1, 1, 1, 0), vt::make_page(1, 9, 0, 0) });
+    std::vector<TileLoader::Tile> tiles;
+    Timer timer;
+    while (tiles.size() < 2 && timer.GetElapsed() < 5000.0f) {
+        loader.Poll(tiles);
+        std::this_thread::yield();
+    }
+    CHECK(tiles.size() == 2);
+    for (auto& done : tiles) {
+        if (vt::page_mip(done.Page) == 1) {
+            CHECK(CheckTile(done.Data, fileWidth, fileHeight, 1, 1, 1, 0));
+        } else {
+            CHECK(done.Data.empty());
+        }
+    }
+}
+
+BENCHMARK(VirtualTextureFeedback)
+{
+    VirtualTextureSystem::Benchmark(1000);
+}
@@ -10,7 +10,7 @@ add_rules("mode.debug", "mode.release")
 target("Oni")
     set_rundir(".")
     set_languages("c++17")
-    add_files("src/**.cpp")
+    add_files("src/**.cpp|cook/**.cpp|capture/**.cpp|tests/**.cpp")
     add_includedirs("src", "ext", "ext/PIX/include", "ext/optick/", "ext/nvtt")
     add_deps("D3D12MA", "ImGui", "stb", "optick", "ImGuizmo", "cgltf", "meshopt")
     add_defines("GLM_FORCE_DEPTH_ZERO_TO_ONE", "USE_PIX")
@@ -33,3 +33,93 @@ target("Oni")
         set_optimize("fastest")
         set_strip("all")
     end
+
+-- Offline cooker, only depends on the portable part of core so that it also builds on Linux
+target("oni_cook")
+    set_kind("binary")
+    set_rundir(".")
+    set_languages("c++17")
+    add_files("src/cook/*.cpp")
+    add_files("src/core/log.cpp", "src/core/timer.cpp", "src/core/util.cpp", "src/core/bitmap.cpp", "src/core/file_system.cpp")
+    add_files("src/core/mapped_file.cpp", "src/core/pak_file.cpp", "src/core/block_codec.cpp", "src/core/texture_compressor.cpp", "src/core/mesh_cooker.cpp")
+    add_files("src/core/shader_loader.cpp", "src/core/shader_bytecode.cpp", "src/core/io_queue.cpp", "src/core/profiler.cpp")
+    add_files("src/core/job_system.cpp", "src/core/virtual_texture/*.cpp")
+    add_includedirs("src", "ext", "ext/nvtt")
+    add_deps("stb", "cgltf", "meshopt")
+    add_defines("GLM_FORCE_DEPTH_ZERO_TO_ONE")
+
+    add_linkdirs("ext/nvtt/lib64")
+
+    if is_plat("windows") then
+        add_syslinks("dxcompiler", "nvtt30205.lib")
+    else
+        -- nvtt and dxc come from the system, DXC through its command line
+        add_syslinks("nvtt", "pthread")
+    end
+
+    if is_mode("debug") then
+        set_symbols("debug")
+        set_optimize("none")
+        add_defines("ONI_DEBUG")
+    end
+
+    if is_mode("release") then
+        set_symbols("hidden")
+        set_optimize("fastest")
+        set_strip("all")
+    end
+
+-- Offline command capture analyzer, portable like oni_cook
+target("oni_capture")
+    set_kind("binary")
+    set_rundir(".")
+    set_languages("c++17")
+    add_files("src/capture/*.cpp")
+    add_files("src/rhi/command_stream.cpp", "src/rhi/command_capture.cpp", "src/core/log.cpp", "src/core/timer.cpp")
+    add_includedirs("src", "ext")
+
+    if not is_plat("windows") then
+        add_syslinks("pthread")
+    end
+
+    if is_mode("debug") then
+        set_symbols("debug")
+        set_optimize("none")
+        add_defines("ONI_DEBUG")
+    end
+
+    if is_mode("release") then
+        set_symbols("hidden")
+        set_optimize("fastest")
+        set_strip("all")
+    end
+
+-- Unit tests and benchmarks for the parts of the engine that don't need a GPU, portable like oni_cook
+target("oni_tests")
+    set_kind("binary")
+    set_rundir(".")
+    set_languages("c++17")
+    add_files("src/tests/*.cpp", "src/core/virtual_texture/*.cpp")
+    add_files("src/core/log.cpp", "src/core/timer.cpp", "src/core/util.cpp", "src/core/file_system.cpp", "src/core/mapped_file.cpp")
+    add_files("src/core/pak_file.cpp", "src/core/io_queue.cpp", "src/core/profiler.cpp", "src/core/block_codec.cpp", "src/core/job_system.cpp")
+    add_files("src/rhi/null/*.cpp", "src/rhi/command_stream.cpp", "src/rhi/command_state.cpp", "src/rhi/command_capture.cpp", "src/rhi/descriptor_allocator.cpp", "src/rhi/row_copy.cpp")
+    add_files("src/renderer/render_graph.cpp", "src/renderer/aliasing_planner.cpp", "src/renderer/techniques/gbuffer_recorder.cpp")
+    add_includedirs("src", "ext")
+    -- RenderContext and the rest of the RHI are the null backend's
+    add_defines("ONI_RHI_NULL")
+
+    if not is_plat("windows") then
+        add_syslinks("pthread")
+    end
+
+    if is_mode("debug") then
+        set_symbols("debug")
+        set_optimize("none")
+        add_defines("ONI_DEBUG")
+    end
+
+    if is_mode("release") then
+        set_symbols("hidden")
+        set_optimize("fastest")
+        set_strip("all")
+    end